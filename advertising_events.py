@@ -0,0 +1,194 @@
+#!/usr/bin/env python
+
+import argparse
+import csv
+import pathlib
+
+from collections import OrderedDict
+
+from models import parseTimestamp
+from records import isGap
+
+__DAY__ = 24 * 60 * 60 * 1000  # The ISO capture timestamps are milliseconds of the day (ms)
+
+# Advertising channels monitored by the probes
+ADVERTISING_CHANNELS = (37, 38, 39)
+
+# An advertiser transmits the same PDU on every used advertising channel within a single Advertising Event.
+# Bluetooth Core 5.4 Vol. 6, Part B, 4.4.2.2.1 limits the time between two PDUs of the same event to 10 ms.
+ADVERTISING_EVENT_WINDOW = 10
+
+
+class AdvertisingEvent:
+    """
+    Reports of one address received on different channels within one Advertising Event
+    """
+    __slots__ = ('address', 'timestamp', 'start', 'arrivals', 'rssi')
+
+    def __init__(self, address, start, timestamp):
+        self.address = address
+        self.timestamp = timestamp  # Capture timestamp of the earliest report of the event (ms)
+        self.start = start          # Arrival of the earliest report on the continuous timeline (ms)
+        self.arrivals = {}  # Channel -> arrival time (capture timestamp, ms)
+        self.rssi = {}      # Channel -> RSSI (dBm)
+
+    def add(self, time, timestamp, channel, rssi):
+        self.arrivals[channel] = timestamp
+        self.rssi[channel] = rssi
+        if time < self.start:
+            self.start = time
+            self.timestamp = timestamp
+
+    def asRow(self):
+        row = {
+            'Timestamp': self.timestamp,
+            'Address': self.address,
+            'Channels': len(self.arrivals)
+        }
+        for channel in ADVERTISING_CHANNELS:
+            row[f'Timestamp{channel}'] = self.arrivals.get(channel, '')
+            row[f'RSSI{channel}'] = self.rssi.get(channel, '')
+        return row
+
+    @staticmethod
+    def fieldnames():
+        names = ['Timestamp', 'Address', 'Channels']
+        for channel in ADVERTISING_CHANNELS:
+            names += [f'Timestamp{channel}', f'RSSI{channel}']
+        return names
+
+
+class AdvertisingEventAssembler:
+    """
+    Streaming grouping of per-channel advertising reports into Advertising Events.
+
+    An event is open until a report newer than `window` ms after its start is seen (on any address),
+    or until the same address is reported again on a channel already present in the event.
+    Only the open events are kept in memory, so the state is bounded by the number of addresses
+    heard within one window. A late report (older than the window behind the newest one) is an event
+    of its own, completed at once: the open events stay ordered by their start.
+    The capture timestamps go back to 0 at midnight, the events are grouped on a continuous timeline instead,
+    as in the live detector; they keep the capture timestamps of their reports.
+    """
+
+    def __init__(self, window=ADVERTISING_EVENT_WINDOW):
+        self.window = window
+        self.watermark = None   # Newest time seen so far on the timeline (ms)
+        self.dayOffset = 0      # Time added to the capture timestamps since the first one (ms, whole days)
+        self._open = OrderedDict()  # Address -> open event, ordered by the event start
+
+    def timeline(self, timestamp):
+        """
+        Time (ms) on the continuous timeline of a capture timestamp
+        """
+        timestamp += self.dayOffset
+        if self.watermark is not None:
+            if timestamp < self.watermark - __DAY__ // 2:      # Midnight passed
+                self.dayOffset += __DAY__
+                timestamp += __DAY__
+            elif timestamp > self.watermark + __DAY__ // 2:    # Late report from before midnight
+                timestamp -= __DAY__
+        return timestamp
+
+    def push(self, address, timestamp, channel, rssi):
+        """
+        Add a report (capture timestamp in ms) and return the list of events completed by it
+        """
+        completed = []
+        time = self.timeline(timestamp)
+
+        if self.watermark is not None and time < self.watermark - self.window:   # Its event has already expired
+            event = AdvertisingEvent(address, time, timestamp)
+            event.add(time, timestamp, channel, rssi)
+            completed.append(event)
+            return completed
+
+        if self.watermark is None or time > self.watermark:
+            self.watermark = time
+            self._expire(completed)
+
+        event = self._open.get(address)
+        if event is not None and (time - event.start > self.window or channel in event.arrivals):
+            completed.append(self._open.pop(address))
+            event = None
+
+        if event is None:
+            event = AdvertisingEvent(address, time, timestamp)
+            self._open[address] = event
+        event.add(time, timestamp, channel, rssi)
+
+        return completed
+
+    def flush(self):
+        """
+        Complete every open event
+        """
+        completed = list(self._open.values())
+        self._open.clear()
+        return completed
+
+    def completeBefore(self, timestamp):
+        """
+        Complete the open events which started before a capture timestamp (ms)
+        """
+        completed = []
+        self._expire(completed, self.timeline(timestamp))
+        return completed
+
+    def _expire(self, completed, horizon=None):
+        if horizon is None:
+            horizon = self.watermark - self.window
+        while self._open:
+            address, event = next(iter(self._open.items()))
+            if event.start >= horizon:
+                break
+            del self._open[address]
+            completed.append(event)
+
+
+def readEvents(captureFile, window=ADVERTISING_EVENT_WINDOW, keepGaps=False):
+    """
+    Generate Advertising Events from a CSV capture, optionally interleaved with the capture outage rows
+    """
+    assembler = AdvertisingEventAssembler(window)
+    for advertisement in csv.DictReader(captureFile):
+        if isGap(advertisement):
+            if keepGaps:
+                # The events heard before the end of the outage come first, their silences are the ones skipped
+                try:
+                    yield from assembler.completeBefore(parseTimestamp(advertisement['DeviceName']))
+                except (ValueError, IndexError, TypeError):
+                    pass
+                yield advertisement
+            continue
+        try:
+            timestamp = parseTimestamp(advertisement['Timestamp'])
+            channel = int(advertisement['Channel'])
+            rssi = int(advertisement['RSSI'])
+        except (ValueError, IndexError, TypeError):    # Short rows have None in the missing fields
+            continue
+        yield from assembler.push(advertisement['Address'], timestamp, channel, rssi)
+    yield from assembler.flush()
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Group per-channel advertising reports of a capture into Advertising Events',
+    )
+    _parser.add_argument("capture")
+    _parser.add_argument('-w', '--window', type=int,
+                         help='Maximal duration of an Advertising Event in ms'
+                              ' [Default: ' + str(ADVERTISING_EVENT_WINDOW) + ']',
+                         default=ADVERTISING_EVENT_WINDOW)
+    _parser.add_argument('-o', '--output', metavar='OUT',
+                         help='File where the events will be stored. [Default: <capture>.events.csv]')
+    _args = _parser.parse_args()
+
+    _capture_path = pathlib.Path(_args.capture)
+    _out_path = pathlib.Path(_args.output) if _args.output else _capture_path.with_suffix('.events.csv')
+
+    with _capture_path.open('r') as _capture_file, _out_path.open('w', newline='') as _out_file:
+        _writer = csv.DictWriter(_out_file, fieldnames=AdvertisingEvent.fieldnames())
+        _writer.writeheader()
+        for _event in readEvents(_capture_file, _args.window):
+            _writer.writerow(_event.asRow())
@@ -0,0 +1,332 @@
+#!/usr/bin/env python
+
+import argparse
+import csv
+import heapq
+import itertools
+import pathlib
+import selectors
+import socket
+import sys
+import time
+
+from datetime import datetime
+
+from link import sendFrame, FrameReader
+from link import HELLO, RESUME, PROBE, RECORDS, ACK
+from link import LINK_MAGIC, LINK_VERSION, FRAME, HELLO_HEADER, RECORDS_HEADER, SEQUENCE, ENTRY_SIZE
+from metrics import MetricsRegistry, MetricsExporter
+from records import unpackRecord
+
+__DEFAULT_PORT__ = 5160
+__REORDER_DELAY__ = 0.5     # How long a record may arrive after newer ones of the same link and stay in order (s)
+__IDLE_TIMEOUT__ = 2        # Links silent for longer do not hold the merge back (s)
+__MAX_MERGE_SIZE__ = 1 << 20    # Records waiting in the merge before the oldest are written regardless of the links
+__STATS_INTERVAL__ = 10     # Seconds between two link throughput reports
+__METRICS_INTERVAL__ = 10   # Seconds between two writes of the metrics file
+
+
+class LinkState:
+    """
+    State of a forwarder kept across its reconnections
+    """
+
+    def __init__(self, name):
+        self.name = name
+        self.session = None
+        self.nextSequence = 0
+        self.probes = {}    # Probe index -> probe name
+        self.connected = False
+        self.connections = 0
+        self.records = 0
+        self.bytes = 0
+        self.lost = 0
+        self.lastTimestamp = 0  # Newest record timestamp (us since the epoch)
+        self.lastActivity = 0   # Monotonic time of the last received records
+
+        self.reportedRecords = 0
+        self.reportedBytes = 0
+
+        self.merge = None   # Latency histograms (us) and counters, when the metrics are exported
+        self.total = None
+        self.recordsCounter = None
+        self.lostCounter = None
+
+    def instrument(self, registry):
+        self.merge = registry.histogram(
+            'stage_latency', 'Latency of an aggregation stage', link=self.name, stage='merge'
+        )
+        self.total = registry.histogram(
+            'stage_latency', 'Latency of an aggregation stage', link=self.name, stage='total'
+        )
+        self.recordsCounter = registry.counter('records', 'Records received from the link', link=self.name)
+        self.lostCounter = registry.counter('lost_records', 'Records the link lost', link=self.name)
+
+
+class Connection:
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.reader = FrameReader()
+        self.link = None
+
+
+class Aggregator:
+    """
+    Merges the record streams of many edge forwarders into a single time-ordered capture.
+
+    Records wait in a heap until every active link has sent newer ones (minus the reorder delay).
+    Each link is read only when the socket is ready, a slow aggregator therefore fills the TCP
+    windows and pushes back on the forwarders, whose bounded buffers then drop the oldest records.
+    """
+
+    def __init__(self, host, port, writeRecord, reorderDelay=__REORDER_DELAY__, idleTimeout=__IDLE_TIMEOUT__,
+                 metrics=None):
+        self.writeRecord = writeRecord  # Called with (link name, probe name, record) in time order
+        self.metrics = metrics  # MetricsRegistry of the merge latencies, None when not exported
+        self.reorderDelay = int(reorderDelay * 1000000)
+        self.idleTimeout = idleTimeout
+        self.links = {}     # Forwarder name -> LinkState
+        self.late = 0       # Records written after newer ones already were
+        self._merge = []    # Heap of (timestamp, counter, link, probe name, record, monotonic arrival in ns)
+        self._counter = itertools.count()
+        self._lastWritten = 0
+
+        self._selector = selectors.DefaultSelector()
+        self._server = socket.create_server((host, port))
+        self._server.setblocking(False)
+        self._selector.register(self._server, selectors.EVENT_READ)
+
+    def close(self):
+        for key in list(self._selector.get_map().values()):
+            key.fileobj.close()
+        self._selector.close()
+        self.flush()
+
+    def poll(self, timeout=0.1):
+        """
+        Receive what the forwarders sent and write the records already in order
+        """
+        for key, _ in self._selector.select(timeout):
+            if key.fileobj is self._server:
+                try:
+                    sock, _ = self._server.accept()
+                except BlockingIOError:
+                    continue
+                sock.setblocking(False)
+                self._selector.register(sock, selectors.EVENT_READ, Connection(sock))
+            else:
+                self._receive(key.data)
+        self._writeOrdered()
+
+    def _disconnect(self, connection):
+        self._selector.unregister(connection.sock)
+        connection.sock.close()
+        if connection.link is not None:
+            connection.link.connected = False
+
+    def _receive(self, connection):
+        try:
+            data = connection.sock.recv(1 << 20)
+            if not data:
+                raise ConnectionError("Connection closed by the forwarder.")
+            for frameType, payload in connection.reader.feed(data):
+                self._process(connection, frameType, payload)
+        except BlockingIOError:
+            pass
+        except (OSError, ValueError) as e:
+            name = connection.link.name if connection.link is not None else 'unknown forwarder'
+            print(f'Aggregator: Link of {name} lost ({e})', file=sys.stderr)
+            self._disconnect(connection)
+
+    def _process(self, connection, frameType, payload):
+        if frameType == HELLO:
+            if len(payload) < HELLO_HEADER.size:
+                raise ValueError("HELLO frame is too short.")
+            magic, version, session = HELLO_HEADER.unpack_from(payload)
+            if magic != LINK_MAGIC or version != LINK_VERSION:
+                raise ValueError(f"Unsupported link version {version}.")
+            name = payload[HELLO_HEADER.size:].decode('utf8', errors='replace')
+            link = self.links.get(name)
+            if link is None:
+                link = self.links[name] = LinkState(name)
+                if self.metrics is not None:
+                    link.instrument(self.metrics)
+            if link.session != session:    # Forwarder restarted, sequences start over
+                link.session = session
+                link.nextSequence = 0
+                link.probes = {}
+            link.connected = True
+            link.connections += 1
+            link.lastActivity = time.monotonic()
+            connection.link = link
+            connection.sock.setblocking(True)   # Control frames are tiny, they never block for long
+            sendFrame(connection.sock, RESUME, SEQUENCE.pack(link.nextSequence))
+            connection.sock.setblocking(False)
+            return
+
+        link = connection.link
+        if link is None:
+            raise ValueError("Link was not introduced.")
+
+        if frameType == PROBE:
+            if not payload:
+                raise ValueError("PROBE frame is empty.")
+            link.probes[payload[0]] = payload[1:].decode('utf8', errors='replace')
+        elif frameType == RECORDS:
+            if len(payload) < RECORDS_HEADER.size:
+                raise ValueError("RECORDS frame is too short.")
+            sequence, count = RECORDS_HEADER.unpack_from(payload)
+            if len(payload) != RECORDS_HEADER.size + count * ENTRY_SIZE:
+                raise ValueError(f"RECORDS frame of {len(payload)} B does not hold {count} records.")
+            if sequence > link.nextSequence:
+                link.lost += sequence - link.nextSequence
+                if link.lostCounter is not None:
+                    link.lostCounter.value += sequence - link.nextSequence
+            arrived = time.monotonic_ns()
+            offset = RECORDS_HEADER.size + max(link.nextSequence - sequence, 0) * ENTRY_SIZE  # Skip resent records
+            end = RECORDS_HEADER.size + count * ENTRY_SIZE
+            while offset < end:
+                record = unpackRecord(payload, offset + 1)
+                probe = link.probes.get(payload[offset], str(payload[offset]))
+                heapq.heappush(self._merge, (record['Timestamp'], next(self._counter), link, probe, record, arrived))
+                link.lastTimestamp = max(link.lastTimestamp, record['Timestamp'])
+                link.records += 1
+                offset += ENTRY_SIZE
+            link.nextSequence = max(link.nextSequence, sequence + count)
+            link.bytes += FRAME.size + len(payload)
+            link.lastActivity = time.monotonic()
+            connection.sock.setblocking(True)
+            sendFrame(connection.sock, ACK, SEQUENCE.pack(link.nextSequence))
+            connection.sock.setblocking(False)
+        else:
+            raise ValueError(f"Unexpected frame {frameType}.")
+
+    def _watermark(self):
+        """
+        Timestamp up to which no active link will send further records
+        """
+        now = time.monotonic()
+        active = [
+            link.lastTimestamp for link in self.links.values()
+            if link.connected and now - link.lastActivity < self.idleTimeout
+        ]
+        if not active:  # Nothing is coming, write everything received
+            return sys.maxsize
+        return min(active) - self.reorderDelay
+
+    def _writeOrdered(self):
+        watermark = self._watermark()
+        while self._merge and (self._merge[0][0] <= watermark or len(self._merge) > __MAX_MERGE_SIZE__):
+            self._write(heapq.heappop(self._merge))
+
+    def _write(self, entry):
+        timestamp, _, link, probe, record, arrived = entry
+        if timestamp < self._lastWritten:
+            self.late += 1
+        self._lastWritten = max(self._lastWritten, timestamp)
+        self.writeRecord(link.name, probe, record)
+        if link.merge is not None:  # Time in the merge, then from the capture callback to the merged capture
+            link.merge.recordValue((time.monotonic_ns() - arrived) // 1000)
+            link.total.recordValue(time.time_ns() // 1000 - timestamp)
+            link.recordsCounter.value += 1
+
+    def flush(self):
+        while self._merge:
+            self._write(heapq.heappop(self._merge))
+
+    def report(self, interval):
+        """
+        Throughput of every link since the previous report
+        """
+        lines = []
+        for link in self.links.values():
+            lines.append(
+                f'{link.name}: {(link.records - link.reportedRecords) / interval:.0f} records/s,'
+                f' {(link.bytes - link.reportedBytes) / interval / 1024:.1f} KiB/s,'
+                f' {link.lost} lost, {link.connections} connections'
+                + ('' if link.connected else ', disconnected')
+            )
+            link.reportedRecords = link.records
+            link.reportedBytes = link.bytes
+        return lines
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Merge the records of edge collectors (collector --forward) into a single time-ordered capture',
+    )
+    _parser.add_argument('-l', '--listen', metavar='HOST:PORT',
+                         help='Address to listen on [Default: 0.0.0.0:' + str(__DEFAULT_PORT__) + ']',
+                         default='0.0.0.0:' + str(__DEFAULT_PORT__)
+                         )
+    _parser.add_argument('-o', '--output', metavar='OUT',
+                         help='File where the merged data will be stored. Will be overwritten.'
+                              ' [Default: capture/YYYY-mm-dd_HH-MM.merged.csv]',
+                         default=pathlib.Path(
+                             'capture',
+                             time.strftime('%Y-%m-%d_%H-%M', time.gmtime()) + '.merged.csv'
+                             ),
+                         )
+    _parser.add_argument('-d', '--reorder-delay', type=float, metavar='SEC',
+                         help='Time allowed for records to arrive out of order'
+                              ' [Default: ' + str(__REORDER_DELAY__) + ' s]',
+                         default=__REORDER_DELAY__
+                         )
+    _parser.add_argument('-s', '--stats-interval', type=float, metavar='SEC',
+                         help='Seconds between two link throughput reports'
+                              ' [Default: ' + str(__STATS_INTERVAL__) + ' s]',
+                         default=__STATS_INTERVAL__
+                         )
+    _parser.add_argument('--metrics', metavar='FILE',
+                         help='Periodically write the merge latencies of every link into FILE'
+                              ' (Prometheus text format).'
+                         )
+    _parser.add_argument('--metrics-port', type=int, metavar='PORT',
+                         help='Serve the merge latencies at http://127.0.0.1:PORT/metrics.'
+                         )
+    _args = _parser.parse_args()
+
+    _host, _, _port = _args.listen.rpartition(':')
+    _out_path = pathlib.Path(_args.output)
+    _out_path.parent.mkdir(parents=True, exist_ok=True)
+
+    with _out_path.open('w', buffering=1 << 16, newline='') as _out_file:
+        _writer = csv.DictWriter(_out_file, fieldnames=[
+            'Timestamp', 'Address', 'AddressType', 'AdvertisingType', 'RSSI', 'Channel', 'DeviceName', 'Probe'
+        ])
+        _writer.writeheader()
+
+        def write_record(link_name, probe, record):
+            _writer.writerow(dict(
+                record,
+                Timestamp=datetime.fromtimestamp(record['Timestamp'] / 1000000).isoformat(),
+                Probe=f'{link_name}/{probe}'
+            ))
+
+        _registry = None
+        _exporter = None
+        if _args.metrics or _args.metrics_port:
+            _registry = MetricsRegistry('bleaggregator')
+            _exporter = MetricsExporter(_registry, _args.metrics, _args.metrics_port, __METRICS_INTERVAL__)
+
+        aggregator = Aggregator(
+            _host or '0.0.0.0', int(_port), write_record, reorderDelay=_args.reorder_delay, metrics=_registry
+        )
+        print(f'Aggregating on {_args.listen} into {_out_path}', flush=True)
+        _last_report = time.monotonic()
+        try:
+            while True:
+                aggregator.poll()
+                if time.monotonic() - _last_report >= _args.stats_interval:
+                    for _line in aggregator.report(time.monotonic() - _last_report):
+                        print(_line, flush=True)
+                    _last_report = time.monotonic()
+        except KeyboardInterrupt:
+            print()  # Insert end of line (after the ^C)
+        finally:
+            aggregator.close()
+            if _exporter is not None:
+                _exporter.close()
+            if aggregator.late:
+                print(f'{aggregator.late} records arrived later than the reorder delay', file=sys.stderr)
@@ -0,0 +1,58 @@
+"""
+Edge forwarding on the loopback interface: forwarder processes (3 probes each) ship records to one aggregator.
+Reports the merged records/s, the lost and late records.
+
+    python3 -m benchmarks.aggregator_benchmark [-n RECORDS] [-f FORWARDERS]
+"""
+import argparse
+import multiprocessing
+import time
+
+from aggregator import Aggregator
+from forwarder import EdgeForwarder
+
+
+def forward(port, name, records):
+    forwarder = EdgeForwarder('127.0.0.1', port, name)
+    start = time.time_ns() // 1000
+    for index in range(records):
+        forwarder.publish(f'probe{index % 3}', start + index * 10, {
+            'Address': f'c0:00:00:00:{index % 65536 >> 8:02x}:{index % 256:02x}', 'AddressType': 1,
+            'AdvertisingType': 0, 'Channel': 37 + index % 3, 'RSSI': -60, 'DeviceName': 'Sensor'
+        })
+    forwarder.close(timeout=60)
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the forwarder to aggregator link')
+    _parser.add_argument('-n', '--records', type=int, default=100000, help='Records per forwarder [Default: 100000]')
+    _parser.add_argument('-f', '--forwarders', type=int, default=4, help='[Default: 4]')
+    _args = _parser.parse_args()
+
+    _written = 0
+
+    def count(link, probe, record):
+        global _written
+        _written += 1
+
+    _aggregator = Aggregator('127.0.0.1', 0, count)
+    _port = _aggregator._server.getsockname()[1]
+    _processes = [multiprocessing.Process(target=forward, args=(_port, f'edge{_index}', _args.records))
+                  for _index in range(_args.forwarders)]
+    _total = _args.records * _args.forwarders
+    _start = time.perf_counter()
+    for _process in _processes:
+        _process.start()
+    try:
+        while sum(link.records + link.lost for link in _aggregator.links.values()) < _total:
+            _aggregator.poll(0.01)
+        _aggregator.flush()
+        _spent = time.perf_counter() - _start
+    finally:
+        for _process in _processes:
+            _process.join()
+        _aggregator.close()
+
+    _lost = sum(link.lost for link in _aggregator.links.values())
+    print(f"{_args.forwarders} forwarders, {_total} records: {_written / _spent / 1000:.0f}k records/s merged,"
+          f" {_lost} lost, {_aggregator.late} late")
@@ -0,0 +1,67 @@
+"""
+False positive rate of the appearance filters against the configured error rate: a rotating Bloom filter ring is
+filled with steady traffic at a fraction of its capacity per horizon, then probed with addresses never heard (a
+false positive is a missed appearance event). Also the memory against an exact set of the same addresses and the
+cost of AppearanceTracker.publish.
+
+    python3 -m benchmarks.bloom_benchmark [-c CAPACITY] [-e ERROR_RATE ...] [-g GENERATIONS] [-p PROBES]
+"""
+import argparse
+import pathlib
+import random
+import sys
+import tempfile
+import time
+
+from sketches import AppearanceTracker, RotatingBloomFilter
+
+__HORIZON__ = 3600
+
+
+def measure(capacity, errorRate, generations, load, probes, seed):
+    """
+    :return: (False positive rate, filter memory in B)
+    """
+    rng = random.Random(seed)
+    seen = RotatingBloomFilter(__HORIZON__, capacity, errorRate, generations)
+    # `load` x capacity distinct addresses within every horizon, over two horizons so every filter took its share
+    heard = int(load * capacity * 2)
+    for index in range(heard):
+        seen.add(rng.getrandbits(48), index * 2 * __HORIZON__ / heard)
+    now = 2 * __HORIZON__ - 1
+    missed = sum(not seen.add(rng.getrandbits(48), now) for _ in range(probes))
+    return missed / probes, seen.memory()
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the false positive rate of the appearance filters')
+    _parser.add_argument('-c', '--capacity', type=int, default=100000, help='[Default: 100000]')
+    _parser.add_argument('-e', '--error-rate', dest='errorRates', type=float, action='append',
+                         help='Configured error rate, repeatable [Default: 0.01 and 0.001]')
+    _parser.add_argument('-g', '--generations', type=int, default=2, help='[Default: 2]')
+    _parser.add_argument('-p', '--probes', type=int, default=20000,
+                         help='New addresses checked per measurement [Default: 20000]')
+    _args = _parser.parse_args()
+
+    print(f"capacity {_args.capacity}, {_args.generations} generations, {_args.probes} new addresses checked")
+    print(f"{'error rate':>10} {'load':>5} {'measured':>9} {'memory':>9}")
+    for _errorRate in _args.errorRates or [0.01, 0.001]:
+        for _load in (0.5, 1, 1.5):
+            _measured, _memory = measure(_args.capacity, _errorRate, _args.generations, _load, _args.probes, 0)
+            print(f"{_errorRate:>10} {_load:>5} {_measured:>9.5f} {_memory / 1024:>6.0f} KiB")
+
+    _rng = random.Random(1)
+    _addresses = [_rng.getrandbits(48) for _ in range(_args.capacity)]
+    _exact = set(f'{_address:012x}' for _address in _addresses)
+    _exactMemory = sys.getsizeof(_exact) + sum(sys.getsizeof(_address) for _address in _exact)
+    print(f"exact set of {_args.capacity} addresses: {_exactMemory / 1024:.0f} KiB")
+
+    _infos = [{'Address': _address.to_bytes(6, 'big').hex(':'), 'AddressType': 1} for _address in _addresses]
+    with tempfile.TemporaryDirectory() as _folder:
+        _tracker = AppearanceTracker(pathlib.Path(_folder) / 'benchmark.appearances.csv', __HORIZON__, _args.capacity)
+        _start = time.perf_counter()
+        for _index in range(2 * len(_infos)):   # Every address appears, then is heard again
+            _tracker.publish('ESP 1', 1700000000000000 + _index * 1000, _infos[_index % len(_infos)])
+        _spent = time.perf_counter() - _start
+        _tracker.close()
+    print(f"publish: {2 * len(_infos) / _spent / 1000:.0f}k records/s")
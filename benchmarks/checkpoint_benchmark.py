@@ -0,0 +1,45 @@
+"""
+Snapshot of the live detector state: write and load time and file size with 100k tracked devices.
+
+    python3 -m benchmarks.checkpoint_benchmark [-n DEVICES] [-d DETECTOR]
+"""
+import argparse
+import pathlib
+import random
+import tempfile
+import time
+
+from checkpoint import loadSnapshot, writeSnapshot
+from models import MODELS, modelFactory
+from tests.synthetic import INTERVALS, randomAddress
+from tests.test_models import feed, jittered
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the detector state snapshots')
+    _parser.add_argument('-n', '--devices', type=int, default=100000, help='[Default: 100000]')
+    _parser.add_argument('-d', '--detector', default='simple_statistics',
+                         help="[" + ", ".join(MODELS) + "] [Default: simple_statistics]")
+    _parser.add_argument('-s', '--seed', type=int, default=0)
+    _args = _parser.parse_args()
+
+    _rng = random.Random(_args.seed)
+    _factory = modelFactory(_args.detector)
+    _models = {}
+    for _device in range(_args.devices):
+        _models[randomAddress(_rng)] = _model = _factory()
+        feed(_model, jittered(_rng.randrange(1, 1000), _rng.choice(INTERVALS), 25, _device))   # Past initialisation
+
+    with tempfile.TemporaryDirectory() as _folder:
+        _path = pathlib.Path(_folder) / 'models.ckpt'
+        _start = time.perf_counter()
+        writeSnapshot(_path, _args.detector, _models, _factory, (1, 1))
+        _write = time.perf_counter() - _start
+
+        _start = time.perf_counter()
+        _restored, _ = loadSnapshot(_path, _args.detector, _factory)
+        _load = time.perf_counter() - _start
+        assert len(_restored) == len(_models)
+
+        print(f"{_args.devices} {_args.detector} models: write {_write * 1000:.0f} ms, load {_load * 1000:.0f} ms,"
+              f" {_path.stat().st_size / 1e6:.1f} MB")
@@ -0,0 +1,58 @@
+"""
+Wall time of detector.py running several detectors in a single pass over a synthetic capture against one run per
+detector. A single pass reads and parses the capture once, so it saves most when the parsing dominates (several
+configurations of a cheap model, or the numpy backend); with costly models (mixed) the detection dominates and the
+single pass can be slower, its models of every detector live in one process.
+
+    python3 -m benchmarks.detector_benchmark [-d DEVICES] [--duration S] [-r REPEAT]
+"""
+import argparse
+import pathlib
+import subprocess
+import sys
+import tempfile
+import time
+
+from tests.synthetic import advertisingTraffic, writeCapture
+from tests.test_models import REPOSITORY
+
+CASES = {
+    '3x simple_statistics': (['simple_statistics:thresholdFactor=2', 'simple_statistics:thresholdFactor=3',
+                              'simple_statistics:thresholdFactor=4'], []),
+    'mixed': (['simple_statistics', 'sliding_window', 'interval_histogram'], []),
+    'mixed, events': (['simple_statistics', 'sliding_window', 'interval_histogram'], ['-e']),
+    '2x numpy': (['simple_statistics', 'sliding_window'], ['-b', 'numpy']),
+}
+
+
+def wallTime(capture, output, specs, options, repeat):
+    """
+    Best wall time (s) of `repeat` runs of detector.py
+    """
+    best = float('inf')
+    for _ in range(repeat):
+        start = time.perf_counter()
+        subprocess.run([sys.executable, REPOSITORY / 'detector.py', capture, '-o', output, *options,
+                        *(option for spec in specs for option in ('-d', spec))],
+                       stdout=subprocess.DEVNULL, check=True)
+        best = min(best, time.perf_counter() - start)
+    return best
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark a single pass of several detectors against one run each')
+    _parser.add_argument('-d', '--devices', type=int, default=100, help='[Default: 100]')
+    _parser.add_argument('--duration', type=int, default=120, help='Capture duration (s) [Default: 120]')
+    _parser.add_argument('-r', '--repeat', type=int, default=2, help='Runs of every case, the best counts [Default: 2]')
+    _args = _parser.parse_args()
+
+    _rows, _, _ = advertisingTraffic(_args.devices, _args.duration * 1000)
+    print(f"{_args.devices} devices, {len(_rows)} reports")
+    print(f"{'case':>22} {'separate':>9} {'single':>9} {'speedup':>8}")
+    with tempfile.TemporaryDirectory() as _folder:
+        _capture = pathlib.Path(_folder) / 'capture.csv'
+        writeCapture(_capture, _rows)
+        for _case, (_specs, _options) in CASES.items():
+            _separate = sum(wallTime(_capture, _folder, [_spec], _options, _args.repeat) for _spec in _specs)
+            _single = wallTime(_capture, _folder, _specs, _options, _args.repeat)
+            print(f"{_case:>22} {_separate:>8.2f}s {_single:>8.2f}s {_separate / _single:>7.2f}x")
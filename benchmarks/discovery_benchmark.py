@@ -0,0 +1,88 @@
+"""
+Time to capture of the collector with simulated probes bound by identity (fake_probe.py): from the collector start
+to the identification of every probe (parallel scan of the serial devices), to every probe capturing again after
+its reset (or warm attach), and to the first row of every probe in the capture.
+
+    python3 -m benchmarks.discovery_benchmark [-n PROBES ...] [--boot-delay S] [--init-delay S]
+"""
+import argparse
+import csv
+import pathlib
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+from fake_probe import FakeProbe
+from tests.test_models import REPOSITORY
+
+__TIMEOUT__ = 60    # Seconds the probes have to capture
+
+
+def timeToCapture(count, bootDelay, initDelay, warm):
+    """
+    :return: Seconds to (identified, capturing, first row of every channel)
+    """
+    with tempfile.TemporaryDirectory() as folder:
+        folder = pathlib.Path(folder)
+        probes = [FakeProbe(index, folder / f'ttyFAKE{index}', bootDelay, initDelay) for index in range(count)]
+        for probe in probes:
+            probe.start()
+        deadline = time.monotonic() + __TIMEOUT__
+        while not all(probe.capturing for probe in probes) and time.monotonic() < deadline:
+            time.sleep(0.01)
+        config = folder / 'collector.ini'
+        config.write_text(''.join(f'[ESP {index + 1}]\nid = {probe.chip.hex(":")}\n\n'
+                                  for index, probe in reversed(list(enumerate(probes)))))
+        output = folder / 'capture.csv'
+        boots = [probe.bootTime for probe in probes]
+
+        start = time.monotonic()
+        process = subprocess.Popen([sys.executable, REPOSITORY / 'collector.py', '-c', config, '--scan',
+                                    str(folder / 'ttyFAKE*'), '-o', output] + (['--warm'] if warm else []),
+                                   stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True, cwd=folder)
+        try:
+            identified = capturing = None
+            for line in process.stdout:
+                if line.startswith('- Identified'):
+                    identified = time.monotonic() - start
+                    break
+            deadline = time.monotonic() + __TIMEOUT__
+            while capturing is None and time.monotonic() < deadline:
+                if all(probe.capturing and (warm or probe.bootTime != boot) for probe, boot in zip(probes, boots)):
+                    capturing = time.monotonic() - start
+                time.sleep(0.01)
+            # Every probe captures its own channel (the first three probes cover them all)
+            channels = {str(probe.channel) for probe in probes}
+            while time.monotonic() < deadline:
+                with output.open(newline='') as captureFile:
+                    if channels <= {row['Channel'] for row in csv.DictReader(captureFile)}:
+                        break
+                time.sleep(0.01)
+            rows = time.monotonic() - start
+        finally:
+            process.send_signal(signal.SIGINT)
+            process.communicate(timeout=30)
+            for probe in probes:
+                probe.stop()
+    return identified, capturing, rows
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the time to capture of probes bound by identity')
+    _parser.add_argument('-n', '--probes', type=int, action='append',
+                         help='Number of simulated probes, repeatable [Default: 1, 8 and 32]')
+    _parser.add_argument('--boot-delay', type=float, default=0.5,
+                         help='Seconds from a reset to the application start [Default: 0.5]')
+    _parser.add_argument('--init-delay', type=float, default=4,
+                         help='Seconds from the application start to the capture [Default: 4]')
+    _args = _parser.parse_args()
+
+    print(f"boot {_args.boot_delay} s, Bluetooth bring-up {_args.init_delay} s")
+    print(f"{'probes':>6} {'attach':>6} {'identified':>11} {'capturing':>10} {'first rows':>11}")
+    for _count in _args.probes or [1, 8, 32]:
+        for _warm in (False, True):
+            _identified, _capturing, _rows = timeToCapture(_count, _args.boot_delay, _args.init_delay, _warm)
+            print(f"{_count:>6} {'warm' if _warm else 'reset':>6} {_identified:>10.2f}s {_capturing:>9.2f}s"
+                  f" {_rows:>10.2f}s")
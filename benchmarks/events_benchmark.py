@@ -0,0 +1,48 @@
+"""
+Advertising event grouping on synthetic multi-channel traffic: throughput, input reduction of the detectors and
+the short silences they no longer see.
+
+    python3 -m benchmarks.events_benchmark [-n DEVICES] [-t SECONDS]
+"""
+import argparse
+import io
+import time
+
+from advertising_events import ADVERTISING_EVENT_WINDOW, readEvents
+from models import SlidingWindowModel
+from tests.synthetic import advertisingTraffic, captureText
+
+
+def shortSilences(stream):
+    """
+    Silences between the consecutive reports of an address shorter than the lowest advertising interval
+    """
+    lastSeen = {}
+    short = 0
+    for address, timestamp in stream:
+        if address in lastSeen and timestamp - lastSeen[address] < SlidingWindowModel.BLE_LowDutyCycle_MinInterval:
+            short += 1
+        lastSeen[address] = timestamp
+    return short
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the advertising event grouping')
+    _parser.add_argument('-n', '--devices', type=int, default=200, help='[Default: 200]')
+    _parser.add_argument('-t', '--duration', type=int, default=600, help='Seconds of traffic [Default: 600]')
+    _parser.add_argument('-l', '--loss', type=float, default=0.1, help='Report loss per channel [Default: 0.1]')
+    _parser.add_argument('-s', '--seed', type=int, default=0)
+    _args = _parser.parse_args()
+
+    _rows, _expected, _ = advertisingTraffic(_args.devices, _args.duration * 1000, _args.seed, _args.loss)
+    _text = captureText(_rows)
+
+    _start = time.perf_counter()
+    _events = list(readEvents(io.StringIO(_text), ADVERTISING_EVENT_WINDOW))
+    _duration = time.perf_counter() - _start
+
+    print(f"{len(_rows)} reports -> {len(_events)} events ({len(_rows) / len(_events):.2f}x fewer detector inputs,"
+          f" {len(_expected)} heard), {_duration:.2f} s ({len(_rows) / _duration:.0f} reports/s)")
+    print(f"Silences < {SlidingWindowModel.BLE_LowDutyCycle_MinInterval} ms: "
+          f"{shortSilences((row['Address'], int(row['Timestamp'])) for row in _rows)} between reports, "
+          f"{shortSilences((event.address, event.timestamp) for event in _events)} between events")
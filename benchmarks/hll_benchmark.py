@@ -0,0 +1,69 @@
+"""
+HyperLogLog accuracy against exact distinct counts: mean and rms relative error over independent address sets for
+every cardinality, next to the standard error 1.04 / sqrt(2^precision), and the cost of the collector publish path
+(DistinctDeviceCounter) against an exact set per window.
+
+    python3 -m benchmarks.hll_benchmark [-p PRECISION] [-t TRIALS] [--max N]
+"""
+import argparse
+import math
+import pathlib
+import random
+import tempfile
+import time
+
+from sketches import DistinctDeviceCounter, HyperLogLog
+
+_INFO = {'Address': '', 'AddressType': 1, 'Channel': 37}
+
+
+def relativeErrors(cardinality, trials, precision, seed):
+    errors = []
+    for trial in range(trials):
+        rng = random.Random(seed * 1000 + trial)
+        sketch = HyperLogLog(precision)
+        for _ in range(cardinality):
+            sketch.add(rng.getrandbits(48))
+        errors.append(sketch.count() / cardinality - 1)
+    return errors
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the accuracy and the cost of the distinct device counts')
+    _parser.add_argument('-p', '--precision', type=int, default=12, help='[Default: 12]')
+    _parser.add_argument('-t', '--trials', type=int, default=20, help='Address sets per cardinality [Default: 20]')
+    _parser.add_argument('--max', type=int, default=100000, help='Largest cardinality [Default: 100000]')
+    _parser.add_argument('-n', '--records', type=int, default=300000, help='Records published [Default: 300000]')
+    _args = _parser.parse_args()
+
+    print(f"precision {_args.precision}: {1 << _args.precision} B of registers,"
+          f" standard error {1.04 / math.sqrt(1 << _args.precision):.4f}")
+    print(f"{'distinct':>10} {'mean error':>11} {'rms error':>10} {'max error':>10}")
+    _cardinality = 10
+    while _cardinality <= _args.max:
+        # Fewer trials for the large sets, the pure Python sketch adds about 1M addresses per second
+        _trials = min(_args.trials, max(_args.trials * 10000 // _cardinality, 3))
+        _errors = relativeErrors(_cardinality, _trials, _args.precision, _cardinality)
+        print(f"{_cardinality:>10} {sum(_errors) / len(_errors):>+11.4f}"
+              f" {math.sqrt(sum(e * e for e in _errors) / len(_errors)):>10.4f}"
+              f" {max(abs(e) for e in _errors):>10.4f}")
+        _cardinality *= 10
+
+    _rng = random.Random(0)
+    _addresses = [_rng.getrandbits(48).to_bytes(6, 'big').hex(':') for _ in range(20000)]
+    _records = [(1700000000000000 + index * 1000, _rng.choice(_addresses)) for index in range(_args.records)]
+    with tempfile.TemporaryDirectory() as _folder:
+        _counter = DistinctDeviceCounter(pathlib.Path(_folder) / 'benchmark.hll', precision=_args.precision)
+        _start = time.perf_counter()
+        for _timestamp, _address in _records:
+            _counter.publish('ESP 1', _timestamp, dict(_INFO, Address=_address))
+        _counter.close()
+        _sketched = time.perf_counter() - _start
+
+    _exact = {}
+    _start = time.perf_counter()
+    for _timestamp, _address in _records:
+        _exact.setdefault(_timestamp // 60000000, set()).add(_address)
+    _counted = time.perf_counter() - _start
+    print(f"publish: {_args.records / _sketched / 1000:.0f}k records/s"
+          f" (exact set per window {_args.records / _counted / 1000:.0f}k records/s)")
@@ -0,0 +1,49 @@
+// Memory per device and update throughput of the probe interval histogram (main/interval-histogram.c),
+// built on the host:
+//
+//   cc -O2 -I main -I tests/host main/interval-histogram.c benchmarks/interval_histogram_bench.c -o ih_bench
+//   ./ih_bench [devices] [updates per device]
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "interval-histogram.h"
+
+int main(int argc, char *argv[])
+{
+    uint32_t devices = argc > 1 ? atoi(argv[1]) : 10000;
+    uint32_t updates = argc > 2 ? atoi(argv[2]) : 1000;
+    interval_histogram_t *histograms = calloc(devices, sizeof(interval_histogram_t));
+    uint32_t *next = calloc(devices, sizeof(uint32_t));
+    uint32_t *interval = calloc(devices, sizeof(uint32_t));
+    uint32_t seed = 1;
+    uint64_t connections = 0;
+
+    for (uint32_t d = 0; d < devices; d++) {
+        bd_addr_t addr = {d & 0xFF, (d >> 8) & 0xFF, (d >> 16) & 0xFF, 0, 0, 0};
+        interval_histogram_init(&histograms[d], addr);
+        interval[d] = 100 + d % 1000;
+        next[d] = 1 + d % 1000;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t u = 0; u < updates; u++) {
+        for (uint32_t d = 0; d < devices; d++) {
+            seed = seed * 1103515245 + 12345;   // advDelay of 0-10 ms, now and then a connection
+            next[d] += interval[d] + (seed >> 16) % 11 + ((seed >> 8) % 500 == 0 ? 2000 : 0);
+            connections += interval_histogram_update(&histograms[d], next[d]) > 0;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%zu B per device, %.1fM updates/s (%u devices, %llu connections)\n",
+           sizeof(interval_histogram_t), (double)devices * updates / seconds / 1e6, devices,
+           (unsigned long long)connections);
+
+    free(histograms);
+    free(next);
+    free(interval);
+    return 0;
+}
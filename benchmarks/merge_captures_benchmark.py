@@ -0,0 +1,99 @@
+"""
+Throughput and peak memory of the capture merge (merge_captures.CaptureSorter) for several memory budgets, against
+reading every input into a list and sorting it. Every measurement runs in a fresh process so that its peak resident
+memory is its own; the inputs are synthetic sessions, loosely ordered as written by the collector.
+
+    python3 -m benchmarks.merge_captures_benchmark [-s SESSIONS] [-d DEVICES] [--duration S] [-m MIB ...] [-j JOBS]
+"""
+import argparse
+import csv
+import multiprocessing
+import pathlib
+import random
+import resource
+import tempfile
+import time
+
+from merge_captures import CaptureSorter, readHeader, sortKey
+from tests.synthetic import advertisingTraffic, writeCapture
+
+
+def writeSessions(directory, sessions, devices, duration):
+    """
+    Capture files of overlapping sessions, every row at most a second out of order
+    """
+    rng = random.Random(0)
+    paths = []
+    for session in range(sessions):
+        rows, _, _ = advertisingTraffic(devices, duration, seed=session)
+        for row in rows:
+            row['Timestamp'] = str(int(row['Timestamp']) + session * duration // 2)
+        rows.sort(key=lambda row: int(row['Timestamp']) + rng.uniform(0, 1000))
+        paths.append(pathlib.Path(directory, f'session-{session:03d}.csv'))
+        writeCapture(paths[-1], rows)
+    return paths
+
+
+def externalSort(inputs, output, memory, jobs):
+    sorter = CaptureSorter(memory, jobs)
+    sorter.sort(inputs, output, deduplicated=True)
+    return sorter.rows, sorter.runs
+
+
+def inMemorySort(inputs, output, memory, jobs):
+    rows = []
+    for path in inputs:
+        with open(path, newline='') as captureFile:
+            reader = csv.reader(captureFile)
+            next(reader)
+            rows += reader
+    rows.sort(key=lambda values: sortKey(values[0]))
+    with open(output, 'w', newline='') as outputFile:
+        writer = csv.writer(outputFile)
+        writer.writerow(readHeader(inputs[0]))
+        writer.writerows(rows)
+    return len(rows), 1
+
+
+def measure(queue, method, inputs, output, memory, jobs):
+    """
+    Child process: (rows, runs, seconds, peak MiB of this process, peak MiB of its largest worker)
+    """
+    start = time.perf_counter()
+    rows, runs = method(inputs, output, memory, jobs)
+    duration = time.perf_counter() - start
+    queue.put((rows, runs, duration, resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024,
+               resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss / 1024))
+
+
+def run(method, inputs, output, memory, jobs):
+    queue = multiprocessing.Queue()
+    process = multiprocessing.Process(target=measure, args=(queue, method, inputs, output, memory, jobs))
+    process.start()
+    result = queue.get()
+    process.join()
+    return result
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the throughput and the peak memory of the capture merge')
+    _parser.add_argument('-s', '--sessions', type=int, default=8, help='Input files [Default: 8]')
+    _parser.add_argument('-d', '--devices', type=int, default=200, help='Advertisers per session [Default: 200]')
+    _parser.add_argument('--duration', type=int, default=120, help='Session duration (s) [Default: 120]')
+    _parser.add_argument('-m', '--memory', type=int, action='append',
+                         help='Memory budget (MiB) of the external sort, repeatable [Default: 16, 64 and 256]')
+    _parser.add_argument('-j', '--jobs', type=int, default=multiprocessing.cpu_count(),
+                         help='Worker processes [Default: number of CPUs]')
+    _args = _parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as _folder:
+        _inputs = writeSessions(_folder, _args.sessions, _args.devices, _args.duration * 1000)
+        _size = sum(path.stat().st_size for path in _inputs) / 1024 / 1024
+        _output = pathlib.Path(_folder, 'merged.csv')
+        print(f"{_args.sessions} sessions, {_size:.1f} MiB, {_args.jobs} jobs")
+        print(f"{'method':>16} {'rows/s':>9} {'MiB/s':>6} {'runs':>5} {'peak merge':>11} {'peak worker':>12}")
+        for _name, _method, _memory in ([(f'external {m} MiB', externalSort, m) for m in _args.memory or [16, 64, 256]]
+                                        + [('in memory', inMemorySort, 0)]):
+            _rows, _runs, _duration, _own, _workers = run(_method, _inputs, _output, _memory, _args.jobs)
+            print(f"{_name:>16} {_rows / _duration:>9.0f} {_size / _duration:>6.1f} {_runs:>5}"
+                  f" {_own:>7.0f} MiB {_workers:>8.0f} MiB")
@@ -0,0 +1,44 @@
+"""
+Cost of the stage instrumentation of the collector: HdrHistogram.recordValue alone, the updates of one
+instrumented record (ProbeMetrics), and the rendering of the metrics of several probes.
+
+    python3 -m benchmarks.metrics_benchmark [-n VALUES] [-p PROBES]
+"""
+import argparse
+import random
+import time
+
+import collector
+from metrics import HdrHistogram, MetricsRegistry
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the latency histograms and the metrics export')
+    _parser.add_argument('-n', '--values', type=int, default=1000000, help='[Default: 1000000]')
+    _parser.add_argument('-p', '--probes', type=int, default=8, help='[Default: 8]')
+    _args = _parser.parse_args()
+
+    _rng = random.Random(0)
+    _values = [int(_rng.lognormvariate(6, 2)) for _ in range(_args.values)]
+
+    _histogram = HdrHistogram()
+    _start = time.perf_counter()
+    for _value in _values:
+        _histogram.recordValue(_value)
+    _spent = time.perf_counter() - _start
+    print(f"recordValue: {_spent / _args.values * 1e9:.0f} ns/value")
+
+    _registry = MetricsRegistry('benchmark')
+    _instruments = [collector.ProbeMetrics(_registry, f'ESP {_index + 1}') for _index in range(_args.probes)]
+    _now = time.time_ns() // 1000
+    _start = time.perf_counter()
+    for _index, _value in enumerate(_values):
+        _monotonic = time.monotonic_ns()
+        _instruments[_index % _args.probes].record_written(_now - _value, _monotonic, _monotonic + 1000, _monotonic + 30000)
+    _spent = time.perf_counter() - _start
+    print(f"record_written (merge, write, total, counter): {_spent / _args.values * 1e9:.0f} ns/record")
+
+    _start = time.perf_counter()
+    _text = _registry.render()
+    _spent = time.perf_counter() - _start
+    print(f"render of {_args.probes} probes: {_spent * 1000:.1f} ms, {len(_text)} B")
@@ -0,0 +1,67 @@
+"""
+Per-update cost of the detector models on synthetic advertising intervals, across window sizes, and
+the memory per device and update throughput of the fixed-memory models against SimpleStatisticsModel.
+The probe implementation of the interval histogram has its own benchmark (interval_histogram_bench.c).
+
+    python3 -m benchmarks.models_benchmark [-w WINDOW ...] [-n UPDATES] [-d DEVICES]
+"""
+import argparse
+import time
+import tracemalloc
+
+from models import ConnectionAlert, ModelInitialised
+from models import IntervalHistogramModel, SimpleStatisticsModel, SlidingQuantileModel, SlidingWindowModel
+from tests.test_models import jittered
+
+
+def updateCost(model, timestamps):
+    """
+    Mean cost (us) of a processAdv() call
+    """
+    start = time.perf_counter()
+    for timestamp in timestamps:
+        try:
+            model.processAdv(timestamp)
+        except (ModelInitialised, ConnectionAlert):
+            pass
+    return (time.perf_counter() - start) / len(timestamps) * 1e6
+
+
+def memoryPerDevice(model, devices, timestamps):
+    """
+    Bytes allocated per model of a ready device
+    """
+    tracemalloc.start()
+    before = tracemalloc.get_traced_memory()[0]
+    models = []
+    for _ in range(devices):
+        models.append(model())
+        for timestamp in timestamps:
+            try:
+                models[-1].processAdv(timestamp)
+            except (ModelInitialised, ConnectionAlert):
+                pass
+    allocated = tracemalloc.get_traced_memory()[0] - before
+    tracemalloc.stop()
+    return allocated / devices
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the per-update cost of the detector models')
+    _parser.add_argument('-w', '--window', type=int, action='append', dest='windows',
+                         help='Window size, repeat for several [Default: 11, 101, 1001]')
+    _parser.add_argument('-n', '--updates', type=int, default=20000, help='[Default: 20000]')
+    _parser.add_argument('-d', '--devices', type=int, default=10000,
+                         help='Devices of the memory measurement [Default: 10000]')
+    _args = _parser.parse_args()
+
+    _timestamps = jittered(1000, 100, _args.updates)
+    print(f"{'window':>8} {'sliding_window':>16} {'sliding_quantile':>18}  (us per update)")
+    for _window in _args.windows or [11, 101, 1001]:
+        print(f"{_window:>8} {updateCost(SlidingWindowModel(windowSize=_window), _timestamps):>16.1f}"
+              f" {updateCost(SlidingQuantileModel(windowSize=_window), _timestamps):>18.1f}")
+
+    print(f"{'model':>22} {'B/device':>9} {'updates/s':>10}")
+    for _model in (SimpleStatisticsModel, IntervalHistogramModel):
+        print(f"{_model.__name__:>22} {memoryPerDevice(_model, _args.devices, _timestamps[:30]):>9.0f}"
+              f" {1e6 / updateCost(_model(), _timestamps):>10.0f}")
@@ -0,0 +1,46 @@
+"""
+Resolutions per second of the private address resolution against the number of known IRKs: new addresses checked
+one at a time (RpaResolver.identity, as the detector loop does) and in batches (resolveMany), and the lookups of
+the cached addresses. Every checked address is an RPA of an unknown device, so it is hashed under every IRK.
+
+    python3 -m benchmarks.rpa_resolver_benchmark [-k IRKS ...] [-n ADDRESSES]
+"""
+import argparse
+import random
+import time
+
+from rpa_resolver import IrkStore, RpaResolver
+
+
+def unknownAddresses(count, seed=0):
+    rng = random.Random(seed)
+    return [bytes((0x40 | rng.randrange(0x40),)).hex() + ':' + rng.randbytes(5).hex(':') for _ in range(count)]
+
+
+def rate(function, addresses):
+    start = time.perf_counter()
+    function(addresses)
+    return len(addresses) / (time.perf_counter() - start)
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the resolution of private addresses against the IRKs')
+    _parser.add_argument('-k', '--irks', type=int, action='append',
+                         help='Number of known IRKs, repeatable [Default: 1, 10, 100, 1000 and 10000]')
+    _parser.add_argument('-n', '--addresses', type=int, default=2000, help='New addresses checked [Default: 2000]')
+    _args = _parser.parse_args()
+
+    _rng = random.Random(1)
+    print(f"{'IRKs':>6} {'single/s':>10} {'batch/s':>10} {'hashes/s':>10} {'cached/s':>10}")
+    for _count in _args.irks or [1, 10, 100, 1000, 10000]:
+        _store = IrkStore()
+        for _index in range(_count):
+            _store.add(f'Device {_index}', _rng.randbytes(16).hex())
+        _resolver = RpaResolver(_store)
+        # Fewer addresses one at a time for many IRKs, every check hashes all of them
+        _single = rate(lambda addresses: [_resolver.identity(address) for address in addresses],
+                       unknownAddresses(max(_args.addresses * 10 // _count, 20), _count))
+        _batch = rate(_resolver.resolveMany, unknownAddresses(_args.addresses, _count + 1))
+        _cached = rate(lambda addresses: [_resolver.identity(address) for address in addresses],
+                       list(_resolver.cache) * 10)
+        print(f"{_count:>6} {_single:>10.0f} {_batch:>10.0f} {_batch * _count:>10.0f} {_cached:>10.0f}")
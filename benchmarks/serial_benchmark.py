@@ -0,0 +1,86 @@
+"""
+Advertising frames parsed from a pseudo terminal with the pyserial and the termios (serial_port.RawSerial) backends:
+reader CPU time and system calls per frame, and the delay from the write of a frame to its parsing.
+
+    python3 -m benchmarks.serial_benchmark [-n FRAMES] [-r RATE] [-b BURST]
+"""
+import argparse
+import os
+import pty
+import struct
+import threading
+import time
+import tty
+
+import serial
+
+import collector
+from serial_port import Log2Histogram, RawSerial
+
+
+def frame(index):
+    name = b'JBL Flip 5' if index % 4 == 0 else b''
+    # The timestamp field carries the write time, so the reader measures the delay
+    return (
+        b'Adv:' + struct.pack('<q', time.monotonic_ns() // 1000) + struct.pack('<IH', index, 0xc001)
+        + struct.pack('<BBBbB', 1, 0, 37, -60, len(name)) + name
+    )
+
+
+def produce(master, frames, rate, burst):
+    """
+    Write the frames in bursts of `burst`, `rate` frames per second on average
+    """
+    start = time.monotonic()
+    for index in range(0, frames, burst):
+        delay = start + index / rate - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+        os.write(master, b''.join(frame(index + i) for i in range(min(burst, frames - index))))
+
+
+def measure(backend, frames, rate, burst):
+    master, slave = pty.openpty()
+    tty.setraw(slave)
+    path = os.ttyname(slave)
+    conn = RawSerial(path, 115200, timeout=2) if backend == 'termios' else serial.Serial(path, 115200, timeout=2)
+    reads = [0]
+    if backend == 'pyserial':   # Every read() of pyserial ends in at least one os.read
+        original = conn.read
+
+        def read(size=1):
+            reads[0] += 1
+            return original(size)
+        conn.read = read
+
+    producer = threading.Thread(target=produce, args=(master, frames, rate, burst))
+    delays = Log2Histogram('us')
+    cpu = time.thread_time()
+    producer.start()
+    for _ in range(frames):
+        if conn.read(4) != b'Adv:':
+            raise RuntimeError("Stream out of sync.")
+        info = collector.get_advertising_info_from_serial(conn)
+        delays.add(time.monotonic_ns() // 1000 - info['Timestamp'])
+    cpu = time.thread_time() - cpu
+    producer.join()
+    if backend == 'termios':
+        reads[0] = conn.reads
+    conn.close()
+    os.close(master)
+    os.close(slave)
+    return cpu, reads[0], delays
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the serial backends of the collector')
+    _parser.add_argument('-n', '--frames', type=int, default=20000, help='[Default: 20000]')
+    _parser.add_argument('-r', '--rate', type=float, default=5000, help='Frames per second [Default: 5000]')
+    _parser.add_argument('-b', '--burst', type=int, default=8, help='Frames written at once [Default: 8]')
+    _args = _parser.parse_args()
+
+    print(f"{_args.frames} frames at {_args.rate:.0f} frames/s in bursts of {_args.burst}:")
+    for _backend in ('pyserial', 'termios'):
+        _cpu, _reads, _delays = measure(_backend, _args.frames, _args.rate, _args.burst)
+        print(f"  {_backend}: {_cpu / _args.frames * 1e6:.1f} us CPU/frame, {_reads / _args.frames:.2f} reads/frame,"
+              f" delay {_delays}")
@@ -0,0 +1,67 @@
+"""
+Shared memory record ring with several consumer processes attached: publish rate, and for every consumer the
+records received, its overruns and its read rate.
+
+    python3 -m benchmarks.shm_ring_benchmark [-n RECORDS] [-c CONSUMERS]
+"""
+import argparse
+import multiprocessing
+import os
+import time
+
+from shm_ring import ShmRingConsumer, ShmRingPublisher
+
+_INFO = {
+    'Address': 'c0:01:02:03:04:05', 'AddressType': 1, 'AdvertisingType': 0, 'Channel': 37, 'RSSI': -60,
+    'DeviceName': 'Sensor'
+}
+
+
+def consume(name, records, ready, results):
+    consumer = ShmRingConsumer(name)
+    ready.release()
+    received = 0
+    start = None
+    while received + consumer.overruns < records:
+        batch = consumer.read()
+        if batch and start is None:
+            start = time.perf_counter()
+        received += len(batch)
+    results.put((os.getpid(), received, consumer.overruns, time.perf_counter() - start))
+    consumer.close()
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the shared memory record ring')
+    _parser.add_argument('-n', '--records', type=int, default=300000, help='[Default: 300000]')
+    _parser.add_argument('-c', '--consumers', type=int, default=4, help='[Default: 4]')
+    _parser.add_argument('--slots', type=int, default=65536, help='[Default: 65536]')
+    _args = _parser.parse_args()
+
+    _name = f'shm-ring-benchmark-{os.getpid()}'
+    _publisher = ShmRingPublisher(_name, _args.slots)
+    _ready = multiprocessing.Semaphore(0)
+    _results = multiprocessing.Queue()
+    _processes = [multiprocessing.Process(target=consume, args=(_name, _args.records, _ready, _results))
+                  for _ in range(_args.consumers)]
+    try:
+        for _process in _processes:
+            _process.start()
+        for _ in _processes:
+            _ready.acquire()
+
+        _start = time.perf_counter()
+        for _index in range(_args.records):
+            _publisher.publish('probe', _index, _INFO)
+        _publish = time.perf_counter() - _start
+        print(f"{_args.records} records published with {_args.consumers} consumers:"
+              f" {_args.records / _publish / 1000:.0f}k records/s")
+
+        for _ in _processes:
+            _pid, _received, _overruns, _spent = _results.get()
+            print(f"  consumer {_pid}: {_received} received, {_overruns} overruns,"
+                  f" {_received / _spent / 1000:.0f}k records/s")
+        for _process in _processes:
+            _process.join()
+    finally:
+        _publisher.close()
@@ -0,0 +1,95 @@
+"""
+Subscription load test: subscriber processes with heterogeneous filters (none, channel, RSSI, address set,
+name prefixes and types) on the loopback socket. Reports the publish rate and, for every subscriber, the
+records received and dropped and the latency from publishing to receiving.
+
+    python3 -m benchmarks.subscriptions_benchmark [-n RECORDS] [-c SUBSCRIBERS]
+"""
+import argparse
+import multiprocessing
+import pathlib
+import random
+import tempfile
+import time
+
+from subscriptions import SubscriptionClient, SubscriptionServer
+from tests.synthetic import randomAddress
+
+
+def filters(addresses):
+    return [
+        {},
+        {'channels': [37]},
+        {'minRssi': -60},
+        {'addresses': addresses[:20]},
+        {'namePrefixes': ['Tile', 'Air'], 'types': [0, 3]},
+    ]
+
+
+def subscribe(path, spec, ready, results):
+    client = SubscriptionClient(path, **spec)
+    ready.release()
+    latencies = []
+    for record in client:
+        latencies.append(time.time_ns() // 1000 - record['Timestamp'])
+    client.close()
+    latencies.sort()
+    results.put((spec, len(latencies), latencies))
+
+
+def label(spec):
+    return ', '.join(f'{key}=[{len(value)} values]' if isinstance(value, list) and len(value) > 3 else f'{key}={value}'
+                     for key, value in spec.items()) or 'no filter'
+
+
+def percentile(values, fraction):
+    return values[min(int(len(values) * fraction), len(values) - 1)] / 1000 if values else float('nan')
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Load test of the record subscriptions')
+    _parser.add_argument('-n', '--records', type=int, default=200000, help='[Default: 200000]')
+    _parser.add_argument('-c', '--subscribers', type=int, default=8, help='[Default: 8]')
+    _parser.add_argument('-d', '--devices', type=int, default=1000, help='[Default: 1000]')
+    _parser.add_argument('-s', '--seed', type=int, default=0)
+    _args = _parser.parse_args()
+
+    _rng = random.Random(_args.seed)
+    _addresses = [randomAddress(_rng) for _ in range(_args.devices)]
+    _names = ['Tile', 'AirTag', 'Band', '']
+    _infos = [{
+        'Address': _rng.choice(_addresses), 'AddressType': 1, 'AdvertisingType': _rng.choice([0, 2, 3]),
+        'Channel': _rng.choice([37, 38, 39]), 'RSSI': _rng.randrange(-95, -30), 'DeviceName': _rng.choice(_names)
+    } for _ in range(10000)]
+    _filters = filters(_addresses)
+
+    with tempfile.TemporaryDirectory() as _folder:
+        _path = pathlib.Path(_folder) / 'records.sock'
+        _server = SubscriptionServer(_path)
+        _ready = multiprocessing.Semaphore(0)
+        _results = multiprocessing.Queue()
+        _processes = [multiprocessing.Process(target=subscribe,
+                                              args=(_path, _filters[_index % len(_filters)], _ready, _results))
+                      for _index in range(_args.subscribers)]
+        for _process in _processes:
+            _process.start()
+        for _ in _processes:
+            _ready.acquire()
+        while len(_server.stats()) < _args.subscribers:
+            time.sleep(0.01)
+
+        _start = time.perf_counter()
+        for _index in range(_args.records):
+            _server.publish('probe', time.time_ns() // 1000, _infos[_index % len(_infos)])
+        _publish = time.perf_counter() - _start
+        _dropped = sum(dropped for _, dropped in _server.stats())
+        _server.close()
+
+        print(f"{_args.records} records published to {_args.subscribers} subscribers:"
+              f" {_args.records / _publish / 1000:.0f}k records/s, {_dropped} dropped")
+        for _ in _processes:
+            _spec, _received, _latencies = _results.get()
+            print(f"  {label(_spec)}: {_received} received,"
+                  f" latency p50 {percentile(_latencies, 0.5):.1f} ms, p99 {percentile(_latencies, 0.99):.1f} ms")
+        for _process in _processes:
+            _process.join()
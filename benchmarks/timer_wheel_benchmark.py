@@ -0,0 +1,64 @@
+"""
+Deadline scheduling of the live detector with a million tracked devices: cost of an insert and of a
+reschedule (cancel + insert, once per advertisement), and the latency from a deadline to its alert when the
+wheel is advanced on every capture poll (live_detector.__POLL_INTERVAL__).
+
+    python3 -m benchmarks.timer_wheel_benchmark [-n DEVICES]
+"""
+import argparse
+import random
+import statistics
+import time
+
+from live_detector import __POLL_INTERVAL__
+from timer_wheel import HierarchicalTimerWheel
+from tests.synthetic import INTERVALS
+
+
+def percentile(values, fraction):
+    return values[min(int(len(values) * fraction), len(values) - 1)]
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the timer wheel of the live detector')
+    _parser.add_argument('-n', '--devices', type=int, default=1000000, help='[Default: 1000000]')
+    _parser.add_argument('-t', '--duration', type=int, default=30, help='Seconds of deadlines [Default: 30]')
+    _parser.add_argument('-s', '--seed', type=int, default=0)
+    _args = _parser.parse_args()
+
+    _rng = random.Random(_args.seed)
+    _wheel = HierarchicalTimerWheel(tick=1)
+    _intervals = [_rng.choice(INTERVALS) for _ in range(_args.devices)]
+    _deadlines = [_rng.uniform(1, _args.duration * 1000) for _ in range(_args.devices)]
+
+    _start = time.perf_counter()
+    for _device, _deadline in enumerate(_deadlines):
+        _wheel.schedule(_device, _deadline)
+    _insert = time.perf_counter() - _start
+
+    # Every device advertises once: its deadline moves one interval (and some margin) later
+    _start = time.perf_counter()
+    for _device, _deadline in enumerate(_deadlines):
+        _wheel.schedule(_device, _deadline + 2 * _intervals[_device])
+    _reschedule = time.perf_counter() - _start
+    print(f"{_args.devices} devices: insert {_insert / _args.devices * 1e6:.2f} us,"
+          f" reschedule {_reschedule / _args.devices * 1e6:.2f} us")
+
+    # Deadlines fire as the wheel follows the (simulated) wall clock, one advance per poll
+    _poll = int(__POLL_INTERVAL__ * 1000)
+    _latencies = []
+    _advances = []
+    _end = _args.duration * 1000 + 2 * max(INTERVALS) + _poll
+    for _now in range(0, int(_end) + _poll, _poll):
+        _start = time.perf_counter()
+        _fired = _wheel.advance(_now)
+        _spent = (time.perf_counter() - _start) * 1000
+        _advances.append(_spent)
+        # An alert is out once its advance returns: the lag of the poll plus the processing time
+        _latencies += [_now - _expiry + _spent for _, _expiry in _fired]
+    _latencies.sort()
+    _advances.sort()
+    print(f"{len(_latencies)} deadline alerts, latency from deadline to alert: mean {statistics.mean(_latencies):.1f} ms,"
+          f" p99 {percentile(_latencies, 0.99):.1f} ms, max {_latencies[-1]:.1f} ms")
+    print(f"{len(_advances)} advances every {_poll} ms: p50 {percentile(_advances, 0.5):.2f} ms,"
+          f" p99 {percentile(_advances, 0.99):.2f} ms, max {_advances[-1]:.2f} ms")
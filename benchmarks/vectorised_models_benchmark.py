@@ -0,0 +1,49 @@
+"""
+Detection time of the Python and the NumPy backends of detector.py on a synthetic capture (with connections,
+capture outages and rotation pauses), for every vectorised detector: the loop calls and the log writes of the
+Python backend against the collection, grouping and evaluation of the vectorised one. The alert logs are compared.
+
+    python3 -m benchmarks.vectorised_models_benchmark [-d DEVICES] [--duration S] [-s SPEC ...]
+"""
+import argparse
+import contextlib
+import io
+import pathlib
+import tempfile
+import time
+
+from detector import Detector
+from tests.test_vectorised_models import SPECS, detectorCalls, run
+from vectorised_models import CaptureArrays, VectorDetector
+
+
+def detect(detectorClass, spec, calls, directory):
+    """
+    :return: (Seconds, alert log)
+    """
+    modelPath, alertPath = pathlib.Path(directory, 'model.csv'), pathlib.Path(directory, 'alerts.csv')
+    with modelPath.open('w') as modelLog, alertPath.open('w') as alertLog, contextlib.redirect_stdout(io.StringIO()):
+        start = time.perf_counter()
+        detector = detectorClass(spec, modelLog, alertLog)
+        run(detector, CaptureArrays() if detectorClass is VectorDetector else detector, calls)
+        duration = time.perf_counter() - start
+    return duration, alertPath.read_text()
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(description='Benchmark the NumPy backend of the detector against the Python one')
+    _parser.add_argument('-d', '--devices', type=int, default=300, help='[Default: 300]')
+    _parser.add_argument('--duration', type=int, default=120, help='Capture duration (s) [Default: 120]')
+    _parser.add_argument('-s', '--spec', dest='specs', action='append',
+                         help='Detector specification, repeatable [Default: ' + ', '.join(SPECS) + ']')
+    _args = _parser.parse_args()
+
+    _calls = detectorCalls(_args.devices, _args.duration * 1000)
+    print(f"{_args.devices} devices, {sum(call[0] == 'adv' for call in _calls)} advertisements")
+    print(f"{'detector':>60} {'python':>8} {'numpy':>8} {'speedup':>8} {'alerts':>7} same")
+    with tempfile.TemporaryDirectory() as _folder:
+        for _spec in _args.specs or SPECS:
+            _python, _alerts = detect(Detector, _spec, _calls, _folder)
+            _numpy, _vectorAlerts = detect(VectorDetector, _spec, _calls, _folder)
+            print(f"{_spec:>60} {_python:>7.2f}s {_numpy:>7.2f}s {_python / _numpy:>7.1f}x"
+                  f" {_alerts.count(chr(10)) - 1:>7} {'yes' if _alerts == _vectorAlerts else 'NO'}")
@@ -0,0 +1,79 @@
+import mmap
+import os
+import pathlib
+import struct
+
+# Snapshot layout (little endian):
+#   header:  magic "BLECKPT", version (B), record size (I), record count (Q), capture file id (Q),
+#            capture position (Q), spec length (H), detector spec
+#   records: address (6 B) followed by the packed model state, all records of the same size
+SNAPSHOT_MAGIC = b'BLECKPT'
+SNAPSHOT_VERSION = 2
+
+_version = struct.Struct('<7sB')
+_header = struct.Struct('<7sBIQQQH')
+
+
+def packAddress(address):
+    return bytes.fromhex(address.replace(':', ''))
+
+
+def unpackAddress(raw):
+    return raw.hex(':')
+
+
+def writeSnapshot(path, spec, models, modelFactory, capture=(0, 0)):
+    """
+    Atomically store the state of all `models` (address -> model) created by `modelFactory` from detector `spec`
+    :param capture: Capture file id (inode) and the position behind its last processed row
+    """
+    path = pathlib.Path(path)
+    stateSize = modelFactory().stateStruct().size
+    specRaw = spec.encode('utf-8')
+
+    snapshot = bytearray(_header.pack(SNAPSHOT_MAGIC, SNAPSHOT_VERSION, 6 + stateSize, len(models), *capture,
+                                      len(specRaw)))
+    snapshot += specRaw
+    for address, model in models.items():
+        snapshot += packAddress(address)
+        snapshot += model.packState()
+
+    tmpPath = path.with_name(path.name + '.tmp')
+    with tmpPath.open('wb') as snapshotFile:
+        snapshotFile.write(snapshot)
+        snapshotFile.flush()
+        os.fsync(snapshotFile.fileno())
+    os.replace(tmpPath, path)   # Never leave a partially written snapshot behind
+
+
+def loadSnapshot(path, spec, modelFactory):
+    """
+    Restore models (address -> model) from a snapshot written for the same detector `spec`
+    :return: The models and the capture (file id, position) they were processed to
+    """
+    with pathlib.Path(path).open('rb') as snapshotFile, \
+            mmap.mmap(snapshotFile.fileno(), 0, access=mmap.ACCESS_READ) as snapshot:
+        magic, version = _version.unpack_from(snapshot, 0)
+        if magic != SNAPSHOT_MAGIC or version != SNAPSHOT_VERSION:
+            raise ValueError(f"Unsupported snapshot format (version {version}).")
+        _, _, recordSize, count, captureId, position, specLength = _header.unpack_from(snapshot, 0)
+
+        offset = _header.size
+        snapshotSpec = bytes(snapshot[offset:offset + specLength]).decode('utf-8')
+        if snapshotSpec != spec:
+            raise ValueError(f"Snapshot was taken with detector {snapshotSpec}.")
+        offset += specLength
+
+        if recordSize != 6 + modelFactory().stateStruct().size:
+            raise ValueError("Snapshot record size does not match the model state.")
+        if len(snapshot) < offset + count * recordSize:
+            raise ValueError("Snapshot is truncated.")
+
+        models = {}
+        for _ in range(count):
+            model = modelFactory()
+            model.unpackState(snapshot, offset + 6)
+            models[unpackAddress(snapshot[offset:offset + 6])] = model
+            offset += recordSize
+
+    return models, (captureId, position)
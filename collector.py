@@ -1,10 +1,16 @@
 #!/usr/bin/env python
 
 import argparse
+import collections
+import concurrent.futures
 import configparser
 import csv
+import functools
+import glob
+import json
 import pathlib
 import serial
+import signal
 import struct
 import sys
 import time
@@ -15,23 +21,137 @@ from datetime import datetime
 from scapy.layers.bluetooth import HCI_Hdr, HCI_PHDR_Hdr
 from scapy.utils import PcapWriter
 
+from flight_recorder import FlightRecorder, advertisingReport, extract
+from forwarder import EdgeForwarder
+from hci_compression import HciStreamDecoder
+from metrics import MetricsRegistry, MetricsExporter
+from records import gapRow
+from serial_port import RawSerial, SerialStats
+from shm_ring import ShmRingPublisher
+from sketches import AppearanceTracker, DistinctDeviceCounter, HeavyHitterTracker
+from subscriptions import SubscriptionServer
+
 __CONFIG_NAME__ = "collector.ini"
 __DEFAULT_BAUD__ = 115200
+__DEFAULT_RECORDER_SIZE__ = 64      # MiB of raw frames kept per probe
+__DEFAULT_RECORDER_WINDOW__ = 60    # Seconds extracted on an operator trigger
+__DEFAULT_SCAN__ = ['/dev/ttyUSB*', '/dev/ttyACM*']  # Serial devices searched for probes bound by identity
+__IDENTIFY_TIMEOUT__ = 8    # Seconds a probe has to answer the identification (covers the probe boot)
+__REQUEST_RETRY__ = 0.5     # Seconds between two repeated requests to a probe
+__ATTACH_TIMEOUT__ = 2      # Seconds a running probe has to answer the sync request of a warm attach
+__SYNC_WINDOW__ = 16        # Sync frames the clock offset is estimated from
+__HANDSHAKE_TIMEOUT__ = 15  # Seconds a reopened probe has to get capturing again (covers a reset)
+__MIN_BACKOFF__ = 0.1       # Delays between attempts to reopen a lost probe (s), doubled after every failure
+__MAX_BACKOFF__ = 10
+__DELAY_BUCKETS__ = 24      # Power of two buckets of the probe transmission delays (PC_DELAY_BUCKETS)
+__METRICS_INTERVAL__ = 10   # Seconds between two writes of the metrics file
+__DIAGNOSTIC_SECTIONS__ = ['callback', 'parser']  # Timed code sections of the probe (pd_section_t)
+__DISTINCT_WINDOW__ = 60    # Seconds of a distinct device count window
+__HEAVY_WINDOW__ = 10       # Seconds of a heavy hitter window
+__APPEARANCE_HORIZON__ = 3600  # Seconds after which a device heard again appears again
+__APPEARANCE_CAPACITY__ = 100000    # Devices heard within the horizon the appearance filters are sized for
+__APPEARANCE_ERROR__ = 0.001    # Probability that an appearance is missed (Bloom filter false positive)
 
 
 write_lock = threading.Lock()
 start_cond = threading.Condition()
 
+flight_recorders = {}   # Probe name -> FlightRecorder
+publishers = []         # Consumers of the decoded records, publish(probe name, timestamp in us, advertising info)
+warm_attach = False     # Attach to running probes without resetting them
+port_openers = {}       # Probe name -> function (re)opening its serial port
+open_ports = {}         # Probe name -> path of its open serial device
+scan_lock = threading.Lock()    # Serialises the scans for lost probes, so two never open the same device
+native_serial = False   # Open the probes with the termios backend (serial_port.RawSerial) instead of pyserial
+read_coalesce = 0       # Tenths of a second the termios backend lets the driver gather data before a read returns
+serial_stats = {}       # Probe name -> serial_port.SerialStats (termios backend only)
+metrics = None          # MetricsRegistry of the stage latencies and throughputs, None when not exported
+probe_metrics = {}      # Probe name -> ProbeMetrics
+diagnostics_log = None  # Text file the probe diagnostics are logged into (JSON lines), None discards them
+diagnostics_state = {}  # Probe name -> (total run time, {(task name, core) -> run time}) of the previous frame
+
+
+def open_serial(path: str, baud: int) -> serial.Serial:
+    """
+    Open the serial port of a probe with the selected backend
+    """
+    if native_serial:
+        return RawSerial(path, baud, coalesce=read_coalesce)
+    return serial.Serial(path, baud)
+
+
+class ProbeMetrics:
+    """
+    Latency (us) of every stage of a record, from the capture callback on the probe to the written capture row:
+    queue (callback to UART transmission, from the delay frames), receive (callback to host reception),
+    decode (reception to decoded frame, termios backend only), merge (wait for the shared capture),
+    write (capture row and publishers) and total (callback to written row), with throughput counters
+    """
+
+    def __init__(self, registry: MetricsRegistry, name: str):
+        stage = functools.partial(registry.histogram, 'stage_latency', 'Latency of a capture stage', probe=name)
+        self.queue = stage(stage='queue')
+        self.receive = stage(stage='receive')
+        self.decode = stage(stage='decode')
+        self.merge = stage(stage='merge')
+        self.write = stage(stage='write')
+        self.total = stage(stage='total')
+        self.frames = registry.counter('frames', 'Capture frames decoded', probe=name)
+        self.bytes = registry.counter('frame_bytes', 'Bytes of the decoded capture frames', probe=name)
+        self.records = registry.counter('records', 'Records written to the capture', probe=name)
+        self.errors = registry.counter('transmission_errors', 'Frames without a start sequence', probe=name)
+        self.recoveries = registry.counter('recoveries', 'Captures resumed after the probe was lost', probe=name)
+
+    def frame_received(self, conn: serial.Serial, clock: 'ClockSync', device_time: int, size: int) -> None:
+        self.receive.recordValue(received_time(conn) - clock.start_time - device_time)
+        if isinstance(conn, RawSerial):
+            self.decode.recordValue((time.monotonic_ns() - conn.arrivalStamp()) // 1000)
+        self.frames.value += 1
+        self.bytes.value += size
+
+    def delays_received(self, counts: tuple) -> None:
+        for bucket, count in enumerate(counts):
+            if count:   # Counted at the middle of the bucket [2^(bucket-1), 2^bucket)
+                self.queue.recordValue(3 << (bucket - 2) if bucket >= 2 else bucket, count)
+
+    def record_written(self, timestamp: int, waiting: int, locked: int, written: int) -> None:
+        """
+        :param timestamp: Host time of the capture callback (us since the epoch)
+        :param waiting: Monotonic time (ns) the shared capture was requested at, then obtained and released
+        """
+        self.merge.recordValue((locked - waiting) // 1000)
+        self.write.recordValue((written - locked) // 1000)
+        self.total.recordValue(time.time_ns() // 1000 - timestamp)
+        self.records.value += 1
+
+
+def get_probe_metrics(name: str) -> typing.Optional[ProbeMetrics]:
+    if metrics is None:
+        return None
+    return probe_metrics.setdefault(name, ProbeMetrics(metrics, name))
+
+
+def received_time(conn: serial.Serial) -> int:
+    """
+    Host time (us since the epoch) the last byte read from `conn` was received at
+    """
+    if isinstance(conn, RawSerial):  # Stamped when the driver delivered it, not when it was parsed
+        return conn.arrivalTime()
+    return time.time_ns() // 1000   # Nanoseconds precision to microseconds
+
 
-def esp_init(conn: serial.Serial) -> None:
+def esp_init(conn: serial.Serial, deadline: typing.Optional[float] = None) -> None:
     """
-    Reset the ESP and wait for the main loop to start
+    Reset the ESP and wait for the main loop to start (until the monotonic `deadline`, if given)
     """
     name = threading.current_thread().name
     
     # Toggle Data Terminal Ready to reset the ESP chip for synchronization
-    conn.dtr = False
-    conn.dtr = True
+    try:
+        conn.dtr = False
+        conn.dtr = True
+    except OSError:     # No modem control lines (e.g. a pseudo terminal), ask the probe itself to restart
+        conn.write(b'RST\n')
     conn.reset_input_buffer()   # Drop pre-reset messages
 
     # Wait for the main loop
@@ -40,11 +160,334 @@ def esp_init(conn: serial.Serial) -> None:
             message = conn.readline()
             if message.startswith(b'entry '):    # entry 0xhex denotes the start of the main loop
                 break
+            if deadline is not None and time.monotonic() > deadline:
+                raise TimeoutError("Probe did not restart")
+    except TimeoutError:
+        raise
     except OSError as e:
         with write_lock:
             print(f'{name}: Error ({e})', flush=True, file=sys.stderr)
 
 
+def find_frame(conn: serial.Serial, start: bytes, request: bytes, timeout: float) -> typing.Optional[int]:
+    """
+    Send the `request` (repeatedly) until a frame beginning with `start` arrives. The stream is consumed up to
+    the end of the start sequence, so the frame content can be read right after.
+    :return: Host time (us since the epoch) the start sequence was received at, None if the `timeout` expired
+    """
+    deadline = time.monotonic() + timeout
+    read_timeout = conn.timeout
+    conn.timeout = __REQUEST_RETRY__
+    try:
+        window = b''
+        next_request = 0
+        while time.monotonic() < deadline:
+            if time.monotonic() >= next_request:
+                conn.write(request)
+                next_request = time.monotonic() + __REQUEST_RETRY__
+            byte = conn.read(1)     # Byte by byte, nothing after the start sequence may be consumed
+            if not byte:
+                continue
+            window = (window + byte)[-len(start):]
+            if window == start:
+                return received_time(conn)
+    finally:
+        conn.timeout = read_timeout
+    return None
+
+
+def identify_probe(conn: serial.Serial, timeout: float = __IDENTIFY_TIMEOUT__) -> typing.Optional[dict]:
+    """
+    Ask the probe for its identity (repeatedly, until it answers or the `timeout` expires)
+    """
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if find_frame(conn, b'Ide:', b'ID?\n', deadline - time.monotonic()) is None:
+            break
+        read_timeout = conn.timeout
+        conn.timeout = __REQUEST_RETRY__    # Another device may stop in the middle of the frame
+        try:
+            identity = get_identity_from_serial(conn)
+        finally:
+            conn.timeout = read_timeout
+        if identity is not None:
+            return identity
+    return None
+
+
+def get_identity(data: bytes) -> typing.Optional[dict]:
+    """
+    Decode an identity frame (after its start sequence), None if it does not look like one
+    """
+    mode = chr(data[7])
+    if mode not in ('A', 'R'):
+        return None
+    return {
+        'Chip': data[0:6].hex(':'),
+        'Channel': data[6],
+        'Mode': 'advertising' if mode == 'A' else 'raw',
+        'Build': data[9:9 + data[8]].decode('utf8', errors='replace')
+    }
+
+
+def get_identity_from_serial(conn: serial.Serial) -> typing.Optional[dict]:
+    data = conn.read(9)
+    if len(data) != 9:  # Timed out, not an identity frame
+        return None
+    data += conn.read(data[8])
+    return get_identity(data)
+
+
+def get_diagnostics_from_serial(conn: serial.Serial) -> dict:
+    timestamp, free_heap, minimum_free_heap, largest_free_block, section_count = struct.unpack('<qIIIB', conn.read(21))
+    sections = {}
+    for i in range(section_count):
+        executions, total, longest = struct.unpack('<III', conn.read(12))
+        name = __DIAGNOSTIC_SECTIONS__[i] if i < len(__DIAGNOSTIC_SECTIONS__) else f'section{i}'
+        sections[name] = {'Executions': executions, 'Total': total, 'Longest': longest}
+    total_run_time, task_count = struct.unpack('<IB', conn.read(5))
+    tasks = []
+    for _ in range(task_count):
+        name = conn.read(conn.read(1)[0]).decode('utf8', errors='replace')
+        core, priority, stack, run_time = struct.unpack('<BBII', conn.read(10))
+        tasks.append({
+            'Name': name,
+            'Core': None if core == 0xFF else core,
+            'Priority': priority,
+            'StackHighWaterMark': stack,    # Bytes never used
+            'RunTime': run_time
+        })
+    return {
+        'Timestamp': timestamp,
+        'FreeHeap': free_heap,
+        'MinimumFreeHeap': minimum_free_heap,
+        'LargestFreeBlock': largest_free_block,
+        'Sections': sections,
+        'TotalRunTime': total_run_time,
+        'Tasks': tasks
+    }
+
+
+def log_diagnostics(name: str, diagnostics: dict) -> None:
+    """
+    Write the diagnostics of a probe into the diagnostics log, with the CPU load of every task since the previous
+    diagnostics (run times are modulo 2^32 us) and the load of every core (time not spent in its idle task)
+    """
+    if diagnostics_log is None:
+        return
+
+    previous_total, previous_run_times = diagnostics_state.get(name, (None, {}))
+    elapsed = (diagnostics['TotalRunTime'] - previous_total) % (1 << 32) if previous_total is not None else 0
+    run_times = {}
+    cores = {}
+    for task in diagnostics['Tasks']:
+        key = (task['Name'], task['Core'])
+        run_times[key] = task['RunTime']
+        task['CPU'] = None
+        if elapsed and key in previous_run_times:
+            task['CPU'] = round((task['RunTime'] - previous_run_times[key]) % (1 << 32) / elapsed * 100, 2)
+            if task['Name'].startswith('IDLE') and task['Core'] is not None:
+                cores[task['Core']] = round(100 - task['CPU'], 2)
+    diagnostics_state[name] = (diagnostics['TotalRunTime'], run_times)
+
+    for section in diagnostics['Sections'].values():
+        section['Mean'] = round(section['Total'] / section['Executions'], 1) if section['Executions'] else None
+
+    entry = dict(diagnostics, Probe=name, Time=datetime.now().isoformat(), CoreLoad=cores)
+    with write_lock:
+        diagnostics_log.write(json.dumps(entry) + '\n')
+        diagnostics_log.flush()
+
+
+def discover_probes(patterns: list, baud: int, exclude: typing.Iterable = ()) -> dict:
+    """
+    Identify the probes on all serial devices matching `patterns` (except the `exclude`d ones) in parallel
+    :return: Chip MAC -> (open connection, identity)
+    """
+    paths = sorted({path for pattern in patterns for path in glob.glob(pattern)} - set(exclude))
+
+    def identify(path):
+        try:
+            conn = open_serial(path, baud)
+        except (OSError, serial.SerialException):
+            return path, None, None
+        try:
+            identity = identify_probe(conn)
+        except (OSError, serial.SerialException):   # Not a probe, e.g. a device without serial line
+            identity = None
+        if identity is None:
+            conn.close()
+        return path, conn, identity
+
+    probes = {}
+    with concurrent.futures.ThreadPoolExecutor(max_workers=max(len(paths), 1)) as executor:
+        for path, conn, identity in executor.map(identify, paths):
+            if identity is None:
+                continue
+            identity['Path'] = path
+            if identity['Chip'] in probes:
+                print(f'Probe {identity["Chip"]} found on both {probes[identity["Chip"]][1]["Path"]} and {path}',
+                      file=sys.stderr)
+                conn.close()
+                continue
+            probes[identity['Chip']] = (conn, identity)
+    return probes
+
+
+def find_probe(chip: str, patterns: list, baud: int) -> serial.Serial:
+    """
+    Scan the serial devices not used by the other probes for the probe `chip`
+    :return: Open connection to the probe
+    """
+    with scan_lock:
+        discovered = discover_probes(patterns, baud, exclude=open_ports.values())
+        conn = None
+        for found, (found_conn, identity) in discovered.items():
+            if found == chip:
+                conn = found_conn
+                open_ports[threading.current_thread().name] = identity['Path']
+            else:
+                found_conn.close()
+    if conn is None:
+        raise LookupError(f"Probe {chip} not found")
+    return conn
+
+
+class ClockSync:
+    """
+    Host time of the probe boot, estimated from pairs of device time and host receive time.
+    Every sample is late by its transmission delay, so the earliest of the recent ones is the closest.
+    """
+
+    def __init__(self, window: int = __SYNC_WINDOW__):
+        self.samples = collections.deque(maxlen=window)
+        self.start_time = 0     # Microseconds since the epoch
+
+    def update(self, host_time: int, device_time: int) -> None:
+        self.samples.append(host_time - device_time)
+        self.start_time = min(self.samples)
+
+
+def get_sync_from_serial(conn: serial.Serial) -> dict:
+    timestamp, channel, capturing = struct.unpack('<qBB', conn.read(10))
+    return {
+        'Timestamp': timestamp,
+        'Channel': channel,
+        'Capturing': capturing != 0
+    }
+
+
+def get_delays_from_serial(conn: serial.Serial) -> tuple:
+    return struct.unpack(f'<{__DELAY_BUCKETS__}H', conn.read(2 * __DELAY_BUCKETS__))
+
+
+def attach_running(conn: serial.Serial) -> typing.Optional[tuple]:
+    """
+    Attach to a probe which is already capturing, without resetting it
+    :return: (clock synchronisation, channel), None if the probe does not answer or does not capture yet
+    """
+    conn.reset_input_buffer()   # Drop the (possibly partial) frames sent before the attach
+    received = find_frame(conn, b'Syn:', b'SYN?\n', __ATTACH_TIMEOUT__)
+    if received is None:
+        return None
+    sync = get_sync_from_serial(conn)
+    if not sync['Capturing']:
+        return None
+    clock = ClockSync()
+    clock.update(received, sync['Timestamp'])
+    return clock, sync['Channel']   # The stream continues with the next frame
+
+
+def start_capture(conn: serial.Serial, raw: bool = False, warm: typing.Optional[bool] = None,
+                  timeout: typing.Optional[float] = None) -> tuple:
+    """
+    Get the probe capturing, either by attaching to the running capture (warm attach) or by resetting the probe
+    :param warm: Try the warm attach first [Default: --warm]
+    :param timeout: Seconds the probe has to get capturing, TimeoutError is raised afterwards [Default: no limit]
+    :return: (clock synchronisation, channel)
+    """
+    name = threading.current_thread().name
+    deadline = time.monotonic() + timeout if timeout is not None else None
+
+    if warm_attach if warm is None else warm:
+        attached = attach_running(conn)
+        if attached is not None:
+            with write_lock:
+                print(f'- {name}: Attached to the running capture', flush=True)
+            return attached
+        with write_lock:
+            print(f'{name}: Probe is not capturing, resetting it', flush=True, file=sys.stderr)
+
+    read_timeout = conn.timeout
+    if deadline is not None:
+        conn.timeout = 1    # Lets the deadline be checked while the probe is silent
+    esp_init(conn, deadline)
+    clock = ClockSync()
+    channel = 0
+
+    # Initialisation phase
+    while True:
+        if deadline is not None and time.monotonic() > deadline:
+            raise TimeoutError("Probe did not start capturing")
+        message_raw = conn.readline()
+        timestamp = received_time(conn)
+        if message_raw.startswith(b'Capture started at:'):
+            device_start_time = int(message_raw[20:])   # Milliseconds
+            clock.update(timestamp, device_start_time * 1000)
+        elif message_raw.startswith(b'Locked to channel:'):
+            channel = int(message_raw[19:])
+            break
+
+    if raw:
+        # Wait for the Scan Start message
+        decoder = HciStreamDecoder()    # The probe was reset, its first event is sent as a plain frame
+        while True:
+            if deadline is not None and time.monotonic() > deadline:
+                raise TimeoutError("Probe did not start scanning")
+            msg_start = conn.read(4)
+            data = None
+            if msg_start == b'BLE:':
+                packet = get_packet_from_serial(conn, decoder)
+                data = bytes(packet.payload)
+            elif msg_start == b'BLZ:':
+                decoded = decoder.compressed(conn)
+                data = decoded[1] if decoded is not None else None
+            elif msg_start == b'Syn:':
+                get_sync_from_serial(conn)
+            elif msg_start == b'Lat:':
+                get_delays_from_serial(conn)
+            elif msg_start == b'Dia:':
+                log_diagnostics(threading.current_thread().name, get_diagnostics_from_serial(conn))
+            if data == b'\x04\x0e\x04\x05\x0c\x20\x00':  # LE Set Scan Enable Complete
+                break
+
+    conn.timeout = read_timeout
+    return clock, channel
+
+
+def recover_probe(name: str, raw: bool = False) -> tuple:
+    """
+    Reopen the serial port of a lost probe (retrying with exponential backoff) and get it capturing again
+    :return: (connection, clock synchronisation, channel)
+    """
+    backoff = __MIN_BACKOFF__
+    while True:
+        time.sleep(backoff)
+        backoff = min(backoff * 2, __MAX_BACKOFF__)
+        try:
+            conn = port_openers[name]()
+        except (OSError, LookupError, serial.SerialException):
+            continue
+        open_ports[name] = conn.port    # Excluded from the scans for the other lost probes again
+        try:
+            # The probe has most likely kept capturing, a reset is only needed after a power loss
+            clock, channel = start_capture(conn, raw, warm=True, timeout=__HANDSHAKE_TIMEOUT__)
+            return conn, clock, channel
+        except (OSError, ValueError, struct.error):
+            conn.close()
+            open_ports.pop(name, None)
+
+
 def log_timing_info(conn: serial.Serial, writer: csv.DictWriter) -> None:
     name = threading.current_thread().name
     start_time = 0  # Timestamp when the timing started. (Received starting message, adjusted with device time.)
@@ -108,24 +551,11 @@ def log_timing_info(conn: serial.Serial, writer: csv.DictWriter) -> None:
 
 def log_advertising_info(conn: serial.Serial, writer: csv.DictWriter) -> None:
     name = threading.current_thread().name
-    channel = 0
-    start_time = 0  # Timestamp when the timing started. (Received starting message, adjusted with device time.)
 
     with start_cond:
         start_cond.wait()
-    
-    esp_init(conn)
 
-    # Initialisation phase
-    while True:
-        message_raw = conn.readline()
-        timestamp = time.time_ns() // 1000  # Nanoseconds precision to microseconds
-        if message_raw.startswith(b'Capture started at:'):
-            device_start_time = int(message_raw[20:])
-            start_time = timestamp - device_start_time
-        elif message_raw.startswith(b'Locked to channel:'):
-            channel = int(message_raw[19:])
-            break
+    clock, channel = start_capture(conn)
 
     with write_lock:
         if channel == 0:
@@ -133,24 +563,73 @@ def log_advertising_info(conn: serial.Serial, writer: csv.DictWriter) -> None:
         else:
             print(f'- {name}: Capture of channel {channel} started', flush=True)
 
-    # Capture phase
+    # Supervise the capture, a lost probe is reopened and the outage is marked in the capture
+    while True:
+        capture_advertising_info(name, conn, writer, clock)
+        lost = time.time_ns() // 1000   # Nanoseconds precision to microseconds
+        conn.close()
+        open_ports.pop(name, None)
+        conn, clock, channel = recover_probe(name)
+        resumed = time.time_ns() // 1000    # Nanoseconds precision to microseconds
+        if get_probe_metrics(name) is not None:
+            get_probe_metrics(name).recoveries.value += 1
+        with write_lock:
+            writer.writerow(gapRow(channel, lost, resumed))
+            print(f'- {name}: Capture resumed after {(resumed - lost) / 1000000:.2f} s', flush=True)
+
+
+def capture_advertising_info(name: str, conn: serial.Serial, writer: csv.DictWriter, clock: ClockSync) -> None:
+    """
+    Capture phase, returns once the probe is lost
+    """
+    stats = None
+    if isinstance(conn, RawSerial):
+        stats = conn.stats = serial_stats.setdefault(name, SerialStats())
+    instruments = get_probe_metrics(name)
     try:
         while True:
             try:
                 msg_start = conn.read(4)
                 if msg_start == b'Adv:':
                     advertising_info = get_advertising_info_from_serial(conn)
-                    advertising_info['Timestamp'] = datetime.fromtimestamp(
-                        (start_time + advertising_info['Timestamp'])
+                    if stats is not None:
+                        stats.latency.add(conn.arrivalTime() - clock.start_time - advertising_info['Timestamp'])
+                    if instruments is not None:
+                        instruments.frame_received(
+                            conn, clock, advertising_info['Timestamp'],
+                            23 + len(advertising_info['DeviceName'].encode('utf8'))     # Header and fixed fields
+                        )
+                    write_advertising_info(name, clock.start_time, advertising_info, writer, instruments)
+                elif msg_start == b'Syn:':  # Periodic clock synchronisation
+                    received = received_time(conn)
+                    clock.update(received, get_sync_from_serial(conn)['Timestamp'])
+                elif msg_start == b'Lat:':  # Transmission delays on the probe
+                    delays = get_delays_from_serial(conn)
+                    if instruments is not None:
+                        instruments.delays_received(delays)
+                elif msg_start == b'Dia:':  # Run time statistics of the probe
+                    log_diagnostics(name, get_diagnostics_from_serial(conn))
+                elif msg_start == b'Ide:':  # Answer to a late identification request
+                    get_identity_from_serial(conn)
+                elif msg_start == b'Con:':  # Connection detected by the probe itself
+                    connection_info = get_connection_info_from_serial(conn)
+                    connection_time = datetime.fromtimestamp(
+                        (clock.start_time + connection_info['Timestamp'])
                         / 1000000  # Timestamp shall be in seconds
                     ).isoformat()
                     with write_lock:
-                        writer.writerow(advertising_info)
+                        print(
+                            f'{name}: Connection of {connection_info["Address"]} for {connection_info["Duration"]} ms'
+                            f' detected at {connection_time}',
+                            flush=True
+                        )
                 else:   # Transmission error, no start sequence present
                     raise ValueError(f"Message starts with 0x{msg_start.hex()}")
             except ValueError as e:
                 with write_lock:
                     print(f'{name}: Error ({e})', flush=True, file=sys.stderr)
+                if instruments is not None:
+                    instruments.errors.value += 1
                 
                 # Find the start sequence
                 while True:
@@ -161,17 +640,35 @@ def log_advertising_info(conn: serial.Serial, writer: csv.DictWriter) -> None:
                                     break
                 # Process the packet
                 advertising_info = get_advertising_info_from_serial(conn)
-                advertising_info['Timestamp'] = datetime.fromtimestamp(
-                    (start_time + advertising_info['Timestamp'])
-                    / 1000000  # Timestamp shall be in seconds
-                )
-                with write_lock:
-                    writer.writerow(advertising_info)
+                write_advertising_info(name, clock.start_time, advertising_info, writer, instruments)
     except OSError as e:
         with write_lock:
             print(f'{name}: Error ({e})', flush=True, file=sys.stderr)
 
 
+def write_advertising_info(name: str, start_time: int, advertising_info: dict, writer: csv.DictWriter,
+                           instruments: typing.Optional[ProbeMetrics] = None) -> None:
+    """
+    Pass the decoded report to the record publishers and write it to the capture
+    """
+    timestamp = start_time + advertising_info['Timestamp']  # Microseconds since the epoch
+    row = dict(advertising_info, Timestamp=datetime.fromtimestamp(
+        timestamp / 1000000  # Timestamp shall be in seconds
+    ).isoformat())
+
+    record_report(name, timestamp, advertising_info)
+
+    # Publishers see the records in the same order as the capture
+    waiting = time.monotonic_ns() if instruments is not None else 0
+    with write_lock:
+        locked = time.monotonic_ns() if instruments is not None else 0
+        writer.writerow(row)
+        for publisher in publishers:
+            publisher.publish(name, timestamp, advertising_info)
+    if instruments is not None:
+        instruments.record_written(timestamp, waiting, locked, time.monotonic_ns())
+
+
 def get_advertising_info_from_serial(conn: serial.Serial):
     timestamp_raw = conn.read(8)
     timestamp = struct.unpack('<q', timestamp_raw)[0]
@@ -208,36 +705,30 @@ def get_advertising_info_from_serial(conn: serial.Serial):
     }
 
 
+def get_connection_info_from_serial(conn: serial.Serial):
+    timestamp_raw = conn.read(8)
+    timestamp = struct.unpack('<q', timestamp_raw)[0]
+
+    bdaddr_raw = conn.read(6)  # BDADDR size is 6 bytes
+    bdaddr = bdaddr_raw[::-1].hex(':')
+
+    duration_raw = conn.read(4)
+    duration = struct.unpack('<I', duration_raw)[0]
+
+    return {
+        'Timestamp': timestamp,
+        'Address': bdaddr,
+        'Duration': duration
+    }
+
+
 def log_raw_packets(conn: serial.Serial, out: typing.BinaryIO) -> None:
     name = threading.current_thread().name
-    channel = 0
-    start_time = 0  # Timestamp when the timing started. (Received starting message, adjusted with device time.)
 
     with start_cond:
         start_cond.wait()
 
-    esp_init(conn)
-
-    # Initialisation phase
-    while True:
-        message_raw = conn.readline()
-        timestamp = time.time_ns() // 1000  # Nanoseconds precision to microseconds
-        if message_raw.startswith(b'Capture started at:'):
-            device_start_time = int(message_raw[20:])
-            start_time = timestamp - device_start_time
-        elif message_raw.startswith(b'Locked to channel:'):
-            channel = int(message_raw[19:])
-            break
-    # Wait for the Scan Start message
-    while True:
-        msg_start = conn.read(4)
-        if msg_start == b'BLE:':
-            conn.read(8)  # Timestamp, not needed yet
-            length_raw = conn.read(2)
-            length = struct.unpack('<H', length_raw)[0]
-            data = conn.read(length)
-            if data == b'\x04\x0e\x04\x05\x0c\x20\x00':  # LE Set Scan Enable Complete
-                break
+    clock, channel = start_capture(conn, raw=True)
 
     with write_lock:
         if channel == 0:
@@ -245,46 +736,133 @@ def log_raw_packets(conn: serial.Serial, out: typing.BinaryIO) -> None:
         else:
             print(f'- {name}: Capture of channel {channel} started', flush=True)
 
-    # Capture phase
+    # Supervise the capture, a lost probe is reopened
     while True:
-        msg_start = conn.read(4)
-        if msg_start == b'BLE:':
-            packet = get_packet_from_serial(conn)
-            packet.time = (start_time + packet.time) / 1000000  # Timestamp shall be in seconds
-            try:
-                for report in packet.reports:
-                    report.rssi = channel  # FIXME: Ugly hack, but found no other way to keep the channel info
-            except AttributeError:
-                # Channel info is lost
-                pass
-            out.write(packet)
-        else:   # Transmission error, no start sequence present
-            with write_lock:
-                print(
-                    f'{name}: Error in transmission, message starts with 0x{msg_start.hex()}',
-                    flush=True,
-                    file=sys.stderr
-                )
-            # Find the start sequence
-            while True:
-                if conn.read(1) == b'B':
-                    if conn.read(1) == b'L':
-                        if conn.read(1) == b'E':
-                            if conn.read(1) == b':':
-                                break
-            # Process the packet
-            packet = get_packet_from_serial(conn)
-            packet.time = (start_time + packet.time) / 1000000  # Timestamp shall be in seconds
-            try:
-                for report in packet.reports:
-                    report.rssi = channel  # FIXME: Ugly hack, but found no other way to keep the channel info
-            except AttributeError:
-                # The Channel info is lost
-                pass
+        capture_raw_packets(name, conn, out, clock, channel)
+        lost = time.monotonic()
+        conn.close()
+        open_ports.pop(name, None)
+        conn, clock, channel = recover_probe(name, raw=True)
+        if get_probe_metrics(name) is not None:
+            get_probe_metrics(name).recoveries.value += 1
+        with write_lock:
+            print(f'- {name}: Capture resumed after {time.monotonic() - lost:.2f} s', flush=True)
+
+
+def capture_raw_packets(name: str, conn: serial.Serial, out: typing.BinaryIO, clock: ClockSync, channel: int) -> None:
+    """
+    Capture phase, returns once the probe is lost
+    """
+    stats = None
+    if isinstance(conn, RawSerial):
+        stats = conn.stats = serial_stats.setdefault(name, SerialStats())
+    instruments = get_probe_metrics(name)
+    # A compressed stream can be decoded from the next plain frame on (the probe was possibly attached warm)
+    decoder = HciStreamDecoder()
+
+    def process(packet: HCI_PHDR_Hdr) -> None:
+        record_packet(name, clock.start_time + packet.time, packet)
+        packet.time = (clock.start_time + packet.time) / 1000000  # Timestamp shall be in seconds
+        try:
+            for report in packet.reports:
+                report.rssi = channel  # FIXME: Ugly hack, but found no other way to keep the channel info
+        except AttributeError:
+            # Channel info is lost
+            pass
+        if out is not None:
             out.write(packet)
 
+    try:
+        while True:
+            msg_start = conn.read(4)
+            if msg_start in (b'BLE:', b'BLZ:'):
+                wire_bytes = decoder.wireBytes
+                if msg_start == b'BLE:':
+                    packet = get_packet_from_serial(conn, decoder)
+                else:   # Compressed
+                    packet = get_compressed_packet_from_serial(conn, decoder)
+                    if packet is None:
+                        continue
+                if stats is not None:
+                    stats.latency.add(conn.arrivalTime() - clock.start_time - packet.time)
+                if instruments is not None:
+                    instruments.frame_received(conn, clock, packet.time, decoder.wireBytes - wire_bytes)
+                process(packet)
+            elif msg_start == b'Syn:':  # Periodic clock synchronisation
+                received = received_time(conn)
+                clock.update(received, get_sync_from_serial(conn)['Timestamp'])
+            elif msg_start == b'Lat:':  # Transmission delays on the probe
+                delays = get_delays_from_serial(conn)
+                if instruments is not None:
+                    instruments.delays_received(delays)
+            elif msg_start == b'Dia:':  # Run time statistics of the probe
+                log_diagnostics(name, get_diagnostics_from_serial(conn))
+            elif msg_start == b'Ide:':  # Answer to a late identification request
+                get_identity_from_serial(conn)
+            else:   # Transmission error, no start sequence present
+                with write_lock:
+                    print(
+                        f'{name}: Error in transmission, message starts with 0x{msg_start.hex()}',
+                        flush=True,
+                        file=sys.stderr
+                    )
+                if instruments is not None:
+                    instruments.errors.value += 1
+                decoder.lost()
+                # Find the start sequence, the compressed frames only decode again from a plain frame
+                while True:
+                    if conn.read(1) == b'B':
+                        if conn.read(1) == b'L':
+                            if conn.read(1) == b'E':
+                                if conn.read(1) == b':':
+                                    break
+                # Process the packet
+                process(get_packet_from_serial(conn, decoder))
+    except (OSError, EOFError) as e:
+        with write_lock:
+            print(f'{name}: Error ({e})', flush=True, file=sys.stderr)
+    if decoder.frames:
+        with write_lock:
+            print(f'- {name}: Compression ratio {decoder.ratio():.2f}, {decoder.skipped} frames skipped,'
+                  f' {decoder.corrupted} corrupted', flush=True)
+
+
+def record_packet(name: str, timestamp: int, packet: HCI_PHDR_Hdr) -> None:
+    """
+    Keep the raw packet in the flight recorder of the probe (if enabled)
+    """
+    recorder = flight_recorders.get(name)
+    if recorder is not None:
+        recorder.append(timestamp, bytes(packet.payload))   # Raw HCI packet without the pseudo-header
+
+
+def record_report(name: str, timestamp: int, advertising_info: dict) -> None:
+    """
+    Keep the decoded report in the flight recorder of the probe (if enabled) as an HCI advertising report
+    """
+    recorder = flight_recorders.get(name)
+    if recorder is not None:
+        recorder.append(timestamp, advertisingReport(
+            advertising_info['Address'], advertising_info['AddressType'], advertising_info['AdvertisingType'],
+            advertising_info['RSSI'], advertising_info['DeviceName']
+        ))
+
+
+def extract_flight_recordings(window: float) -> None:
+    """
+    Store the last `window` seconds of all flight recorders into a pcap file (operator trigger)
+    """
+    end = time.time_ns() // 1000
+    rings = [recorder.path for recorder in flight_recorders.values()]
+    if not rings:   # No probe enabled
+        return
+    out_path = rings[0].parent / (time.strftime('trigger_%Y-%m-%d_%H-%M-%S', time.localtime()) + '.pcap')
+    count = extract(rings, out_path, end - int(window * 1000000), end)
+    with write_lock:
+        print(f'- Flight recorder: {count} packets stored into {out_path}', flush=True)
+
 
-def get_packet_from_serial(conn: serial.Serial) -> HCI_Hdr:
+def get_packet_from_serial(conn: serial.Serial, decoder: typing.Optional[HciStreamDecoder] = None) -> HCI_Hdr:
     timestamp_raw = conn.read(8)
     timestamp = struct.unpack('<q', timestamp_raw)[0]
 
@@ -292,7 +870,23 @@ def get_packet_from_serial(conn: serial.Serial) -> HCI_Hdr:
     length = struct.unpack('<H', length_raw)[0]
 
     data = conn.read(length)
+    if decoder is not None:
+        decoder.plain(timestamp, data)
 
+    return make_packet(timestamp, data)
+
+
+def get_compressed_packet_from_serial(conn: serial.Serial, decoder: HciStreamDecoder) -> typing.Optional[HCI_Hdr]:
+    """
+    :return: Packet of a BLZ: frame, None if the decoder has not seen a plain frame since it lost track of the stream
+    """
+    decoded = decoder.compressed(conn)
+    if decoded is None:
+        return None
+    return make_packet(*decoded)
+
+
+def make_packet(timestamp: int, data: bytes) -> HCI_Hdr:
     packet = HCI_PHDR_Hdr(direction=0)
     packet /= HCI_Hdr(data)
     packet.time = timestamp
@@ -321,14 +915,141 @@ if __name__ == "__main__":
                          action='store_true',
                          help='Captures raw packets into a pcap file. (ESP modules have to be preloaded with the collector-raw code.)'
                          )
+    _parser.add_argument('-f', '--flight-recorder', metavar='DIR',
+                         help='Keep the recent packets in per-probe circular buffers in DIR. With --raw, the raw packets'
+                              ' are kept only there instead of the pcap file; otherwise every report is kept as an HCI'
+                              ' advertising report (the advertising data only holds the device name) next to the CSV'
+                              ' capture. SIGUSR1 stores the recent packets of all probes into a pcap file.'
+                         )
+    _parser.add_argument('--flight-recorder-size', type=int, metavar='MIB',
+                         help='Size of the circular buffer of every probe'
+                              ' [Default: ' + str(__DEFAULT_RECORDER_SIZE__) + ' MiB]',
+                         default=__DEFAULT_RECORDER_SIZE__
+                         )
+    _parser.add_argument('--flight-recorder-window', type=float, metavar='SEC',
+                         help='Time window stored on SIGUSR1'
+                              ' [Default: ' + str(__DEFAULT_RECORDER_WINDOW__) + ' s]',
+                         default=__DEFAULT_RECORDER_WINDOW__
+                         )
+    _parser.add_argument('-s', '--shm', metavar='NAME',
+                         help='Publish the decoded records into a shared memory ring /dev/shm/NAME for local consumers.'
+                         )
+    _parser.add_argument('-u', '--subscriptions', metavar='SOCKET',
+                         help='Serve filtered subscriptions to the decoded records on the Unix socket SOCKET.'
+                         )
+    _parser.add_argument('-n', '--forward', metavar='HOST:PORT',
+                         help='Also forward the decoded records to an aggregator (see aggregator.py).'
+                         )
+    _parser.add_argument('--forward-name', metavar='NAME',
+                         help='Name of this collector at the aggregator [Default: host name]'
+                         )
+    _parser.add_argument('--scan', metavar='GLOB', action='append',
+                         help='Serial devices searched for the probes configured by identity (id = chip MAC), repeatable'
+                              ' [Default: ' + ', '.join(__DEFAULT_SCAN__) + ']'
+                         )
+    _parser.add_argument('-i', '--identify',
+                         action='store_true',
+                         help='Only list the identities of the probes found on the scanned serial devices.'
+                         )
+    _parser.add_argument('-w', '--warm',
+                         action='store_true',
+                         help='Attach to already capturing probes without resetting them.'
+                              ' Probes which are not capturing are reset as usual.'
+                         )
+    _parser.add_argument('--native-serial',
+                         action='store_true',
+                         help='Read the probes through raw termios (low latency mode, chunked reads, arrival stamps)'
+                              ' instead of pyserial. Read and latency statistics are printed when stopped.'
+                         )
+    _parser.add_argument('--read-coalesce', type=int, metavar='DS', default=0,
+                         help='Let the driver gather data for up to DS tenths of a second before a read returns,'
+                              ' fewer system calls for more latency. (Requires --native-serial.) [Default: 0]'
+                         )
+    _parser.add_argument('--metrics', metavar='FILE',
+                         help='Periodically write the stage latencies and throughputs of every probe into FILE'
+                              ' (Prometheus text format).'
+                         )
+    _parser.add_argument('--metrics-port', type=int, metavar='PORT',
+                         help='Serve the stage latencies and throughputs at http://127.0.0.1:PORT/metrics.'
+                         )
+    _parser.add_argument('--metrics-interval', type=float, metavar='SEC', default=__METRICS_INTERVAL__,
+                         help='Seconds between two writes of the metrics file'
+                              ' [Default: ' + str(__METRICS_INTERVAL__) + ' s]'
+                         )
+    _parser.add_argument('--diagnostics', metavar='FILE',
+                         help='Log the periodic diagnostics of the probes (CPU load per task, stack high-water marks,'
+                              ' heap, callback and parser times) into FILE as JSON lines.'
+                         )
+    _parser.add_argument('--distinct',
+                         action='store_true',
+                         help='Count the distinct devices of every probe per window into HyperLogLog sketches stored'
+                              ' alongside the capture (OUT.hll, see sketches.py).'
+                         )
+    _parser.add_argument('--distinct-window', type=int, metavar='SEC', default=__DISTINCT_WINDOW__,
+                         help='Window of the distinct device counts'
+                              ' [Default: ' + str(__DISTINCT_WINDOW__) + ' s]'
+                         )
+    _parser.add_argument('--heavy-hitters', type=int, metavar='K',
+                         help='Export the K advertisers of every probe with the most reports per window as metrics,'
+                              ' candidates for filtering. (Requires --metrics or --metrics-port.)'
+                         )
+    _parser.add_argument('--heavy-window', type=int, metavar='SEC', default=__HEAVY_WINDOW__,
+                         help='Window of the heavy hitters'
+                              ' [Default: ' + str(__HEAVY_WINDOW__) + ' s]'
+                         )
+    _parser.add_argument('--appearances',
+                         action='store_true',
+                         help='Write an event for every device not heard within the appearance horizon'
+                              ' (OUT.appearances.csv), with rotating Bloom filters instead of a set of all addresses.'
+                         )
+    _parser.add_argument('--appearance-horizon', type=float, metavar='SEC', default=__APPEARANCE_HORIZON__,
+                         help='Time a device is remembered at least (at most twice as long)'
+                              ' [Default: ' + str(__APPEARANCE_HORIZON__) + ' s]'
+                         )
+    _parser.add_argument('--appearance-capacity', type=int, metavar='N', default=__APPEARANCE_CAPACITY__,
+                         help='Devices heard within the horizon the filters are sized for'
+                              ' [Default: ' + str(__APPEARANCE_CAPACITY__) + ']'
+                         )
+    _parser.add_argument('--appearance-error', type=float, metavar='P', default=__APPEARANCE_ERROR__,
+                         help='Probability that a new device is taken for a known one at the capacity'
+                              ' [Default: ' + str(__APPEARANCE_ERROR__) + ']'
+                         )
     _parser.add_argument('-t', '--timing',
                          action='store_true',
                          help='Perform only timing testing. (ESP modules have to be preloaded with the beeper code.)'
                          )
     _args = _parser.parse_args()
+    if _args.heavy_hitters is not None:
+        if not _args.metrics and not _args.metrics_port:
+            _parser.error('--heavy-hitters requires --metrics or --metrics-port')
+        if _args.heavy_hitters < 1 or _args.heavy_window < 1:
+            _parser.error('--heavy-hitters and --heavy-window shall be at least 1')
 
     _config = configparser.ConfigParser()
     _config.read(_args.config)
+    warm_attach = _args.warm
+    native_serial = _args.native_serial
+    read_coalesce = _args.read_coalesce
+    if _args.diagnostics:
+        pathlib.Path(_args.diagnostics).parent.mkdir(parents=True, exist_ok=True)
+        diagnostics_log = open(_args.diagnostics, 'a')
+    _exporter = None
+    if _args.metrics or _args.metrics_port:
+        metrics = MetricsRegistry('blecollector')
+        _exporter = MetricsExporter(metrics, _args.metrics, _args.metrics_port, _args.metrics_interval)
+
+    # Probes configured by identity are found among the serial devices, their paths change between reboots
+    _discovered = {}
+    if _args.identify or any(_config.has_option(section, "id") for section in _config.sections()):
+        _scan_start = time.monotonic()
+        _discovered = discover_probes(_args.scan or __DEFAULT_SCAN__, __DEFAULT_BAUD__)
+        print(f'- Identified {len(_discovered)} probes in {time.monotonic() - _scan_start:.2f} s', flush=True)
+    if _args.identify:
+        for _chip, (_conn, _identity) in sorted(_discovered.items()):
+            print(f'{_chip}: {_identity["Path"]}, {_identity["Mode"]} capture on channel {_identity["Channel"]},'
+                  f' build {_identity["Build"]}')
+            _conn.close()
+        raise SystemExit(0)
 
     threads = []
 
@@ -357,7 +1078,8 @@ if __name__ == "__main__":
     elif _args.raw:
         print("Raw BLE Advertising Collection")
         _target_fn = log_raw_packets
-        _writer = PcapWriter(_out_file, sync=True)
+        if not _args.flight_recorder:
+            _writer = PcapWriter(_out_file, sync=True)
     else:
         print("BLE Advertising Collection")
         _target_fn = log_advertising_info
@@ -365,16 +1087,68 @@ if __name__ == "__main__":
             'Timestamp', 'Address', 'AddressType', 'AdvertisingType', 'RSSI', 'Channel', 'DeviceName'
         ])
         _writer.writeheader()
+        if _args.shm:
+            publishers.append(ShmRingPublisher(_args.shm))
+        if _args.subscriptions:
+            publishers.append(SubscriptionServer(_args.subscriptions))
+        if _args.forward:
+            _host, _, _port = _args.forward.rpartition(':')
+            publishers.append(EdgeForwarder(_host, int(_port), _args.forward_name))
+        if _args.distinct:
+            publishers.append(DistinctDeviceCounter(_out_path.with_suffix('.hll'), _args.distinct_window))
+        if _args.heavy_hitters is not None:
+            publishers.append(HeavyHitterTracker(metrics, _args.heavy_hitters, _args.heavy_window))
+        if _args.appearances:
+            publishers.append(AppearanceTracker(
+                _out_path.with_suffix('.appearances.csv'), _args.appearance_horizon, _args.appearance_capacity,
+                _args.appearance_error, registry=metrics
+            ))
+
+    if _args.flight_recorder and not _args.timing:
+        _recorder_path = pathlib.Path(_args.flight_recorder)
+        _recorder_path.mkdir(parents=True, exist_ok=True)
+        for section in _config.sections():
+            if _config.getboolean(section, "enabled", fallback=True):
+                flight_recorders[section] = FlightRecorder(
+                    _recorder_path / f'{section}.ring',
+                    _args.flight_recorder_size * 1024 * 1024
+                )
+        # Extract in a separate thread, so the capture is never paused
+        signal.signal(signal.SIGUSR1, lambda signum, frame: threading.Thread(
+            target=extract_flight_recordings,
+            args=(_args.flight_recorder_window,),
+            daemon=True
+        ).start())
 
     for section in _config.sections():
         enabled = _config.getboolean(section, "enabled", fallback=True)
         if not enabled:
             continue
 
-        _conn = serial.Serial(
-            _config.get(section, "path"),
-            _config.getint(section, "baud", fallback=__DEFAULT_BAUD__)
-        )
+        if _config.has_option(section, "id"):
+            _chip = _config.get(section, "id").lower()
+            if _chip not in _discovered:
+                print(f'{section}: Probe {_chip} not found', file=sys.stderr)
+                continue
+            _conn, _identity = _discovered.pop(_chip)
+            _conn.baudrate = _config.getint(section, "baud", fallback=__DEFAULT_BAUD__)
+            if _identity['Channel'] != _config.getint(section, "channel", fallback=_identity['Channel']):
+                print(f'{section}: Probe {_chip} captures channel {_identity["Channel"]}'
+                      f' instead of the configured {_config.get(section, "channel")}', file=sys.stderr)
+            print(f'- {section}: Probe {_chip} on {_identity["Path"]}', flush=True)
+            open_ports[section] = _identity["Path"]
+            port_openers[section] = functools.partial(
+                find_probe, _chip, _args.scan or __DEFAULT_SCAN__,
+                _config.getint(section, "baud", fallback=__DEFAULT_BAUD__)
+            )
+        else:
+            port_openers[section] = functools.partial(
+                open_serial,
+                _config.get(section, "path"),
+                _config.getint(section, "baud", fallback=__DEFAULT_BAUD__)
+            )
+            _conn = port_openers[section]()
+            open_ports[section] = _config.get(section, "path")
 
         thread = threading.Thread(
             name=section,
@@ -387,6 +1161,9 @@ if __name__ == "__main__":
         thread.daemon = True
         threads.append(thread)
 
+    for _conn, _identity in _discovered.values():   # Probes not bound to any section
+        _conn.close()
+
     # Start the threads
     for thread in threads:
         thread.start()
@@ -410,3 +1187,12 @@ if __name__ == "__main__":
             print("Stopped the ESP Timing Testing")
         else:
             print("Stopped the BLE AD Collection")
+    finally:
+        with write_lock:
+            for publisher in publishers:
+                publisher.close()
+            if _exporter is not None:
+                _exporter.close()
+            for _name, _stats in sorted(serial_stats.items()):
+                print(f'{_name}: Read sizes: {_stats.readSizes}')
+                print(f'{_name}: Frame latency: {_stats.latency}')
@@ -2,75 +2,212 @@
 
 import argparse
 import csv
+import io
 import pathlib
 import sys
 
-from models import SimpleStatisticsModel, SlidingWindowModel
+from advertising_events import ADVERTISING_EVENT_WINDOW, readEvents
+from models import MODELS, modelFactory
 from models import ModelInitialised, ConnectionAlert
+from models import parseTimestamp
+from records import isGap
+from rotation_linker import RotationLinker
+from rpa_resolver import loadResolver
+from vectorised_models import CaptureArrays, VectorDetector
+
+
+class Detector:
+    """
+    One detector configuration with its per-address models and output logs
+    """
+
+    def __init__(self, spec, modelLogFile, alertLogFile):
+        self.spec = spec
+        self.modelFactory = modelFactory(spec)
+        self.models = {}
+        self.modelLogFile = modelLogFile
+        self.alertLog = csv.DictWriter(alertLogFile, fieldnames=['Address', 'Timestamp', 'Duration'])
+        self.alertLog.writeheader()
+        self.modelLogFile.write('bdaddr,' + self.modelFactory().headerStr() + '\n')
+
+    def processAdv(self, address, timestamp):
+        try:
+            model = self.models[address]
+        except KeyError:
+            model = self.modelFactory()
+            self.models[address] = model
+
+        try:
+            model.processAdv(timestamp)
+        except ModelInitialised:
+            pass
+#            print(f"Model for {address} was initialised as: {model.initState()}")
+        except ConnectionAlert as alert:
+            self.alertLog.writerow({
+                'Address': address,
+                'Timestamp': alert.timestamp,
+                'Duration': alert.duration
+            })
+        except (RuntimeWarning, RuntimeError):
+            print(f"Error occurred while processing {address} at {timestamp} by {self.spec}.")
+        finally:
+            self.modelLogFile.write(f"{address},{str(model)}\n")
+
+    def processRotation(self, address):
+        """
+        Ignore the silence before the next advertisement, the device paused to change its address
+        """
+        model = self.models.get(address)
+        if model is not None:
+            model.skipSilence()
+
+    def processGap(self, end):
+        """
+        Ignore the silences across a capture outage which ended at `end`
+        """
+        for model in self.models.values():
+            if model.lastSeen < end:
+                model.skipSilence()
+
+
+def specLabel(spec):
+    """
+    File name friendly label of a detector specification
+    """
+    return spec.replace(':', '-').replace(',', '-')
+
 
 if __name__ == "__main__":
     _parser = argparse.ArgumentParser(
-        description='Run selected detector on given capture',
+        description='Run selected detectors on given capture',
     )
     _parser.add_argument("capture")
     _parser.add_argument('-d', '--detector',
-                         dest='detectorID',
-                         help="Set the detector to be used [simple_statistics, sliding_window].",
-                         default='simple_statistics')
+                         dest='detectorSpecs', action='append',
+                         help="Set the detector to be used [" + ", ".join(MODELS) + "]."
+                              " Parameters may be given as name:parameter=value,... (e.g. sliding_window:windowSize=21)."
+                              " Repeat to run several detectors in a single pass over the capture"
+                              " (a repeated detector runs once).")
+    _parser.add_argument('-e', '--events',
+                         action='store_true',
+                         help="Group reports from different channels into Advertising Events before detection.")
+    _parser.add_argument('-w', '--event-window',
+                         dest='eventWindow', type=int,
+                         help="Maximal duration of an Advertising Event in ms"
+                              " [Default: " + str(ADVERTISING_EVENT_WINDOW) + "].",
+                         default=ADVERTISING_EVENT_WINDOW)
     _parser.add_argument('-o', '--output',
                          dest='outputFolder',
                          help="Set the output folder for analysis result files")
+    _parser.add_argument('-k', '--irks',
+                         help="CSV file of known IRKs (columns Identity, IRK). The resolvable private addresses"
+                              " of these devices are detected as their identity, across the address rotations.")
+    _parser.add_argument('-l', '--link',
+                         action='store_true',
+                         help="Link the rotating random addresses of the devices without known IRK heuristically"
+                              " (interval, phase, RSSI, payload), so their models continue across the rotations.")
+    _parser.add_argument('-b', '--backend',
+                         choices=['python', 'numpy'],
+                         help="Evaluate the models per advertisement (python) or on the whole capture at once with"
+                              " array operations (numpy, simple_statistics and sliding_window only, same alerts,"
+                              " the model log holds the last states) [Default: python].",
+                         default='python')
     _args = _parser.parse_args()
 
     capturePath = pathlib.Path(_args.capture)
     outputPath = pathlib.Path(_args.outputFolder) if _args.outputFolder else pathlib.Path()
-    if _args.detectorID == 'simple_statistics':
-        modelFactory = SimpleStatisticsModel
-    elif _args.detectorID == 'sliding_window':
-        modelFactory = SlidingWindowModel
-    else:
-        print(f"Unknown detector {_args.detectorID}.", file=sys.stderr)
-        raise SystemExit(1)
+    detectorSpecs = _args.detectorSpecs or ['simple_statistics']
+    # A repeated detector would overwrite the logs of the first one, it runs once
+    labels = {}
+    for spec in detectorSpecs:
+        labels.setdefault(specLabel(spec), spec)
+    if len(labels) < len(detectorSpecs):
+        print(f"Ignoring {len(detectorSpecs) - len(labels)} repeated detector(s).", file=sys.stderr)
+        detectorSpecs = list(labels.values())
 
-    measurementName = capturePath.stem
-    modelLogPath = outputPath / f"{measurementName}.model.csv"
-    alertLogPath = outputPath / f"{measurementName}.alerts.csv"
+    detectorClass = VectorDetector if _args.backend == 'numpy' else Detector
+    for spec in detectorSpecs:
+        try:
+            modelFactory(spec)
+            if detectorClass is VectorDetector:
+                VectorDetector(spec, io.StringIO(), io.StringIO())
+        except (ValueError, TypeError) as e:
+            print(f"Invalid detector {spec}: {e}", file=sys.stderr)
+            raise SystemExit(1)
+
+    resolver = loadResolver(_args.irks)
 
+    measurementName = capturePath.stem
     outputPath.mkdir(parents=True, exist_ok=True)
 
-    with (capturePath.open('r') as captureFile,
-          modelLogPath.open('w') as modelLogFile,
-          alertLogPath.open('w') as alertLogFile):
-
-        capture = csv.DictReader(captureFile)
-        alertLog = csv.DictWriter(alertLogFile, fieldnames=['Address', 'Timestamp', 'Duration'])
-        alertLog.writeheader()
-        modelLogFile.write('bdaddr,' + modelFactory().headerStr() + '\n')
-
-        models = {}
-
-        for advertisement in capture:
-            address = advertisement['Address']
-            timestamp = advertisement['Timestamp']
-
-            try:
-                model = models[address]
-            except KeyError:
-                model = modelFactory()
-                models[address] = model
-
-            try:
-                model.processAdv(timestamp)
-            except ModelInitialised:
-                pass
-#                print(f"Model for {address} was initialised as: {model.initState()}")
-            except ConnectionAlert as alert:
-                alertLog.writerow({
-                    'Address': address,
-                    'Timestamp': alert.timestamp,
-                    'Duration': alert.duration
-                })
-            except (RuntimeWarning, RuntimeError):
-                print(f"Error occurred while processing {address} at {timestamp}.")
-            finally:
-                modelLogFile.write(f"{address},{str(model)}\n")
+    logFiles = []
+    detectors = []
+    for spec in detectorSpecs:
+        # A single detector keeps the original log names
+        logName = measurementName if len(detectorSpecs) == 1 else f"{measurementName}.{specLabel(spec)}"
+        modelLogFile = (outputPath / f"{logName}.model.csv").open('w')
+        alertLogFile = (outputPath / f"{logName}.alerts.csv").open('w')
+        logFiles += [modelLogFile, alertLogFile]
+        detectors.append(detectorClass(spec, modelLogFile, alertLogFile))
+
+    # The vectorised detectors take the whole capture once it is read
+    sinks = [CaptureArrays()] if detectorClass is VectorDetector else detectors
+
+    linker = None
+    try:
+        with capturePath.open('r') as captureFile:
+
+            if _args.events:
+                capture = (
+                    event if isinstance(event, dict) else {
+                        'Address': event.address,
+                        'Timestamp': event.timestamp,
+                        'RSSI': sum(event.rssi.values()) / len(event.rssi)
+                    }
+                    for event in readEvents(captureFile, _args.eventWindow, keepGaps=True)
+                )
+            else:
+                capture = csv.DictReader(captureFile)
+
+            if _args.link:
+                # The known IRKs are resolved first, so the heuristic never relabels the addresses of these devices
+                linker = RotationLinker(resolver=resolver)
+                capture = linker.link(capture)
+
+            for advertisement in capture:
+                if isGap(advertisement):    # A probe was lost, silences across the outage are not real
+                    print(f"Capture outage from {advertisement['Timestamp']} to {advertisement['DeviceName']}"
+                          f" on channel {advertisement['Channel']}.")
+                    for sink in sinks:
+                        sink.processGap(parseTimestamp(advertisement['DeviceName']))
+                    continue
+
+                address = advertisement['Address']
+                if resolver is not None and linker is None:     # Otherwise resolved by the linker
+                    address = resolver.identity(address, advertisement.get('AddressType', '1'))
+
+                # Decode the timestamp once for all the detectors
+                try:
+                    timestamp = parseTimestamp(advertisement['Timestamp'])
+                except (ValueError, IndexError):
+                    print(f"Invalid timestamp {advertisement['Timestamp']} of {address}.")
+                    continue
+
+                for sink in sinks:
+                    if advertisement.get('Rotation') == 'pause':
+                        sink.processRotation(address)
+                    sink.processAdv(address, timestamp)
+
+        if detectorClass is VectorDetector:
+            rejected = sinks[0].group()
+            for detector in detectors:
+                detector.run(sinks[0], rejected)
+    finally:
+        for logFile in logFiles:
+            logFile.close()
+
+    if resolver is not None:
+        print(f"{resolver.resolved} of {resolver.resolutions} private addresses resolved"
+              f" against {len(resolver.store)} IRKs.")
+    if linker is not None:
+        print(f"{len(linker.links)} address rotations linked.")
@@ -0,0 +1,271 @@
+#!/usr/bin/env python
+
+import argparse
+import os
+import pathlib
+import pty
+import random
+import select
+import struct
+import threading
+import time
+import tty
+
+__BOOT_DELAY__ = 0.5    # Seconds from a reset to the start of the application
+__INIT_DELAY__ = 4      # Seconds from the start of the application to the capture (Bluetooth bring-up)
+__RATE__ = 50           # Advertising reports per second of every probe
+__SYNC_INTERVAL__ = 1   # Seconds between two sync frames during the capture
+__FAULT_DOWNTIME__ = 1  # Seconds an unplugged probe stays away
+__QUEUE_DELAY__ = 300   # Mean microseconds from the capture callback to the UART transmission
+__DELAY_BUCKETS__ = 24  # Power of two buckets of the delay frames (PC_DELAY_BUCKETS)
+__DIAGNOSTICS_INTERVAL__ = 10  # Seconds between two diagnostics frames during the capture
+__CALLBACK_TIME__ = 12  # Simulated microseconds in controller_out_rdy() per report
+__PARSER_TIME__ = 45    # Simulated microseconds of the processing task per report
+# Simulated tasks: name, core affinity (0xFF none), priority, stack high-water mark (B)
+__TASKS__ = [
+    ('IDLE', 0, 0, 1000), ('IDLE', 1, 0, 1020), ('btController', 0, 23, 2100), ('Process HCI Event', 0, 6, 412),
+    ('Probe Control', 0xFF, 2, 1580), ('esp_timer', 0, 22, 3300), ('ipc0', 0, 24, 528), ('ipc1', 1, 24, 536),
+    ('main', 0, 1, 2200)
+]
+
+
+class FakeProbe(threading.Thread):
+    """
+    Simulated probe behind a pseudo terminal, speaking the collector-ad firmware protocol:
+    boot messages, advertising reports, periodic sync, delay and diagnostics frames and answers to the host commands
+    (ID?, SYN?, DIA?, RST).
+    """
+
+    def __init__(self, index, linkPath, bootDelay=__BOOT_DELAY__, initDelay=__INIT_DELAY__, rate=__RATE__,
+                 faultInterval=None, faultDowntime=__FAULT_DOWNTIME__, faultReset=False,
+                 diagnosticsInterval=__DIAGNOSTICS_INTERVAL__):
+        super().__init__(name=f'Fake probe {index}', daemon=True)
+        self.chip = bytes((0x24, 0x0a, 0xc4, 0x00, index >> 8, index & 0xFF))
+        self.channel = 37 + index % 3
+        self.bootDelay = bootDelay
+        self.initDelay = initDelay
+        self.rate = rate
+        self.random = random.Random(index)
+        self.addresses = [self.random.randbytes(6) for _ in range(64)]
+        self.faultInterval = faultInterval  # Mean seconds between two unplugs, None never unplugs
+        self.faultDowntime = faultDowntime
+        self.faultReset = faultReset        # Probe restarts when plugged back (powered by the USB)
+        self.faults = 0
+        self.diagnosticsInterval = diagnosticsInterval
+
+        self.path = pathlib.Path(linkPath)
+        self.plug()
+
+        self.bootTime = 0
+        self.running = False    # Application started, commands are answered
+        self.capturing = False
+        self.stopped = False
+        self.delays = [0] * __DELAY_BUCKETS__
+        self.reports = 0    # Advertising reports since the previous diagnostics frame
+        self.busy = 0       # Simulated run time of the capture tasks on core 0 (us)
+        self._command = b''
+
+    def plug(self):
+        """
+        Create the pseudo terminal of the probe, a fresh device as after plugging the USB cable
+        """
+        self.master, self._slave = pty.openpty()
+        tty.setraw(self._slave)     # No echo nor line ending translation, as a real UART
+        os.set_blocking(self.master, False)
+        self.path.unlink(missing_ok=True)
+        self.path.symlink_to(os.ttyname(self._slave))
+
+    def unplug(self):
+        """
+        Remove the device for the fault downtime, the host reads fail as on a USB disconnection
+        """
+        self.faults += 1
+        self.path.unlink(missing_ok=True)
+        os.close(self.master)
+        os.close(self._slave)
+        time.sleep(self.faultDowntime)
+        self._command = b''
+        self.plug()
+
+    def stop(self):
+        """
+        End the simulation and remove the device
+        """
+        self.stopped = True
+        self.join()
+
+    def write(self, data):
+        try:
+            os.write(self.master, data)
+        except BlockingIOError:     # Nobody reads the UART, the data is lost as on the real probe
+            pass
+
+    def deviceTime(self):
+        """
+        Microseconds since the probe boot (esp_timer_get_time)
+        """
+        return (time.monotonic_ns() - self.bootTime) // 1000
+
+    def identityFrame(self):
+        build = b'fake-probe'
+        return b'Ide:' + self.chip + bytes((self.channel, ord('A'), len(build))) + build
+
+    def syncFrame(self):
+        return b'Syn:' + struct.pack('<qBB', self.deviceTime(), self.channel, self.capturing)
+
+    def wait(self, seconds):
+        """
+        Serve the host commands for `seconds`, return True once a restart (or the end) was requested
+        """
+        deadline = time.monotonic() + seconds
+        while not self.stopped:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return False
+            if not select.select([self.master], [], [], min(remaining, 0.1))[0]:   # Notices stop() soon
+                continue
+            try:
+                self._command += os.read(self.master, 256)
+            except (BlockingIOError, OSError):
+                continue
+            while b'\n' in self._command:
+                line, self._command = self._command.split(b'\n', 1)
+                line = line.strip()
+                if line == b'RST':
+                    return True
+                if line == b'ID?' and self.running:
+                    self.write(self.identityFrame())
+                if line == b'SYN?' and self.running:
+                    self.write(self.syncFrame())
+                if line == b'DIA?' and self.running:
+                    self.write(self.diagnosticsFrame())
+        return True
+
+    def delaysFrame(self):
+        frame = b'Lat:' + struct.pack(f'<{__DELAY_BUCKETS__}H', *self.delays)
+        self.delays = [0] * __DELAY_BUCKETS__
+        return frame
+
+    def diagnosticsFrame(self):
+        now = self.deviceTime()
+        frame = b'Dia:' + struct.pack('<qIIIB', now, 151000, 148200, 110592, 2)
+        frame += struct.pack('<III', self.reports, self.reports * __CALLBACK_TIME__, 3 * __CALLBACK_TIME__)
+        frame += struct.pack('<III', self.reports, self.reports * __PARSER_TIME__, 4 * __PARSER_TIME__)
+        self.reports = 0
+        frame += struct.pack('<IB', now % (1 << 32), len(__TASKS__))
+        for name, core, priority, stack in __TASKS__:
+            if name == 'IDLE':
+                runTime = now - self.busy if core == 0 else now - now // 200
+            elif name == 'btController':
+                runTime = self.busy * __CALLBACK_TIME__ // (__CALLBACK_TIME__ + __PARSER_TIME__)
+            elif name == 'Process HCI Event':
+                runTime = self.busy * __PARSER_TIME__ // (__CALLBACK_TIME__ + __PARSER_TIME__)
+            else:
+                runTime = now // 200
+            frame += bytes((len(name),)) + name.encode() + struct.pack('<BBII', core, priority, stack, runTime % (1 << 32))
+        return frame
+
+    def advertisingFrame(self):
+        name = self.random.choice([b'', b'', b'Tile', b'JBL Flip 5'])
+        delay = int(self.random.expovariate(1 / __QUEUE_DELAY__))   # From the capture callback to the UART
+        self.reports += 1
+        self.busy += __CALLBACK_TIME__ + __PARSER_TIME__
+        self.delays[min(delay.bit_length(), __DELAY_BUCKETS__ - 1)] += 1
+        return (
+            b'Adv:' + struct.pack('<q', self.deviceTime() - delay) + self.random.choice(self.addresses)
+            + struct.pack('<BBBbB', 0, 0, self.channel, self.random.randrange(-95, -40), len(name)) + name
+        )
+
+    def run(self):
+        while not self.stopped:
+            self.running = False
+            self.capturing = False
+            self._command = b''
+            self.bootTime = time.monotonic_ns()
+            self.write(b'ets Jun  8 2016 00:22:57\r\n\r\nrst:0x1 (POWERON_RESET),boot:0x13 (SPI_FAST_FLASH_BOOT)\r\n')
+            if self.wait(self.bootDelay):
+                continue
+            self.write(b'entry 0x40080680\n')
+            self.write(f'Capture started at: {self.deviceTime() // 1000}\n'.encode())
+            self.running = True
+            if self.wait(self.initDelay):
+                continue
+            self.write(f'Locked to channel: {self.channel}\n'.encode())
+            self.capturing = True
+
+            nextSync = time.monotonic() + __SYNC_INTERVAL__
+            nextDiagnostics = time.monotonic() + self.diagnosticsInterval
+            nextFault = time.monotonic() + self.random.expovariate(1 / self.faultInterval) \
+                if self.faultInterval else float('inf')
+            while not self.wait(self.random.expovariate(self.rate)):
+                self.write(self.advertisingFrame())
+                if time.monotonic() >= nextSync:
+                    self.write(self.syncFrame())
+                    self.write(self.delaysFrame())
+                    nextSync += __SYNC_INTERVAL__
+                if time.monotonic() >= nextDiagnostics:
+                    self.write(self.diagnosticsFrame())
+                    nextDiagnostics += self.diagnosticsInterval
+                if time.monotonic() >= nextFault:
+                    self.unplug()
+                    if self.faultReset:
+                        break
+                    nextFault = time.monotonic() + self.random.expovariate(1 / self.faultInterval)
+
+        self.path.unlink(missing_ok=True)
+        os.close(self.master)
+        os.close(self._slave)
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Simulate probes on pseudo terminals, for testing the collector without hardware',
+    )
+    _parser.add_argument('-n', '--count', type=int, default=3, help="Number of probes [Default: 3]")
+    _parser.add_argument('-d', '--dir', default='fake-probes',
+                         help="Folder of the probe device links ttyFAKE0.. [Default: fake-probes]")
+    _parser.add_argument('-c', '--config', help="Write a collector configuration binding the probes by identity")
+    _parser.add_argument('--boot-delay', type=float, default=__BOOT_DELAY__,
+                         help="Seconds from a reset to the application start [Default: " + str(__BOOT_DELAY__) + "]")
+    _parser.add_argument('--init-delay', type=float, default=__INIT_DELAY__,
+                         help="Seconds from the application start to the capture [Default: " + str(__INIT_DELAY__) + "]")
+    _parser.add_argument('-r', '--rate', type=float, default=__RATE__,
+                         help="Advertising reports per second of every probe [Default: " + str(__RATE__) + "]")
+    _parser.add_argument('--fault-interval', type=float, metavar='SEC',
+                         help="Unplug every probe on average every SEC seconds [Default: never]")
+    _parser.add_argument('--fault-downtime', type=float, default=__FAULT_DOWNTIME__, metavar='SEC',
+                         help="Seconds an unplugged probe stays away [Default: " + str(__FAULT_DOWNTIME__) + "]")
+    _parser.add_argument('--fault-reset', action='store_true',
+                         help="Unplugged probes restart when plugged back, as when powered by the USB")
+    _parser.add_argument('--diagnostics-interval', type=float, default=__DIAGNOSTICS_INTERVAL__, metavar='SEC',
+                         help="Seconds between two diagnostics frames [Default: " + str(__DIAGNOSTICS_INTERVAL__) + "]")
+    _args = _parser.parse_args()
+
+    _dir = pathlib.Path(_args.dir)
+    _dir.mkdir(parents=True, exist_ok=True)
+    _probes = [
+        FakeProbe(i, _dir / f'ttyFAKE{i}', _args.boot_delay, _args.init_delay, _args.rate,
+                  _args.fault_interval, _args.fault_downtime, _args.fault_reset, _args.diagnostics_interval)
+        for i in range(_args.count)
+    ]
+
+    if _args.config:
+        with open(_args.config, 'w') as _config:
+            # Reversed, so the binding cannot rely on the device order
+            for _i, _probe in reversed(list(enumerate(_probes))):
+                _config.write(f'[ESP {_i + 1}]\nid = {_probe.chip.hex(":")}\nchannel = {_probe.channel}\n\n')
+
+    for _probe in _probes:
+        _probe.start()
+        print(f'{_probe.chip.hex(":")}: {_probe.path} (channel {_probe.channel})', flush=True)
+
+    try:
+        while True:
+            time.sleep(1)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if _args.fault_interval:
+            print(f'{sum(_probe.faults for _probe in _probes)} unplugs', flush=True)
+        for _probe in _probes:
+            _probe.path.unlink(missing_ok=True)
@@ -0,0 +1,199 @@
+#!/usr/bin/env python
+
+import argparse
+import collections
+import mmap
+import os
+import pathlib
+import struct
+import sys
+
+from datetime import datetime
+
+# Ring file layout (little endian):
+#   header:  magic "BLEFLREC", version (I), capacity (Q), head (Q), tail (Q), padded to 64 B
+#   data:    `capacity` bytes of records, each aligned to 8 B:
+#            absolute position (Q), timestamp in us (q), length (H), padding (6 B), raw HCI packet
+#   Positions are absolute byte counts since the ring creation, the offset in the data area is position % capacity.
+#   A record which would cross the end of the data area is replaced by a wrap marker (length 0xFFFF).
+RING_MAGIC = b'BLEFLREC'
+RING_VERSION = 1
+
+_header = struct.Struct('<8sIQQQ')
+_HEADER_SIZE = 64
+_record = struct.Struct('<QqH6x')
+_WRAP = 0xFFFF
+
+# Bluetooth HCI H4 with pseudo-header (direction) [https://www.tcpdump.org/linktypes.html]
+LINKTYPE_BLUETOOTH_HCI_H4_WITH_PHDR = 201
+
+
+def _aligned(size):
+    return (size + 7) & ~7
+
+
+class FlightRecorder:
+    """
+    Fixed-size memory-mapped circular buffer of raw HCI frames.
+
+    The ring lives in a file, so other processes can extract from it while the collector keeps writing.
+    The tail is published before a record is overwritten and the head after it is complete,
+    every record also carries its absolute position so a reader can tell a torn or stale record.
+    """
+
+    def __init__(self, path, capacity):
+        self.path = pathlib.Path(path)
+        self.capacity = _aligned(capacity)
+        self._file = self.path.open('w+b')
+        self._file.truncate(_HEADER_SIZE + self.capacity)
+        self._map = mmap.mmap(self._file.fileno(), _HEADER_SIZE + self.capacity)
+        self._records = collections.deque()  # Positions of the records in the ring, oldest first
+        self.head = 0
+        self.tail = 0
+        self._publish()
+
+    def close(self):
+        self._map.close()
+        self._file.close()
+
+    def _publish(self):
+        _header.pack_into(self._map, 0, RING_MAGIC, RING_VERSION, self.capacity, self.head, self.tail)
+
+    def _reserve(self, size):
+        """
+        Drop the oldest records until `size` bytes after the head are free
+        """
+        while self._records and self._records[0] < self.head + size - self.capacity:
+            self._records.popleft()
+        self.tail = self._records[0] if self._records else self.head
+        _header.pack_into(self._map, 0, RING_MAGIC, RING_VERSION, self.capacity, self.head, self.tail)
+
+    def append(self, timestamp, data):
+        """
+        Store a raw frame received at `timestamp` (us since the epoch)
+        """
+        size = _aligned(_record.size + len(data))
+        if size > self.capacity:
+            return
+
+        offset = self.head % self.capacity
+        if offset + size > self.capacity:   # Does not fit before the end, continue from the start
+            self._reserve(self.capacity - offset)
+            if self.capacity - offset >= _record.size:
+                _record.pack_into(self._map, _HEADER_SIZE + offset, self.head, 0, _WRAP)
+            self.head += self.capacity - offset
+            offset = 0
+
+        self._reserve(size)
+        self._records.append(self.head)
+        _record.pack_into(self._map, _HEADER_SIZE + offset, self.head, timestamp, len(data))
+        start = _HEADER_SIZE + offset + _record.size
+        self._map[start:start + len(data)] = data
+        self.head += size
+        self._publish()
+
+
+def readRing(path):
+    """
+    Consistent copy of the frames (timestamp, data) currently held by a ring file, oldest first
+    """
+    with pathlib.Path(path).open('rb') as ringFile, \
+            mmap.mmap(ringFile.fileno(), 0, access=mmap.ACCESS_READ) as ring:
+        magic, version, capacity, head, tail = _header.unpack_from(ring, 0)
+        if magic != RING_MAGIC or version != RING_VERSION:
+            raise ValueError(f"{path} is not a flight recorder ring.")
+        data = bytes(ring[_HEADER_SIZE:_HEADER_SIZE + capacity])
+        # Records older than the tail after the copy may have been overwritten meanwhile
+        tail = max(tail, _header.unpack_from(ring, 0)[4])
+
+    frames = []
+    position = tail
+    while position < head:
+        offset = position % capacity
+        if capacity - offset < _record.size:
+            position += capacity - offset
+            continue
+        recordPosition, timestamp, length = _record.unpack_from(data, offset)
+        if recordPosition != position:  # Overwritten while copying
+            break
+        if length == _WRAP:
+            position += capacity - offset
+            continue
+        start = offset + _record.size
+        frames.append((timestamp, data[start:start + length]))
+        position += _aligned(_record.size + length)
+    return frames
+
+
+def reportAddresses(data):
+    """
+    Addresses of an HCI LE Advertising Report event, empty for other packets
+    """
+    # H4 type, event code, parameter length, subevent code, number of reports, types, address types, addresses
+    if len(data) < 5 or data[0] != 0x04 or data[1] != 0x3E or data[3] != 0x02:
+        return []
+    count = data[4]
+    start = 5 + 2 * count
+    return [data[start + 6 * i:start + 6 * (i + 1)][::-1].hex(':') for i in range(count)]
+
+
+def advertisingReport(address, addressType, eventType, rssi, name=''):
+    """
+    HCI LE Advertising Report event (H4) of a decoded report, its advertising data only holds the device name
+    """
+    name = name.encode('utf-8')[:29]    # Advertising data length is limited to 31 B
+    data = bytes([len(name) + 1, 0x09]) + name if name else b''    # Complete Local Name
+    return (bytes([0x04, 0x3E, 12 + len(data), 0x02, 1, eventType, addressType])
+            + bytes.fromhex(address.replace(':', ''))[::-1] + bytes([len(data)]) + data + struct.pack('<b', rssi))
+
+
+def writePcap(path, frames):
+    """
+    Store the frames (timestamp, data) as a pcap file readable by Wireshark
+    """
+    with pathlib.Path(path).open('wb') as pcap:
+        pcap.write(struct.pack('<IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 65535, LINKTYPE_BLUETOOTH_HCI_H4_WITH_PHDR))
+        for timestamp, data in frames:
+            packet = struct.pack('>I', 0) + data   # Direction: received by the host
+            pcap.write(struct.pack('<IIII', timestamp // 1000000, timestamp % 1000000, len(packet), len(packet)))
+            pcap.write(packet)
+
+
+def extract(ringPaths, output, start, end, address=None):
+    """
+    Extract frames between `start` and `end` (us since the epoch) of all the rings into a pcap file,
+    optionally only advertising reports of `address`
+    """
+    frames = []
+    for ringPath in ringPaths:
+        try:
+            frames += [
+                frame for frame in readRing(ringPath)
+                if start <= frame[0] <= end and (address is None or address in reportAddresses(frame[1]))
+            ]
+        except (OSError, ValueError) as e:
+            print(f"Cannot read {ringPath} ({e})", file=sys.stderr)
+    frames.sort(key=lambda frame: frame[0])
+    writePcap(output, frames)
+    return len(frames)
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Extract a time window of raw frames from flight recorder rings into a pcap file',
+    )
+    _parser.add_argument("rings", nargs='+', help="Ring files (or a folder containing them)")
+    _parser.add_argument('-s', '--start', help="Start of the window (ISO time) [Default: oldest frame]")
+    _parser.add_argument('-e', '--end', help="End of the window (ISO time) [Default: newest frame]")
+    _parser.add_argument('-a', '--address', help="Only advertising reports of this address")
+    _parser.add_argument('-o', '--output', required=True, help="Output pcap file")
+    _args = _parser.parse_args()
+
+    _rings = []
+    for _path in map(pathlib.Path, _args.rings):
+        _rings += sorted(_path.glob('*.ring')) if _path.is_dir() else [_path]
+
+    _start = int(datetime.fromisoformat(_args.start).timestamp() * 1000000) if _args.start else 0
+    _end = int(datetime.fromisoformat(_args.end).timestamp() * 1000000) if _args.end else sys.maxsize
+    _count = extract(_rings, _args.output, _start, _end, _args.address.lower() if _args.address else None)
+    print(f"Extracted {_count} frames into {_args.output}")
@@ -0,0 +1,143 @@
+import collections
+import itertools
+import random
+import socket
+import sys
+import threading
+import time
+
+from link import sendFrame, receiveFrame, FrameReader
+from link import HELLO, RESUME, PROBE, RECORDS, ACK
+from link import LINK_MAGIC, LINK_VERSION, HELLO_HEADER, RECORDS_HEADER, SEQUENCE
+from records import packRecord
+
+__BUFFER_SIZE__ = 1 << 18   # Records kept until acknowledged by the aggregator
+__BATCH_SIZE__ = 256        # Records sent in a single frame
+__MIN_BACKOFF__ = 0.1       # Reconnection delays (s), doubled after every failed attempt
+__MAX_BACKOFF__ = 10
+
+
+class EdgeForwarder:
+    """
+    Ships the decoded records of a collector to an aggregator over TCP.
+
+    Records stay in a bounded buffer until the aggregator acknowledges them, so they survive a reconnection.
+    When the aggregator or the network cannot keep up, the buffer fills and the oldest records are dropped,
+    the collector itself is never blocked. The aggregator sees dropped records as gaps in the sequence.
+    """
+
+    def __init__(self, host, port, name=None, bufferSize=__BUFFER_SIZE__):
+        self.address = (host, port)
+        self.name = name if name is not None else socket.gethostname()
+        self.session = random.getrandbits(63)
+        self.bufferSize = bufferSize
+        self.dropped = 0
+        self._probes = {}   # Probe name -> index
+        self._buffer = collections.deque()  # (sequence, probe index + packed record), oldest first
+        self._nextSequence = 0
+        self._sentSequence = 0  # Records before it were sent over the current link
+        self._cond = threading.Condition()
+        self._running = True
+        self._socket = None
+        self._linkLost = False
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def close(self, timeout=1):
+        """
+        Stop forwarding after waiting up to `timeout` seconds for the buffer to be acknowledged
+        """
+        with self._cond:
+            self._cond.wait_for(lambda: not self._buffer, timeout)
+            self._running = False
+            self._cond.notify_all()
+        if self._socket is not None:
+            self._socket.close()
+        self._thread.join()
+
+    def publish(self, probe, timestamp, info):
+        with self._cond:
+            index = self._probes.setdefault(probe, len(self._probes))
+            if len(self._buffer) >= self.bufferSize:
+                if self._buffer.popleft()[0] >= self._sentSequence:
+                    self.dropped += 1   # Evicted before it was even sent
+            self._buffer.append((self._nextSequence, bytes((index,)) + packRecord(timestamp, info)))
+            self._nextSequence += 1
+            self._cond.notify_all()
+
+    def _acknowledge(self, sequence):
+        with self._cond:
+            while self._buffer and self._buffer[0][0] < sequence:
+                self._buffer.popleft()
+            self._cond.notify_all()
+
+    def _receiveAcks(self, sock, reader, pending):
+        try:
+            while True:
+                frameType, payload = receiveFrame(sock, reader, pending)
+                if frameType == ACK:
+                    if len(payload) != SEQUENCE.size:
+                        raise ValueError("ACK frame of a wrong size.")
+                    self._acknowledge(SEQUENCE.unpack(payload)[0])
+        except (OSError, ValueError):
+            with self._cond:    # Makes the sender reconnect, even when it has nothing to send
+                if sock is self._socket:
+                    self._linkLost = True
+                    self._cond.notify_all()
+
+    def _run(self):
+        backoff = __MIN_BACKOFF__
+        while self._running:
+            try:
+                self._socket = socket.create_connection(self.address, timeout=__MAX_BACKOFF__)
+            except OSError:
+                time.sleep(backoff)
+                backoff = min(backoff * 2, __MAX_BACKOFF__)
+                continue
+            backoff = __MIN_BACKOFF__
+
+            try:
+                self._forward(self._socket)
+            except (OSError, ValueError) as e:
+                if self._running:
+                    print(f'Forwarder: Link to {self.address[0]}:{self.address[1]} lost ({e})', file=sys.stderr)
+            finally:
+                self._socket.close()
+
+    def _forward(self, sock):
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        sendFrame(sock, HELLO, HELLO_HEADER.pack(LINK_MAGIC, LINK_VERSION, self.session) + self.name.encode('utf8'))
+        reader = FrameReader()
+        pending = []
+        frameType, payload = receiveFrame(sock, reader, pending)
+        if frameType != RESUME:
+            raise ValueError(f"Unexpected frame {frameType} instead of RESUME.")
+        if len(payload) != SEQUENCE.size:
+            raise ValueError("RESUME frame of a wrong size.")
+        sequence = SEQUENCE.unpack(payload)[0]
+        self._acknowledge(sequence)
+        sock.settimeout(None)
+        self._linkLost = False
+        threading.Thread(target=self._receiveAcks, args=(sock, reader, pending), daemon=True).start()
+
+        declared = 0    # Probes announced to the aggregator
+        while True:
+            with self._cond:
+                self._sentSequence = sequence
+                self._cond.wait_for(
+                    lambda: not self._running or self._linkLost or (self._buffer and self._buffer[-1][0] >= sequence)
+                )
+                if not self._running:
+                    return
+                if self._linkLost:
+                    raise ConnectionError("Connection closed by the aggregator.")
+                sequence = max(sequence, self._buffer[0][0])    # Skip the dropped records
+                start = sequence - self._buffer[0][0]
+                batch = [entry for _, entry in itertools.islice(self._buffer, start, start + __BATCH_SIZE__)]
+                probes = list(self._probes.items())[declared:]
+
+            for probe, index in probes:
+                sendFrame(sock, PROBE, bytes((index,)) + probe.encode('utf8'))
+            declared += len(probes)
+            sendFrame(sock, RECORDS, RECORDS_HEADER.pack(sequence, len(batch)) + b''.join(batch))
+            sequence += len(batch)
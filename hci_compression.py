@@ -0,0 +1,157 @@
+__SLOTS__ = 120         # Events kept by the probe for the deltas (HC_SLOTS)
+__NO_SLOT__ = 0x7F      # Literal event which is not kept (HC_NO_SLOT)
+__LITERAL__ = 0x80      # Slot flag of the literal events (HC_LITERAL)
+__EVENT_MAX_SIZE__ = 3 + 255    # Longest HCI event (HC_EVENT_MAX_SIZE)
+__CRC8_POLY__ = 0x07    # Polynomial of the frame checksum (HC_CRC8_POLY)
+
+
+def _crc8Table():
+    table = []
+    for byte in range(256):
+        crc = byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ __CRC8_POLY__) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+        table.append(crc)
+    return table
+
+
+_CRC8_TABLE = _crc8Table()
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc = _CRC8_TABLE[crc ^ byte]
+    return crc
+
+
+def readVarint(stream, frame=None):
+    """
+    Unsigned LEB128 integer (at most 64 bits, ValueError beyond), its bytes are appended to `frame`
+    """
+    value = 0
+    shift = 0
+    while True:
+        byte = stream.read(1)
+        if not byte:
+            raise EOFError('Stream ended within a compressed frame')
+        if frame is not None:
+            frame += byte
+        value |= (byte[0] & 0x7F) << shift
+        if byte[0] < 0x80:
+            return value
+        shift += 7
+        if shift > 63:
+            raise ValueError('Varint longer than 64 bits')
+
+
+class HciStreamDecoder:
+    """
+    Decoder of the compressed raw HCI stream of a probe (main/hci-compress.h): BLZ: frames carry an event as
+    a delta against the previous event of its advertiser (kept in a slot) and their timestamp relative to the
+    previous frame. From a plain BLE: frame on, the timestamps are known, the events of an advertiser are decoded
+    from its next literal event on (the probe sends them every few seconds). A frame failing its checksum is
+    dropped and the decoder starts over, so a transmission error never turns into wrong events.
+    """
+
+    def __init__(self):
+        self.synchronised = False
+        self.lastTimestamp = 0
+        self.slots = [None] * __SLOTS__     # Unknown content until a literal event
+        self.wireBytes = 0      # Bytes of the decoded frames as sent by the probe
+        self.plainBytes = 0     # Bytes of the decoded frames as plain BLE: frames
+        self.frames = 0         # BLZ: frames decoded
+        self.skipped = 0        # Frames which could not be decoded, the decoder was not synchronised
+        self.corrupted = 0      # Frames dropped as invalid (checksum, lengths)
+
+    def lost(self):
+        """
+        Frames were lost (transmission error), the stream is decoded again from the next plain frame
+        """
+        self.synchronised = False
+        self.slots = [None] * __SLOTS__
+
+    def plain(self, timestamp, data):
+        """
+        Plain BLE: frame, the timestamp reference
+        """
+        self.synchronised = True
+        self.lastTimestamp = timestamp
+        self.wireBytes += 14 + len(data)
+        self.plainBytes += 14 + len(data)
+
+    def compressed(self, stream):
+        """
+        Read the rest of a BLZ: frame (after the start sequence)
+        :return: (Probe timestamp, HCI event), None if it cannot be decoded (the frame is consumed anyway,
+                 up to the invalid field of a corrupted one)
+        """
+        frame = bytearray()
+        try:
+            timestampDelta, slot, data = self._decode(stream, frame)
+        except ValueError:
+            self.corrupted += 1
+            self.lost()
+            return None
+
+        literal = bool(slot & __LITERAL__)
+        slot &= ~__LITERAL__
+        known = literal or self.slots[slot] is not None
+        if slot != __NO_SLOT__:
+            self.slots[slot] = data if known else None
+        self.lastTimestamp += timestampDelta
+        if not self.synchronised or not known:
+            self.skipped += 1
+            return None
+        self.wireBytes += 4 + len(frame) + 1
+        self.plainBytes += 14 + len(data)
+        self.frames += 1
+        return self.lastTimestamp, data
+
+    def ratio(self):
+        """
+        Compression ratio of the decoded stream (size as plain frames over size as sent)
+        """
+        return self.plainBytes / self.wireBytes if self.wireBytes else 1
+
+    def _decode(self, stream, frame):
+        """
+        Fields of a BLZ: frame, the bytes read are appended to `frame`. ValueError if the frame is invalid
+        :return: (Timestamp delta, slot byte, event), padded with zeros where the reference event is unknown
+        """
+        timestampDelta = readVarint(stream, frame)
+        slot = self._read(stream, 1, frame)[0]
+        length = readVarint(stream, frame)
+        if length > __EVENT_MAX_SIZE__:
+            raise ValueError(f'Event of {length} B')
+        index = slot & ~__LITERAL__
+        if (index >= __SLOTS__ and index != __NO_SLOT__) or slot == __NO_SLOT__:    # No delta against nothing
+            raise ValueError(f'Invalid slot 0x{slot:02x}')
+
+        if slot & __LITERAL__:
+            data = self._read(stream, length, frame)
+        else:
+            reference = self.slots[index] or b''
+            event = bytearray()
+            while len(event) < length:
+                equal = readVarint(stream, frame)
+                changed = readVarint(stream, frame)
+                if not equal + changed or len(event) + equal + changed > length:
+                    raise ValueError('Delta runs do not match the event length')
+                # Unknown reference: padded, so the frame is still consumed whole
+                event += reference[len(event):len(event) + equal].ljust(equal, b'\0')
+                event += self._read(stream, changed, frame)
+            data = bytes(event)
+
+        if self._read(stream, 1)[0] != crc8(frame):
+            raise ValueError('Checksum mismatch')
+        return timestampDelta, slot, data
+
+    @staticmethod
+    def _read(stream, length, frame=None):
+        data = stream.read(length)
+        if len(data) < length:
+            raise EOFError('Stream ended within a compressed frame')
+        if frame is not None:
+            frame += data
+        return data
@@ -0,0 +1,67 @@
+import socket
+import struct
+
+from records import RECORD
+
+# Framing of the forwarder to aggregator link over TCP (little endian):
+#   frame:    type (B), payload length (I), payload
+#   HELLO:    magic "BLEFWD", version (B), session (Q), forwarder name        forwarder -> aggregator
+#   RESUME:   sequence of the first record the aggregator misses (Q)         aggregator -> forwarder
+#   PROBE:    probe index (B), probe name                                    forwarder -> aggregator
+#   RECORDS:  sequence of the first record (Q), record count (H),            forwarder -> aggregator
+#             records, each a probe index (B) followed by a records.RECORD
+#   ACK:      sequence of the first record not received yet (Q)              aggregator -> forwarder
+# Record sequences are consecutive within a session (a run of the forwarder), a gap means lost records.
+LINK_MAGIC = b'BLEFWD'
+LINK_VERSION = 1
+
+HELLO, RESUME, PROBE, RECORDS, ACK = range(1, 6)
+
+FRAME = struct.Struct('<BI')
+HELLO_HEADER = struct.Struct('<6sBQ')
+RECORDS_HEADER = struct.Struct('<QH')
+SEQUENCE = struct.Struct('<Q')
+ENTRY_SIZE = 1 + RECORD.size
+
+MAX_FRAME = 1 << 20
+
+
+def sendFrame(sock: socket.socket, frameType, payload):
+    sock.sendall(FRAME.pack(frameType, len(payload)) + payload)
+
+
+class FrameReader:
+    """
+    Split a byte stream into frames (type, payload)
+    """
+
+    def __init__(self):
+        self._buffer = bytearray()
+
+    def feed(self, data):
+        self._buffer += data
+        frames = []
+        offset = 0
+        while len(self._buffer) - offset >= FRAME.size:
+            frameType, length = FRAME.unpack_from(self._buffer, offset)
+            if length > MAX_FRAME:
+                raise ValueError(f"Frame of {length} B is too long.")
+            if len(self._buffer) - offset - FRAME.size < length:
+                break
+            start = offset + FRAME.size
+            frames.append((frameType, bytes(self._buffer[start:start + length])))
+            offset = start + length
+        del self._buffer[:offset]
+        return frames
+
+
+def receiveFrame(sock: socket.socket, reader: FrameReader, pending: list):
+    """
+    Next frame of a blocking socket, `pending` keeps the frames received together with it
+    """
+    while not pending:
+        data = sock.recv(65536)
+        if not data:
+            raise ConnectionError("Connection closed.")
+        pending += reader.feed(data)
+    return pending.pop(0)
@@ -0,0 +1,337 @@
+#!/usr/bin/env python
+
+import argparse
+import csv
+import os
+import pathlib
+import statistics
+import struct
+import sys
+import threading
+import time
+
+from datetime import datetime, timedelta
+
+from checkpoint import loadSnapshot, writeSnapshot
+from flight_recorder import extract
+from models import MODELS, modelFactory
+from models import ModelInitialised, ConnectionAlert
+from models import parseTimestamp
+from records import isGap
+from rpa_resolver import loadResolver
+from timer_wheel import HierarchicalTimerWheel
+
+__POLL_INTERVAL__ = 0.01   # How often a followed capture is checked for new data (s)
+__CHECKPOINT_INTERVAL__ = 60   # How often the model state is stored (s)
+__RECORDING_MARGIN__ = 5   # Seconds of flight recording stored before the last advertisement of an alerting address
+__DAY__ = 24 * 60 * 60 * 1000  # The ISO capture timestamps are milliseconds of the day (ms)
+
+
+class LiveDetector:
+    """
+    Raises an alert as soon as the learned deadline of an address passes, not only once the address is heard again.
+
+    The expected-next-arrival deadline of every ready model is kept in a hierarchical timer wheel, so each
+    advertisement costs a single O(1) cancel and insert regardless of the number of tracked devices.
+
+    The capture timestamps go back to 0 at midnight, the models and the wheel run on a continuous timeline
+    instead: a day is added whenever the time jumps back by more than half a day. The alerts are reported
+    on the capture clock.
+    """
+
+    def __init__(self, modelFactory, tick=1):
+        self.modelFactory = modelFactory
+        self.models = {}
+        self.wheel = HierarchicalTimerWheel(tick)
+        self.overdue = set()   # Addresses whose deadline already fired and which were not heard since
+        self.latencies = []    # Delay between a deadline and its alert (ms)
+        self.dayOffset = 0     # Time added to the capture timestamps since the first one (ms, whole days)
+        self.latest = None     # Newest time on the timeline (ms)
+
+    def timeline(self, timestamp):
+        """
+        Time (ms) on the continuous timeline of a capture timestamp
+        """
+        timestamp = parseTimestamp(timestamp) + self.dayOffset
+        if self.latest is not None:
+            if timestamp < self.latest - __DAY__ // 2:      # Midnight passed
+                self.dayOffset += __DAY__
+                timestamp += __DAY__
+            elif timestamp > self.latest + __DAY__ // 2:    # Late row from before midnight
+                timestamp -= __DAY__
+        if self.latest is None or timestamp > self.latest:
+            self.latest = timestamp
+        return timestamp
+
+    def captureTime(self, timestamp):
+        """
+        Capture timestamp of a time on the timeline
+        """
+        timestamp -= self.dayOffset
+        return timestamp + __DAY__ if timestamp < 0 else timestamp
+
+    def restore(self, models):
+        """
+        Continue from previously stored models (address -> model). The time the detector was down is an outage,
+        an address is scheduled again from its next advertisement.
+        """
+        self.models = models
+        for model in models.values():
+            model.skipSilence()
+
+    def advance(self, now):
+        """
+        Move the detector time to `now` (capture timestamp) and return alerts of the deadlines passed meanwhile
+        """
+        return self._advance(self.timeline(now))
+
+    def _advance(self, now):
+        alerts = []
+        for address, deadline in self.wheel.advance(now):
+            self.overdue.add(address)
+            self.latencies.append(now - deadline)
+            alerts.append({
+                'Address': address,
+                'Timestamp': int(self.captureTime(deadline)),
+                'Duration': int(deadline - self.models[address].lastSeen),
+                'Type': 'deadline'
+            })
+        return alerts
+
+    def processAdv(self, address, timestamp):
+        """
+        Feed an advertisement to the model of `address` and return the resulting alerts
+        """
+        timestamp = self.timeline(timestamp)
+        alerts = self._advance(timestamp)
+
+        try:
+            model = self.models[address]
+        except KeyError:
+            model = self.modelFactory()
+            self.models[address] = model
+
+        try:
+            model.processAdv(timestamp)
+        except ModelInitialised:
+            pass
+        except ConnectionAlert as alert:
+            # Closes the connection reported by the deadline or reports one the deadline did not catch
+            alerts.append({
+                'Address': address,
+                'Timestamp': self.captureTime(alert.timestamp),
+                'Duration': alert.duration,
+                'Type': 'end' if address in self.overdue else 'arrival'
+            })
+        except (RuntimeWarning, RuntimeError):
+            print(f"Error occurred while processing {address} at {self.captureTime(timestamp)}.", file=sys.stderr)
+        self.overdue.discard(address)
+
+        deadline = model.deadline()
+        if deadline is None:
+            self.wheel.cancel(address)
+        else:
+            self.wheel.schedule(address, deadline)
+
+        return alerts
+
+    def processGap(self, end):
+        """
+        Ignore the silences across a capture outage which ended at `end` (capture timestamp)
+        """
+        end = self.timeline(end)
+        for address, model in self.models.items():
+            if model.lastSeen < end:
+                model.skipSilence()
+                self.wheel.cancel(address)
+                self.overdue.discard(address)
+
+
+def wallclock():
+    """
+    Current local time in the capture timestamp domain (milliseconds of the day)
+    """
+    now = datetime.now()
+    return ((now.hour * 60 + now.minute) * 60 + now.second) * 1000 + now.microsecond // 1000
+
+
+def epochMicroseconds(timestamp):
+    """
+    Convert a capture timestamp (milliseconds of the day, local time) to microseconds since the epoch,
+    a timestamp over half a day ahead of the wall clock is from the day before
+    """
+    midnight = datetime.now().replace(hour=0, minute=0, second=0, microsecond=0)
+    if timestamp - wallclock() > __DAY__ // 2:
+        midnight -= timedelta(days=1)
+    return int((midnight + timedelta(milliseconds=timestamp)).timestamp() * 1000000)
+
+
+def storeRecording(recorderPath, outputPath, alert, lastSeen, address=None):
+    """
+    Extract the raw frames of the alerting address around the alert from the collector flight recorders
+    :param address: Last device address of the alerting identity [Default: the alert address]
+    """
+    rings = sorted(pathlib.Path(recorderPath).glob('*.ring'))
+    if not rings:
+        return
+    start = epochMicroseconds(lastSeen - __RECORDING_MARGIN__ * 1000)
+    end = epochMicroseconds(wallclock())
+    name = f"{alert['Address'].replace(':', '')}_{alert['Timestamp']}.pcap"
+    extract(rings, outputPath / name, start, end, address or alert['Address'])
+
+
+class CaptureLines:
+    """
+    Complete lines of a capture file, keeping the position behind the last one so a restart resumes from there.
+    With `idle`, the growing file is followed and `idle` is called while waiting for new data.
+    """
+
+    def __init__(self, file, idle=None, resume=0):
+        self.file = file
+        self.idle = idle
+        self.resume = resume    # Position to skip to after the header
+        self.position = file.tell()
+
+    def __iter__(self):
+        header = self.file.readline()
+        if self.resume > self.file.tell():
+            self.file.seek(self.resume)
+        self.position = self.file.tell()
+        yield header
+
+        partial = ''
+        while True:
+            line = self.file.readline()
+            if not line:
+                if self.idle is None:
+                    break
+                self.idle()
+                time.sleep(__POLL_INTERVAL__)
+                continue
+            partial += line
+            if partial.endswith('\n'):
+                self.position = self.file.tell()
+                yield partial
+                partial = ''
+
+        if partial:
+            self.position = self.file.tell()
+            yield partial
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Run selected detector with deadline alerts on a (live) capture',
+    )
+    _parser.add_argument("capture")
+    _parser.add_argument('-d', '--detector',
+                         dest='detectorID',
+                         help="Set the detector to be used [" + ", ".join(MODELS) + "]."
+                              " Parameters may be given as name:parameter=value,...",
+                         default='simple_statistics')
+    _parser.add_argument('-f', '--follow',
+                         action='store_true',
+                         help="Keep reading the capture as the collector appends to it and fire deadlines on wall-clock time.")
+    _parser.add_argument('-c', '--checkpoint',
+                         help="Snapshot file of the model state. Loaded on start (if present) and updated periodically.")
+    _parser.add_argument('--checkpoint-interval',
+                         dest='checkpointInterval', type=float,
+                         help="Seconds between two snapshots [Default: " + str(__CHECKPOINT_INTERVAL__) + "]",
+                         default=__CHECKPOINT_INTERVAL__)
+    _parser.add_argument('-r', '--flight-recorder',
+                         dest='flightRecorder', metavar='DIR',
+                         help="Collector flight recorder folder (collector -f). The frames of every deadline alert are extracted from it.")
+    _parser.add_argument('-o', '--output',
+                         dest='outputFolder',
+                         help="Set the output folder for analysis result files")
+    _parser.add_argument('-k', '--irks',
+                         help="CSV file of known IRKs (columns Identity, IRK). The resolvable private addresses"
+                              " of these devices are detected as their identity, across the address rotations.")
+    _args = _parser.parse_args()
+
+    capturePath = pathlib.Path(_args.capture)
+    outputPath = pathlib.Path(_args.outputFolder) if _args.outputFolder else pathlib.Path()
+    try:
+        factory = modelFactory(_args.detectorID)
+    except (ValueError, TypeError) as e:
+        print(f"Invalid detector {_args.detectorID}: {e}", file=sys.stderr)
+        raise SystemExit(1)
+
+    alertLogPath = outputPath / f"{capturePath.stem}.live-alerts.csv"
+    outputPath.mkdir(parents=True, exist_ok=True)
+
+    detector = LiveDetector(factory)
+    resolver = loadResolver(_args.irks)
+    addresses = {}  # Identity -> its last device address (flight recordings)
+
+    captureId = os.stat(capturePath).st_ino
+    resume = 0
+    lastCheckpoint = time.monotonic()
+    if _args.checkpoint and pathlib.Path(_args.checkpoint).exists():
+        try:
+            models, (snapshotCapture, position) = loadSnapshot(_args.checkpoint, _args.detectorID, factory)
+            detector.restore(models)
+            print(f"Restored {len(detector.models)} models in {(time.monotonic() - lastCheckpoint) * 1000:.0f} ms")
+            # The rows processed before the snapshot are not fed twice, unless the capture was replaced
+            if snapshotCapture == captureId and position <= os.stat(capturePath).st_size:
+                resume = position
+        except (ValueError, struct.error) as e:
+            print(f"Cannot restore the snapshot {_args.checkpoint}: {e}", file=sys.stderr)
+
+    def checkpoint(force=False):
+        global lastCheckpoint
+        if not _args.checkpoint or (not force and time.monotonic() - lastCheckpoint < _args.checkpointInterval):
+            return
+        writeSnapshot(_args.checkpoint, _args.detectorID, detector.models, factory, (captureId, lines.position))
+        lastCheckpoint = time.monotonic()
+
+    def logAlerts(alerts):
+        alertLog.writerows(alerts)
+        if not _args.flightRecorder:
+            return
+        for alert in alerts:
+            if alert['Type'] == 'deadline':
+                # Extract in a separate thread, so the detection is never paused
+                threading.Thread(
+                    target=storeRecording,
+                    args=(_args.flightRecorder, outputPath, alert,
+                          detector.captureTime(detector.models[alert['Address']].lastSeen),
+                          addresses.get(alert['Address'])),
+                    daemon=True
+                ).start()
+
+    def idle():
+        logAlerts(detector.advance(wallclock()))
+        checkpoint()
+
+    with capturePath.open('r') as captureFile, alertLogPath.open('w', buffering=1, newline='') as alertLogFile:
+        alertLog = csv.DictWriter(alertLogFile, fieldnames=['Address', 'Timestamp', 'Duration', 'Type'])
+        alertLog.writeheader()
+
+        lines = CaptureLines(captureFile, idle if _args.follow else None, resume)
+        capture = csv.DictReader(lines)
+
+        try:
+            for advertisement in capture:
+                if isGap(advertisement):
+                    detector.processGap(advertisement['DeviceName'])
+                    continue
+                address = advertisement['Address']
+                if resolver is not None:
+                    identity = resolver.identity(address, advertisement.get('AddressType', '1'))
+                    if identity != address:
+                        addresses[identity] = address
+                    address = identity
+                logAlerts(detector.processAdv(address, advertisement['Timestamp']))
+                checkpoint()
+        except KeyboardInterrupt:
+            print()  # Insert end of line (after the ^C)
+        finally:
+            checkpoint(force=True)
+
+    if detector.latencies:
+        latencies = sorted(detector.latencies)
+        print(f"{len(latencies)} deadline alerts, latency from deadline to alert:"
+              f" mean {statistics.mean(latencies):.1f} ms,"
+              f" p99 {latencies[int(len(latencies) * 0.99)]:.1f} ms,"
+              f" max {latencies[-1]:.1f} ms")
@@ -17,10 +17,21 @@
 
 #include "driver/uart.h"
 
+#include "interval-histogram.h"
+#include "probe-control.h"
+#include "probe-diagnostics.h"
+
 #define HCI_EVENT_MAX_SIZE (3 + 255) // 3 octet header + 255 bytes of data [Vol. 4, Part E, 5.4]
 #define HCI_BUFFER_SIZE 10  // Empirically tested that ESP manages to process messages fast enough,
                             // that 3 items are mostly sufficient
 
+// Run the interval histogram connection detection on the probe and report detected connections ("Con:" frames),
+// off by default (idf.py -DON_PROBE_DETECTION=1 build, see main/CMakeLists.txt)
+#ifndef ON_PROBE_DETECTION
+#define ON_PROBE_DETECTION 0
+#endif
+#define ON_PROBE_DETECTION_MAX_DEVICES 64   // 52 B per device
+
 // Logging tag
 static const char *TAG = "BLE AD SCANNER";
 
@@ -56,15 +67,44 @@ typedef struct {
 
 static QueueHandle_t adv_queue;
 
+#if ON_PROBE_DETECTION
+static interval_histogram_t histograms[ON_PROBE_DETECTION_MAX_DEVICES];
+
+/*
+ * @brief: Find the histogram of given address. If the address is not tracked yet, the least recently seen one
+ *         is replaced.
+ */
+static interval_histogram_t *get_histogram(const bd_addr_t addr)
+{
+    interval_histogram_t *oldest = &histograms[0];
+
+    for (uint8_t i = 0; i < ON_PROBE_DETECTION_MAX_DEVICES; i++) {
+        if (!histograms[i].used) {
+            interval_histogram_init(&histograms[i], addr);
+            return &histograms[i];
+        }
+        if (memcmp(histograms[i].addr, addr, BD_ADDR_LEN) == 0) {
+            return &histograms[i];
+        }
+        if ((int32_t)(histograms[i].last_seen - oldest->last_seen) < 0) {
+            oldest = &histograms[i];
+        }
+    }
+
+    interval_histogram_init(oldest, addr);
+    return oldest;
+}
+#endif
+
 
 // Buffer for HCI events; 
 static uint8_t *hci_buffer = NULL;
 static uint8_t hci_buffer_idx = 0;
 
 /*
- * @brief: Callback function of Bluetooth controller used to notify that the controller has a packet to send to the host.
+ * @brief: Copy a packet of the Bluetooth controller into the HCI buffer and queue it for the processing task.
  */
-static int controller_out_rdy(uint8_t *data, uint16_t len)
+static int enqueue_hci_packet(uint8_t *data, uint16_t len)
 {
     hci_data_t queue_data;
     queue_data.timestamp = esp_timer_get_time();  // Get microseconds since ESP boot
@@ -90,6 +130,17 @@ static int controller_out_rdy(uint8_t *data, uint16_t len)
     return ESP_OK;
 }
 
+/*
+ * @brief: Callback function of Bluetooth controller used to notify that the controller has a packet to send to the host.
+ */
+static int controller_out_rdy(uint8_t *data, uint16_t len)
+{
+    int64_t start = esp_timer_get_time();
+    int result = enqueue_hci_packet(data, len);
+    probe_diagnostics_add(PD_SECTION_CALLBACK, start);
+    return result;
+}
+
 static esp_vhci_host_callback_t vhci_host_cb = {
     NULL,
     controller_out_rdy
@@ -162,6 +213,7 @@ void hci_evt_process(void *pvParameters)
             ESP_LOGE(TAG, "Error while receiving a packet from HCI queue.");
             continue;
         }
+        int64_t parse_start = esp_timer_get_time();
 
         uint8_t* cursor = hci_data->data;
 
@@ -321,6 +373,13 @@ void hci_evt_process(void *pvParameters)
 //                      );
 
 
+#if ON_PROBE_DETECTION
+            // Outside of the UART lock, the lookup scans all the tracked devices
+            uint32_t duration = interval_histogram_update(get_histogram(bdaddr[i]), (uint32_t)(hci_data->timestamp / 1000));
+#endif
+
+            probe_control_tx_lock();
+            probe_control_record_tx_delay(hci_data->timestamp);
             uart_write_bytes(uart_num, "Adv:", 4);
             uart_write_bytes(uart_num, (const char*)&hci_data->timestamp, 8);
             uart_write_bytes(uart_num, (const char*)&bdaddr[i], BD_ADDR_LEN);
@@ -330,6 +389,17 @@ void hci_evt_process(void *pvParameters)
             uart_write_bytes(uart_num, (const char*)&rssi[i], 1);
             uart_write_bytes(uart_num, (const char*)&names[i].len, 1);
             uart_write_bytes(uart_num, (const char*)names[i].name, names[i].len);
+
+#if ON_PROBE_DETECTION
+            // Format: Con:{Timestamp},{Address},{Duration}
+            if (duration > 0) {
+                uart_write_bytes(uart_num, "Con:", 4);
+                uart_write_bytes(uart_num, (const char*)&hci_data->timestamp, 8);
+                uart_write_bytes(uart_num, (const char*)&bdaddr[i], BD_ADDR_LEN);
+                uart_write_bytes(uart_num, (const char*)&duration, 4);
+            }
+#endif
+            probe_control_tx_unlock();
         }
 
         // Reset every buffer to 0 to prevent accidental data contamination
@@ -340,6 +410,7 @@ void hci_evt_process(void *pvParameters)
         memset(names, 0, sizeof(char*) * MAX_REPORT_COUNT);
         memset(hci_data, 0, sizeof(hci_data_t));
         report_data_total = 0;
+        probe_diagnostics_add(PD_SECTION_PARSER, parse_start);
     }
 
 free_heap:
@@ -374,6 +445,9 @@ void app_main(void)
     ESP_ERROR_CHECK(uart_set_pin(uart_num, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
     ESP_ERROR_CHECK(uart_driver_install(uart_num, HCI_BUFFER_SIZE * HCI_EVENT_MAX_SIZE, HCI_BUFFER_SIZE * HCI_EVENT_MAX_SIZE, HCI_BUFFER_SIZE, &uart_queue, 0));
 
+    /* Answer the host commands (identification) */
+    probe_control_start(uart_num, CHANNEL, PC_MODE_ADVERTISING);
+
     /* Initialise Bluetooth */
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
 
@@ -467,6 +541,7 @@ void app_main(void)
                     uint8_t scan_filter_dups = 0x00;    // Disable duplicates filtering
                     size = make_cmd_ble_set_scan_enable(hci_message, scan_enable, scan_filter_dups);
                     esp_vhci_host_send_packet(hci_message, size);
+                    probe_control_set_capturing();
                     ble_scan_initialising = false;
                     break;
                 default:
@@ -17,10 +17,20 @@
 
 #include "driver/uart.h"
 
+#include "hci-compress.h"
+#include "probe-control.h"
+#include "probe-diagnostics.h"
+
 #define HCI_EVENT_MAX_SIZE (3 + 255) // 3 octet header + 255 bytes of data [Vol. 4, Part E, 5.4]
 #define HCI_BUFFER_SIZE 10  // Empirically tested that ESP manages to process messages fast enough,
                             // that 3 items are mostly sufficient
 
+// Send the events as deltas against the previous event of the same advertiser ("BLZ:" frames, see hci-compress.h),
+// about 3 times less data on the UART, off by default (idf.py -DRAW_COMPRESSION=1 build, see main/CMakeLists.txt)
+#ifndef RAW_COMPRESSION
+#define RAW_COMPRESSION 0
+#endif
+
 // Logging tag
 static const char *TAG = "BLE AD SCANNER";
 
@@ -51,14 +61,20 @@ typedef struct {
 
 static QueueHandle_t adv_queue;
 
+#if RAW_COMPRESSION
+// Used by the processing task only, too large for its stack
+static hc_state_t compressor;
+static uint8_t frame[HC_FRAME_MAX_SIZE];
+#endif
+
 // Buffer for HCI events; 
 static uint8_t *hci_buffer = NULL;
 static uint8_t hci_buffer_idx = 0;
 
 /*
- * @brief: Callback function of Bluetooth controller used to notify that the controller has a packet to send to the host.
+ * @brief: Copy a packet of the Bluetooth controller into the HCI buffer and queue it for the processing task.
  */
-static int controller_out_rdy(uint8_t *data, uint16_t len)
+static int enqueue_hci_packet(uint8_t *data, uint16_t len)
 {
     hci_data_t queue_data;
     queue_data.timestamp = esp_timer_get_time();  // Get microseconds since ESP boot
@@ -84,6 +100,17 @@ static int controller_out_rdy(uint8_t *data, uint16_t len)
     return ESP_OK;
 }
 
+/*
+ * @brief: Callback function of Bluetooth controller used to notify that the controller has a packet to send to the host.
+ */
+static int controller_out_rdy(uint8_t *data, uint16_t len)
+{
+    int64_t start = esp_timer_get_time();
+    int result = enqueue_hci_packet(data, len);
+    probe_diagnostics_add(PD_SECTION_CALLBACK, start);
+    return result;
+}
+
 static esp_vhci_host_callback_t vhci_host_cb = {
     NULL,
     controller_out_rdy
@@ -97,12 +124,16 @@ void hci_evt_process(void *pvParameters)
         return;
     }
     memset(hci_data, 0, sizeof(hci_data_t));
+#if RAW_COMPRESSION
+    hc_init(&compressor);
+#endif
 
     while (1) {
         if (xQueueReceive(adv_queue, hci_data, portMAX_DELAY) != pdTRUE) {
             ESP_LOGE(TAG, "Error while receiving a packet from HCI queue.");
             continue;
         }
+        int64_t parse_start = esp_timer_get_time();
 
 //  Text format:
 //        esp_rom_printf("Adv:");
@@ -112,13 +143,25 @@ void hci_evt_process(void *pvParameters)
 //        }
 //        esp_rom_printf("\n");
 
+#if RAW_COMPRESSION
+        size_t frame_len = hc_encode(&compressor, hci_data->timestamp, hci_data->data, hci_data->len, frame);
+#endif
+
+        probe_control_tx_lock();
+        probe_control_record_tx_delay(hci_data->timestamp);
+#if RAW_COMPRESSION
+        uart_write_bytes(uart_num, (const char*)frame, frame_len);
+#else
         uart_write_bytes(uart_num, "BLE:", 4);
         uart_write_bytes(uart_num, (const char*)&hci_data->timestamp, 8);
         uart_write_bytes(uart_num, (const char*)&hci_data->len, 2);
         uart_write_bytes(uart_num, (const char*)hci_data->data, hci_data->len);
+#endif
         uart_wait_tx_done(uart_num, portMAX_DELAY);
+        probe_control_tx_unlock();
 
         memset(hci_data->data, 0, HCI_EVENT_MAX_SIZE);
+        probe_diagnostics_add(PD_SECTION_PARSER, parse_start);
     }
 
     free(hci_data);
@@ -147,6 +190,9 @@ void app_main(void)
     ESP_ERROR_CHECK(uart_set_pin(uart_num, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
     ESP_ERROR_CHECK(uart_driver_install(uart_num, HCI_BUFFER_SIZE * HCI_EVENT_MAX_SIZE, HCI_BUFFER_SIZE * HCI_EVENT_MAX_SIZE, HCI_BUFFER_SIZE, &uart_queue, 0));
 
+    /* Answer the host commands (identification) */
+    probe_control_start(uart_num, CHANNEL, PC_MODE_RAW);
+
     /* Initialise Bluetooth */
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
 
@@ -241,6 +287,7 @@ void app_main(void)
                     uint8_t scan_filter_dups = 0x00;    // Disable duplicates filtering
                     size = make_cmd_ble_set_scan_enable(hci_message, scan_enable, scan_filter_dups);
                     esp_vhci_host_send_packet(hci_message, size);
+                    probe_control_set_capturing();
                     ble_scan_initialising = false;
                     break;
                 default:
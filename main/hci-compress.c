@@ -0,0 +1,163 @@
+#include <string.h>
+
+#include "hci-compress.h"
+
+#define H4_TYPE_EVENT 0x04
+#define LE_META_EVENTS 0x3E
+#define HCI_LE_ADV_REPORT 0x02
+
+static const uint8_t unused_key[7] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static uint8_t key_tag(const uint8_t *key)
+{
+    return key[0] ^ key[1] ^ key[2] ^ key[3] ^ key[4] ^ key[5] ^ key[6];
+}
+
+void hc_init(hc_state_t *state)
+{
+    memset(state, 0, sizeof(hc_state_t));
+    for (uint8_t i = 0; i < HC_SLOTS; i++) {
+        memcpy(state->slots[i].key, unused_key, sizeof(unused_key));
+        state->tags[i] = key_tag(unused_key);
+    }
+    state->plain_pending = 1;
+}
+
+static uint8_t crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ HC_CRC8_POLY) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static size_t put_varint(uint8_t *out, uint64_t value)
+{
+    size_t len = 0;
+    while (value >= 0x80) {
+        out[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+    return len;
+}
+
+/*
+ * @brief: Slot of the advertiser of the event, or the least recently used one (to be replaced) with *found = 0.
+ *         HC_NO_SLOT for events without advertiser or too long to be kept.
+ */
+static uint8_t find_slot(hc_state_t *state, const uint8_t *data, uint16_t len, uint8_t *found)
+{
+    *found = 0;
+    // H4 type, LE Meta event, parameter length, subevent, report count, event type, address type, address
+    if (len < 13 || len > HC_SLOT_DATA_SIZE
+        || data[0] != H4_TYPE_EVENT || data[1] != LE_META_EVENTS || data[3] != HCI_LE_ADV_REPORT) {
+        return HC_NO_SLOT;
+    }
+    const uint8_t *key = data + 6;  // Address type and address of the first report
+    uint8_t tag = key_tag(key);
+
+    for (uint8_t i = 0; i < HC_SLOTS; i++) {
+        if (state->tags[i] == tag && memcmp(state->slots[i].key, key, 7) == 0) {
+            *found = 1;
+            return i;
+        }
+    }
+
+    uint8_t oldest = 0;
+    for (uint8_t i = 1; i < HC_SLOTS; i++) {
+        if (state->slots[i].last_use < state->slots[oldest].last_use) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+/*
+ * @brief: Delta of the event against the slot content into `out`, stops once it is not shorter than `limit`.
+ * @return: Delta length, `limit` if it is not worth it
+ */
+static size_t encode_delta(const hc_slot_t *slot, const uint8_t *data, uint16_t len, uint8_t *out, size_t limit)
+{
+    size_t out_len = 0;
+    uint16_t i = 0;
+    while (i < len) {
+        uint16_t equal = 0;
+        while (i + equal < len && i + equal < slot->len && data[i + equal] == slot->data[i + equal]) {
+            equal++;
+        }
+        i += equal;
+        uint16_t changed = 0;
+        // A single equal byte between changes costs more as a new pair than as a changed byte
+        while (i + changed < len && (i + changed >= slot->len || data[i + changed] != slot->data[i + changed]
+               || (i + changed + 1 < len && i + changed + 1 < slot->len
+                   && data[i + changed + 1] != slot->data[i + changed + 1]))) {
+            changed++;
+        }
+        if (out_len + 6 + changed >= limit) {
+            return limit;
+        }
+        out_len += put_varint(out + out_len, equal);
+        out_len += put_varint(out + out_len, changed);
+        memcpy(out + out_len, data + i, changed);
+        out_len += changed;
+        i += changed;
+    }
+    return out_len;
+}
+
+size_t hc_encode(hc_state_t *state, int64_t timestamp, const uint8_t *data, uint16_t len, uint8_t *out)
+{
+    if (state->plain_pending || timestamp - state->last_plain >= HC_SYNC_INTERVAL_US) {
+        // Plain frame: BLE:{Timestamp (8 B)},{Length (2 B)},{Event}, the slots are kept
+        state->plain_pending = 0;
+        state->last_plain = timestamp;
+        state->last_timestamp = timestamp;
+        memcpy(out, "BLE:", 4);
+        memcpy(out + 4, &timestamp, 8);
+        memcpy(out + 12, &len, 2);
+        memcpy(out + 14, data, len);
+        return 14 + len;
+    }
+
+    size_t out_len = 4;
+    memcpy(out, "BLZ:", 4);
+    out_len += put_varint(out + out_len, (uint64_t)(timestamp - state->last_timestamp));
+    state->last_timestamp = timestamp;
+
+    uint8_t found;
+    uint8_t slot_index = find_slot(state, data, len, &found);
+    size_t slot_pos = out_len++;
+    out_len += put_varint(out + out_len, len);
+
+    size_t delta_len = len;     // Literal unless the delta is shorter
+    if (found && timestamp - state->slots[slot_index].last_literal < HC_REFRESH_INTERVAL_US) {
+        delta_len = encode_delta(&state->slots[slot_index], data, len, out + out_len, len);
+    }
+    if (delta_len < len) {
+        out[slot_pos] = slot_index;
+        out_len += delta_len;
+    } else {
+        out[slot_pos] = HC_LITERAL | slot_index;
+        memcpy(out + out_len, data, len);
+        out_len += len;
+    }
+
+    if (slot_index != HC_NO_SLOT) {
+        hc_slot_t *slot = &state->slots[slot_index];
+        memcpy(slot->key, data + 6, 7);
+        state->tags[slot_index] = key_tag(slot->key);
+        memcpy(slot->data, data, len);
+        slot->len = len;
+        slot->last_use = ++state->uses;
+        if (delta_len >= len) {
+            slot->last_literal = timestamp;
+        }
+    }
+    out[out_len] = crc8(out + 4, out_len - 4);
+    return out_len + 1;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Streaming compression of the raw HCI events: every advertising report is sent as a delta against the previous
+ * event of the same advertiser (same address type and address), which usually differs only in the RSSI and a few
+ * bytes of the payload.
+ *
+ * Compressed frame format (varints are unsigned LEB128):
+ *   BLZ:{Timestamp delta us (varint)},{Slot (1 B)},{Event length (varint)},{Body},{CRC-8 (1 B)}
+ *     Slot bit 7 set: the body is the literal event, stored into slot (bits 0-6) unless the slot is HC_NO_SLOT
+ *       (events other than advertising reports up to HC_SLOT_DATA_SIZE)
+ *     Slot bit 7 clear: the body is a delta against the event in the slot, which is then replaced by the result.
+ *       Delta: pairs of {Equal bytes (varint)},{Changed bytes (varint)},{Changed bytes}, until the event length
+ * The timestamp delta is relative to the previous frame (BLE: or BLZ:). The CRC-8 (polynomial 0x07) covers the frame
+ * after the start sequence: a corrupted delta would otherwise decode into a wrong event, and every later delta of
+ * the slot after it, so the host drops the frame and decodes again from the next plain frame.
+ *
+ * So a host which lost track of the stream (transmission error, attach) decodes it again, an event is sent as
+ * a plain BLE: frame every HC_SYNC_INTERVAL_US (timestamp reference) and the events of every advertiser literally
+ * every HC_REFRESH_INTERVAL_US (slot content).
+ */
+#define HC_SLOTS 120        // Advertisers kept (at most 127), 72 B per slot
+#define HC_SLOT_DATA_SIZE 48    // Legacy advertising reports (one report, 31 B of data) take at most 46 B
+#define HC_NO_SLOT 0x7F
+#define HC_LITERAL 0x80
+#define HC_SYNC_INTERVAL_US 1000000
+#define HC_REFRESH_INTERVAL_US 5000000
+#define HC_EVENT_MAX_SIZE (3 + 255)
+#define HC_CRC8_POLY 0x07
+#define HC_FRAME_MAX_SIZE (4 + 10 + 1 + 3 + HC_EVENT_MAX_SIZE + HC_EVENT_MAX_SIZE / 2 + 1)
+
+typedef struct {
+    int64_t last_literal;
+    uint32_t last_use;
+    uint16_t len;
+    uint8_t key[7];     // Address type and address, 0xFF... when unused
+    uint8_t data[HC_SLOT_DATA_SIZE];
+} hc_slot_t;
+
+typedef struct {
+    hc_slot_t slots[HC_SLOTS];
+    uint8_t tags[HC_SLOTS];     // Hash of the slot keys, scanned before comparing the keys
+    uint32_t uses;
+    int64_t last_timestamp;
+    int64_t last_plain;
+    uint8_t plain_pending;
+} hc_state_t;
+
+/*
+ * @brief: Prepare the compressor, the first event is sent as a plain BLE: frame.
+ */
+void hc_init(hc_state_t *state);
+
+/*
+ * @brief: Encode the HCI event `data` captured at `timestamp` into `out` (HC_FRAME_MAX_SIZE B),
+ *         as a BLZ: frame or, every HC_SYNC_INTERVAL_US, a BLE: frame.
+ * @return: Frame length
+ */
+size_t hc_encode(hc_state_t *state, int64_t timestamp, const uint8_t *data, uint16_t len, uint8_t *out);
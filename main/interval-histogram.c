@@ -0,0 +1,108 @@
+#include <string.h>
+
+#include "interval-histogram.h"
+
+/*
+ * @brief: Index of the bucket holding given interval (ms).
+ */
+static uint8_t bucket_index(uint32_t interval)
+{
+    if (interval < (1u << IH_MIN_EXPONENT)) {
+        return 0;
+    }
+
+    uint8_t exponent = 31 - __builtin_clz(interval);    // floor(log2(interval))
+    uint8_t sub_bucket = (interval >> (exponent - 2)) & (IH_SUB_BUCKETS - 1);
+    uint32_t idx = (exponent - IH_MIN_EXPONENT) * IH_SUB_BUCKETS + sub_bucket;
+
+    return idx < IH_BUCKET_COUNT ? idx : IH_BUCKET_COUNT - 1;
+}
+
+/*
+ * @brief: Lowest interval (ms) belonging to the bucket.
+ */
+static uint32_t bucket_lower_bound(uint8_t idx)
+{
+    uint8_t exponent = idx / IH_SUB_BUCKETS + IH_MIN_EXPONENT;
+    uint8_t sub_bucket = idx % IH_SUB_BUCKETS;
+
+    return (uint32_t)(IH_SUB_BUCKETS + sub_bucket) << (exponent - 2);
+}
+
+void interval_histogram_init(interval_histogram_t *hist, const bd_addr_t addr)
+{
+    memset(hist, 0, sizeof(interval_histogram_t));
+    memcpy(hist->addr, addr, BD_ADDR_LEN);
+    hist->init_cnt = IH_INIT_ELEMENTS;
+    hist->used = 1;
+}
+
+uint32_t interval_histogram_quantile(const interval_histogram_t *hist, uint8_t percent)
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < IH_BUCKET_COUNT; i++) {
+        total += hist->buckets[i];
+    }
+
+    uint32_t rank = (total * percent + 99) / 100;   // Rank of the wanted interval, rounded up
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i < IH_BUCKET_COUNT; i++) {
+        cumulative += hist->buckets[i];
+        if (cumulative >= rank) {
+            // Middle of the bucket
+            return (bucket_lower_bound(i) + bucket_lower_bound(i + 1)) / 2;
+        }
+    }
+
+    return 0;
+}
+
+static void add_interval(interval_histogram_t *hist, uint32_t interval)
+{
+    uint8_t idx = bucket_index(interval);
+
+    if (hist->buckets[idx] + 1 >= IH_DECAY_LIMIT) {
+        for (uint8_t i = 0; i < IH_BUCKET_COUNT; i++) {
+            hist->buckets[i] >>= 1;
+        }
+    }
+    hist->buckets[idx]++;
+}
+
+uint32_t interval_histogram_update(interval_histogram_t *hist, uint32_t timestamp)
+{
+    if (hist->last_seen == 0) {     // First occurrence
+        hist->last_seen = timestamp;
+        return 0;
+    }
+
+    uint32_t silence = timestamp - hist->last_seen;
+    hist->last_seen = timestamp;
+
+    // Intervals shorter than the minimal Low Duty Cycle interval are considered mistakes
+    if (silence < IH_MIN_INTERVAL) {
+        return 0;
+    }
+
+    if (hist->init_cnt > 0) {
+        add_interval(hist, silence);
+        hist->init_cnt--;
+        return 0;
+    }
+
+    // Two missed Advertising messages mean the whole Advertising Event was skipped,
+    // the inter-quantile range takes fluctuations of the interval into account
+    uint32_t threshold = 2 * interval_histogram_quantile(hist, 50)
+                         + interval_histogram_quantile(hist, IH_UPPER_QUANTILE)
+                         - interval_histogram_quantile(hist, IH_LOWER_QUANTILE);
+    if (silence > threshold) {
+        return silence;
+    }
+
+    add_interval(hist, silence);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_hci_common.h"
+
+// Log-bucketed histogram of advertising intervals: 4 buckets per power of two, from 16 ms up to 16 s
+#define IH_MIN_EXPONENT 4   // 2^4 = 16 ms
+#define IH_SUB_BUCKETS 4
+#define IH_BUCKET_COUNT 40
+
+// Minimal interval for low duty cycle advertising (Bluetooth Core 5.4 Vol. 6, Part B, 4.4.2.2.1)
+#define IH_MIN_INTERVAL 20
+
+// Number of intervals collected before the histogram is used for detection
+#define IH_INIT_ELEMENTS 10
+
+// All buckets are halved once any of them reaches this count (exponential decay of older intervals)
+#define IH_DECAY_LIMIT 64
+
+// Quantiles (in percent) used for the threshold: 2 * median + (upper - lower)
+#define IH_LOWER_QUANTILE 10
+#define IH_UPPER_QUANTILE 90
+
+typedef struct {
+    bd_addr_t addr;
+    uint8_t init_cnt;   // Intervals still needed before the model is ready
+    uint8_t used;
+    uint32_t last_seen; // ms
+    uint8_t buckets[IH_BUCKET_COUNT];
+} interval_histogram_t;
+
+/*
+ * @brief: Reset the histogram and assign it to an address.
+ */
+void interval_histogram_init(interval_histogram_t *hist, const bd_addr_t addr);
+
+/*
+ * @brief: Process an advertisement received at `timestamp` (ms).
+ * @return: Duration of the detected silence (ms) if it is considered a connection, 0 otherwise.
+ */
+uint32_t interval_histogram_update(interval_histogram_t *hist, uint32_t timestamp);
+
+/*
+ * @brief: Approximate interval (ms) at quantile `percent` of the histogram.
+ */
+uint32_t interval_histogram_quantile(const interval_histogram_t *hist, uint8_t percent);
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_app_desc.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "probe-control.h"
+#include "probe-diagnostics.h"
+
+static const char *TAG = "PROBE CONTROL";
+
+static uart_port_t control_uart;
+static uint8_t control_channel;
+static char control_mode;
+static volatile uint8_t capturing = 0;
+
+static SemaphoreHandle_t tx_mutex = NULL;
+static uint16_t tx_delays[PC_DELAY_BUCKETS];   // Guarded by the UART lock
+
+void probe_control_tx_lock(void)
+{
+    if (tx_mutex != NULL) {
+        xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    }
+}
+
+void probe_control_tx_unlock(void)
+{
+    if (tx_mutex != NULL) {
+        xSemaphoreGive(tx_mutex);
+    }
+}
+
+/*
+ * @brief: Transmit the identity frame: chip MAC, configured channel, capture mode and firmware build.
+ */
+static void send_identity(void)
+{
+    uint8_t mac[6];
+    ESP_ERROR_CHECK(esp_read_mac(mac, ESP_MAC_BT));
+
+    const esp_app_desc_t *app = esp_app_get_description();
+    char build[sizeof(app->version) + sizeof(app->date) + sizeof(app->time)];
+    int len = snprintf(build, sizeof(build), "%s %s %s", app->version, app->date, app->time);
+    uint8_t build_len = len < (int)sizeof(build) ? len : sizeof(build) - 1;
+
+    probe_control_tx_lock();
+    uart_write_bytes(control_uart, "Ide:", 4);
+    uart_write_bytes(control_uart, (const char*)mac, sizeof(mac));
+    uart_write_bytes(control_uart, (const char*)&control_channel, 1);
+    uart_write_bytes(control_uart, &control_mode, 1);
+    uart_write_bytes(control_uart, (const char*)&build_len, 1);
+    uart_write_bytes(control_uart, build, build_len);
+    probe_control_tx_unlock();
+}
+
+/*
+ * @brief: Transmit the sync frame: current device time (the same clock as the report timestamps) and capture state.
+ */
+static void send_sync(void)
+{
+    probe_control_tx_lock();
+    int64_t timestamp = esp_timer_get_time();   // Taken with the UART locked, so it is sent right away
+    uart_write_bytes(control_uart, "Syn:", 4);
+    uart_write_bytes(control_uart, (const char*)&timestamp, 8);
+    uart_write_bytes(control_uart, (const char*)&control_channel, 1);
+    uart_write_bytes(control_uart, (const char*)&capturing, 1);
+    probe_control_tx_unlock();
+}
+
+void probe_control_record_tx_delay(int64_t callback_time)
+{
+    int64_t delay = esp_timer_get_time() - callback_time;
+    uint8_t bucket = 0;
+    if (delay > 0) {
+        bucket = 64 - __builtin_clzll((uint64_t)delay);    // Bit length of the delay
+        if (bucket >= PC_DELAY_BUCKETS) {
+            bucket = PC_DELAY_BUCKETS - 1;
+        }
+    }
+    if (tx_delays[bucket] < UINT16_MAX) {
+        tx_delays[bucket]++;
+    }
+}
+
+/*
+ * @brief: Transmit the delays counted since the previous delay frame and clear them.
+ */
+static void send_delays(void)
+{
+    probe_control_tx_lock();
+    uart_write_bytes(control_uart, "Lat:", 4);
+    uart_write_bytes(control_uart, (const char*)tx_delays, sizeof(tx_delays));
+    memset(tx_delays, 0, sizeof(tx_delays));
+    probe_control_tx_unlock();
+}
+
+/*
+ * @brief: Transmit the diagnostics frame (task run times, stacks, heap and code section times).
+ */
+static void send_diagnostics(void)
+{
+    probe_control_tx_lock();
+    probe_diagnostics_send(control_uart);
+    probe_control_tx_unlock();
+}
+
+void probe_control_set_capturing(void)
+{
+    capturing = 1;
+}
+
+/*
+ * @brief: Worker process, which reads command lines from the host and executes them
+ */
+static void probe_control_process(void *pvParameters)
+{
+    char command[PC_COMMAND_MAX_LEN];
+    uint8_t len = 0;
+    uint8_t c;
+    int64_t last_sync = 0;
+    int64_t last_diagnostics = 0;
+
+    while (1) {
+        int read = uart_read_bytes(control_uart, &c, 1, pdMS_TO_TICKS(PC_SYNC_INTERVAL_MS));
+
+        if (capturing && esp_timer_get_time() - last_sync >= PC_SYNC_INTERVAL_MS * 1000) {
+            send_sync();
+            send_delays();
+            last_sync = esp_timer_get_time();
+        }
+        if (capturing && esp_timer_get_time() - last_diagnostics >= PD_INTERVAL_MS * 1000) {
+            send_diagnostics();
+            last_diagnostics = esp_timer_get_time();
+        }
+        if (read != 1) {
+            continue;
+        }
+
+        if (c != '\n' && c != '\r') {
+            if (len < PC_COMMAND_MAX_LEN - 1) {
+                command[len++] = c;
+            }
+            continue;
+        }
+        if (len == 0) {
+            continue;
+        }
+        command[len] = '\0';
+        len = 0;
+
+        if (strcmp(command, PC_IDENTIFY_CMD) == 0) {
+            send_identity();
+        } else if (strcmp(command, PC_SYNC_CMD) == 0) {
+            send_sync();
+        } else if (strcmp(command, PC_DIAGNOSTICS_CMD) == 0) {
+            send_diagnostics();
+        } else if (strcmp(command, PC_RESET_CMD) == 0) {
+            ESP_LOGI(TAG, "Restart requested by the host");
+            esp_restart();
+        } else {
+            ESP_LOGD(TAG, "Unknown command %s", command);
+        }
+    }
+}
+
+void probe_control_start(uart_port_t uart_num, uint8_t channel, char mode)
+{
+    control_uart = uart_num;
+    control_channel = channel;
+    control_mode = mode;
+
+    tx_mutex = xSemaphoreCreateMutex();
+    if (tx_mutex == NULL) {
+        ESP_LOGE(TAG, "Cannot create the UART transmission mutex.");
+        return;
+    }
+
+    // Low priority, commands are rare and never time critical
+    // 3072 B of stack for the diagnostics, its high-water mark is in the diagnostics frames
+    xTaskCreatePinnedToCore(&probe_control_process, "Probe Control", 3072, NULL, 2, NULL, tskNO_AFFINITY);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "driver/uart.h"
+
+// Commands are received from the host as text lines
+#define PC_COMMAND_MAX_LEN 16
+#define PC_IDENTIFY_CMD "ID?"   // Answered by an identity frame
+#define PC_RESET_CMD "RST"      // Restart of the probe, for hosts without control of the DTR line
+#define PC_SYNC_CMD "SYN?"      // Answered by a sync frame, lets the host attach to a running capture
+#define PC_DIAGNOSTICS_CMD "DIA?"   // Answered by a diagnostics frame (see probe-diagnostics.h)
+
+// Sync frames are also sent periodically during the capture, so the host keeps its clock offset up to date
+#define PC_SYNC_INTERVAL_MS 1000
+
+// Delay from the capture callback to the UART transmission, counted in power of two buckets of microseconds
+// (bucket 0: below 1 us, bucket i: [2^(i-1), 2^i) us, the last one everything longer) and sent after every
+// periodic sync frame, then cleared
+#define PC_DELAY_BUCKETS 24
+
+// Capture modes reported in the identity frame
+#define PC_MODE_ADVERTISING 'A'
+#define PC_MODE_RAW 'R'
+
+/*
+ * @brief: Start the task answering host commands received on the UART.
+ *         Identity frame format: Ide:{Chip MAC (6 B)},{Channel (1 B)},{Mode (1 B)},{Build length (1 B)},{Build}
+ */
+void probe_control_start(uart_port_t uart_num, uint8_t channel, char mode);
+
+/*
+ * @brief: Mark the capture as running, from now on the periodic sync frames are sent.
+ *         Sync frame format: Syn:{Timestamp (8 B)},{Channel (1 B)},{Capturing (1 B)}
+ */
+void probe_control_set_capturing(void);
+
+/*
+ * @brief: Count the delay of a frame from its capture callback (`callback_time`, esp_timer_get_time) to now,
+ *         to be called with the UART locked right before the frame is written.
+ *         Delay frame format: Lat:{Counts (PC_DELAY_BUCKETS x 2 B)}
+ */
+void probe_control_record_tx_delay(int64_t callback_time);
+
+/*
+ * @brief: Exclusive access to the UART transmission, so frames of different tasks never interleave.
+ */
+void probe_control_tx_lock(void);
+void probe_control_tx_unlock(void);
@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "probe-diagnostics.h"
+
+static const char *TAG = "PROBE DIAGNOSTICS";
+
+typedef struct {
+    uint32_t executions;
+    uint32_t total;     // Microseconds
+    uint32_t longest;   // Microseconds
+} pd_timing_t;
+
+static pd_timing_t timings[PD_SECTION_COUNT];
+static portMUX_TYPE timings_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void probe_diagnostics_add(pd_section_t section, int64_t start)
+{
+    uint32_t duration = (uint32_t)(esp_timer_get_time() - start);
+
+    portENTER_CRITICAL_SAFE(&timings_mux);
+    timings[section].executions++;
+    timings[section].total += duration;
+    if (duration > timings[section].longest) {
+        timings[section].longest = duration;
+    }
+    portEXIT_CRITICAL_SAFE(&timings_mux);
+}
+
+static void write_u32(uart_port_t uart_num, uint32_t value)
+{
+    uart_write_bytes(uart_num, (const char*)&value, 4);
+}
+
+void probe_diagnostics_send(uart_port_t uart_num)
+{
+    int64_t timestamp = esp_timer_get_time();
+    pd_timing_t sections[PD_SECTION_COUNT];
+
+    portENTER_CRITICAL(&timings_mux);
+    memcpy(sections, timings, sizeof(timings));
+    memset(timings, 0, sizeof(timings));
+    portEXIT_CRITICAL(&timings_mux);
+
+    uart_write_bytes(uart_num, "Dia:", 4);
+    uart_write_bytes(uart_num, (const char*)&timestamp, 8);
+    write_u32(uart_num, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    write_u32(uart_num, heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+    write_u32(uart_num, heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    uint8_t section_count = PD_SECTION_COUNT;
+    uart_write_bytes(uart_num, (const char*)&section_count, 1);
+    uart_write_bytes(uart_num, (const char*)sections, sizeof(sections));
+
+    uint32_t total_run_time = 0;
+    uint8_t task_count = 0;
+#if configUSE_TRACE_FACILITY
+    // On the heap, a status is about 40 B and the caller's stack is small
+    TaskStatus_t *tasks = (TaskStatus_t *)malloc(sizeof(TaskStatus_t) * PD_MAX_TASKS);
+    if (tasks == NULL) {
+        ESP_LOGE(TAG, "Cannot allocate heap for the task statuses.");
+    } else {
+        // Returns 0 if there are more tasks than statuses
+        task_count = uxTaskGetSystemState(tasks, PD_MAX_TASKS, &total_run_time);
+    }
+#else
+    ESP_LOGD(TAG, "Task statistics need CONFIG_FREERTOS_USE_TRACE_FACILITY.");
+#endif
+
+    write_u32(uart_num, total_run_time);
+    uart_write_bytes(uart_num, (const char*)&task_count, 1);
+
+#if configUSE_TRACE_FACILITY
+    for (uint8_t i = 0; i < task_count; i++) {
+        uint8_t name_len = strnlen(tasks[i].pcTaskName, configMAX_TASK_NAME_LEN);
+        BaseType_t affinity = xTaskGetAffinity(tasks[i].xHandle);
+        uint8_t core = affinity == tskNO_AFFINITY ? 0xFF : (uint8_t)affinity;
+        uint8_t priority = tasks[i].uxCurrentPriority;
+#if configGENERATE_RUN_TIME_STATS
+        uint32_t run_time = tasks[i].ulRunTimeCounter;
+#else
+        uint32_t run_time = 0;
+#endif
+
+        uart_write_bytes(uart_num, (const char*)&name_len, 1);
+        uart_write_bytes(uart_num, tasks[i].pcTaskName, name_len);
+        uart_write_bytes(uart_num, (const char*)&core, 1);
+        uart_write_bytes(uart_num, (const char*)&priority, 1);
+        write_u32(uart_num, tasks[i].usStackHighWaterMark);    // Bytes, the ESP-IDF stacks are counted in bytes
+        write_u32(uart_num, run_time);
+    }
+    free(tasks);
+#endif
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "driver/uart.h"
+
+// Diagnostics frames are sent periodically during the capture
+#define PD_INTERVAL_MS 10000
+#define PD_MAX_TASKS 24     // Tasks reported at most, the ESP32 runs about 15 with Bluetooth
+
+// Code sections whose execution time is measured
+typedef enum {
+    PD_SECTION_CALLBACK = 0,    // controller_out_rdy(), in the Bluetooth controller task
+    PD_SECTION_PARSER,          // Parsing and transmission of a HCI event by the processing task
+    PD_SECTION_COUNT
+} pd_section_t;
+
+/*
+ * @brief: Add the execution of a code section started at `start` (esp_timer_get_time) and ending now.
+ *         Safe to call from any task and core.
+ */
+void probe_diagnostics_add(pd_section_t section, int64_t start);
+
+/*
+ * @brief: Transmit the diagnostics frame, to be called with the UART locked. The section times are cleared.
+ *         Diagnostics frame format (little endian):
+ *           Dia:{Timestamp (8 B)},{Free heap (4 B)},{Minimum free heap (4 B)},{Largest free block (4 B)},
+ *               {Section count (1 B)}, per section: {Executions (4 B)},{Total time us (4 B)},{Longest time us (4 B)},
+ *               {Total run time (4 B)},{Task count (1 B)},
+ *               per task: {Name length (1 B)},{Name},{Core affinity (1 B, 0xFF none)},{Priority (1 B)},
+ *                         {Stack high-water mark B (4 B)},{Run time (4 B)}
+ *         Run times are in microseconds of the esp_timer (modulo 2^32), the CPU load of a task is the difference
+ *         of its run time between two frames over the difference of the total run time. Without the FreeRTOS
+ *         run time statistics, the run times are 0, without the trace facility no task is reported.
+ */
+void probe_diagnostics_send(uart_port_t uart_num);
@@ -0,0 +1,280 @@
+#!/usr/bin/env python
+
+import argparse
+import collections
+import csv
+import heapq
+import io
+import itertools
+import multiprocessing
+import operator
+import os
+import pathlib
+import pickle
+import resource
+import sys
+import tempfile
+import time
+
+from datetime import datetime
+
+__MEMORY__ = 512            # MiB the sort may use in total (workers and merge)
+__BLOCK_FOOTPRINT__ = 20    # Bytes of memory per byte of a block in flight: its rows in the worker (~14) and copies
+__BATCH_ROWS__ = 1024       # Rows pickled together in a run file, the read buffer of a run during the merge
+__MAX_FAN_IN__ = 128        # Runs merged at once, more are first merged into longer runs
+__ROW_SIZE__ = 1024         # Bytes of memory per row read from a run (tuple of strings and the pickled batch)
+__READ_SIZE__ = 1 << 20     # Bytes read at once while splitting the inputs into blocks
+
+
+def sortKey(timestamp):
+    """
+    Microseconds since the epoch of a capture timestamp (ISO time, or milliseconds as in the synthetic captures)
+    """
+    if timestamp.isdigit():
+        return int(timestamp) * 1000
+    return round(datetime.fromisoformat(timestamp).timestamp() * 1000000)
+
+
+def readHeader(path):
+    with open(path, newline='') as captureFile:
+        return next(csv.reader(captureFile), [])
+
+
+def readBlocks(path, blockSize):
+    """
+    Generate the rows of a capture (without its header) in blocks of about `blockSize` bytes of whole rows:
+    a block ends at a line end outside of the quoted fields (even number of quotes)
+    """
+    with open(path, 'rb') as captureFile:
+        captureFile.readline()  # Header
+        block = bytearray()
+        quotes = 0
+        while True:
+            data = captureFile.read(__READ_SIZE__)
+            if not data:
+                if block:
+                    yield bytes(block)
+                return
+            start = len(block)
+            block += data
+            quotes += data.count(b'"')
+            if len(block) < blockSize:
+                continue
+            # Cut at the last line end after which the quotes are balanced
+            cut = len(block)
+            trailingQuotes = 0
+            while True:
+                cut = block.rfind(b'\n', start, cut)
+                if cut < 0:
+                    break
+                trailingQuotes = block.count(b'"', cut + 1)
+                if (quotes - trailingQuotes) % 2 == 0:
+                    break
+            if cut < 0:
+                continue    # No row end in the new data yet
+            yield bytes(block[:cut + 1])
+            del block[:cut + 1]
+            quotes = trailingQuotes
+
+
+def sortBlock(task):
+    """
+    Worker: parse a block, sort its rows by time and store them as a run file
+    :return: (Run path, rows, rows with an invalid timestamp)
+    """
+    block, inputFields, outputFields, runDirectory, runIndex = task
+    # Output columns missing in this input are taken from an empty value appended to the row
+    positions = [inputFields.index(field) if field in inputFields else len(inputFields) for field in outputFields]
+    select = operator.itemgetter(*positions) if len(positions) > 1 else lambda values: (values[positions[0]],)
+    timestampPosition = inputFields.index('Timestamp')
+    rows = []
+    invalid = 0
+    for values in csv.reader(io.StringIO(block.decode('utf-8', errors='replace'), newline='')):
+        if len(values) != len(inputFields):
+            invalid += 1
+            continue
+        try:
+            key = sortKey(values[timestampPosition])
+        except ValueError:
+            invalid += 1
+            continue
+        values.append('')
+        rows.append((key, select(values)))
+    rows.sort(key=lambda row: row[0])
+
+    runPath = pathlib.Path(runDirectory, f'run-{runIndex:06d}')
+    writeRun(runPath, rows)
+    return str(runPath), len(rows), invalid
+
+
+def writeRun(path, rows):
+    with open(path, 'wb') as runFile:
+        batch = []
+        for row in rows:
+            batch.append(row)
+            if len(batch) >= __BATCH_ROWS__:
+                pickle.dump(batch, runFile, pickle.HIGHEST_PROTOCOL)
+                batch = []
+        if batch:
+            pickle.dump(batch, runFile, pickle.HIGHEST_PROTOCOL)
+
+
+def readRun(path):
+    with open(path, 'rb') as runFile:
+        while True:
+            try:
+                batch = pickle.load(runFile)
+            except EOFError:
+                return
+            yield from batch
+
+
+def mergeRuns(paths):
+    """
+    Rows of the sorted runs in time order (stable: the runs of earlier inputs first on equal times)
+    """
+    return heapq.merge(*(readRun(path) for path in paths), key=lambda row: row[0])
+
+
+def deduplicate(rows):
+    """
+    Drop the repeated rows, the same record from several input files has the same time and values
+    """
+    currentKey = None
+    seen = set()
+    for row in rows:
+        if row[0] != currentKey:
+            currentKey = row[0]
+            seen.clear()
+        elif row[1] in seen:
+            continue
+        seen.add(row[1])
+        yield row
+
+
+class CaptureSorter:
+    """
+    Globally time-ordered merge of capture files in bounded memory: the inputs are split into blocks which
+    worker processes sort into run files (sorted runs, in parallel), the runs are then merged k-way, with
+    intermediate merges when there are more of them than fit in the memory (at most __MAX_FAN_IN__).
+    """
+
+    def __init__(self, memory=__MEMORY__, jobs=None, temporaryDirectory=None):
+        self.jobs = jobs or multiprocessing.cpu_count()
+        # Every worker sorts one block while the reader prepares the next one
+        self.blockSize = max(1 << 20, memory * 1024 * 1024 // ((self.jobs + 1) * __BLOCK_FOOTPRINT__))
+        # Runs merged at once, their read buffers fit in half of the memory
+        self.fanIn = max(2, min(__MAX_FAN_IN__, memory * 1024 * 1024 // (2 * __BATCH_ROWS__ * __ROW_SIZE__)))
+        self.temporaryDirectory = temporaryDirectory
+        self.rows = 0
+        self.invalid = 0
+        self.duplicates = 0
+        self.runs = 0
+        self.bytes = 0
+
+    def sort(self, inputs, output, deduplicated=False):
+        headers = [readHeader(path) for path in inputs]
+        for path, header in zip(inputs, headers):
+            if 'Timestamp' not in header:
+                raise ValueError(f"{path} is not a capture (no Timestamp column).")
+        outputFields = list(dict.fromkeys(itertools.chain.from_iterable(headers)))
+
+        with tempfile.TemporaryDirectory(prefix='merge-captures-', dir=self.temporaryDirectory) as runDirectory:
+            runs = self._generateRuns(inputs, headers, outputFields, runDirectory)
+            runs = self._reduceRuns(runs, runDirectory)
+
+            rows = mergeRuns(runs)
+            if deduplicated:
+                rows = deduplicate(rows)
+            written = itertools.count()
+            with open(output, 'w', newline='') as outputFile:
+                writer = csv.writer(outputFile)
+                writer.writerow(outputFields)
+                writer.writerows(values for (key, values), _ in zip(rows, written))
+            self.duplicates = self.rows - next(written)
+
+    def _generateRuns(self, inputs, headers, outputFields, runDirectory):
+        runs = []
+        pending = collections.deque()
+        with multiprocessing.Pool(self.jobs) as pool:
+            index = 0
+            for path, header in zip(inputs, headers):
+                self.bytes += os.path.getsize(path)
+                for block in readBlocks(path, self.blockSize):
+                    if len(pending) >= self.jobs:   # Bounded read ahead
+                        self._collect(pending.popleft().get(), runs)
+                    pending.append(pool.apply_async(sortBlock, ((block, header, outputFields, runDirectory, index),)))
+                    index += 1
+            while pending:
+                self._collect(pending.popleft().get(), runs)
+        return runs
+
+    def _collect(self, result, runs):
+        runPath, rows, invalid = result
+        runs.append(runPath)
+        self.runs += 1
+        self.rows += rows
+        self.invalid += invalid
+
+    def _reduceRuns(self, runs, runDirectory):
+        generation = 0
+        while len(runs) > self.fanIn:
+            merged = []
+            for start in range(0, len(runs), self.fanIn):
+                path = pathlib.Path(runDirectory, f'merged-{generation}-{start:06d}')
+                writeRun(path, mergeRuns(runs[start:start + self.fanIn]))
+                for run in runs[start:start + self.fanIn]:
+                    os.remove(run)
+                merged.append(str(path))
+            runs = merged
+            generation += 1
+        return runs
+
+
+def peakMemory():
+    """
+    Peak resident memory (MiB) of this process and of its largest worker
+    """
+    own = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024
+    workers = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss / 1024
+    return own, workers
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Merge capture files into a single time-ordered capture in bounded memory',
+    )
+    _parser.add_argument("inputs", nargs='+', metavar='CAPTURE')
+    _parser.add_argument('-o', '--output', metavar='OUT', required=True,
+                         help='File where the merged capture will be stored. Will be overwritten.')
+    _parser.add_argument('-d', '--deduplicate',
+                         action='store_true',
+                         help='Drop the rows repeated across the inputs (same time and values)')
+    _parser.add_argument('-m', '--memory', type=int, metavar='MIB',
+                         help='Memory the sort buffers may use, besides the interpreters'
+                              ' [Default: ' + str(__MEMORY__) + ' MiB]',
+                         default=__MEMORY__)
+    _parser.add_argument('-j', '--jobs', type=int,
+                         help='Number of worker processes sorting the runs [Default: number of CPUs]',
+                         default=multiprocessing.cpu_count())
+    _parser.add_argument('-t', '--temp-dir', metavar='DIR',
+                         help='Directory of the sorted runs, needs the size of the inputs [Default: system temporary]')
+    _args = _parser.parse_args()
+
+    _sorter = CaptureSorter(_args.memory, _args.jobs, _args.temp_dir)
+    _start = time.perf_counter()
+    try:
+        _sorter.sort(_args.inputs, _args.output, _args.deduplicate)
+    except ValueError as e:
+        print(e, file=sys.stderr)
+        raise SystemExit(1)
+    _duration = time.perf_counter() - _start
+
+    _own, _workers = peakMemory()
+    print(f"{_sorter.rows} rows from {len(_args.inputs)} files in {_sorter.runs} runs, {_duration:.1f} s"
+          f" ({_sorter.rows / _duration:.0f} rows/s, {_sorter.bytes / _duration / 1024 / 1024:.1f} MiB/s)")
+    if _args.deduplicate:
+        print(f"{_sorter.duplicates} duplicate rows dropped")
+    if _sorter.invalid:
+        print(f"{_sorter.invalid} rows without a valid timestamp dropped", file=sys.stderr)
+    print(f"Peak memory: {_own:.0f} MiB (merge), {_workers:.0f} MiB (largest worker)")
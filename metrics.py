@@ -0,0 +1,227 @@
+import http.server
+import os
+import pathlib
+import threading
+
+__SUB_BUCKET_BITS__ = 8     # 256 sub-buckets, every value is kept within 1/128 (better than 1 %)
+__PREALLOCATED_RANGE__ = 1 << 32    # Buckets allocated upfront, up to more than an hour in microseconds
+__QUANTILES__ = (0.5, 0.9, 0.99, 0.999)
+__EXPORT_INTERVAL__ = 10    # Seconds between two writes of the metrics file
+
+
+class HdrHistogram:
+    """
+    High dynamic range histogram (as HdrHistogram): values are counted in linear sub-buckets within
+    power of two buckets, so the relative precision is the same from microseconds to hours and recording
+    an integer value costs a handful of operations.
+    """
+
+    def __init__(self, subBucketBits=__SUB_BUCKET_BITS__):
+        self._subBits = subBucketBits
+        self._halfBits = subBucketBits - 1
+        self._subCount = 1 << subBucketBits
+        self.counts = [0] * (self._index(__PREALLOCATED_RANGE__) + 1)
+        self.count = 0
+        self.total = 0
+        self.max = 0
+
+    def _index(self, value):
+        if value < self._subCount:
+            return value
+        shift = value.bit_length() - self._subBits
+        return (shift << self._halfBits) + (value >> shift)
+
+    def _highestEquivalent(self, index):
+        """
+        Largest value counted in the bucket `index`
+        """
+        if index < self._subCount:
+            return index
+        shift = (index >> self._halfBits) - 1
+        return (((index - (shift << self._halfBits)) + 1) << shift) - 1
+
+    def recordValue(self, value, count=1):
+        if value < 0:   # Clock estimates may place an event marginally before its cause
+            value = 0
+        if value < self._subCount:
+            index = value
+        else:
+            shift = value.bit_length() - self._subBits
+            index = (shift << self._halfBits) + (value >> shift)
+        try:
+            self.counts[index] += count
+        except IndexError:
+            self.counts.extend([0] * (index + 1 - len(self.counts)))
+            self.counts[index] += count
+        self.count += count
+        self.total += value * count
+        if value > self.max:
+            self.max = value
+
+    def add(self, other):
+        if len(other.counts) > len(self.counts):
+            self.counts.extend([0] * (len(other.counts) - len(self.counts)))
+        for index, count in enumerate(other.counts):
+            self.counts[index] += count
+        self.count += other.count
+        self.total += other.total
+        self.max = max(self.max, other.max)
+
+    def valueAtQuantile(self, quantile):
+        if not self.count:
+            return 0
+        rank = max(self.count * quantile, 1)
+        seen = 0
+        for index, count in enumerate(self.counts):
+            seen += count
+            if seen >= rank:
+                return min(self._highestEquivalent(index), self.max)
+        return self.max
+
+    def mean(self):
+        return self.total / self.count if self.count else 0
+
+
+class Counter:
+
+    def __init__(self):
+        self.value = 0
+
+
+def _escape(value):
+    return str(value).replace('\\', '\\\\').replace('"', '\\"').replace('\n', '\\n')
+
+
+def _labels(labels, **extra):
+    labels = dict(labels, **extra)
+    if not labels:
+        return ''
+    return '{' + ','.join(f'{key}="{_escape(value)}"' for key, value in labels.items()) + '}'
+
+
+class MetricsRegistry:
+    """
+    Latency histograms, throughput counters and computed gauges, rendered in the Prometheus text format.
+    Every probe thread updates only its own series, the exporter reads them without locking.
+    """
+
+    def __init__(self, prefix):
+        self.prefix = prefix
+        self._lock = threading.Lock()   # Creation of series only
+        self._histograms = {}   # Name -> (help, {labels tuple -> HdrHistogram})
+        self._counters = {}     # Name -> (help, {labels tuple -> Counter})
+        self._gauges = {}       # Name -> (help, function returning the [(labels dict, value)] of the series)
+
+    def histogram(self, name, description, **labels):
+        """
+        Histogram of microsecond values, exported in seconds
+        """
+        with self._lock:
+            series = self._histograms.setdefault(name, (description, {}))[1]
+            return series.setdefault(tuple(labels.items()), HdrHistogram())
+
+    def counter(self, name, description, **labels):
+        with self._lock:
+            series = self._counters.setdefault(name, (description, {}))[1]
+            return series.setdefault(tuple(labels.items()), Counter())
+
+    def gauges(self, name, description, collect):
+        """
+        Gauges computed at every export, for series which come and go (e.g. the heaviest advertisers)
+        """
+        with self._lock:
+            self._gauges[name] = (description, collect)
+
+    def render(self):
+        lines = []
+        with self._lock:
+            histograms = [(name, description, list(series.items()))
+                          for name, (description, series) in self._histograms.items()]
+            counters = [(name, description, list(series.items()))
+                        for name, (description, series) in self._counters.items()]
+            gauges = list(self._gauges.items())
+
+        for name, description, series in histograms:
+            metric = f'{self.prefix}_{name}_seconds'
+            lines.append(f'# HELP {metric} {description}')
+            lines.append(f'# TYPE {metric} summary')
+            for labels, histogram in series:
+                labels = dict(labels)
+                for quantile in __QUANTILES__:
+                    value = histogram.valueAtQuantile(quantile) / 1000000
+                    lines.append(f'{metric}{_labels(labels, quantile=quantile)} {value:.6f}')
+                lines.append(f'{metric}_sum{_labels(labels)} {histogram.total / 1000000:.6f}')
+                lines.append(f'{metric}_count{_labels(labels)} {histogram.count}')
+
+        for name, description, series in counters:
+            metric = f'{self.prefix}_{name}_total'
+            lines.append(f'# HELP {metric} {description}')
+            lines.append(f'# TYPE {metric} counter')
+            for labels, counter in series:
+                lines.append(f'{metric}{_labels(dict(labels))} {counter.value}')
+
+        for name, (description, collect) in gauges:
+            metric = f'{self.prefix}_{name}'
+            lines.append(f'# HELP {metric} {description}')
+            lines.append(f'# TYPE {metric} gauge')
+            for labels, value in collect():
+                lines.append(f'{metric}{_labels(labels)} {value}')
+        return '\n'.join(lines) + '\n'
+
+
+class MetricsExporter:
+    """
+    Periodically writes the metrics to a file (atomically, for the node exporter textfile collector)
+    and serves them at http://127.0.0.1:port/metrics
+    """
+
+    def __init__(self, registry, path=None, port=None, interval=__EXPORT_INTERVAL__):
+        self.registry = registry
+        self.path = pathlib.Path(path) if path is not None else None
+        self.interval = interval
+        self._stop = threading.Event()
+        self._server = None
+
+        if port is not None:
+            exporter = self
+
+            class Handler(http.server.BaseHTTPRequestHandler):
+
+                def do_GET(self):
+                    if self.path != '/metrics':
+                        self.send_error(404)
+                        return
+                    body = exporter.registry.render().encode('utf8')
+                    self.send_response(200)
+                    self.send_header('Content-Type', 'text/plain; version=0.0.4')
+                    self.send_header('Content-Length', str(len(body)))
+                    self.end_headers()
+                    self.wfile.write(body)
+
+                def log_message(self, format, *args):
+                    pass
+
+            self._server = http.server.ThreadingHTTPServer(('127.0.0.1', port), Handler)
+            self._server.daemon_threads = True
+            threading.Thread(target=self._server.serve_forever, daemon=True).start()
+
+        if self.path is not None:
+            self.path.parent.mkdir(parents=True, exist_ok=True)
+            threading.Thread(target=self._exportPeriodically, daemon=True).start()
+
+    def write(self):
+        temporary = self.path.with_name(self.path.name + '.tmp')
+        temporary.write_text(self.registry.render())
+        os.replace(temporary, self.path)
+
+    def _exportPeriodically(self):
+        while not self._stop.wait(self.interval):
+            self.write()
+
+    def close(self):
+        self._stop.set()
+        if self.path is not None:
+            self.write()
+        if self._server is not None:
+            self._server.shutdown()
+            self._server.server_close()
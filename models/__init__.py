@@ -1,5 +1,44 @@
 from .model import Model
 from .model import ModelInitialised, ConnectionAlert
+from .model import parseTimestamp
 
 from .simple_statistics import SimpleStatisticsModel
 from .sliding_window import SlidingWindowModel
+from .sliding_quantile import SlidingQuantileModel
+from .interval_histogram import IntervalHistogramModel
+
+MODELS = {
+    'simple_statistics': SimpleStatisticsModel,
+    'sliding_window': SlidingWindowModel,
+    'sliding_quantile': SlidingQuantileModel,
+    'interval_histogram': IntervalHistogramModel,
+}
+
+
+def parameterValue(value):
+    """
+    Model parameter given as text: an integer if it is one, a float otherwise
+    """
+    try:
+        return int(value)
+    except ValueError:
+        return float(value)
+
+
+def modelFactory(spec):
+    """
+    Create a model factory from a specification "name[:parameter=value,...]", e.g. "sliding_window:windowSize=21"
+    """
+    name, _, params = spec.partition(':')
+    try:
+        model = MODELS[name]
+    except KeyError:
+        raise ValueError(f"Unknown detector {name}.")
+
+    kwargs = {}
+    for param in filter(None, params.split(',')):
+        key, _, value = param.partition('=')
+        kwargs[key] = parameterValue(value)
+
+    model(**kwargs)  # Validate the parameters
+    return lambda: model(**kwargs)
@@ -0,0 +1,127 @@
+import struct
+
+from .model import Model
+from .model import ModelInitialised, ConnectionAlert
+from .model import parseTimestamp
+
+
+class IntervalHistogramModel(Model):
+    """
+    Fixed-memory model keeping a log-bucketed histogram of the intervals with exponential decay.
+
+    Mirrors the on-probe implementation in main/interval-histogram.c, which uses 52 B per device.
+    """
+
+    # According to Bluetooth specification, minimal interval for low duty cycle advertising is 20 ms
+    BLE_LowDutyCycle_MinInterval = 20
+
+    # 4 buckets per power of two, from 16 ms up to 16 s
+    MinExponent = 4
+    SubBuckets = 4
+    BucketCount = 40
+
+    def __init__(self, initElements=10, decayLimit=64, lowerQuantile=0.1, upperQuantile=0.9):
+        self.initElements = initElements
+        self.decayLimit = decayLimit  # All buckets are halved once any of them reaches this count
+        self.lowerQuantile = lowerQuantile
+        self.upperQuantile = upperQuantile
+        self.buckets = bytearray(self.BucketCount)
+        self.lastSeen = 0
+        super().__init__()
+
+    @classmethod
+    def bucketIndex(cls, interval):
+        if interval < (1 << cls.MinExponent):
+            return 0
+        exponent = interval.bit_length() - 1
+        subBucket = (interval >> (exponent - 2)) & (cls.SubBuckets - 1)
+        return min((exponent - cls.MinExponent) * cls.SubBuckets + subBucket, cls.BucketCount - 1)
+
+    @classmethod
+    def bucketLowerBound(cls, idx):
+        exponent = idx // cls.SubBuckets + cls.MinExponent
+        return (cls.SubBuckets + idx % cls.SubBuckets) << (exponent - 2)
+
+    def isReady(self):
+        return self.initElements <= 0
+
+    def quantiles(self, *qs):
+        """
+        Middles of the buckets holding the intervals at ascending quantiles `qs`, computed in a single pass
+        """
+        total = sum(self.buckets)
+        ranks = [max(-(-total * round(q * 100) // 100), 1) for q in qs]  # Rounded up, as on the probe
+        result = []
+        cumulative = 0
+        for idx, count in enumerate(self.buckets):
+            cumulative += count
+            while len(result) < len(ranks) and cumulative >= ranks[len(result)]:
+                result.append((self.bucketLowerBound(idx) + self.bucketLowerBound(idx + 1)) // 2)
+            if len(result) == len(ranks):
+                break
+        return result + [0] * (len(ranks) - len(result))
+
+    def threshold(self):
+        # Two missed Advertising messages mean the whole Advertising Event was skipped,
+        # the inter-quantile range takes fluctuations of the interval into account
+        lower, median, upper = self.quantiles(self.lowerQuantile, 0.5, self.upperQuantile)
+        return 2 * median + upper - lower
+
+    def addInterval(self, interval):
+        idx = self.bucketIndex(interval)
+        if self.buckets[idx] + 1 >= self.decayLimit:
+            for i in range(self.BucketCount):
+                self.buckets[i] >>= 1
+        self.buckets[idx] += 1
+
+    def processAdv(self, timestamp):
+
+        timestamp = parseTimestamp(timestamp)
+
+        if timestamp == 0:
+            raise RuntimeWarning("Invalid timestamp")
+
+        if self.lastSeen == 0:  # First occurrence
+            self.lastSeen = timestamp
+            return
+
+        silenceDuration = timestamp - self.lastSeen
+        self.lastSeen = timestamp
+
+        # Intervals shorter than minimal Low Duty Cycle interval are considered mistakes (see SlidingWindowModel)
+        if silenceDuration < self.BLE_LowDutyCycle_MinInterval:
+            return
+
+        if not self.isReady():  # Still initialising
+            self.addInterval(silenceDuration)
+            self.initElements -= 1
+            if self.isReady():
+                self._initState = str(self.quantiles(0.5)[0]) + "," + str(self.threshold())
+                raise ModelInitialised()
+            return
+
+        if silenceDuration > self.threshold():
+            raise ConnectionAlert(timestamp, silenceDuration)
+
+        self.addInterval(silenceDuration)
+
+    def deadline(self):
+        if not self.isReady():
+            return None
+        return self.lastSeen + self.threshold()
+
+    def stateStruct(self):
+        return struct.Struct(f'<qi{self.BucketCount}s')
+
+    def packState(self):
+        return self.stateStruct().pack(self.lastSeen, self.initElements, bytes(self.buckets))
+
+    def unpackState(self, buffer, offset=0):
+        self.lastSeen, self.initElements, buckets = self.stateStruct().unpack_from(buffer, offset)
+        self.buckets = bytearray(buckets)
+
+    def headerStr(self):
+        return "lastTimestamp,median,threshold"
+
+    def __str__(self):
+        return str(self.lastSeen) + "," + str(self.quantiles(0.5)[0]) + "," + str(self.threshold())
@@ -7,6 +7,17 @@ class ConnectionAlert(Exception):
     self.duration  = duration
     super().__init__(str(timestamp) + " - A connection of " + str(duration) + " ms has been detected.")
 
+def parseTimestamp(timestamp):
+  """
+  Convert a capture timestamp (milliseconds or ISO time) to milliseconds
+  """
+  try:
+    return int(timestamp)
+  except ValueError:
+    time = timestamp.split('T')[1]
+    hours, minutes, sec = time.split(':')
+    return int(float(sec) * 1000) + int(minutes) * 60000 + int(hours) * 3600000
+
 class Model:
   def __init__(self):
     self._initState = "Uninitialised"
@@ -17,6 +28,30 @@ class Model:
   def isReady(self):
     pass
 
+  def skipSilence(self):
+    """
+    Forget the last advertisement, so the silence across a capture outage is not measured
+    """
+    self.lastSeen = 0
+
+  def deadline(self):
+    """
+    Time (ms) after which a missing advertisement is considered a connection, None if not known
+    """
+    return None
+
+  def stateStruct(self):
+    """
+    Fixed-size binary layout of the model state (depends only on the model parameters)
+    """
+    raise NotImplementedError()
+
+  def packState(self):
+    raise NotImplementedError()
+
+  def unpackState(self, buffer, offset=0):
+    raise NotImplementedError()
+
   def headerStr(self):
     return "Model state header"
 
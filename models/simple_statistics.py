@@ -1,11 +1,15 @@
+import struct
+
 from .model import Model
 from .model import ModelInitialised, ConnectionAlert
+from .model import parseTimestamp
 
 
 class SimpleStatisticsModel(Model):
-    def __init__(self):
+    def __init__(self, initElements=10, thresholdFactor=2):
         self.currThreshold = 0
-        self.initElements = 10
+        self.initElements = initElements
+        self.thresholdFactor = thresholdFactor
         self.lastSeen = 0
         self.silenceMidpoint = 0
         super().__init__()
@@ -15,12 +19,7 @@ class SimpleStatisticsModel(Model):
 
     def processAdv(self, timestamp):
 
-        try:
-            timestamp = int(timestamp)
-        except ValueError:
-            time = timestamp.split('T')[1]
-            hours, minutes, sec = time.split(':')
-            timestamp = int(float(sec) * 1000) + int(minutes) * 60000 + int(hours) * 3600000
+        timestamp = parseTimestamp(timestamp)
 
         if timestamp == 0:
             raise RuntimeWarning("Invalid timestamp")
@@ -48,12 +47,27 @@ class SimpleStatisticsModel(Model):
                 raise ModelInitialised()
 
         else:
-            if silenceDelta > 2 * self.currThreshold:
+            if silenceDelta > self.thresholdFactor * self.currThreshold:
                 raise ConnectionAlert(timestamp, silenceDuration)
             else:
                 self.silenceMidpoint = (self.silenceMidpoint + silenceDuration) / 2
                 self.currThreshold = silenceDelta if (silenceDelta > self.currThreshold) else self.currThreshold
 
+    def deadline(self):
+        if not self.isReady():
+            return None
+        return self.lastSeen + self.silenceMidpoint + self.thresholdFactor * self.currThreshold
+
+    def stateStruct(self):
+        return struct.Struct('<qddi')
+
+    def packState(self):
+        return self.stateStruct().pack(self.lastSeen, self.silenceMidpoint, self.currThreshold, self.initElements)
+
+    def unpackState(self, buffer, offset=0):
+        self.lastSeen, self.silenceMidpoint, self.currThreshold, self.initElements = \
+            self.stateStruct().unpack_from(buffer, offset)
+
     def headerStr(self):
         return "lastTimestamp,midpoint,threshold"
 
@@ -0,0 +1,110 @@
+import bisect
+import struct
+
+from collections import deque
+
+from .model import Model
+from .model import ModelInitialised, ConnectionAlert
+from .model import parseTimestamp
+
+
+class SlidingQuantileModel(Model):
+
+    # According to Bluetooth specification, minimal interval for low duty cycle advertising is 20 ms
+    BLE_LowDutyCycle_MinInterval = 20
+
+    def __init__(self, windowSize=11, upperQuantile=0.75, lowerQuantile=0.25):
+        self.windowSize = windowSize
+        self.upperQuantile = upperQuantile
+        self.lowerQuantile = lowerQuantile
+        self.initCnt = self.windowSize  # Counter of elements for initialization of the model
+        self.window = deque()   # Intervals in the order of arrival
+        self.ordered = []       # The same intervals kept sorted, for order statistics
+        self.lastSeen = 0
+        super().__init__()
+
+    def isReady(self):
+        return self.initCnt <= 0
+
+    def quantile(self, q):
+        """
+        Order statistic of the window at quantile `q` (linear interpolation between closest ranks)
+        """
+        position = q * (len(self.ordered) - 1)
+        lower = int(position)
+        if lower + 1 >= len(self.ordered):
+            return self.ordered[lower]
+        return self.ordered[lower] + (self.ordered[lower + 1] - self.ordered[lower]) * (position - lower)
+
+    def threshold(self):
+        # Two missed Advertising messages mean the whole Advertising Event was skipped. The inter-quantile range
+        # takes the place of the standard deviation, so the outliers we look for do not inflate the threshold.
+        return 2 * self.quantile(0.5) + self.quantile(self.upperQuantile) - self.quantile(self.lowerQuantile)
+
+    def processAdv(self, timestamp):
+
+        timestamp = parseTimestamp(timestamp)
+
+        if timestamp == 0:
+            raise RuntimeWarning("Invalid timestamp")
+
+        if self.lastSeen == 0:  # First occurrence
+            self.lastSeen = timestamp
+            return
+
+        silenceDuration = timestamp - self.lastSeen
+        self.lastSeen = timestamp
+
+        # Intervals shorter than minimal Low Duty Cycle interval are considered mistakes (see SlidingWindowModel)
+        if silenceDuration < self.BLE_LowDutyCycle_MinInterval:
+            return
+
+        if not self.isReady():  # Still initialising
+            self.window.append(silenceDuration)
+            bisect.insort(self.ordered, silenceDuration)
+            self.initCnt -= 1
+            if self.isReady():
+                self._initState = str(list(self.window)) + ", " + str(self.quantile(0.5))
+                raise ModelInitialised()
+            return
+
+        if silenceDuration > self.threshold():
+            raise ConnectionAlert(timestamp, silenceDuration)
+
+        # Update the window
+        oldest = self.window.popleft()
+        del self.ordered[bisect.bisect_left(self.ordered, oldest)]
+        self.window.append(silenceDuration)
+        bisect.insort(self.ordered, silenceDuration)
+
+    def deadline(self):
+        if not self.isReady():
+            return None
+        return self.lastSeen + self.threshold()
+
+    def stateStruct(self):
+        # Last timestamp, initialisation counter, window length and the window padded to its full size
+        return struct.Struct(f'<qii{self.windowSize}i')
+
+    def packState(self):
+        padding = [0] * (self.windowSize - len(self.window))
+        return self.stateStruct().pack(self.lastSeen, self.initCnt, len(self.window), *self.window, *padding)
+
+    def unpackState(self, buffer, offset=0):
+        self.lastSeen, self.initCnt, length, *window = self.stateStruct().unpack_from(buffer, offset)
+        self.window = deque(window[:length])
+        self.ordered = sorted(self.window)
+
+    def headerStr(self):
+        return "lastTimestamp,window,median,lower_quantile,upper_quantile"
+
+    def __str__(self):
+        median = None
+        lower = None
+        upper = None
+        if self.ordered:
+            median = self.quantile(0.5)
+            lower = self.quantile(self.lowerQuantile)
+            upper = self.quantile(self.upperQuantile)
+        return (str(self.lastSeen) + "," + str(list(self.window)) + "," + str(median) + ","
+                + str(lower) + "," + str(upper))
@@ -1,7 +1,9 @@
 import statistics
+import struct
 
 from .model import Model
 from .model import ModelInitialised, ConnectionAlert
+from .model import parseTimestamp
 
 
 class SlidingWindowModel(Model):
@@ -10,8 +12,10 @@ class SlidingWindowModel(Model):
     BLE_LowDutyCycle_MinInterval = 20
     # Note: High duty cycle advertising has Advertising Interval =< 3.75 ms
 
-    def __init__(self):
-        self.windowSize = 11
+    def __init__(self, windowSize=11, meanFactor=2, stdDevFactor=1):
+        self.windowSize = windowSize
+        self.meanFactor = meanFactor
+        self.stdDevFactor = stdDevFactor
         self.initCnt = self.windowSize  # Counter of elements for initialization of the model
         self.window = []
         self.lastSeen = 0
@@ -22,12 +26,7 @@ class SlidingWindowModel(Model):
 
     def processAdv(self, timestamp):
 
-        try:
-            timestamp = int(timestamp)
-        except ValueError:
-            time = timestamp.split('T')[1]
-            hours, minutes, sec = time.split(':')
-            timestamp = int(float(sec) * 1000) + int(minutes) * 60000 + int(hours) * 3600000
+        timestamp = parseTimestamp(timestamp)
 
         if timestamp == 0:
             raise RuntimeWarning("Invalid timestamp")
@@ -60,13 +59,30 @@ class SlidingWindowModel(Model):
 
         # Two missed Advertising messages mean the whole Advertising Event was skipped,
         # so we consider it a connection. We include standard deviation to take fluctuations into account.
-        if silenceDuration > 2 * windowMean + windowStdDev:
+        if silenceDuration > self.meanFactor * windowMean + self.stdDevFactor * windowStdDev:
             raise ConnectionAlert(timestamp, silenceDuration)
 
         # Update the window
         self.window.pop(0)
         self.window.append(silenceDuration)
 
+    def deadline(self):
+        if not self.isReady():
+            return None
+        return self.lastSeen + self.meanFactor * statistics.mean(self.window) + self.stdDevFactor * statistics.stdev(self.window)
+
+    def stateStruct(self):
+        # Last timestamp, initialisation counter, window length and the window padded to its full size
+        return struct.Struct(f'<qii{self.windowSize}i')
+
+    def packState(self):
+        padding = [0] * (self.windowSize - len(self.window))
+        return self.stateStruct().pack(self.lastSeen, self.initCnt, len(self.window), *self.window, *padding)
+
+    def unpackState(self, buffer, offset=0):
+        self.lastSeen, self.initCnt, length, *window = self.stateStruct().unpack_from(buffer, offset)
+        self.window = window[:length]
+
     def headerStr(self):
         return "lastTimestamp,window,median,std_deviation"
 
@@ -0,0 +1,68 @@
+import struct
+
+from datetime import datetime
+
+# Decoded advertising report in a fixed-size binary form, shared by the local and network record streams:
+#   timestamp in us since the epoch (q), address in display order (6 B), address type (B), advertising type (B),
+#   channel (B), RSSI (b), device name length (B), device name padded to 31 B
+# Maximal size of Advertising Data is 31 B (Bluetooth Core 5.4 Vol. 4, Part E, 7.7.65.2)
+RECORD = struct.Struct('<q6sBBBbB31s')
+
+
+def packRecord(timestamp, info):
+    """
+    Pack an advertising report (as decoded by the collector) received at `timestamp` (us since the epoch)
+    """
+    name = info['DeviceName'].encode('utf8')[:31]
+    return RECORD.pack(
+        timestamp,
+        bytes.fromhex(info['Address'].replace(':', '')),
+        info['AddressType'],
+        info['AdvertisingType'],
+        info['Channel'],
+        info['RSSI'],
+        len(name),
+        name
+    )
+
+
+def packRecordInto(buffer, offset, timestamp, info):
+    buffer[offset:offset + RECORD.size] = packRecord(timestamp, info)
+
+
+def unpackRecord(buffer, offset=0):
+    timestamp, address, addressType, advertisingType, channel, rssi, nameLength, name = \
+        RECORD.unpack_from(buffer, offset)
+    return {
+        'Timestamp': timestamp,
+        'Address': address.hex(':'),
+        'AddressType': addressType,
+        'AdvertisingType': advertisingType,
+        'Channel': channel,
+        'RSSI': rssi,
+        'DeviceName': name[:nameLength].decode('utf8', errors='replace')
+    }
+
+
+# Capture outage of a probe, marked in the CSV capture by a row of AdvertisingType "gap" without an address:
+#   Timestamp is the moment the probe was lost, DeviceName the moment its capture resumed (both ISO times)
+GAP_TYPE = 'gap'
+
+
+def gapRow(channel, start, end):
+    """
+    CSV capture row of an outage from `start` to `end` (us since the epoch)
+    """
+    return {
+        'Timestamp': datetime.fromtimestamp(start / 1000000).isoformat(),
+        'Address': '',
+        'AddressType': '',
+        'AdvertisingType': GAP_TYPE,
+        'RSSI': '',
+        'Channel': channel,
+        'DeviceName': datetime.fromtimestamp(end / 1000000).isoformat()
+    }
+
+
+def isGap(row):
+    return row.get('AdvertisingType') == GAP_TYPE
@@ -0,0 +1,285 @@
+#!/usr/bin/env python
+
+import argparse
+import csv
+import math
+import time
+
+from advertising_events import ADVERTISING_EVENT_WINDOW
+from models import parseTimestamp
+from records import isGap
+from timer_wheel import HierarchicalTimerWheel
+
+__LINK_WINDOW__ = 10000     # How long a silent address may be continued by a new one (ms)
+__PROBE_ADVERTISEMENTS__ = 4    # Advertisements of a new address before it is matched (3 intervals)
+__INTERVAL_TOLERANCE__ = 0.05   # Relative difference of the advertising intervals of a linked pair
+__INTERVAL_BUCKET__ = 1.05      # Ratio of the interval buckets of the index
+__ADV_DELAY__ = 10          # Maximal random delay added to every advertising interval (ms) [Core 5.4 Vol. 6, Part B, 4.4.2.2.1]
+__RSSI_TOLERANCE__ = 8      # Difference of the mean RSSI of a linked pair (dB)
+__RSSI_WEIGHT__ = 0.1       # Weight of the newest RSSI in the running mean
+__INTERVAL_WEIGHT__ = 0.2   # Weight of the newest interval in the running mean
+__MISSED__ = 1.5            # Silences longer than this many intervals contain missed advertisements
+__PAUSE__ = 3000            # Longest pause of an advertiser around its rotation (ms), the phase is lost then
+__PAUSE_PENALTY__ = 2       # Score of a link without phase alignment
+__DAY__ = 24 * 60 * 60 * 1000  # The ISO capture timestamps are milliseconds of the day (ms)
+
+
+def isPrivate(address):
+    """
+    Random private address (resolvable 0b01 or non-resolvable 0b00 in the two most significant bits),
+    the static random (0b11) and public addresses do not rotate
+    """
+    try:
+        return int(address[:2], 16) >> 6 in (0b00, 0b01) and len(address) == 17
+    except ValueError:  # Not an address (e.g. a resolved identity)
+        return False
+
+
+def rowRssi(row):
+    """
+    RSSI of a capture row or of an advertising event row (mean of its channels), None if unknown
+    """
+    try:
+        return float(row['RSSI'])
+    except (KeyError, ValueError):
+        values = [float(value) for key, value in row.items() if key.startswith('RSSI') and value not in ('', None)]
+        return sum(values) / len(values) if values else None
+
+
+class AddressTrack:
+    """
+    Advertising pattern of one device address
+    """
+    __slots__ = ('address', 'identity', 'fingerprint', 'firstSeen', 'lastSeen', 'count', 'interval', 'rssi',
+                 'bucket', 'pending', 'linked')
+
+    def __init__(self, address, fingerprint, timestamp, rssi):
+        self.address = address
+        self.identity = address     # Address of the first track of the linked chain
+        self.fingerprint = fingerprint
+        self.firstSeen = timestamp
+        self.lastSeen = timestamp
+        self.count = 1
+        self.interval = None        # Running mean of the advertising interval (ms)
+        self.rssi = rssi
+        self.bucket = None          # Key in the index
+        self.pending = []           # Rows held back until the track is matched
+        self.linked = False         # Already continued by a newer address
+
+    def add(self, timestamp, rssi):
+        silence = timestamp - self.lastSeen
+        if silence < ADVERTISING_EVENT_WINDOW:  # Same advertising event on another channel
+            if rssi is not None and self.rssi is not None:
+                self.rssi += __RSSI_WEIGHT__ * (rssi - self.rssi)
+            return
+        self.lastSeen = timestamp
+        self.count += 1
+        if self.interval is None or silence < 0.75 * self.interval:  # The previous estimate contained a miss
+            self.interval = silence
+        elif silence < __MISSED__ * self.interval:
+            self.interval += __INTERVAL_WEIGHT__ * (silence - self.interval)
+        else:   # Missed advertisements, counted as a whole number of intervals
+            missed = round(silence / self.interval)
+            self.interval += __INTERVAL_WEIGHT__ * (silence / missed - self.interval)
+        if rssi is not None:
+            self.rssi = rssi if self.rssi is None else self.rssi + __RSSI_WEIGHT__ * (rssi - self.rssi)
+
+
+class RotationLinker:
+    """
+    Links the new random addresses to the addresses which have just disappeared, so the model of a device
+    without known IRK is carried across its address rotations. A new address is matched once its interval is
+    known (__PROBE_ADVERTISEMENTS__ advertisements, its rows are held back until then) against the silent
+    addresses of the same fingerprint (advertising type, device name) and a similar interval,
+    taken from an index bucketed by both. Among them the best one by interval continuity, phase alignment
+    (the new address continues the advertising timer) and RSSI wins.
+    The rows are passed on with the address of the first address of the linked chain. The first row of an address
+    linked without phase alignment (the advertiser paused around the rotation) has Rotation set to 'pause',
+    the silence before it is not the one of a connection.
+    The addresses the `resolver` resolves (known IRKs) are passed on as their identities and never linked.
+    The capture timestamps go back to 0 at midnight, the tracks and the wheel run on a continuous timeline
+    instead, as in the live detector.
+    """
+
+    def __init__(self, window=__LINK_WINDOW__, resolver=None):
+        self.window = window
+        self.resolver = resolver
+        self.tracks = {}    # Address -> AddressTrack (heard within the link window)
+        self.index = {}     # (Fingerprint, interval bucket) -> {address: AddressTrack}
+        self.wheel = HierarchicalTimerWheel(tick=10)
+        self.links = {}     # New address -> linked silent address
+        self.candidates = 0     # Silent addresses scored
+        self.dayOffset = 0      # Time added to the capture timestamps since the first one (ms, whole days)
+        self.latest = None      # Newest time on the timeline (ms)
+
+    def timeline(self, timestamp):
+        """
+        Time (ms) on the continuous timeline of a capture timestamp
+        """
+        timestamp = parseTimestamp(timestamp) + self.dayOffset
+        if self.latest is not None:
+            if timestamp < self.latest - __DAY__ // 2:      # Midnight passed
+                self.dayOffset += __DAY__
+                timestamp += __DAY__
+            elif timestamp > self.latest + __DAY__ // 2:    # Late row from before midnight
+                timestamp -= __DAY__
+        if self.latest is None or timestamp > self.latest:
+            self.latest = timestamp
+        return timestamp
+
+    def link(self, rows):
+        """
+        Generate the rows with the addresses replaced by their chain identities (reordered by the held back rows)
+        """
+        for row in rows:
+            if isGap(row):
+                yield row
+                continue
+            address = row['Address']
+            if not isPrivate(address) or row.get('AddressType', '1') not in ('1', 1):
+                yield row
+                continue
+            if self.resolver is not None:
+                identity = self.resolver.identity(address, row.get('AddressType', '1'))
+                if identity != address:     # Known device, followed across its rotations by its IRK
+                    yield dict(row, Address=identity)
+                    continue
+            try:
+                timestamp = self.timeline(row['Timestamp'])
+            except (ValueError, IndexError):
+                yield row
+                continue
+
+            yield from self._advance(timestamp)
+
+            track = self.tracks.get(address)
+            if track is None:
+                fingerprint = (row.get('AdvertisingType'), row.get('DeviceName', ''))
+                track = AddressTrack(address, fingerprint, timestamp, rowRssi(row))
+                self.tracks[address] = track
+            else:
+                self._unindex(track)
+                track.add(timestamp, rowRssi(row))
+
+            if track.pending is not None:
+                track.pending.append(row)
+                if track.count >= __PROBE_ADVERTISEMENTS__:
+                    yield from self._match(track)
+            else:
+                yield dict(row, Address=track.identity)
+
+            self._indexTrack(track)
+            self.wheel.schedule(address, track.lastSeen + self.window)
+
+        for track in list(self.tracks.values()):    # End of the capture
+            if track.pending is not None:
+                yield from self._release(track)
+
+    def _advance(self, now):
+        for address, _ in self.wheel.advance(now):
+            track = self.tracks.pop(address)
+            self._unindex(track)
+            if track.pending is not None:   # Never heard often enough to be matched
+                yield from self._release(track)
+
+    def _match(self, track):
+        best = None
+        bestScore = None
+        bucket = self._bucket(track.interval)
+        for neighbour in (bucket - 1, bucket, bucket + 1):
+            for candidate in self.index.get((track.fingerprint, neighbour), {}).values():
+                self.candidates += 1
+                score = self._score(candidate, track)
+                if score is not None and (bestScore is None or score < bestScore):
+                    best, bestScore = candidate, score
+        if best is not None:
+            self._unindex(best)
+            best.linked = True
+            track.identity = best.identity
+            self.links[track.address] = best.address
+            if bestScore >= __PAUSE_PENALTY__:
+                track.pending[0] = dict(track.pending[0], Rotation='pause')
+        return self._release(track)
+
+    def _score(self, old, new):
+        """
+        Mismatch of a silent address and a new one (0 is a perfect continuation), None if they cannot be linked
+        """
+        if old.linked or old.pending is not None or old.interval is None or old.lastSeen >= new.firstSeen:
+            return None
+        silence = new.firstSeen - old.lastSeen
+        if silence > self.window:
+            return None
+
+        intervalError = abs(new.interval - old.interval) / old.interval
+        if intervalError > __INTERVAL_TOLERANCE__:
+            return None
+
+        # The new address continues the advertising timer: it appears a whole number of intervals later,
+        # give or take the random advertising delays, which add up over the intervals
+        intervals = max(round(silence / old.interval), 1)
+        phaseError = abs(silence - intervals * old.interval) / (__ADV_DELAY__ * math.sqrt(intervals) + 1)
+        if phaseError > 1:  # Some advertisers pause around the rotation, restarting their timer
+            if silence > __PAUSE__:
+                return None
+            phaseError = __PAUSE_PENALTY__
+
+        rssiError = 0
+        if old.rssi is not None and new.rssi is not None:
+            rssiError = abs(new.rssi - old.rssi) / __RSSI_TOLERANCE__
+            if rssiError > 1:
+                return None
+
+        return intervalError / __INTERVAL_TOLERANCE__ + phaseError + rssiError + intervals / 100
+
+    def _release(self, track):
+        rows = track.pending
+        track.pending = None
+        for row in rows:
+            yield dict(row, Address=track.identity)
+
+    @staticmethod
+    def _bucket(interval):
+        return round(math.log(interval) / math.log(__INTERVAL_BUCKET__))
+
+    def _indexTrack(self, track):
+        if track.interval is None or track.linked:
+            return
+        track.bucket = (track.fingerprint, self._bucket(track.interval))
+        self.index.setdefault(track.bucket, {})[track.address] = track
+
+    def _unindex(self, track):
+        if track.bucket is None:
+            return
+        entries = self.index[track.bucket]
+        del entries[track.address]
+        if not entries:
+            del self.index[track.bucket]
+        track.bucket = None
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Link the rotating random addresses of a capture',
+    )
+    _parser.add_argument("capture")
+    _parser.add_argument('-o', '--output', metavar='OUT',
+                         help='File where the links (new address, previous address) will be stored'
+                              ' [Default: <capture>.links.csv]')
+    _args = _parser.parse_args()
+
+    _linker = RotationLinker()
+    _rows = 0
+    _start = time.perf_counter()
+    with open(_args.capture, newline='') as _capture_file:
+        for _ in _linker.link(csv.DictReader(_capture_file)):
+            _rows += 1
+    _duration = time.perf_counter() - _start
+
+    _out_path = _args.output or str(_args.capture).rsplit('.', 1)[0] + '.links.csv'
+    with open(_out_path, 'w', newline='') as _out_file:
+        _writer = csv.writer(_out_file)
+        _writer.writerow(['Address', 'Previous'])
+        _writer.writerows(_linker.links.items())
+    print(f"{len(_linker.links)} links among {_rows} rows in {_duration:.2f} s"
+          f" ({_rows / _duration:.0f} rows/s, {_linker.candidates} candidates scored)")
@@ -0,0 +1,261 @@
+#!/usr/bin/env python
+
+import argparse
+import csv
+import time
+
+from collections import OrderedDict
+
+import numpy as np
+
+__CACHE_SIZE__ = 65536      # Addresses whose resolution is kept (an RPA is used for about 15 minutes)
+__RANDOM_ADDRESS__ = '1'    # AddressType of the random device addresses in the captures
+
+# AES S-box (FIPS-197, 5.1.1)
+_SBOX = np.array([
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+], dtype=np.uint8)
+_RCON = (0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36)
+__BATCH_ROWS__ = 1 << 16    # (address, key) pairs encrypted in one pass, bounds the memory of the tiled keys
+
+
+def _tables():
+    """
+    T-tables: SubBytes, ShiftRows and MixColumns of one state byte as a 32-bit column (FIPS-197, 5.2.1)
+    """
+    sbox = _SBOX.astype(np.uint32)
+    double = ((sbox << 1) ^ np.where(sbox & 0x80, 0x1b, 0)) & 0xff
+    te0 = (double << 24) | (sbox << 16) | (sbox << 8) | (double ^ sbox)
+    return [((te0 >> (8 * i)) | (te0 << (32 - 8 * i))) & 0xffffffff if i else te0 for i in range(4)]
+
+
+_TE = [table.astype(np.uint32) for table in _tables()]
+
+
+class BatchAes128:
+    """
+    AES-128 encryption under many keys at once: the state of every key is a lane of four arrays of 32-bit
+    columns, so a round is a few T-table lookups over all the keys (no AES-NI from plain Python, but the
+    interpreter overhead is paid once per batch instead of once per key)
+    """
+
+    def __init__(self, keys):
+        """
+        :param keys: (N, 16) uint8 array of keys (most significant octet first)
+        """
+        keys = np.ascontiguousarray(np.asarray(keys, dtype=np.uint8).reshape(-1, 16))
+        words = list(keys.view('>u4').astype(np.uint32).T)
+        sbox = _SBOX.astype(np.uint32)
+        for i in range(4, 44):
+            word = words[i - 1]
+            if i % 4 == 0:  # RotWord, SubWord, Rcon
+                word = ((sbox[(word >> 16) & 0xff] << 24) | (sbox[(word >> 8) & 0xff] << 16)
+                        | (sbox[word & 0xff] << 8) | sbox[word >> 24]) ^ (_RCON[i // 4 - 1] << 24)
+            words.append(words[i - 4] ^ word)
+        # Round keys: (11, 4, N) columns
+        self.roundKeys = np.stack(words).reshape(11, 4, -1)
+
+    def __len__(self):
+        return self.roundKeys.shape[2]
+
+    def encryptColumns(self, columns):
+        """
+        :param columns: Plaintext as four 32-bit columns (big endian), scalars or arrays of N lanes
+        :return: Ciphertexts as four arrays of N 32-bit columns
+        """
+        te0, te1, te2, te3 = _TE
+        s0, s1, s2, s3 = (column ^ key for column, key in zip(columns, self.roundKeys[0]))
+        for keys in self.roundKeys[1:10]:
+            s0, s1, s2, s3 = (
+                te0[s0 >> 24] ^ te1[(s1 >> 16) & 0xff] ^ te2[(s2 >> 8) & 0xff] ^ te3[s3 & 0xff] ^ keys[0],
+                te0[s1 >> 24] ^ te1[(s2 >> 16) & 0xff] ^ te2[(s3 >> 8) & 0xff] ^ te3[s0 & 0xff] ^ keys[1],
+                te0[s2 >> 24] ^ te1[(s3 >> 16) & 0xff] ^ te2[(s0 >> 8) & 0xff] ^ te3[s1 & 0xff] ^ keys[2],
+                te0[s3 >> 24] ^ te1[(s0 >> 16) & 0xff] ^ te2[(s1 >> 8) & 0xff] ^ te3[s2 & 0xff] ^ keys[3],
+            )
+        sbox = _SBOX.astype(np.uint32)
+        keys = self.roundKeys[10]
+        return [
+            ((sbox[a >> 24] << 24) | (sbox[(b >> 16) & 0xff] << 16) | (sbox[(c >> 8) & 0xff] << 8) | sbox[d & 0xff])
+            ^ key
+            for (a, b, c, d), key in zip(((s0, s1, s2, s3), (s1, s2, s3, s0), (s2, s3, s0, s1), (s3, s0, s1, s2)), keys)
+        ]
+
+    def encrypt(self, block):
+        """
+        :param block: 16 B plaintext
+        :return: (N, 16) uint8 array of the ciphertexts under every key
+        """
+        columns = [np.uint32(word) for word in np.frombuffer(block, dtype='>u4')]
+        return np.stack(self.encryptColumns(columns), axis=1).astype('>u4').view(np.uint8).reshape(-1, 16)
+
+    def tiled(self, copies):
+        """
+        Cipher of the keys repeated `copies` times (one lane per key and copy, copies major)
+        """
+        aes = BatchAes128.__new__(BatchAes128)
+        aes.roundKeys = np.tile(self.roundKeys, (1, 1, copies))
+        return aes
+
+
+def parseAddress(address):
+    return bytes.fromhex(address.replace(':', ''))
+
+
+def isResolvable(address):
+    """
+    Resolvable private address: random address whose two most significant bits are 0b01
+    (Bluetooth Core 5.4 Vol. 6, Part B, 1.3.2.2)
+    """
+    return parseAddress(address)[0] >> 6 == 0b01
+
+
+class IrkStore:
+    """
+    Identity Resolving Keys of the known devices, loaded from a CSV file with the columns Identity, IRK
+    (the IRK in hexadecimal, most significant octet first, as used by the security function e)
+    """
+
+    def __init__(self):
+        self.identities = []
+        self.keys = []
+
+    def add(self, identity, irk):
+        irk = bytes.fromhex(irk.replace(':', '').replace(' ', ''))
+        if len(irk) != 16:
+            raise ValueError(f'IRK of {identity} is not 128 bits long')
+        self.identities.append(identity)
+        self.keys.append(irk)
+
+    def load(self, path):
+        with open(path, newline='') as irkFile:
+            for row in csv.DictReader(irkFile):
+                self.add(row['Identity'], row['IRK'])
+        return self
+
+    def __len__(self):
+        return len(self.keys)
+
+
+class RpaResolver:
+    """
+    Maps the resolvable private addresses to the identities of their IRKs, so a device keeps its model
+    across the address rotations. Every new address is checked against all the IRKs at once (the random part
+    of an address is hashed under every key in one batch), the result is kept in an LRU cache.
+    """
+
+    def __init__(self, store, cacheSize=__CACHE_SIZE__):
+        self.store = store
+        self.cache = OrderedDict()  # Address -> identity, None if it does not resolve
+        self.cacheSize = cacheSize
+        self.resolutions = 0        # Addresses checked against the IRKs
+        self.resolved = 0
+        self._aes = BatchAes128(np.frombuffer(b''.join(store.keys), dtype=np.uint8)) if len(store) else None
+        self._tiled = None          # Keys repeated for a batch of addresses
+
+    def identity(self, address, addressType=__RANDOM_ADDRESS__):
+        """
+        :return: Identity of the address, the address itself if it is not resolved
+        """
+        if str(addressType) != __RANDOM_ADDRESS__ or self._aes is None:
+            return address
+        try:
+            identity = self.cache[address]
+            self.cache.move_to_end(address)
+        except KeyError:
+            identity = self.resolveMany([address])[0]
+            self._remember(address, identity)
+        return identity if identity is not None else address
+
+    def resolveMany(self, addresses):
+        """
+        Check the addresses against all the IRKs (uncached), in a single batch
+        :return: Identity of every address, None if it does not resolve
+        """
+        results = [None] * len(addresses)
+        candidates = [(i, parseAddress(address)) for i, address in enumerate(addresses) if isResolvable(address)]
+        if not candidates or self._aes is None:
+            return results
+        self.resolutions += len(candidates)
+
+        # ah(k, r) = e(k, padding || prand) mod 2^24, the address is prand (3 MSB) || hash (3 LSB)
+        # (Bluetooth Core 5.4 Vol. 3, Part H, 2.2.2)
+        keys = len(self._aes)
+        prands = np.array([int.from_bytes(address[:3], 'big') for _, address in candidates], dtype=np.uint32)
+        hashes = np.array([int.from_bytes(address[3:], 'big') for _, address in candidates], dtype=np.uint32)
+        zero = np.uint32(0)
+        matches = []
+        perPass = max(__BATCH_ROWS__ // keys, 1)
+        for first in range(0, len(candidates), perPass):
+            count = min(perPass, len(candidates) - first)
+            if count == 1:
+                aes, prand, hashed = self._aes, prands[first], hashes[first]
+            else:   # One lane per (address, key) pair, addresses major
+                if self._tiled is None or len(self._tiled) != count * keys:
+                    self._tiled = self._aes.tiled(count)
+                aes = self._tiled
+                prand = np.repeat(prands[first:first + count], keys)
+                hashed = np.repeat(hashes[first:first + count], keys)
+            output = aes.encryptColumns((zero, zero, zero, prand))[3] & 0xffffff
+            matches += list((output == hashed).reshape(count, keys))
+
+        for (i, _), match in zip(candidates, (np.flatnonzero(row) for row in matches)):
+            if len(match):
+                results[i] = self.store.identities[match[0]]
+                self.resolved += 1
+        return results
+
+    def _remember(self, address, identity):
+        self.cache[address] = identity
+        if len(self.cache) > self.cacheSize:
+            self.cache.popitem(last=False)
+
+
+def loadResolver(irkPath):
+    """
+    Resolver of the IRKs in `irkPath`, None without IRK file
+    """
+    if irkPath is None:
+        return None
+    return RpaResolver(IrkStore().load(irkPath))
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Resolve the random private addresses of a capture with the given IRKs',
+    )
+    _parser.add_argument("capture")
+    _parser.add_argument('-k', '--irks', required=True,
+                         help="CSV file of the known IRKs (columns Identity, IRK)")
+    _args = _parser.parse_args()
+
+    resolver = loadResolver(_args.irks)
+    identities = {}
+    start = time.perf_counter()
+    with open(_args.capture, newline='') as captureFile:
+        for advertisement in csv.DictReader(captureFile):
+            address = advertisement['Address']
+            if address in identities:
+                continue
+            identities[address] = resolver.identity(address, advertisement.get('AddressType', __RANDOM_ADDRESS__))
+    duration = time.perf_counter() - start
+
+    for address, identity in identities.items():
+        if identity != address:
+            print(f"{address},{identity}")
+    print(f"{resolver.resolved} of {resolver.resolutions} private addresses resolved against {len(resolver.store)} IRKs"
+          f" in {duration:.2f} s")
@@ -0,0 +1,268 @@
+import collections
+import errno
+import fcntl
+import os
+import select
+import struct
+import termios
+import time
+import tty
+
+__CHUNK_SIZE__ = 4096       # Bytes requested from the driver per read
+__COALESCE_MIN__ = 255      # VMIN of the coalesced reads, the largest a cc_t holds
+__ASYNC_LOW_LATENCY__ = 1 << 13     # serial_struct flag, the driver pushes every received byte to the tty at once
+__SERIAL_STRUCT_SIZE__ = 128        # Room for struct serial_struct (72 B on x86_64)
+__FLAGS_OFFSET__ = 16               # Offset of serial_struct.flags
+
+
+class Log2Histogram:
+    """
+    Histogram with power of two buckets, cheap enough to be updated for every read
+    """
+
+    def __init__(self, unit=''):
+        self.unit = unit
+        self.buckets = [0] * 64     # Bucket i counts the values in [2^(i-1), 2^i), bucket 0 the values below 1
+        self.count = 0
+        self.total = 0
+        self.max = 0
+
+    def add(self, value):
+        self.buckets[max(int(value), 0).bit_length()] += 1
+        self.count += 1
+        self.total += value
+        self.max = max(self.max, value)
+
+    def percentile(self, p):
+        """
+        Upper bound of the bucket holding the `p` percentile
+        """
+        rank = self.count * p / 100
+        seen = 0
+        for i, count in enumerate(self.buckets):
+            seen += count
+            if count and seen >= rank:
+                return min(1 << i, self.max) if i else 0
+        return 0
+
+    def __str__(self):
+        if not self.count:
+            return 'no samples'
+        return (
+            f'{self.count} samples, mean {self.total / self.count:.1f} {self.unit},'
+            f' p50 {self.percentile(50)} {self.unit}, p99 {self.percentile(99)} {self.unit},'
+            f' max {self.max} {self.unit}'
+        )
+
+
+class SerialStats:
+    """
+    Read statistics of a probe, kept across the reopenings of its port
+    """
+
+    def __init__(self):
+        self.readSizes = Log2Histogram('B')
+        self.latency = Log2Histogram('us')  # Frame reception delay beyond the fastest sync frame
+
+
+class RawSerial:
+    """
+    Serial port configured directly through termios, a drop-in for the part of serial.Serial the collector uses.
+
+    The port is in raw mode with VMIN=1 and VTIME=0: a read returns as soon as a byte arrives, together with
+    everything already queued, so a burst of frames costs a single system call and no delay is added on top of
+    the driver. A `coalesce` time (in tenths of a second, VTIME) instead lets the driver gather up to 255 B
+    before waking the reader, fewer system calls for more latency. Where the driver supports it, the low latency
+    mode is enabled and the latency timer of FTDI bridges lowered to 1 ms (16 ms by default).
+
+    The frames are parsed from a buffer, so the small reads of the parser are served without system calls.
+    Every chunk is stamped with the monotonic clock when read, arrivalTime() maps the stamp of the last
+    consumed byte to the host wall clock.
+    """
+
+    def __init__(self, path, baudrate=115200, timeout=None, coalesce=0, stats=None):
+        self.path = str(path)
+        self.timeout = timeout
+        self.coalesce = coalesce
+        self.stats = stats if stats is not None else SerialStats()
+        self.reads = 0
+        self._buffer = bytearray()
+        self._offset = 0        # Start of the unconsumed data in the buffer
+        self._received = 0      # Bytes read from the driver since the opening
+        self._consumed = 0      # Bytes consumed by the parser since the opening
+        self._stamps = collections.deque()  # (bytes received at the end of a chunk, monotonic time in ns)
+        self._clockOffset = time.time_ns() - time.monotonic_ns()
+
+        self.fd = os.open(self.path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        try:
+            fcntl.ioctl(self.fd, termios.TIOCEXCL)  # Nobody else may open the probe meanwhile
+            tty.setraw(self.fd)
+            attributes = termios.tcgetattr(self.fd)
+            attributes[2] |= termios.CLOCAL | termios.CREAD
+            attributes[6][termios.VMIN] = __COALESCE_MIN__ if coalesce else 1
+            attributes[6][termios.VTIME] = coalesce
+            termios.tcsetattr(self.fd, termios.TCSANOW, attributes)
+            self.baudrate = baudrate
+            os.set_blocking(self.fd, bool(coalesce))    # Coalesced reads block in the driver for VTIME
+            self.lowLatency = self._setLowLatency()
+        except termios.error as e:  # Not an OSError, unlike the errors of serial.Serial
+            os.close(self.fd)
+            raise OSError(*e.args) from e
+        except BaseException:
+            os.close(self.fd)
+            raise
+
+    def _setLowLatency(self):
+        """
+        Enable the low latency mode of the driver, return whether it could be
+        """
+        lowered = False
+        timer = f'/sys/class/tty/{os.path.basename(os.path.realpath(self.path))}/device/latency_timer'
+        try:
+            with open(timer, 'w') as file:
+                file.write('1')
+            lowered = True
+        except OSError:     # Not an FTDI bridge
+            pass
+        try:
+            serial = bytearray(__SERIAL_STRUCT_SIZE__)
+            fcntl.ioctl(self.fd, termios.TIOCGSERIAL, serial)
+            flags = struct.unpack_from('<i', serial, __FLAGS_OFFSET__)[0]
+            struct.pack_into('<i', serial, __FLAGS_OFFSET__, flags | __ASYNC_LOW_LATENCY__)
+            fcntl.ioctl(self.fd, termios.TIOCSSERIAL, serial)
+            return True
+        except OSError:     # Pseudo terminal or driver without serial_struct
+            return lowered
+
+    @property
+    def port(self):
+        """
+        Device path, as serial.Serial names it
+        """
+        return self.path
+
+    @property
+    def baudrate(self):
+        return self._baudrate
+
+    @baudrate.setter
+    def baudrate(self, baudrate):
+        speed = getattr(termios, f'B{baudrate}', None)
+        if speed is None:
+            raise ValueError(f"Unsupported baud rate {baudrate}.")
+        attributes = termios.tcgetattr(self.fd)
+        attributes[4] = attributes[5] = speed
+        termios.tcsetattr(self.fd, termios.TCSANOW, attributes)
+        self._baudrate = baudrate
+
+    @property
+    def dtr(self):
+        status = struct.unpack('I', fcntl.ioctl(self.fd, termios.TIOCMGET, struct.pack('I', 0)))[0]
+        return bool(status & termios.TIOCM_DTR)
+
+    @dtr.setter
+    def dtr(self, value):
+        fcntl.ioctl(self.fd, termios.TIOCMBIS if value else termios.TIOCMBIC, struct.pack('I', termios.TIOCM_DTR))
+
+    def close(self):
+        if self.fd is not None:
+            os.close(self.fd)
+            self.fd = None
+
+    def write(self, data):
+        view = memoryview(data)
+        while view:
+            try:
+                view = view[os.write(self.fd, view):]
+            except BlockingIOError:
+                select.select([], [self.fd], [])
+        return len(data)
+
+    def reset_input_buffer(self):
+        try:
+            termios.tcflush(self.fd, termios.TCIFLUSH)
+        except termios.error as e:
+            raise OSError(*e.args) from e
+        self._consumed = self._received
+        del self._buffer[:]
+        self._offset = 0
+        self._stamps.clear()
+
+    @property
+    def in_waiting(self):
+        return len(self._buffer) - self._offset
+
+    def _fill(self, deadline):
+        """
+        Append the next chunk to the buffer, return False if nothing arrived before the `deadline`
+        """
+        remaining = None if deadline is None else deadline - time.monotonic()
+        if remaining is not None and remaining <= 0:
+            return False
+        if not select.select([self.fd], [], [], remaining)[0]:
+            return False
+        try:
+            chunk = os.read(self.fd, __CHUNK_SIZE__)
+        except BlockingIOError:
+            return True
+        except OSError as e:
+            if e.errno == errno.EIO:    # Other side of the line gone
+                raise ConnectionError(f"Device {self.path} disconnected.") from e
+            raise
+        if not chunk:   # Readable without data, the device was removed
+            raise ConnectionError(f"Device {self.path} disconnected.")
+        stamp = time.monotonic_ns()
+
+        if self._offset > __CHUNK_SIZE__ and self._offset * 2 > len(self._buffer):
+            del self._buffer[:self._offset]
+            self._offset = 0
+        self._buffer += chunk
+        self._received += len(chunk)
+        self._stamps.append((self._received, stamp))
+        self.reads += 1
+        self.stats.readSizes.add(len(chunk))
+        return True
+
+    def _take(self, size):
+        data = bytes(self._buffer[self._offset:self._offset + size])
+        self._offset += len(data)
+        self._consumed += len(data)
+        while len(self._stamps) > 1 and self._stamps[0][0] < self._consumed:
+            self._stamps.popleft()
+        return data
+
+    def read(self, size=1):
+        """
+        `size` bytes, fewer once the timeout expired
+        """
+        if len(self._buffer) - self._offset < size:
+            deadline = None if self.timeout is None else time.monotonic() + self.timeout
+            while len(self._buffer) - self._offset < size and self._fill(deadline):
+                pass
+        return self._take(size)
+
+    def readline(self):
+        """
+        Bytes up to and including the next newline, fewer once the timeout expired
+        """
+        deadline = None if self.timeout is None else time.monotonic() + self.timeout
+        searched = 0    # Unconsumed bytes already searched, the buffer may be compacted meanwhile
+        while True:
+            end = self._buffer.find(b'\n', self._offset + searched)
+            if end >= 0:
+                return self._take(end + 1 - self._offset)
+            searched = len(self._buffer) - self._offset
+            if not self._fill(deadline):
+                return self._take(searched)
+
+    def arrivalStamp(self):
+        """
+        Monotonic time (ns) the last consumed byte was read from the driver at
+        """
+        return self._stamps[0][1] if self._stamps else time.monotonic_ns()
+
+    def arrivalTime(self):
+        """
+        Host time (us since the epoch) the last consumed byte was read from the driver at
+        """
+        return (self.arrivalStamp() + self._clockOffset) // 1000
@@ -0,0 +1,171 @@
+#!/usr/bin/env python
+
+import argparse
+import fcntl
+import mmap
+import os
+import pathlib
+import struct
+import sys
+import time
+
+from records import packRecordInto, unpackRecord
+
+# Shared memory layout (little endian):
+#   header:    magic "BLESHMRG", version (I), slot size (I), slot count (Q), write sequence (Q), padded to 64 B
+#   consumers: MAX_CONSUMERS entries of pid (I), padding (4 B), read sequence (Q), overruns (Q)
+#   slots:     slot count entries of sequence (Q) followed by a record (records.RECORD), padded to the slot size
+# The sequence of a slot is the number of the record it holds, IN_PROGRESS while the publisher rewrites it.
+SHM_MAGIC = b'BLESHMRG'
+SHM_VERSION = 1
+SHM_FOLDER = pathlib.Path('/dev/shm')
+MAX_CONSUMERS = 32
+IN_PROGRESS = 0xFFFFFFFFFFFFFFFF
+
+_header = struct.Struct('<8sIIQQ')
+_HEADER_SIZE = 64
+_consumer = struct.Struct('<I4xQQ')
+_CONSUMERS_OFFSET = _HEADER_SIZE
+_SLOTS_OFFSET = _CONSUMERS_OFFSET + MAX_CONSUMERS * _consumer.size
+_sequence = struct.Struct('<Q')
+_SLOT_SIZE = 64
+_WRITE_SEQUENCE_OFFSET = 24
+
+
+class ShmRingPublisher:
+    """
+    Single-producer ring of decoded records in shared memory, read by any number of local consumer processes
+    """
+
+    def __init__(self, name, slots=65536):
+        self.path = SHM_FOLDER / name
+        self.slots = slots
+        self.sequence = 0
+        self._file = self.path.open('w+b')
+        self._file.truncate(_SLOTS_OFFSET + slots * _SLOT_SIZE)
+        self._map = mmap.mmap(self._file.fileno(), _SLOTS_OFFSET + slots * _SLOT_SIZE)
+        _header.pack_into(self._map, 0, SHM_MAGIC, SHM_VERSION, _SLOT_SIZE, slots, 0)
+
+    def close(self):
+        self._map.close()
+        self._file.close()
+        self.path.unlink(missing_ok=True)
+
+    def publish(self, probe, timestamp, info):
+        offset = _SLOTS_OFFSET + (self.sequence % self.slots) * _SLOT_SIZE
+        _sequence.pack_into(self._map, offset, IN_PROGRESS)
+        packRecordInto(self._map, offset + _sequence.size, timestamp, info)
+        _sequence.pack_into(self._map, offset, self.sequence)
+        self.sequence += 1
+        _sequence.pack_into(self._map, _WRITE_SEQUENCE_OFFSET, self.sequence)
+
+    def consumers(self):
+        return consumerStats(self._map)
+
+
+def consumerStats(shm):
+    """
+    List of (pid, lag, overruns) of the attached consumers
+    """
+    writeSequence = _sequence.unpack_from(shm, _WRITE_SEQUENCE_OFFSET)[0]
+    stats = []
+    for idx in range(MAX_CONSUMERS):
+        pid, readSequence, overruns = _consumer.unpack_from(shm, _CONSUMERS_OFFSET + idx * _consumer.size)
+        if pid != 0:
+            stats.append((pid, writeSequence - readSequence, overruns))
+    return stats
+
+
+class ShmRingConsumer:
+    """
+    Reader of a shared memory ring at its own pace. Records are decoded directly from the shared mapping.
+
+    A consumer too slow to keep up with the publisher skips the overwritten records and counts them as overruns.
+    """
+
+    def __init__(self, name, fromStart=False):
+        self._file = (SHM_FOLDER / name).open('r+b')
+        self._map = mmap.mmap(self._file.fileno(), 0)
+        magic, version, slotSize, self.slots, writeSequence = _header.unpack_from(self._map, 0)
+        if magic != SHM_MAGIC or version != SHM_VERSION or slotSize != _SLOT_SIZE:
+            raise ValueError(f"{name} is not a compatible record ring.")
+
+        self.overruns = 0
+        self.nextSequence = max(writeSequence - self.slots, 0) if fromStart else writeSequence
+        self._entry = self._register()
+
+    def close(self):
+        _consumer.pack_into(self._map, self._entry, 0, 0, 0)
+        self._map.close()
+        self._file.close()
+
+    def _register(self):
+        fcntl.flock(self._file, fcntl.LOCK_EX)  # Consumers attaching at the same time must not share an entry
+        try:
+            for idx in range(MAX_CONSUMERS):
+                entry = _CONSUMERS_OFFSET + idx * _consumer.size
+                pid = _consumer.unpack_from(self._map, entry)[0]
+                if pid == 0 or not os.path.exists(f'/proc/{pid}'):   # Free or left by a dead consumer
+                    _consumer.pack_into(self._map, entry, os.getpid(), self.nextSequence, 0)
+                    return entry
+        finally:
+            fcntl.flock(self._file, fcntl.LOCK_UN)
+        raise RuntimeError("Too many consumers attached.")
+
+    def lag(self):
+        return _sequence.unpack_from(self._map, _WRITE_SEQUENCE_OFFSET)[0] - self.nextSequence
+
+    def read(self, maxRecords=1024):
+        """
+        Return up to `maxRecords` of the records not read yet
+        """
+        writeSequence = _sequence.unpack_from(self._map, _WRITE_SEQUENCE_OFFSET)[0]
+        if writeSequence - self.nextSequence > self.slots:
+            self.overruns += writeSequence - self.slots - self.nextSequence
+            self.nextSequence = writeSequence - self.slots
+
+        records = []
+        while self.nextSequence < writeSequence and len(records) < maxRecords:
+            offset = _SLOTS_OFFSET + (self.nextSequence % self.slots) * _SLOT_SIZE
+            record = unpackRecord(self._map, offset + _sequence.size)
+            # The slot was reused by the publisher while being decoded
+            if _sequence.unpack_from(self._map, offset)[0] != self.nextSequence:
+                writeSequence = _sequence.unpack_from(self._map, _WRITE_SEQUENCE_OFFSET)[0]
+                skipTo = max(writeSequence - self.slots + 1, self.nextSequence + 1)   # At least past this slot
+                self.overruns += skipTo - self.nextSequence
+                self.nextSequence = skipTo
+                continue
+            records.append(record)
+            self.nextSequence += 1
+
+        _consumer.pack_into(self._map, self._entry, os.getpid(), self.nextSequence, self.overruns)
+        return records
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Read the decoded records published by the collector into shared memory',
+    )
+    _parser.add_argument("name", help="Name of the shared memory ring (collector --shm)")
+    _parser.add_argument('-s', '--stats', action='store_true', help="Only show the lag of the attached consumers")
+    _args = _parser.parse_args()
+
+    if _args.stats:
+        with (SHM_FOLDER / _args.name).open('rb') as _file, \
+                mmap.mmap(_file.fileno(), 0, access=mmap.ACCESS_READ) as _map:
+            for _pid, _lag, _overruns in consumerStats(_map):
+                print(f"{_pid}: lag {_lag} records, {_overruns} overruns")
+        raise SystemExit(0)
+
+    _reader = ShmRingConsumer(_args.name)
+    try:
+        while True:
+            _records = _reader.read()
+            for _record in _records:
+                print(','.join(str(value) for value in _record.values()))
+            if not _records:
+                time.sleep(0.01)
+    except KeyboardInterrupt:
+        print(f"Overruns: {_reader.overruns}", file=sys.stderr)
+    finally:
+        _reader.close()
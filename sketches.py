@@ -0,0 +1,552 @@
+#!/usr/bin/env python
+
+import argparse
+import array
+import collections
+import csv
+import heapq
+import math
+import pathlib
+import struct
+import sys
+import time
+import zlib
+
+from datetime import datetime
+
+from records import isGap
+
+__PRECISION__ = 12          # HyperLogLog registers 2^12 (4 KiB per sketch, standard error 1.6 %)
+__WINDOW__ = 60             # Seconds of a distinct device count window
+__LATENESS__ = 1            # Windows kept open after a newer one started, for the records arriving out of order
+__CM_WIDTH__ = 1024         # Counters of every count-min row, estimates exceed the counts by e / 1024 of the reports
+__CM_DEPTH__ = 4            # Count-min rows, the bound holds with probability 1 - e^-4 (98 %)
+__TOP_K__ = 16              # Heaviest advertisers kept per probe
+__HEAVY_WINDOW__ = 10       # Seconds of a heavy hitter window
+__HORIZON__ = 3600          # Seconds an address is remembered at least, before it appears again
+__CAPACITY__ = 100000       # Addresses heard within a horizon the Bloom filters are sized for
+__ERROR_RATE__ = 0.001      # Probability that a new address is taken for a known one (no appearance event)
+__GENERATIONS__ = 2         # Bloom filters of the ring, an address is forgotten 1-2 horizons after it was last heard
+
+_MASK64 = (1 << 64) - 1
+
+# Sketch file layout (little endian):
+#   header:  magic "BLEHLL", version (B), precision (B)
+#   records: window start (q, s since the epoch), window length (I, s), channel (B), probe name length (B),
+#            compressed registers length (I), probe name, registers (zlib, 2^precision B)
+SKETCH_MAGIC = b'BLEHLL'
+SKETCH_VERSION = 1
+
+_header = struct.Struct('<6sBB')
+_record = struct.Struct('<qIBBI')
+
+
+def packAddress(address):
+    """
+    48-bit integer of an address in display order (aa:bb:cc:dd:ee:ff)
+    """
+    return int(address.replace(':', ''), 16)
+
+
+def hashAddress(packed, seed=0):
+    """
+    64-bit hash of a packed address (splitmix64 finalizer), every bit depends on every address bit
+    """
+    z = (packed + seed + 0x9E3779B97F4A7C15) & _MASK64
+    z = ((z ^ (z >> 30)) * 0xBF58476D1CE4E5B9) & _MASK64
+    z = ((z ^ (z >> 27)) * 0x94D049BB133111EB) & _MASK64
+    return z ^ (z >> 31)
+
+
+class HyperLogLog:
+    """
+    Number of distinct addresses in fixed memory: the first `precision` bits of the hash select a register,
+    which keeps the longest run of leading zeros seen in the remaining bits (Flajolet et al. 2007). The count
+    uses the improved estimator of Ertl 2017, without the bias of the raw estimate between the small (linear
+    counting) and the large cardinalities. Sketches of the same precision merge into the sketch of the union.
+    """
+    __slots__ = ('precision', 'registers', '_shift', '_mask', '_width')
+
+    def __init__(self, precision=__PRECISION__, registers=None):
+        if not 4 <= precision <= 16:
+            raise ValueError(f"Precision {precision} out of 4..16.")
+        self.precision = precision
+        self.registers = bytearray(1 << precision) if registers is None else bytearray(registers)
+        if len(self.registers) != 1 << precision:
+            raise ValueError("Register count does not match the precision.")
+        self._shift = 64 - precision
+        self._mask = (1 << self._shift) - 1
+        self._width = self._shift + 1
+
+    def add(self, packed):
+        """
+        Count a packed address (see packAddress)
+        """
+        h = hashAddress(packed)
+        index = h >> self._shift
+        rank = self._width - (h & self._mask).bit_length()  # Leading zeros of the remaining bits + 1
+        if rank > self.registers[index]:
+            self.registers[index] = rank
+
+    def merge(self, other):
+        if other.precision != self.precision:
+            raise ValueError("Only sketches of the same precision can be merged.")
+        self.registers = bytearray(map(max, self.registers, other.registers))
+        return self
+
+    def count(self):
+        """
+        Estimated number of distinct addresses added
+        """
+        m = len(self.registers)
+        q = self._shift
+        histogram = collections.Counter(self.registers)
+        z = m * _tau(1 - histogram[q + 1] / m)
+        for rank in range(q, 0, -1):
+            z = 0.5 * (z + histogram[rank])
+        z += m * _sigma(histogram[0] / m)
+        return m * m / (2 * math.log(2) * z)
+
+    def __len__(self):
+        return round(self.count())
+
+
+def _sigma(x):
+    if x == 1:
+        return math.inf
+    y = 1
+    z = x
+    while True:
+        x *= x
+        previous = z
+        z += x * y
+        y += y
+        if z == previous:
+            return z
+
+
+def _tau(x):
+    if x == 0 or x == 1:
+        return 0
+    y = 1
+    z = 1 - x
+    while True:
+        x = math.sqrt(x)
+        previous = z
+        y *= 0.5
+        z -= (1 - x) ** 2 * y
+        if z == previous:
+            return z / 3
+
+
+class CountMinSketch:
+    """
+    Report counts of the addresses in fixed memory (Cormode and Muthukrishnan 2005): an address increments one
+    counter in each of `depth` rows, its estimate is the smallest of them. With the conservative update only
+    the counters below the new estimate are raised, which keeps the overestimates well under the e / width
+    of all the reports guaranteed by the plain update.
+    """
+    __slots__ = ('width', 'depth', 'counters', 'total', '_mask')
+
+    def __init__(self, width=__CM_WIDTH__, depth=__CM_DEPTH__):
+        if width & (width - 1):
+            raise ValueError(f"Width {width} is not a power of two.")
+        self.width = width
+        self.depth = depth
+        self.counters = array.array('I', bytes(4 * width * depth))   # Row after row
+        self.total = 0
+        self._mask = width - 1
+
+    def _cells(self, packed):
+        # Rows indexed by h1 + row * h2 (Kirsch and Mitzenmacher 2006), both halves of a single hash
+        h = hashAddress(packed)
+        h1 = h & 0xFFFFFFFF
+        h2 = (h >> 32) | 1
+        return [row * self.width + ((h1 + row * h2) & self._mask) for row in range(self.depth)]
+
+    def add(self, packed, count=1):
+        """
+        Count reports of a packed address
+        :return: New estimate of its count
+        """
+        counters = self.counters
+        cells = self._cells(packed)
+        estimate = min([counters[cell] for cell in cells]) + count
+        for cell in cells:
+            if counters[cell] < estimate:
+                counters[cell] = estimate
+        self.total += count
+        return estimate
+
+    def estimate(self, packed):
+        counters = self.counters
+        return min([counters[cell] for cell in self._cells(packed)])
+
+
+class HeavyHitters:
+    """
+    The `k` addresses with the most reports: every address is counted in a count-min sketch and those whose
+    estimate beats the smallest of the current top addresses replace it. The heap entries of the top addresses
+    are only refreshed when they reach the top of the heap, so an update is O(1) for the top addresses
+    and O(log k) when the top changes.
+    """
+
+    def __init__(self, k=__TOP_K__, width=__CM_WIDTH__, depth=__CM_DEPTH__):
+        if k < 1:
+            raise ValueError(f"At least one heavy hitter shall be kept, not {k}.")
+        self.k = k
+        self.sketch = CountMinSketch(width, depth)
+        self.top = {}       # Packed address -> estimated count
+        self._heap = []     # (Count, packed address) of the top addresses, the counts may be outdated (lower)
+
+    def add(self, packed):
+        estimate = self.sketch.add(packed)
+        top = self.top
+        if packed in top:
+            top[packed] = estimate
+            return
+        heap = self._heap
+        if len(top) < self.k:
+            top[packed] = estimate
+            heapq.heappush(heap, (estimate, packed))
+            return
+        while heap[0][0] != top[heap[0][1]]:    # Outdated smallest entry
+            heapq.heapreplace(heap, (top[heap[0][1]], heap[0][1]))
+        if estimate > heap[0][0]:
+            del top[heapq.heapreplace(heap, (estimate, packed))[1]]
+            top[packed] = estimate
+
+    def heaviest(self):
+        """
+        [(Packed address, estimated count)] of the top addresses, heaviest first
+        """
+        return sorted(self.top.items(), key=lambda item: item[1], reverse=True)
+
+
+class BloomFilter:
+    """
+    Set membership of addresses in fixed memory, with false positives only: an address sets `hashes` bits
+    derived from a single hash (Kirsch and Mitzenmacher 2006). Sized for `capacity` addresses at `errorRate`.
+    """
+    __slots__ = ('size', 'hashes', 'bits')
+
+    def __init__(self, capacity, errorRate):
+        self.size = max(64, math.ceil(-capacity * math.log(errorRate) / math.log(2) ** 2))
+        self.hashes = max(1, round(self.size / capacity * math.log(2)))
+        self.bits = bytearray((self.size + 7) // 8)
+
+    def positions(self, h):
+        """
+        Bits of a hash (see hashAddress), shared by the filters of the same size
+        """
+        h1 = h & 0xFFFFFFFF
+        h2 = (h >> 32) | 1
+        size = self.size
+        return [(h1 + i * h2) % size for i in range(self.hashes)]
+
+    def contains(self, positions):
+        bits = self.bits
+        for position in positions:
+            if not bits[position >> 3] & (1 << (position & 7)):
+                return False
+        return True
+
+    def add(self, positions):
+        bits = self.bits
+        for position in positions:
+            bits[position >> 3] |= 1 << (position & 7)
+
+    def clear(self):
+        self.bits = bytearray(len(self.bits))
+
+
+class RotatingBloomFilter:
+    """
+    Addresses heard within the last `horizon` seconds, in fixed memory: a ring of `generations` Bloom filters,
+    the newest one takes the addresses and every horizon / (generations - 1) the oldest one is cleared
+    to become the newest. An address is remembered for at least the horizon after it was last heard and at most
+    a rotation longer. Each filter is sized for `errorRate` / `generations`, the filters are checked together.
+    """
+
+    def __init__(self, horizon=__HORIZON__, capacity=__CAPACITY__, errorRate=__ERROR_RATE__,
+                 generations=__GENERATIONS__):
+        if generations < 2:
+            raise ValueError("At least two generations are needed to remember the addresses across a rotation.")
+        self.rotation = horizon / (generations - 1)
+        self.filters = [BloomFilter(capacity, errorRate / generations) for _ in range(generations)]
+        self.newest = 0     # Index of the filter taking the addresses
+        self.rotated = None     # Time of the last rotation (s)
+
+    def memory(self):
+        return sum(len(bloomFilter.bits) for bloomFilter in self.filters)
+
+    def add(self, packed, now):
+        """
+        Remember an address heard at `now` (s)
+        :return: True if it was not heard within the horizon (or at most a rotation earlier)
+        """
+        if self.rotated is None:
+            self.rotated = now
+        rotations = int((now - self.rotated) // self.rotation)
+        if rotations > 0:
+            for _ in range(min(rotations, len(self.filters))):  # After a long silence every filter is cleared
+                self.newest = (self.newest + 1) % len(self.filters)
+                self.filters[self.newest].clear()
+            self.rotated += rotations * self.rotation
+
+        positions = self.filters[0].positions(hashAddress(packed))
+        newest = self.filters[self.newest]
+        if newest.contains(positions):
+            return False
+        newest.add(positions)
+        for bloomFilter in self.filters:
+            if bloomFilter is not newest and bloomFilter.contains(positions):
+                return False
+        return True
+
+
+class DistinctDeviceCounter:
+    """
+    Collector record publisher counting the distinct devices heard by every probe on every channel
+    in fixed windows. Each (probe, channel, window) sketch is appended to the sketch file once the window is over,
+    the counts of longer windows, of several probes or several collectors are the merges of these sketches.
+    """
+
+    def __init__(self, path, window=__WINDOW__, precision=__PRECISION__, lateness=__LATENESS__):
+        self.window = window
+        self.precision = precision
+        self.lateness = lateness
+        self.sketches = {}  # (Window start, probe, channel) -> HyperLogLog
+        self.newest = 0     # Start of the newest window
+        self.late = 0       # Records of already written windows (dropped)
+        self._file = pathlib.Path(path).open('wb')
+        self._file.write(_header.pack(SKETCH_MAGIC, SKETCH_VERSION, precision))
+
+    def publish(self, probe, timestamp, info):
+        start = timestamp // 1000000 // self.window * self.window
+        if start > self.newest:
+            self.newest = start
+            self._writeOver(start - self.lateness * self.window)
+        elif start < self.newest - self.lateness * self.window:
+            self.late += 1
+            return
+
+        key = (start, probe, info['Channel'])
+        sketch = self.sketches.get(key)
+        if sketch is None:
+            sketch = self.sketches[key] = HyperLogLog(self.precision)
+        sketch.add(packAddress(info['Address']))
+
+    def close(self):
+        self._writeOver(math.inf)
+        self._file.close()
+
+    def _writeOver(self, before):
+        for key in sorted(key for key in self.sketches if key[0] < before):
+            start, probe, channel = key
+            writeSketch(self._file, start, self.window, probe, channel, self.sketches.pop(key))
+        self._file.flush()
+
+
+class HeavyHitterTracker:
+    """
+    Collector record publisher finding the heaviest advertisers of every probe per window, such as the high duty
+    cycle advertisers (intervals down to 3.75 ms) which crowd the other devices out of the probe queue.
+    The advertisers of the last complete window are exported as gauges, with the reports of the whole window
+    to tell their share.
+    """
+
+    def __init__(self, registry, k=__TOP_K__, window=__HEAVY_WINDOW__, width=__CM_WIDTH__, depth=__CM_DEPTH__):
+        self.k = k
+        self.window = window
+        self.width = width
+        self.depth = depth
+        self.current = {}   # Probe -> (window start, HeavyHitters)
+        self.last = {}      # Probe -> (window start, reports, [(address, reports)]) of the last complete window
+        if registry is not None:
+            registry.gauges('heavy_hitter_reports', 'Reports of the heaviest advertisers in the last window',
+                            self._heavyHitterSeries)
+            registry.gauges('window_reports', 'Reports of all the advertisers in the last heavy hitter window',
+                            self._windowSeries)
+
+    def publish(self, probe, timestamp, info):
+        start = timestamp // 1000000 // self.window * self.window
+        current = self.current.get(probe)
+        if current is None or start > current[0]:   # Late records are counted in the current window
+            if current is not None:
+                self._complete(probe, *current)
+            current = self.current[probe] = (start, HeavyHitters(self.k, self.width, self.depth))
+        current[1].add(packAddress(info['Address']))
+
+    def close(self):
+        pass
+
+    def _complete(self, probe, start, hitters):
+        self.last[probe] = (
+            start,
+            hitters.sketch.total,
+            [(packed.to_bytes(6, 'big').hex(':'), count) for packed, count in hitters.heaviest()]
+        )
+
+    def _heavyHitterSeries(self):
+        for probe, (start, total, heaviest) in list(self.last.items()):
+            for rank, (address, count) in enumerate(heaviest, 1):
+                yield {'probe': probe, 'rank': rank, 'address': address}, count
+
+    def _windowSeries(self):
+        for probe, (start, total, heaviest) in list(self.last.items()):
+            yield {'probe': probe}, total
+
+
+class AppearanceTracker:
+    """
+    Collector record publisher of the new devices: the first record of an address which was not heard within
+    the horizon (by any probe) is written as an appearance event, without keeping a set of every address.
+    """
+
+    def __init__(self, path, horizon=__HORIZON__, capacity=__CAPACITY__, errorRate=__ERROR_RATE__,
+                 generations=__GENERATIONS__, registry=None):
+        self.seen = RotatingBloomFilter(horizon, capacity, errorRate, generations)
+        self._file = pathlib.Path(path).open('w', buffering=1, newline='')
+        self._writer = csv.DictWriter(self._file, fieldnames=['Timestamp', 'Address', 'AddressType', 'Probe'])
+        self._writer.writeheader()
+        self._counters = {}
+        self._registry = registry
+
+    def publish(self, probe, timestamp, info):
+        if not self.seen.add(packAddress(info['Address']), timestamp / 1000000):
+            return
+        self._writer.writerow({
+            'Timestamp': datetime.fromtimestamp(timestamp / 1000000).isoformat(),
+            'Address': info['Address'],
+            'AddressType': info['AddressType'],
+            'Probe': probe
+        })
+        if self._registry is not None:
+            counter = self._counters.get(probe)
+            if counter is None:
+                counter = self._counters[probe] = self._registry.counter(
+                    'appearances', 'Addresses not heard within the appearance horizon', probe=probe
+                )
+            counter.value += 1
+
+    def close(self):
+        self._file.close()
+
+
+def writeSketch(sketchFile, start, window, probe, channel, sketch):
+    name = probe.encode('utf-8')[:255]
+    registers = zlib.compress(sketch.registers)
+    sketchFile.write(_record.pack(start, window, channel, len(name), len(registers)))
+    sketchFile.write(name)
+    sketchFile.write(registers)
+
+
+def readSketches(path):
+    """
+    Generate the (window start, window length, probe, channel, HyperLogLog) of a sketch file,
+    up to its last complete record
+    """
+    with pathlib.Path(path).open('rb') as sketchFile:
+        magic, version, precision = _header.unpack(sketchFile.read(_header.size))
+        if magic != SKETCH_MAGIC or version != SKETCH_VERSION:
+            raise ValueError(f"Unsupported sketch file format (version {version}).")
+        while True:
+            raw = sketchFile.read(_record.size)
+            if len(raw) < _record.size:
+                return
+            start, window, channel, nameLength, registersLength = _record.unpack(raw)
+            name = sketchFile.read(nameLength)
+            registers = sketchFile.read(registersLength)
+            if len(registers) < registersLength:
+                return  # Interrupted while the collector was writing
+            yield start, window, name.decode('utf-8'), channel, HyperLogLog(precision, zlib.decompress(registers))
+
+
+def sketchCapture(path, window=__WINDOW__, precision=__PRECISION__):
+    """
+    Sketches of a CSV capture (collector or aggregator output), in the same form as readSketches
+    """
+    sketches = {}
+    with pathlib.Path(path).open('r', newline='') as captureFile:
+        for row in csv.DictReader(captureFile):
+            if isGap(row):
+                continue
+            start = int(datetime.fromisoformat(row['Timestamp']).timestamp()) // window * window
+            key = (start, row.get('Probe', ''), int(row['Channel']))
+            sketch = sketches.get(key)
+            if sketch is None:
+                sketch = sketches[key] = HyperLogLog(precision)
+            sketch.add(packAddress(row['Address']))
+    for (start, probe, channel), sketch in sorted(sketches.items()):
+        yield start, window, probe, channel, sketch
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Count the distinct devices per time window from the sketch files of collectors'
+                    ' (collector --distinct) or from CSV captures',
+    )
+    _parser.add_argument("inputs", nargs='+', metavar='INPUT',
+                         help='Sketch files (.hll) or captures (.csv), merged together')
+    _parser.add_argument('-w', '--window', type=int, metavar='SEC',
+                         help='Window of the counts, a multiple of the window of the sketches'
+                              ' [Default: ' + str(__WINDOW__) + ' s]',
+                         default=__WINDOW__)
+    _parser.add_argument('-b', '--by', choices=['probe', 'channel', 'total'],
+                         help='Count the devices of every probe and channel, every channel or all together'
+                              ' [Default: probe]',
+                         default='probe')
+    _parser.add_argument('-e', '--exact',
+                         action='store_true',
+                         help='Also count exactly (set of addresses, captures only) and report the error')
+    _args = _parser.parse_args()
+
+    _counts = {}    # (Window start, probe, channel) -> merged HyperLogLog
+    _start_time = time.perf_counter()
+    for _input in _args.inputs:
+        if _input.endswith('.csv'):
+            _sketches = sketchCapture(_input, _args.window)
+        else:
+            _sketches = readSketches(_input)
+        for _start, _window, _probe, _channel, _sketch in _sketches:
+            if _args.window % _window:
+                print(f"{_input}: Sketches of {_window} s windows cannot be counted per {_args.window} s",
+                      file=sys.stderr)
+                raise SystemExit(1)
+            _key = (
+                _start // _args.window * _args.window,
+                _probe if _args.by == 'probe' else '',
+                _channel if _args.by != 'total' else ''
+            )
+            if _key in _counts:
+                _counts[_key].merge(_sketch)
+            else:
+                _counts[_key] = _sketch
+    _duration = time.perf_counter() - _start_time
+
+    _exact = collections.defaultdict(set)
+    if _args.exact:
+        for _input in _args.inputs:
+            if not _input.endswith('.csv'):
+                continue
+            with open(_input, newline='') as _capture_file:
+                for _row in csv.DictReader(_capture_file):
+                    if isGap(_row):
+                        continue
+                    _start = int(datetime.fromisoformat(_row['Timestamp']).timestamp())
+                    _exact[(
+                        _start // _args.window * _args.window,
+                        _row.get('Probe', '') if _args.by == 'probe' else '',
+                        int(_row['Channel']) if _args.by != 'total' else ''
+                    )].add(_row['Address'])
+
+    _writer = csv.writer(sys.stdout)
+    _writer.writerow(['Window', 'Probe', 'Channel', 'Devices'] + (['Exact', 'Error'] if _args.exact else []))
+    for (_start, _probe, _channel), _sketch in sorted(_counts.items()):
+        _row = [datetime.fromtimestamp(_start).isoformat(), _probe, _channel, len(_sketch)]
+        if _args.exact:
+            _devices = len(_exact[(_start, _probe, _channel)])
+            _row += [_devices, f'{(_sketch.count() - _devices) / _devices:+.4f}' if _devices else '']
+        _writer.writerow(_row)
+    print(f"{len(_counts)} counts in {_duration:.2f} s", file=sys.stderr)
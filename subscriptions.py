@@ -0,0 +1,307 @@
+#!/usr/bin/env python
+
+import argparse
+import json
+import pathlib
+import socket
+import threading
+import time
+
+from records import RECORD, packRecord, unpackRecord
+
+# Subscription protocol over a Unix stream socket:
+#   The client sends its filter as a single line of JSON, all keys optional:
+#     {"addresses": ["aa:bb:..", ...], "channels": [37, ...], "minRssi": -70, "types": [0, 3], "namePrefixes": ["Tile"]}
+#   The collector replies with a single line, "OK" or "ERROR <reason>",
+#   then streams the matching records (records.RECORD) back to back, sent in batches.
+__BATCH_SIZE__ = 64         # Records sent at once to a subscriber
+__BATCH_DELAY__ = 0.01      # Longest time a record waits for its batch to fill (s)
+__PENDING_LIMIT__ = 4096    # Records kept for a subscriber which does not read, newer records are dropped
+
+
+class SubscriptionFilter:
+    """
+    Subscriber filter parsed once into sets and bounds, so matching a record costs only a few lookups
+    """
+
+    def __init__(self, addresses=None, channels=None, minRssi=None, types=None, namePrefixes=None):
+        self.addresses = frozenset(bytes.fromhex(address.replace(':', '')) for address in addresses) \
+            if addresses is not None else None
+        self.channels = frozenset(channels) if channels is not None else None
+        self.minRssi = minRssi
+        self.types = frozenset(types) if types is not None else None
+        self.namePrefixes = tuple(namePrefixes) if namePrefixes is not None else None
+
+    @classmethod
+    def fromJson(cls, line):
+        """
+        Parse the filter sent by a subscriber, ValueError describes the first invalid field
+        """
+        spec = json.loads(line)
+        if not isinstance(spec, dict):
+            raise ValueError("Filter shall be a JSON object.")
+        unknown = set(spec) - {'addresses', 'channels', 'minRssi', 'types', 'namePrefixes'}
+        if unknown:
+            raise ValueError(f"Unknown filter keys {', '.join(sorted(unknown))}.")
+
+        for address in _listOf(spec, 'addresses', str):
+            try:
+                valid = len(bytes.fromhex(address.replace(':', ''))) == 6
+            except ValueError:
+                valid = False
+            if not valid:
+                raise ValueError(f"Invalid address {address}.")
+        _listOf(spec, 'channels', int, 0, 39)
+        _listOf(spec, 'types', int, 0, 255)
+        _listOf(spec, 'namePrefixes', str)
+        if 'minRssi' in spec:
+            _checkValue('minRssi', spec['minRssi'], int, -128, 127)
+        return cls(**spec)
+
+    def matches(self, info):
+        """
+        Whether an advertising report passes the filter, the address is checked by the server index
+        """
+        if self.channels is not None and info['Channel'] not in self.channels:
+            return False
+        if self.minRssi is not None and info['RSSI'] < self.minRssi:
+            return False
+        if self.types is not None and info['AdvertisingType'] not in self.types:
+            return False
+        if self.namePrefixes is not None and not info['DeviceName'].startswith(self.namePrefixes):
+            return False
+        return True
+
+
+def _checkValue(key, value, kind, low=None, high=None):
+    # bool is an int to Python, but not a valid number in a filter
+    if not isinstance(value, kind) or isinstance(value, bool):
+        raise ValueError(f"{key} shall hold {kind.__name__} values.")
+    if low is not None and not low <= value <= high:
+        raise ValueError(f"{key} value {value} is out of range {low}..{high}.")
+
+
+def _listOf(spec, key, kind, low=None, high=None):
+    """
+    Check that the optional filter field `key` is a list of `kind` values (within low..high), return the list
+    """
+    values = spec.get(key, [])
+    if not isinstance(values, list):
+        raise ValueError(f"{key} shall be a list.")
+    for value in values:
+        _checkValue(key, value, kind, low, high)
+    return values
+
+
+class Subscriber:
+
+    def __init__(self, conn, subscriptionFilter):
+        self.conn = conn
+        self.filter = subscriptionFilter
+        self.batch = []             # Packed records waiting for the batch to fill
+        self.pending = bytearray()  # Bytes the socket did not accept yet
+        self.sent = 0
+        self.dropped = 0
+
+
+class SubscriptionServer:
+    """
+    Unix socket service streaming to every subscriber only the records passing its filter.
+
+    Subscribers with an address filter are indexed by address, so a record is matched only against
+    them and the subscribers without one. Records are sent in batches from non-blocking sockets,
+    a subscriber which does not keep up loses records instead of slowing the collector down.
+    """
+
+    def __init__(self, path, batchSize=__BATCH_SIZE__, batchDelay=__BATCH_DELAY__):
+        self.path = pathlib.Path(path)
+        self.batchSize = batchSize
+        self.batchDelay = batchDelay
+        self._lock = threading.Lock()
+        self._subscribers = []
+        self._byAddress = {}    # Packed address -> subscribers filtering on it
+        self._wildcard = []     # Subscribers without an address filter
+
+        self.path.unlink(missing_ok=True)
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._socket.bind(str(self.path))
+        self._socket.listen()
+        self._running = True
+        threading.Thread(target=self._accept, daemon=True).start()
+        threading.Thread(target=self._flushPeriodically, daemon=True).start()
+
+    def close(self):
+        self._running = False
+        self._socket.close()
+        with self._lock:
+            for subscriber in list(self._subscribers):
+                self._flush(subscriber)
+                self._remove(subscriber)
+        self.path.unlink(missing_ok=True)
+
+    def _accept(self):
+        while self._running:
+            try:
+                conn, _ = self._socket.accept()
+            except OSError:
+                return
+            threading.Thread(target=self._handshake, args=(conn,), daemon=True).start()
+
+    def _handshake(self, conn):
+        try:
+            conn.settimeout(5)
+            line = conn.makefile('rb').readline()
+            subscriptionFilter = SubscriptionFilter.fromJson(line)
+        except (OSError, ValueError, TypeError) as e:
+            try:
+                conn.sendall(f'ERROR {e}\n'.encode('utf8'))
+            except OSError:
+                pass
+            conn.close()
+            return
+
+        conn.sendall(b'OK\n')
+        conn.setblocking(False)
+        subscriber = Subscriber(conn, subscriptionFilter)
+        with self._lock:
+            self._subscribers.append(subscriber)
+            if subscriptionFilter.addresses is None:
+                self._wildcard.append(subscriber)
+            else:
+                for address in subscriptionFilter.addresses:
+                    self._byAddress.setdefault(address, []).append(subscriber)
+
+    def _remove(self, subscriber):
+        self._subscribers.remove(subscriber)
+        if subscriber.filter.addresses is None:
+            self._wildcard.remove(subscriber)
+        else:
+            for address in subscriber.filter.addresses:
+                self._byAddress[address].remove(subscriber)
+                if not self._byAddress[address]:
+                    del self._byAddress[address]
+        subscriber.conn.close()
+
+    def _flush(self, subscriber):
+        """
+        Move the batch to the socket, return False once the subscriber has disconnected
+        """
+        if subscriber.batch:
+            if len(subscriber.pending) >= __PENDING_LIMIT__ * RECORD.size:
+                subscriber.dropped += len(subscriber.batch)
+            else:
+                subscriber.pending += b''.join(subscriber.batch)
+                subscriber.sent += len(subscriber.batch)
+            subscriber.batch.clear()
+        if not subscriber.pending:
+            return True
+        try:
+            sent = subscriber.conn.send(subscriber.pending)
+        except BlockingIOError:
+            return True
+        except OSError:
+            return False
+        del subscriber.pending[:sent]
+        return True
+
+    def _flushPeriodically(self):
+        while self._running:
+            time.sleep(self.batchDelay)
+            with self._lock:
+                for subscriber in list(self._subscribers):
+                    if not self._flush(subscriber):
+                        self._remove(subscriber)
+
+    def publish(self, probe, timestamp, info):
+        address = bytes.fromhex(info['Address'].replace(':', ''))
+        with self._lock:
+            record = None
+            disconnected = []
+            for subscribers in (self._wildcard, self._byAddress.get(address, ())):
+                for subscriber in subscribers:
+                    try:
+                        if not subscriber.filter.matches(info):
+                            continue
+                    except Exception:  # Never raise into the capture, only the subscriber is dropped
+                        disconnected.append(subscriber)
+                        continue
+                    if record is None:  # Packed only once there is a subscriber for it
+                        record = packRecord(timestamp, info)
+                    subscriber.batch.append(record)
+                    if len(subscriber.batch) >= self.batchSize and not self._flush(subscriber):
+                        disconnected.append(subscriber)
+            for subscriber in disconnected:
+                self._remove(subscriber)
+
+    def stats(self):
+        """
+        List of (records sent, records dropped) of the connected subscribers
+        """
+        with self._lock:
+            return [(subscriber.sent, subscriber.dropped) for subscriber in self._subscribers]
+
+
+class SubscriptionClient:
+    """
+    Subscription to the records of a collector, iterate over it to receive the decoded records
+    """
+
+    def __init__(self, path, **spec):
+        self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._socket.connect(str(path))
+        self._socket.sendall(json.dumps(spec).encode('utf8') + b'\n')
+        self._file = self._socket.makefile('rb')
+        reply = self._file.readline().decode('utf8').strip()
+        if reply != 'OK':
+            self.close()
+            raise ValueError(f"Subscription refused: {reply}")
+
+    def close(self):
+        self._file.close()
+        self._socket.close()
+
+    def readBatch(self):
+        """
+        Records received since the last call (waits for at least one), empty once the collector closed the stream
+        """
+        data = self._file.read1(RECORD.size * __PENDING_LIMIT__)
+        if not data:
+            return []
+        missing = -len(data) % RECORD.size
+        if missing:
+            data += self._file.read(missing)
+        return [unpackRecord(data, offset) for offset in range(0, len(data) - RECORD.size + 1, RECORD.size)]
+
+    def __iter__(self):
+        while True:
+            records = self.readBatch()
+            if not records:
+                return
+            yield from records
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Subscribe to the filtered records of a running collector',
+    )
+    _parser.add_argument("socket", help="Subscription socket of the collector (collector --subscriptions)")
+    _parser.add_argument('-a', '--address', dest='addresses', action='append', help="Only this address (repeatable)")
+    _parser.add_argument('-c', '--channel', dest='channels', type=int, action='append',
+                         help="Only this channel (repeatable)")
+    _parser.add_argument('-r', '--min-rssi', dest='minRssi', type=int, help="Only records at least this strong (dBm)")
+    _parser.add_argument('-t', '--type', dest='types', type=int, action='append',
+                         help="Only this advertising event type (repeatable)")
+    _parser.add_argument('-n', '--name-prefix', dest='namePrefixes', action='append',
+                         help="Only device names starting with this prefix (repeatable)")
+    _args = _parser.parse_args()
+
+    _spec = {key: value for key, value in vars(_args).items() if key != 'socket' and value is not None}
+
+    _client = SubscriptionClient(_args.socket, **_spec)
+    try:
+        for _record in _client:
+            print(','.join(str(value) for value in _record.values()), flush=True)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        _client.close()
@@ -0,0 +1,307 @@
+#!/usr/bin/env python
+
+import argparse
+import bisect
+import csv
+import itertools
+import multiprocessing
+import pathlib
+import sys
+
+import numpy as np
+
+from advertising_events import ADVERTISING_EVENT_WINDOW, readEvents
+from models import MODELS, SlidingWindowModel
+from models import parameterValue
+from models import parseTimestamp
+from records import isGap
+
+__DEFAULT_TOLERANCE__ = 1000   # How long after the end of a labelled connection an alert still detects it (ms)
+
+
+class SimpleStatisticsLanes:
+    """
+    SimpleStatisticsModel evaluated for many parameter sets at once, one parameter set per array lane
+    """
+
+    def __init__(self, params):
+        self.initElements = np.array([p.get('initElements', 10) for p in params], dtype=np.int64)
+        self.thresholdFactor = np.array([p.get('thresholdFactor', 2) for p in params], dtype=np.float64)
+
+    def run(self, timestamps, skipped=()):
+        """
+        Evaluate the intervals between `timestamps` and return a boolean (intervals x lanes) matrix of alerts.
+        The intervals in `skipped` (across a capture outage) are ignored, as after Model.skipSilence()
+        """
+        lanes = len(self.initElements)
+        midpoint = np.zeros(lanes)
+        threshold = np.zeros(lanes)
+        initLeft = self.initElements.copy()
+        alerts = np.zeros((max(len(timestamps) - 1, 0), lanes), dtype=bool)
+
+        skipped = set(skipped)
+        for i, silence in enumerate(np.diff(timestamps).tolist()):
+            if i in skipped:
+                continue
+            unset = midpoint == 0
+            delta = np.abs(midpoint - silence)
+            alert = (initLeft <= 0) & ~unset & (delta > self.thresholdFactor * threshold)
+            update = ~unset & ~alert
+            initLeft -= update & (initLeft > 0)
+            midpoint = np.where(unset, silence, np.where(update, (midpoint + silence) / 2, midpoint))
+            threshold = np.where(update, np.maximum(threshold, delta), threshold)
+            alerts[i] = alert
+
+        return alerts
+
+
+class SlidingWindowLanes:
+    """
+    SlidingWindowModel evaluated for many parameter sets at once, one parameter set per array lane.
+
+    Windows of all lanes live in one ring buffer matrix with running sums, so the mean and the standard deviation
+    are computed from exact integer sums.
+    """
+
+    def __init__(self, params):
+        self.windowSize = np.array([p.get('windowSize', 11) for p in params], dtype=np.int64)
+        if (self.windowSize < 2).any():
+            raise ValueError("The window needs at least two silences for a standard deviation.")
+        self.meanFactor = np.array([p.get('meanFactor', 2) for p in params], dtype=np.float64)
+        self.stdDevFactor = np.array([p.get('stdDevFactor', 1) for p in params], dtype=np.float64)
+
+    def run(self, timestamps, skipped=()):
+        lanes = len(self.windowSize)
+        laneIdx = np.arange(lanes)
+        size = self.windowSize
+        ring = np.zeros((lanes, int(size.max())), dtype=np.int64)
+        count = np.zeros(lanes, dtype=np.int64)
+        head = np.zeros(lanes, dtype=np.int64)
+        windowSum = np.zeros(lanes, dtype=np.int64)
+        windowSumSq = np.zeros(lanes, dtype=np.int64)
+        alerts = np.zeros((max(len(timestamps) - 1, 0), lanes), dtype=bool)
+
+        skipped = set(skipped)
+        for i, silence in enumerate(np.diff(timestamps).tolist()):
+            if silence < SlidingWindowModel.BLE_LowDutyCycle_MinInterval or i in skipped:
+                continue
+
+            ready = count >= size
+            with np.errstate(invalid='ignore', divide='ignore'):
+                mean = windowSum / size
+                stdDev = np.sqrt((size * windowSumSq - windowSum * windowSum) / (size * (size - 1)))
+            alert = ready & (silence > self.meanFactor * mean + self.stdDevFactor * stdDev)
+            update = ~alert
+
+            position = np.where(ready, head, count)
+            oldest = np.where(ready, ring[laneIdx, position], 0)
+            ring[laneIdx[update], position[update]] = silence
+            windowSum += update * (silence - oldest)
+            windowSumSq += update * (silence * silence - oldest * oldest)
+            head = np.where(update & ready, (head + 1) % size, head)
+            count += update & ~ready
+            alerts[i] = alert
+
+        return alerts
+
+
+LANES = {
+    'simple_statistics': SimpleStatisticsLanes,
+    'sliding_window': SlidingWindowLanes,
+}
+
+
+def parseSweep(spec):
+    """
+    Expand "name:parameter=value|value,..." into the list of all parameter combinations
+    """
+    name, _, params = spec.partition(':')
+    if name not in LANES:
+        raise ValueError(f"Detector {name} cannot be swept [" + ", ".join(LANES) + "].")
+
+    keys = []
+    values = []
+    for param in filter(None, params.split(',')):
+        key, _, alternatives = param.partition('=')
+        keys.append(key)
+        values.append([parameterValue(v) for v in alternatives.split('|')])
+
+    combinations = [dict(zip(keys, combination)) for combination in itertools.product(*values)]
+    for combination in combinations:
+        MODELS[name](**combination)  # Validate the parameters
+    LANES[name](combinations)
+    return name, combinations
+
+
+def scoreAddress(args):
+    """
+    Evaluate every lane on the timestamps of a group of addresses and score the alerts against labelled connections
+    """
+    sweeps, devices, tolerance = args
+    results = []
+
+    for name, params in sweeps:
+        lanes = LANES[name](params)
+        alerts = np.zeros(len(params), dtype=np.int64)
+        truePositives = np.zeros(len(params), dtype=np.int64)
+        detected = np.zeros(len(params), dtype=np.int64)
+        latency = np.zeros(len(params), dtype=np.int64)
+        connections = 0
+        negatives = 0
+
+        for timestamps, skipped, starts, durations in devices:
+            laneAlerts = lanes.run(timestamps, skipped)
+            connections += len(starts)
+            firstDetection = np.full((len(starts), len(params)), -1, dtype=np.int64)
+
+            skipped = set(skipped)
+            for i, alert in enumerate(laneAlerts):
+                if i in skipped:    # Not a decision of the detector
+                    continue
+                timestamp = int(timestamps[i + 1])
+                conn = bisect.bisect_right(starts, timestamp) - 1
+                matched = conn >= 0 and timestamp <= starts[conn] + durations[conn] + tolerance
+                if not matched:
+                    negatives += 1
+                if not alert.any():
+                    continue
+                alerts += alert
+                if matched:
+                    truePositives += alert
+                    first = alert & (firstDetection[conn] < 0)
+                    firstDetection[conn][first] = timestamp - starts[conn]
+
+            found = firstDetection >= 0
+            detected += found.sum(axis=0)
+            latency += np.where(found, firstDetection, 0).sum(axis=0)
+
+        results.append((alerts, truePositives, detected, latency, connections, negatives))
+
+    return results
+
+
+def loadCapture(capturePath, events, eventWindow):
+    """
+    Timestamps (ms) of every address in the capture, and the intervals of every address skipped by the detector:
+    the silences across a capture outage which ended after the previous advertisement (Detector.processGap)
+    :return: (Address -> timestamps, address -> indices of the skipped intervals)
+    """
+    timestamps = {}
+    skipped = {}
+    gapEnds = []    # End (ms) of every capture outage so far
+    gapsBefore = {}     # Address -> outages before its last advertisement
+    with capturePath.open('r') as captureFile:
+        if events:
+            capture = (event if isinstance(event, dict) else {'Address': event.address, 'Timestamp': event.timestamp}
+                       for event in readEvents(captureFile, eventWindow, keepGaps=True))
+        else:
+            capture = csv.DictReader(captureFile)
+        for row in capture:
+            try:
+                if isGap(row):
+                    gapEnds.append(parseTimestamp(row['DeviceName']))
+                    continue
+                timestamp = parseTimestamp(row['Timestamp'])
+            except (ValueError, IndexError, TypeError):
+                continue
+            if timestamp == 0:  # Rejected by the models
+                continue
+            address = row['Address']
+            times = timestamps.setdefault(address, [])
+            if times and gapsBefore[address] < len(gapEnds) and max(gapEnds[gapsBefore[address]:]) > times[-1]:
+                skipped.setdefault(address, []).append(len(times) - 1)
+            gapsBefore[address] = len(gapEnds)
+            times.append(timestamp)
+    return timestamps, skipped
+
+
+def loadLabels(labelsPath):
+    """
+    Labelled connections (Address, Timestamp of the connection start, Duration in ms) grouped by address
+    """
+    labels = {}
+    with labelsPath.open('r') as labelsFile:
+        for row in csv.DictReader(labelsFile):
+            labels.setdefault(row['Address'], []).append((parseTimestamp(row['Timestamp']), int(float(row['Duration']))))
+    return labels
+
+
+if __name__ == "__main__":
+    _parser = argparse.ArgumentParser(
+        description='Evaluate parameter sets of detectors in one pass over a capture and score them against labelled connections',
+    )
+    _parser.add_argument("capture")
+    _parser.add_argument("labels",
+                         help="CSV of labelled connections with Address, Timestamp (start) and Duration (ms) columns")
+    _parser.add_argument('-s', '--sweep',
+                         dest='sweeps', action='append', required=True,
+                         help="Detector parameter grid as name:parameter=value|value,... [" + ", ".join(LANES) + "],"
+                              " e.g. sliding_window:windowSize=7|11|21,meanFactor=1.5|2. Can be repeated.")
+    _parser.add_argument('-e', '--events',
+                         action='store_true',
+                         help="Group reports from different channels into Advertising Events before detection.")
+    _parser.add_argument('-w', '--event-window',
+                         dest='eventWindow', type=int,
+                         default=ADVERTISING_EVENT_WINDOW)
+    _parser.add_argument('-t', '--tolerance', type=int,
+                         help="How long after the end of a labelled connection an alert still detects it (ms)"
+                              " [Default: " + str(__DEFAULT_TOLERANCE__) + "]",
+                         default=__DEFAULT_TOLERANCE__)
+    _parser.add_argument('-j', '--jobs', type=int,
+                         help="Number of worker processes [Default: number of CPUs]",
+                         default=multiprocessing.cpu_count())
+    _parser.add_argument('-o', '--output',
+                         help="ROC table file [Default: <capture>.roc.csv]")
+    _args = _parser.parse_args()
+
+    try:
+        sweeps = [parseSweep(spec) for spec in _args.sweeps]
+    except (ValueError, TypeError) as e:
+        print(f"Invalid sweep: {e}", file=sys.stderr)
+        raise SystemExit(1)
+
+    capturePath = pathlib.Path(_args.capture)
+    outputPath = pathlib.Path(_args.output) if _args.output else capturePath.with_suffix('.roc.csv')
+
+    timestamps, skipped = loadCapture(capturePath, _args.events, _args.eventWindow)
+    labels = loadLabels(pathlib.Path(_args.labels))
+
+    devices = []
+    for address, times in timestamps.items():
+        connections = sorted(labels.get(address, []))
+        devices.append((np.array(times, dtype=np.int64), skipped.get(address, []),
+                        [c[0] for c in connections], [c[1] for c in connections]))
+    unseenConnections = sum(len(c) for address, c in labels.items() if address not in timestamps)
+
+    # Spread the addresses over the workers, largest first to balance the load
+    devices.sort(key=lambda device: -len(device[0]))
+    chunks = [devices[i::_args.jobs] for i in range(_args.jobs)]
+    with multiprocessing.Pool(_args.jobs) as pool:
+        partial = pool.map(scoreAddress, [(sweeps, chunk, _args.tolerance) for chunk in chunks if chunk])
+
+    with outputPath.open('w', newline='') as outputFile:
+        writer = csv.DictWriter(outputFile, fieldnames=[
+            'Detector', 'Alerts', 'TruePositives', 'FalsePositives', 'Detected', 'Missed',
+            'Precision', 'Recall', 'FalsePositiveRate', 'MeanLatency'
+        ])
+        writer.writeheader()
+
+        for sweepIdx, (name, params) in enumerate(sweeps):
+            alerts, truePositives, detected, latency, connections, negatives = (
+                sum(result[sweepIdx][field] for result in partial) for field in range(6)
+            )
+            connections += unseenConnections
+            for lane, param in enumerate(params):
+                falsePositives = int(alerts[lane] - truePositives[lane])
+                writer.writerow({
+                    'Detector': name + ':' + ','.join(f'{k}={v}' for k, v in param.items()),
+                    'Alerts': int(alerts[lane]),
+                    'TruePositives': int(truePositives[lane]),
+                    'FalsePositives': falsePositives,
+                    'Detected': int(detected[lane]),
+                    'Missed': int(connections - detected[lane]),
+                    'Precision': truePositives[lane] / alerts[lane] if alerts[lane] else '',
+                    'Recall': detected[lane] / connections if connections else '',
+                    'FalsePositiveRate': falsePositives / negatives if negatives else '',
+                    'MeanLatency': latency[lane] / detected[lane] if detected[lane] else ''
+                })
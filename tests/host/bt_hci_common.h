@@ -0,0 +1,8 @@
+// Host build of the probe sources for the tests and benchmarks: the only definitions they take from the
+// ESP-IDF hci_common_component
+#pragma once
+
+#include <stdint.h>
+
+#define BD_ADDR_LEN 6
+typedef uint8_t bd_addr_t[BD_ADDR_LEN];
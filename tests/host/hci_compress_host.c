@@ -0,0 +1,25 @@
+// Runs main/hci-compress.c on the host: HCI events as "timestamp hex" lines on stdin (timestamp in us),
+// the frames the probe would send (BLE: and BLZ:) on stdout
+#include <stdio.h>
+
+#include "hci-compress.h"
+
+int main(void)
+{
+    static hc_state_t state;
+    static uint8_t frame[HC_FRAME_MAX_SIZE];
+    uint8_t event[HC_EVENT_MAX_SIZE];
+    long long timestamp;
+    char hex[2 * HC_EVENT_MAX_SIZE + 1];
+
+    hc_init(&state);
+    while (scanf("%lld %516s", &timestamp, hex) == 2) {
+        uint16_t len = 0;
+        unsigned int byte;
+        while (len < HC_EVENT_MAX_SIZE && sscanf(hex + 2 * len, "%2x", &byte) == 1) {
+            event[len++] = (uint8_t)byte;
+        }
+        fwrite(frame, 1, hc_encode(&state, timestamp, event, len, frame), stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,21 @@
+// Runs main/interval-histogram.c on the host: advertisement timestamps (ms) on stdin, one per line,
+// the detected connections as "timestamp,duration" on stdout
+#include <stdio.h>
+
+#include "interval-histogram.h"
+
+int main(void)
+{
+    interval_histogram_t hist;
+    const bd_addr_t addr = {0};
+    unsigned long timestamp;
+
+    interval_histogram_init(&hist, addr);
+    while (scanf("%lu", &timestamp) == 1) {
+        uint32_t duration = interval_histogram_update(&hist, (uint32_t)timestamp);
+        if (duration > 0) {
+            printf("%lu,%u\n", timestamp, (unsigned)duration);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+"""
+Synthetic BLE advertising traffic shared by the tests and the benchmarks
+"""
+import csv
+import io
+import random
+
+from advertising_events import ADVERTISING_CHANNELS
+
+CAPTURE_FIELDS = ['Timestamp', 'Address', 'AddressType', 'AdvertisingType', 'RSSI', 'Channel', 'DeviceName']
+
+# Advertising intervals (ms) of the synthetic devices
+INTERVALS = (100, 152.5, 211.25, 500, 1000, 1022.5, 2000)
+
+
+def randomAddress(rng, private=True):
+    """
+    Random device address, a random private (non-resolvable) one or a static random one
+    """
+    first = rng.randrange(0x40) if private else 0xC0 | rng.randrange(0x40)
+    return ':'.join(f'{byte:02x}' for byte in [first] + [rng.randrange(256) for _ in range(5)])
+
+
+def advertisingTraffic(devices=100, duration=60000, seed=0, loss=0.1, connectionRate=0.002, connection=(500, 4000)):
+    """
+    Reports of `devices` advertisers over `duration` ms, every advertising event sent on the three channels
+    (within 4 ms), every report lost with probability `loss`; after an event a device is in a connection
+    (silent for `connection` ms) with probability `connectionRate`
+    :return: (Rows in time order as read from a capture, advertising events heard (address, start),
+              connections (address, start, end))
+    """
+    rng = random.Random(seed)
+    rows = []
+    events = []
+    connections = []
+    for _ in range(devices):
+        address = randomAddress(rng)
+        interval = rng.choice(INTERVALS)
+        rssi = rng.randrange(-90, -40)
+        time = rng.uniform(1, interval)
+        while time < duration:
+            heard = []
+            for channel, delay in zip(ADVERTISING_CHANNELS, (0, rng.uniform(0.5, 2), rng.uniform(2.5, 4))):
+                if rng.random() >= loss:
+                    heard.append(int(time + delay))
+                    rows.append((int(time + delay), channel, address, rssi + rng.randrange(-3, 4)))
+            if heard:
+                events.append((address, min(heard)))
+            time += interval + rng.uniform(0, 10)  # advDelay [Core 5.4 Vol. 6, Part B, 4.4.2.2.1]
+            if rng.random() < connectionRate:
+                silence = rng.uniform(*connection)
+                connections.append((address, int(time), int(time + silence)))
+                time += silence
+    rows.sort(key=lambda row: (row[0], row[1]))
+    return ([{'Timestamp': str(timestamp), 'Address': address, 'AddressType': '1', 'AdvertisingType': '0',
+              'RSSI': str(rssi), 'Channel': str(channel), 'DeviceName': ''}
+             for timestamp, channel, address, rssi in rows],
+            sorted(events, key=lambda event: event[1]), connections)
+
+
+def captureText(rows):
+    """
+    CSV capture of the rows
+    """
+    text = io.StringIO()
+    writer = csv.DictWriter(text, fieldnames=CAPTURE_FIELDS)
+    writer.writeheader()
+    writer.writerows(rows)
+    return text.getvalue()
+
+
+def writeCapture(path, rows):
+    with open(path, 'w', newline='') as captureFile:
+        captureFile.write(captureText(rows))
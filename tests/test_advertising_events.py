@@ -0,0 +1,89 @@
+import io
+import unittest
+
+from advertising_events import AdvertisingEventAssembler, readEvents, __DAY__
+from models import parseTimestamp
+from tests.synthetic import advertisingTraffic, captureText
+
+
+def isoTimestamp(ms):
+    day, ms = divmod(ms, __DAY__)
+    return f'2026-10-{16 + day:02d}T{ms // 3600000:02d}:{ms // 60000 % 60:02d}:{ms % 60000 / 1000:06.3f}'
+
+
+class AdvertisingEventAssemblerTest(unittest.TestCase):
+
+    def test_groups_channels(self):
+        assembler = AdvertisingEventAssembler(10)
+        self.assertEqual(assembler.push('a', 100, 37, -50), [])
+        self.assertEqual(assembler.push('a', 102, 38, -52), [])
+        self.assertEqual(assembler.push('a', 104, 39, -54), [])
+        event, = assembler.flush()
+        self.assertEqual(event.timestamp, 100)
+        self.assertEqual(event.arrivals, {37: 100, 38: 102, 39: 104})
+        self.assertEqual(event.rssi, {37: -50, 38: -52, 39: -54})
+
+    def test_window_and_repeated_channel_split(self):
+        assembler = AdvertisingEventAssembler(10)
+        assembler.push('a', 100, 37, -50)
+        completed = assembler.push('a', 105, 37, -50)    # Same channel again: a new event
+        self.assertEqual([event.timestamp for event in completed], [100])
+        completed = assembler.push('b', 120, 37, -50)    # Expires the event of a
+        self.assertEqual([event.timestamp for event in completed], [105])
+        self.assertEqual([event.address for event in assembler.flush()], ['b'])
+
+    def test_late_report_keeps_order(self):
+        assembler = AdvertisingEventAssembler(10)
+        assembler.push('a', 100, 37, -50)
+        assembler.push('b', 108, 37, -50)
+        late = assembler.push('c', 50, 37, -50)     # Older than the window
+        self.assertEqual([(event.address, event.timestamp) for event in late], [('c', 50)])
+        # Not left open behind the newer events
+        completed = assembler.push('d', 115, 37, -50)
+        self.assertEqual([event.address for event in completed], ['a'])
+        self.assertEqual([event.address for event in assembler.flush()], ['b', 'd'])
+
+    def test_across_midnight(self):
+        assembler = AdvertisingEventAssembler(10)
+        assembler.push('a', __DAY__ - 2, 37, -50)
+        self.assertEqual(assembler.push('a', 1, 38, -52), [])     # Same event, after midnight
+        completed = assembler.push('b', 20, 37, -50)
+        self.assertEqual([(event.address, event.timestamp, event.arrivals) for event in completed],
+                         [('a', __DAY__ - 2, {37: __DAY__ - 2, 38: 1})])
+        # A report from before midnight after it is late, not the start of the next day
+        late = assembler.push('c', __DAY__ - 100, 37, -50)
+        self.assertEqual([event.timestamp for event in late], [__DAY__ - 100])
+        self.assertEqual([event.address for event in assembler.flush()], ['b'])
+
+
+class ReadEventsTest(unittest.TestCase):
+
+    def test_short_rows_skipped(self):
+        capture = io.StringIO('Timestamp,Address,AddressType,AdvertisingType,RSSI,Channel,DeviceName\n'
+                              '100,aa:bb:cc:dd:ee:ff,1,0,-50,37,\n'
+                              '101,aa:bb:cc:dd:ee:ff\n'
+                              '102,aa:bb:cc:dd:ee:ff,1,0,-50\n'
+                              '103,aa:bb:cc:dd:ee:ff,1,0,-51,38,\n')
+        event, = readEvents(capture)
+        self.assertEqual(event.arrivals, {37: 100, 38: 103})
+
+    def test_synthetic_traffic(self):
+        rows, expected, _ = advertisingTraffic(devices=50, duration=30000, seed=1)
+        events = list(readEvents(io.StringIO(captureText(rows))))
+        self.assertEqual(sorted((event.address, event.timestamp) for event in events), sorted(expected))
+        self.assertEqual(sum(len(event.arrivals) for event in events), len(rows))
+        self.assertLess(len(events), len(rows) / 2.5)
+
+    def test_capture_across_midnight(self):
+        rows, expected, _ = advertisingTraffic(devices=20, duration=20000, seed=2, loss=0)
+        start = __DAY__ - 10000     # 23:59:50
+        for row in rows:
+            row['Timestamp'] = isoTimestamp(start + int(row['Timestamp']))
+        events = list(readEvents(io.StringIO(captureText(rows))))
+        self.assertEqual(sorted((event.address, event.timestamp) for event in events),
+                         sorted((address, parseTimestamp(isoTimestamp(start + time))) for address, time in expected))
+        self.assertEqual({len(event.arrivals) for event in events}, {3})
+
+
+if __name__ == '__main__':
+    unittest.main()
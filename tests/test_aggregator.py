@@ -0,0 +1,141 @@
+import socket
+import time
+import unittest
+
+from aggregator import Aggregator
+from forwarder import EdgeForwarder
+from link import FRAME, HELLO, LINK_MAGIC, LINK_VERSION, HELLO_HEADER, PROBE, RECORDS, RECORDS_HEADER
+from link import sendFrame
+from records import packRecord
+
+
+def info(index):
+    return {'Address': f'c0:00:00:00:00:{index % 256:02x}', 'AddressType': 1, 'AdvertisingType': 0,
+            'Channel': 37 + index % 3, 'RSSI': -60, 'DeviceName': ''}
+
+
+class LoopbackTest(unittest.TestCase):
+    """
+    Aggregator and forwarders on the loopback interface
+    """
+
+    def setUp(self):
+        self.written = []
+        self.aggregator = Aggregator('127.0.0.1', 0, lambda link, probe, record: self.written.append(
+            (link, probe, record['Timestamp'])), reorderDelay=0.05, idleTimeout=0.5)
+        self.port = self.aggregator._server.getsockname()[1]
+        self.forwarders = []
+
+    def tearDown(self):
+        for forwarder in self.forwarders:
+            forwarder.close(timeout=0)
+        self.aggregator.close()
+
+    def forwarder(self, name):
+        forwarder = EdgeForwarder('127.0.0.1', self.port, name)
+        self.forwarders.append(forwarder)
+        return forwarder
+
+    def pollUntil(self, condition, timeout=10):
+        deadline = time.monotonic() + timeout
+        while not condition() and time.monotonic() < deadline:
+            self.aggregator.poll(0.01)
+        self.assertTrue(condition())
+
+
+class AggregatorTest(LoopbackTest):
+
+    def test_merges_links_in_time_order(self):
+        first = self.forwarder('first')
+        second = self.forwarder('second')
+        for index in range(1000):
+            (first if index % 2 else second).publish(f'probe{index % 3}', 1000000 + index * 10, info(index))
+
+        self.pollUntil(lambda: sum(link.records for link in self.aggregator.links.values()) == 1000)
+        self.aggregator.flush()
+        self.assertEqual([timestamp for _, _, timestamp in self.written], [1000000 + i * 10 for i in range(1000)])
+        self.assertEqual({(link, probe) for link, probe, _ in self.written},
+                         {(link, f'probe{i}') for link in ('first', 'second') for i in range(3)})
+        self.assertEqual(self.aggregator.late, 0)
+        self.assertEqual([link.lost for link in self.aggregator.links.values()], [0, 0])
+
+    def test_resume_after_a_lost_connection(self):
+        forwarder = self.forwarder('edge')
+        for index in range(500):
+            forwarder.publish('probe', 1000000 + index, info(index))
+        self.pollUntil(lambda: 'edge' in self.aggregator.links and self.aggregator.links['edge'].records == 500)
+
+        for key in list(self.aggregator._selector.get_map().values()):   # The link drops
+            if key.data is not None:
+                self.aggregator._disconnect(key.data)
+        for index in range(500, 1000):
+            forwarder.publish('probe', 1000000 + index, info(index))
+        self.pollUntil(lambda: self.aggregator.links['edge'].records == 1000)
+        self.aggregator.flush()
+
+        link = self.aggregator.links['edge']
+        self.assertGreaterEqual(link.connections, 2)
+        self.assertEqual(sorted(timestamp for _, _, timestamp in self.written), list(range(1000000, 1001000)))
+
+
+class MalformedFrameTest(LoopbackTest):
+    """
+    A malformed frame only drops its own connection, the other links keep being merged
+    """
+
+    def connect(self, name=b'bad'):
+        sock = socket.create_connection(('127.0.0.1', self.port))
+        sendFrame(sock, HELLO, HELLO_HEADER.pack(LINK_MAGIC, LINK_VERSION, 1) + name)
+        self.pollUntil(lambda: name.decode() in self.aggregator.links)
+        sock.recv(64)   # RESUME
+        return sock
+
+    def assertDropped(self, sock):
+        sock.settimeout(0.01)
+        deadline = time.monotonic() + 5
+        while time.monotonic() < deadline:
+            self.aggregator.poll(0.01)
+            try:
+                if sock.recv(64) == b'':
+                    break
+            except (socket.timeout, BlockingIOError):
+                pass
+            except ConnectionResetError:
+                break
+        else:
+            self.fail("Connection was not dropped.")
+        sock.close()
+
+        healthy = self.forwarder('healthy')
+        healthy.publish('probe', 5000000, info(0))
+        self.pollUntil(lambda: 'healthy' in self.aggregator.links and self.aggregator.links['healthy'].records == 1)
+
+    def test_short_hello(self):
+        sock = socket.create_connection(('127.0.0.1', self.port))
+        sendFrame(sock, HELLO, b'BLE')
+        self.assertDropped(sock)
+
+    def test_empty_probe(self):
+        sock = self.connect()
+        sendFrame(sock, PROBE, b'')
+        self.assertDropped(sock)
+
+    def test_short_records(self):
+        sock = self.connect()
+        sendFrame(sock, RECORDS, b'\x00' * (RECORDS_HEADER.size - 1))
+        self.assertDropped(sock)
+
+    def test_records_count_mismatch(self):
+        sock = self.connect()
+        sendFrame(sock, RECORDS, RECORDS_HEADER.pack(0, 3) + b'\x00' + packRecord(1000, info(0)))
+        self.assertDropped(sock)
+        self.assertEqual(self.aggregator.links['bad'].records, 0)
+
+    def test_frame_too_long(self):
+        sock = self.connect()
+        sock.sendall(FRAME.pack(RECORDS, 1 << 30))
+        self.assertDropped(sock)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,117 @@
+import csv
+import io
+import pathlib
+import struct
+import tempfile
+import unittest
+
+from checkpoint import loadSnapshot, writeSnapshot
+from live_detector import CaptureLines, LiveDetector
+from models import modelFactory
+from tests.synthetic import advertisingTraffic, writeCapture
+from tests.test_live_detector import periodic
+
+
+class StopFollowing(Exception):
+    pass
+
+
+class SnapshotTest(unittest.TestCase):
+
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.path = pathlib.Path(self.folder.name) / 'models.ckpt'
+
+    def tearDown(self):
+        self.folder.cleanup()
+
+    def test_round_trip(self):
+        spec = 'sliding_window:windowSize=5'
+        factory = modelFactory(spec)
+        detector = LiveDetector(factory)
+        for index, address in enumerate(['00:11:22:33:44:55', 'aa:bb:cc:dd:ee:ff']):
+            periodic(detector, address, 1000 + index, 100 + index * 20, 12)
+
+        writeSnapshot(self.path, spec, detector.models, factory, (1234, 5678))
+        models, capture = loadSnapshot(self.path, spec, factory)
+        self.assertEqual(capture, (1234, 5678))
+        self.assertEqual({a: str(m) for a, m in models.items()}, {a: str(m) for a, m in detector.models.items()})
+
+    def test_rejects_other_snapshots(self):
+        factory = modelFactory('simple_statistics')
+        writeSnapshot(self.path, 'simple_statistics', {}, factory)
+        with self.assertRaises(ValueError):
+            loadSnapshot(self.path, 'simple_statistics:initElements=5', factory)
+
+        self.path.write_bytes(struct.pack('<7sBIQH', b'BLECKPT', 1, 0, 0, 0))   # Version 1 had no capture position
+        with self.assertRaises(ValueError):
+            loadSnapshot(self.path, 'simple_statistics', factory)
+
+    def test_restore_is_an_outage(self):
+        factory = modelFactory('simple_statistics')
+        detector = LiveDetector(factory)
+        for address in range(50):
+            periodic(detector, f'00:00:00:00:00:{address:02x}', 1000 + address, 100, 20)
+        writeSnapshot(self.path, 'simple_statistics', detector.models, factory)
+
+        restarted = LiveDetector(factory)
+        restarted.restore(loadSnapshot(self.path, 'simple_statistics', factory)[0])
+        # Minutes later: no deadline of the old models fires and the silence is not measured
+        self.assertEqual(restarted.advance(600000), [])
+        self.assertEqual(periodic(restarted, '00:00:00:00:00:00', 600000, 100, 5), [])
+        # The restored model is scheduled again from its next advertisement
+        alert, = restarted.advance(600000 + 4 * 100 + 500)
+        self.assertEqual((alert['Address'], alert['Type']), ('00:00:00:00:00:00', 'deadline'))
+
+
+class CaptureLinesTest(unittest.TestCase):
+
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.path = pathlib.Path(self.folder.name) / 'capture.csv'
+        self.rows, _, _ = advertisingTraffic(devices=5, duration=2000, seed=3)
+        writeCapture(self.path, self.rows)
+
+    def tearDown(self):
+        self.folder.cleanup()
+
+    def test_resume_behind_processed_rows(self):
+        with self.path.open('r') as captureFile:
+            lines = CaptureLines(captureFile)
+            capture = csv.DictReader(lines)
+            first = [next(capture) for _ in range(10)]
+            position = lines.position
+
+        with self.path.open('r') as captureFile:
+            rest = list(csv.DictReader(CaptureLines(captureFile, resume=position)))
+
+        self.assertEqual([row['Timestamp'] for row in first + rest], [row['Timestamp'] for row in self.rows])
+
+    def test_partial_line_is_not_processed(self):
+        text = self.path.read_text()
+        end = text.index('\n', len(text) // 2) + 1   # Of a row in the middle
+        cut = end + 5
+        self.path.write_text(text[:cut])
+        calls = []
+
+        def idle():
+            calls.append(lines.position)
+            if len(calls) > 1:
+                raise StopFollowing()
+            with self.path.open('a') as captureFile:    # The collector completes the row
+                captureFile.write(text[cut:])
+
+        with self.path.open('r') as captureFile:
+            lines = CaptureLines(captureFile, idle)
+            rows = []
+            with self.assertRaises(StopFollowing):
+                for row in csv.DictReader(lines):
+                    rows.append(row)
+
+        self.assertEqual(calls[0], end)     # Behind the last complete row only
+        self.assertEqual(len(rows), len(self.rows))
+        self.assertEqual(calls[1], len(text))
+
+
+if __name__ == '__main__':
+    unittest.main()
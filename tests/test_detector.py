@@ -0,0 +1,75 @@
+import pathlib
+import subprocess
+import sys
+import tempfile
+import unittest
+
+from detector import specLabel
+from records import GAP_TYPE
+from tests.synthetic import advertisingTraffic, writeCapture
+from tests.test_models import REPOSITORY
+
+# One of every model, two configurations of one of them
+SPECS = ['simple_statistics', 'simple_statistics:thresholdFactor=2', 'sliding_window:windowSize=21',
+         'sliding_quantile', 'interval_histogram']
+VECTORISED_SPECS = ['simple_statistics', 'sliding_window:windowSize=21']
+
+
+def detect(capture, output, specs, *options):
+    result = subprocess.run([sys.executable, REPOSITORY / 'detector.py', capture, '-o', output, *options,
+                             *(option for spec in specs for option in ('-d', spec))],
+                            capture_output=True, text=True, timeout=120)
+    if result.returncode:
+        raise AssertionError(result.stderr)
+    return result
+
+
+class SinglePassTest(unittest.TestCase):
+
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.addCleanup(self.folder.cleanup)
+        self.directory = pathlib.Path(self.folder.name)
+        rows, _, _ = advertisingTraffic(devices=40, duration=90000, connectionRate=0.01)
+        # A capture outage from 40 s to 45 s
+        rows = [row for row in rows if not 40000 <= int(row['Timestamp']) < 45000]
+        resume = next(index for index, row in enumerate(rows) if int(row['Timestamp']) >= 45000)
+        rows.insert(resume, {'Timestamp': '40000', 'Address': '', 'AdvertisingType': GAP_TYPE, 'Channel': '37',
+                             'DeviceName': '45000'})
+        self.capture = self.directory / 'capture.csv'
+        writeCapture(self.capture, rows)
+
+    def assertSameAsSeparateRuns(self, specs, *options):
+        single = self.directory / 'single'
+        detect(self.capture, single, specs, *options)
+        for spec in specs:
+            separate = self.directory / specLabel(spec)
+            detect(self.capture, separate, [spec], *options)
+            for log in ('model', 'alerts'):
+                expected = (separate / f'capture.{log}.csv').read_text()
+                self.assertEqual((single / f'capture.{specLabel(spec)}.{log}.csv').read_text(), expected,
+                                 f'{spec} {log} {" ".join(options)}')
+                if log == 'alerts':
+                    self.assertGreater(expected.count('\n'), 1, f'{spec} raised no alert')
+        self.assertEqual(len(list(single.iterdir())), 2 * len(specs))
+
+    def test_same_logs_as_separate_runs(self):
+        self.assertSameAsSeparateRuns(SPECS)
+
+    def test_same_logs_as_separate_runs_of_events(self):
+        self.assertSameAsSeparateRuns(SPECS, '-e')
+
+    def test_same_logs_as_separate_runs_vectorised(self):
+        self.assertSameAsSeparateRuns(VECTORISED_SPECS, '-b', 'numpy')
+
+    def test_repeated_spec(self):
+        output = self.directory / 'repeated'
+        result = detect(self.capture, output, ['sliding_quantile', 'interval_histogram', 'sliding_quantile'])
+        self.assertIn('Ignoring 1 repeated detector(s).', result.stderr)
+        self.assertEqual(sorted(path.name for path in output.iterdir()),
+                         ['capture.interval_histogram.alerts.csv', 'capture.interval_histogram.model.csv',
+                          'capture.sliding_quantile.alerts.csv', 'capture.sliding_quantile.model.csv'])
+
+
+if __name__ == '__main__':
+    unittest.main()
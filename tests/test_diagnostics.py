@@ -0,0 +1,107 @@
+import io
+import json
+import time
+import unittest
+from unittest import mock
+
+import collector
+from fake_probe import __CALLBACK_TIME__, __PARSER_TIME__, __TASKS__
+from tests.test_warm_attach import FakeProbeTest
+
+# Device times (us) of two diagnostics frames 10 s apart, across the wrap of the 32-bit run time counters
+BEFORE_WRAP = 4294000000
+AFTER_WRAP = 4304000000
+
+
+class DiagnosticsTest(FakeProbeTest):
+
+    def setUp(self):
+        super().setUp()
+        self.log = io.StringIO()
+        for name, value in (('diagnostics_log', self.log), ('diagnostics_state', {})):
+            patcher = mock.patch.object(collector, name, value)
+            patcher.start()
+            self.addCleanup(patcher.stop)
+
+    def frame(self, probe, now, busy, reports):
+        """
+        Diagnostics frame of `probe` at device time `now`, after `busy` us of capture and `reports` reports
+        """
+        probe.busy, probe.reports = busy, reports
+        with mock.patch.object(probe, 'deviceTime', return_value=now):
+            frame = probe.diagnosticsFrame()
+        self.assertEqual(frame[:4], b'Dia:')
+        return collector.get_diagnostics_from_serial(io.BytesIO(frame[4:]))
+
+    def entries(self):
+        return [json.loads(line) for line in self.log.getvalue().splitlines()]
+
+    def test_decoding(self):
+        probe = self.probe(initDelay=60)    # Running but not capturing, no spontaneous frames
+        conn = self.open(probe)
+        deadline = time.monotonic() + 5
+        while not probe.running and time.monotonic() < deadline:
+            time.sleep(0.01)
+        conn.reset_input_buffer()
+        conn.write(b'DIA?\n')
+        self.assertEqual(conn.read(4), b'Dia:')
+        diagnostics = collector.get_diagnostics_from_serial(conn)
+        self.assertEqual(conn.in_waiting, 0)    # The whole frame was read
+
+        self.assertEqual((diagnostics['FreeHeap'], diagnostics['MinimumFreeHeap'], diagnostics['LargestFreeBlock']),
+                         (151000, 148200, 110592))
+        self.assertEqual(diagnostics['TotalRunTime'], diagnostics['Timestamp'] % (1 << 32))
+        self.assertEqual(diagnostics['Sections'], {
+            'callback': {'Executions': 0, 'Total': 0, 'Longest': 3 * __CALLBACK_TIME__},
+            'parser': {'Executions': 0, 'Total': 0, 'Longest': 4 * __PARSER_TIME__}})
+        self.assertEqual([(task['Name'], task['Core'], task['Priority'], task['StackHighWaterMark'])
+                          for task in diagnostics['Tasks']],
+                         [(name, None if core == 0xFF else core, priority, stack)
+                          for name, core, priority, stack in __TASKS__])
+
+    def test_counter_wrap(self):
+        probe = self.probe(initDelay=60)
+        first = self.frame(probe, BEFORE_WRAP, busy=1000000, reports=0)
+        second = self.frame(probe, AFTER_WRAP, busy=2500000, reports=1000)
+        # The total run time and the run time of the idle task of core 0 wrapped between the two frames
+        self.assertLess(second['TotalRunTime'], first['TotalRunTime'])
+        self.assertLess(second['Tasks'][0]['RunTime'], first['Tasks'][0]['RunTime'])
+        collector.log_diagnostics('ESP 1', first)
+        collector.log_diagnostics('ESP 1', second)
+
+        first, second = self.entries()
+        self.assertEqual(first['Probe'], 'ESP 1')
+        self.assertEqual([task['CPU'] for task in first['Tasks']], [None] * len(__TASKS__))
+        self.assertEqual(first['CoreLoad'], {})
+        self.assertEqual([section['Mean'] for section in first['Sections'].values()], [None, None])
+
+        # 1.5 s of capture in 10 s on core 0, split between the callback and the processing task; the other tasks
+        # run 1/200 of the time
+        cpu = {(task['Name'], task['Core']): task['CPU'] for task in second['Tasks']}
+        self.assertEqual(cpu[('IDLE', 0)], 85.0)
+        self.assertEqual(cpu[('IDLE', 1)], 99.5)
+        self.assertEqual(cpu[('btController', 0)], 3.16)
+        self.assertEqual(cpu[('Process HCI Event', 0)], 11.84)
+        self.assertEqual(cpu[('Probe Control', None)], 0.5)
+        self.assertEqual(second['CoreLoad'], {'0': 15.0, '1': 0.5})
+        self.assertEqual({name: section['Mean'] for name, section in second['Sections'].items()},
+                         {'callback': float(__CALLBACK_TIME__), 'parser': float(__PARSER_TIME__)})
+
+    def test_probes_and_restarts(self):
+        probe = self.probe(initDelay=60)
+        collector.log_diagnostics('ESP 1', self.frame(probe, BEFORE_WRAP, busy=0, reports=0))
+        collector.log_diagnostics('ESP 2', self.frame(probe, AFTER_WRAP, busy=0, reports=0))   # Own previous frame
+        collector.log_diagnostics('ESP 1', self.frame(probe, AFTER_WRAP, busy=2000000, reports=0))
+        collector.log_diagnostics('ESP 1', self.frame(probe, AFTER_WRAP, busy=2000000, reports=0))  # No time elapsed
+        entries = self.entries()
+        self.assertEqual([entry['Probe'] for entry in entries], ['ESP 1', 'ESP 2', 'ESP 1', 'ESP 1'])
+        self.assertEqual([entry['CoreLoad'] for entry in entries], [{}, {}, {'0': 20.0, '1': 0.5}, {}])
+
+        with mock.patch.object(collector, 'diagnostics_log', None):     # --diagnostics not given
+            collector.log_diagnostics('ESP 3', self.frame(probe, AFTER_WRAP, busy=0, reports=0))
+        self.assertEqual(len(self.entries()), 4)
+        self.assertNotIn('ESP 3', collector.diagnostics_state)
+
+
+if __name__ == '__main__':
+    unittest.main()
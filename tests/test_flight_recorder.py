@@ -0,0 +1,87 @@
+import csv
+import io
+import pathlib
+import struct
+import tempfile
+import unittest
+
+import collector
+from flight_recorder import FlightRecorder, advertisingReport, extract, readRing, reportAddresses
+
+
+class FlightRecorderTest(unittest.TestCase):
+
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.path = pathlib.Path(self.folder.name)
+
+    def tearDown(self):
+        self.folder.cleanup()
+
+    def test_keeps_the_newest_frames(self):
+        recorder = FlightRecorder(self.path / 'probe.ring', 1024)
+        frames = [(index * 1000, bytes([index % 256]) * (1 + index % 40)) for index in range(500)]
+        for timestamp, data in frames:
+            recorder.append(timestamp, data)
+        recorder.close()
+
+        kept = readRing(self.path / 'probe.ring')
+        self.assertGreater(len(kept), 10)
+        self.assertEqual(kept, frames[-len(kept):])
+        self.assertLessEqual(sum(16 + len(data) for _, data in kept), 1024)
+
+    def test_advertising_report(self):
+        report = advertisingReport('c0:01:02:03:04:05', 1, 0, -70, 'Sensor')
+        self.assertEqual(report[2], len(report) - 3)     # Parameter length
+        self.assertEqual(reportAddresses(report), ['c0:01:02:03:04:05'])
+        self.assertEqual(report[-9:-1], b'\x07\x09Sensor')
+        self.assertEqual(struct.unpack('<b', report[-1:])[0], -70)
+        self.assertEqual(len(advertisingReport('c0:01:02:03:04:05', 1, 0, -70, 'x' * 40)), 3 + 12 + 31)
+
+    def test_extract_window_of_an_address(self):
+        recorder = FlightRecorder(self.path / 'probe.ring', 65536)
+        for index in range(100):
+            recorder.append(1000000 + index * 1000, advertisingReport(f'c0:00:00:00:00:{index % 4:02x}', 1, 0, -60))
+        recorder.close()
+
+        count = extract([self.path / 'probe.ring'], self.path / 'out.pcap', 1010000, 1049000, 'c0:00:00:00:00:02')
+        self.assertEqual(count, 10)    # Frames 10..49 of every 4th
+        pcap = (self.path / 'out.pcap').read_bytes()
+        self.assertEqual(len(pcap), 24 + count * (16 + 4 + 15))    # Reports without a name
+
+
+class CollectorRecorderTest(unittest.TestCase):
+
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.path = pathlib.Path(self.folder.name)
+
+    def tearDown(self):
+        for recorder in collector.flight_recorders.values():
+            recorder.close()
+        collector.flight_recorders.clear()
+        self.folder.cleanup()
+
+    def test_no_recorder(self):
+        collector.extract_flight_recordings(10)     # Nothing to extract, no probe enabled
+
+    def test_advertising_mode_is_recorded(self):
+        collector.flight_recorders['probe'] = FlightRecorder(self.path / 'probe.ring', 65536)
+        writer = csv.DictWriter(io.StringIO(), fieldnames=[
+            'Timestamp', 'Address', 'AddressType', 'AdvertisingType', 'RSSI', 'Channel', 'DeviceName'
+        ])
+        collector.write_advertising_info('probe', 1700000000000000, {
+            'Timestamp': 1500, 'Address': 'c0:01:02:03:04:05', 'AddressType': 1, 'AdvertisingType': 0,
+            'Channel': 37, 'RSSI': -55, 'DeviceName': 'Tag'
+        }, writer)
+
+        (timestamp, data), = readRing(self.path / 'probe.ring')
+        self.assertEqual(timestamp, 1700000000001500)
+        self.assertEqual(reportAddresses(data), ['c0:01:02:03:04:05'])
+
+        collector.extract_flight_recordings(3600 * 24 * 365 * 100)
+        self.assertEqual(len(list(self.path.glob('trigger_*.pcap'))), 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
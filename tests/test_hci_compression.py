@@ -0,0 +1,180 @@
+import io
+import pathlib
+import random
+import shutil
+import struct
+import subprocess
+import tempfile
+import unittest
+
+from hci_compression import HciStreamDecoder, crc8
+from tests.test_models import REPOSITORY
+
+
+def advertisingReport(address, payload, rssi, eventType=0, addressType=1):
+    """
+    HCI LE Advertising Report event (H4 type included) of a single report
+    """
+    parameters = bytes((0x02, 1, eventType, addressType)) + address + bytes((len(payload),)) + payload
+    parameters += struct.pack('<b', rssi)
+    return bytes((0x04, 0x3e, len(parameters))) + parameters
+
+
+def eventTrace(devices=150, duration=12000000, seed=0):
+    """
+    (timestamp us, HCI event) of advertisers with a varying RSSI and counter byte, and a few other events
+    """
+    rng = random.Random(seed)
+    advertisers = []
+    for _ in range(devices):
+        advertisers.append((rng.randbytes(6), bytearray(rng.randbytes(rng.randrange(3, 32))), rng.randrange(1, 20)))
+    events = []
+    timestamp = 0
+    while timestamp < duration:
+        timestamp += rng.randrange(1, 3000)
+        if rng.random() < 0.01:
+            events.append((timestamp, b'\x04\x0e\x04\x05\x0c\x20\x00'))   # Command Complete, never kept
+            continue
+        address, payload, _ = rng.choices(advertisers, weights=[a[2] for a in advertisers])[0]
+        if rng.random() < 0.3:
+            payload[-1] = (payload[-1] + 1) % 256
+        events.append((timestamp, advertisingReport(address, bytes(payload), rng.randrange(-95, -40))))
+    return events
+
+
+def encode(binary, events):
+    lines = ''.join(f'{timestamp} {event.hex()}\n' for timestamp, event in events)
+    return subprocess.run([binary], input=lines.encode(), capture_output=True, check=True).stdout
+
+
+def decodeStream(data, decoder=None):
+    """
+    Events of a probe stream as the capture loop of the collector decodes them, resynchronising on a plain frame
+    after a transmission error
+    """
+    decoder = decoder or HciStreamDecoder()
+    stream = io.BytesIO(data)
+    events = []
+    try:
+        while True:
+            start = stream.read(4)
+            if not start:
+                return events
+            if start == b'BLE:':
+                timestamp, length = struct.unpack('<qH', stream.read(10))
+                event = stream.read(length)
+                decoder.plain(timestamp, event)
+                events.append((timestamp, event))
+            elif start == b'BLZ:':
+                decoded = decoder.compressed(stream)
+                if decoded is not None:
+                    events.append(decoded)
+            else:
+                decoder.lost()
+                position = data.find(b'BLE:', stream.tell())
+                if position < 0:
+                    return events
+                stream.seek(position)
+    except EOFError:
+        return events
+
+
+def frameOffsets(data, start=b'BLZ:'):
+    offsets = []
+    position = data.find(start)
+    while position >= 0:
+        offsets.append(position)
+        position = data.find(start, position + 1)
+    return offsets
+
+
+@unittest.skipIf(shutil.which('cc') is None, 'No C compiler')
+class ProbeStreamTest(unittest.TestCase):
+    """
+    Decoding of the frames of the probe encoder (main/hci-compress.c built for the host)
+    """
+
+    @classmethod
+    def setUpClass(cls):
+        cls.directory = tempfile.TemporaryDirectory()
+        cls.binary = pathlib.Path(cls.directory.name, 'hci_compress_host')
+        subprocess.run(['cc', '-O2', '-I', REPOSITORY / 'main', REPOSITORY / 'main' / 'hci-compress.c',
+                        REPOSITORY / 'tests' / 'host' / 'hci_compress_host.c', '-o', cls.binary], check=True)
+        cls.events = eventTrace()
+        cls.stream = encode(cls.binary, cls.events)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.directory.cleanup()
+
+    def assertNoWrongEvent(self, decoded):
+        expected = dict(self.events)
+        for timestamp, event in decoded:
+            self.assertEqual(event, expected.get(timestamp), timestamp)
+
+    def test_round_trip(self):
+        decoder = HciStreamDecoder()
+        self.assertEqual(decodeStream(self.stream, decoder), self.events)
+        self.assertEqual((decoder.skipped, decoder.corrupted), (0, 0))
+        self.assertGreater(decoder.ratio(), 2)
+        self.assertEqual(decoder.wireBytes, len(self.stream))
+
+    def test_attach_mid_stream(self):
+        offsets = frameOffsets(self.stream)
+        decoder = HciStreamDecoder()
+        decoded = decodeStream(self.stream[offsets[len(offsets) // 4]:], decoder)
+        self.assertNoWrongEvent(decoded)
+        self.assertGreater(decoder.skipped, 0)
+        self.assertEqual(decoded[-100:], self.events[-100:])    # Every advertiser was refreshed since
+
+    def test_corrupted_frames_are_dropped(self):
+        rng = random.Random(1)
+        offsets = frameOffsets(self.stream)
+        for _ in range(40):
+            corrupted = bytearray(self.stream)
+            # Within a compressed frame, after its start sequence
+            position = rng.choice(offsets[:len(offsets) // 4]) + 4 + rng.randrange(6)
+            corrupted[position] ^= 1 << rng.randrange(8)
+            decoder = HciStreamDecoder()
+            decoded = decodeStream(bytes(corrupted), decoder)
+            self.assertNoWrongEvent(decoded)
+            self.assertEqual(decoded[-100:], self.events[-100:])
+
+
+class InvalidFrameTest(unittest.TestCase):
+
+    def decode(self, body, checksum=None):
+        decoder = HciStreamDecoder()
+        decoder.plain(1000, b'\x04\x0e\x04\x05\x0c\x20\x00')
+        frame = body + bytes((crc8(body) if checksum is None else checksum,))
+        return decoder, decoder.compressed(io.BytesIO(frame))
+
+    def test_literal(self):
+        event = advertisingReport(b'\x01' * 6, b'\x02\x01\x06', -60)
+        decoder, decoded = self.decode(bytes((10, 0x80 | 3, len(event))) + event)
+        self.assertEqual(decoded, (1010, event))
+        self.assertEqual(decoder.slots[3], event)
+
+    def test_invalid_frames(self):
+        event = advertisingReport(b'\x01' * 6, b'\x02\x01\x06', -60)
+        for body, checksum in [
+            (bytes((10, 0x80 | 3, len(event))) + event, crc8(b'other')),   # Checksum mismatch
+            (b'\xff' * 12, None),                       # Varint beyond 64 bits
+            (bytes((10, 0x80, 0x83, 0x02)), None),      # Event longer than any HCI event
+            (bytes((10, 0x7f, 4, 0, 0, 0, 0)), None),   # Delta without slot
+            (bytes((10, 0x80 | 125, 1, 0)), None),      # Slot beyond the probe slots
+            (bytes((10, 3, 4, 0, 0)), None),            # Empty delta runs, would never end
+            (bytes((10, 3, 4, 2, 5)) + b'\0' * 5, None),    # Delta runs past the event
+        ]:
+            decoder, decoded = self.decode(body, checksum)
+            self.assertIsNone(decoded, body)
+            self.assertEqual(decoder.corrupted, 1)
+            self.assertFalse(decoder.synchronised)  # Decoded again from the next plain frame
+
+    def test_truncated_frame(self):
+        with self.assertRaises(EOFError):
+            HciStreamDecoder().compressed(io.BytesIO(bytes((10, 0x80 | 3, 20, 1, 2))))
+
+
+if __name__ == '__main__':
+    unittest.main()
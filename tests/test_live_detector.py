@@ -0,0 +1,51 @@
+import unittest
+
+from live_detector import LiveDetector, __DAY__
+from models import modelFactory
+
+
+def periodic(detector, address, start, interval, count):
+    """
+    Advertisements every `interval` ms, give or take 5 ms
+    """
+    alerts = []
+    for index in range(count):
+        alerts += detector.processAdv(address, (start + index * interval + index % 3 * 5) % __DAY__)
+    return alerts
+
+
+class LiveDetectorTest(unittest.TestCase):
+
+    def test_deadline_before_next_advertisement(self):
+        detector = LiveDetector(modelFactory('simple_statistics'))
+        self.assertEqual(periodic(detector, 'a', 1000, 100, 20), [])
+        last = 1000 + 19 * 100 + 5
+        self.assertEqual(detector.advance(last + 110), [])
+        alert, = detector.advance(last + 400)
+        self.assertEqual((alert['Address'], alert['Type']), ('a', 'deadline'))
+        self.assertLess(alert['Timestamp'], last + 400)
+        end, = detector.processAdv('a', last + 3000)
+        self.assertEqual((end['Type'], end['Duration']), ('end', 3000))
+
+    def test_deadlines_across_midnight(self):
+        detector = LiveDetector(modelFactory('simple_statistics'))
+        start = __DAY__ - 1500
+        self.assertEqual(periodic(detector, 'a', start, 100, 30), [])     # Until 01:30 past midnight
+        self.assertEqual(detector.dayOffset, __DAY__)
+        last = (start + 29 * 100 + 10) % __DAY__
+        alert, = detector.advance(last + 400)
+        self.assertEqual(alert['Type'], 'deadline')
+        self.assertTrue(last < alert['Timestamp'] < last + 400)   # On the capture clock
+        end, = detector.processAdv('a', last + 2000)
+        self.assertEqual((end['Type'], end['Timestamp'], end['Duration']), ('end', last + 2000, 2000))
+
+    def test_late_row_from_before_midnight(self):
+        detector = LiveDetector(modelFactory('simple_statistics'))
+        detector.processAdv('a', __DAY__ - 10)
+        detector.processAdv('b', 5)
+        self.assertEqual(detector.timeline(__DAY__ - 5), __DAY__ - 5)
+        self.assertEqual(detector.timeline(20), __DAY__ + 20)
+
+
+if __name__ == '__main__':
+    unittest.main()
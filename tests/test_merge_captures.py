@@ -0,0 +1,149 @@
+import csv
+import pathlib
+import random
+import subprocess
+import sys
+import tempfile
+import unittest
+from unittest import mock
+
+import merge_captures
+from merge_captures import CaptureSorter, readBlocks, sortKey
+from tests.synthetic import CAPTURE_FIELDS, advertisingTraffic, writeCapture
+from tests.test_models import REPOSITORY
+
+
+def looselyOrdered(rows, rng, window=50):
+    """
+    Rows shuffled within consecutive windows, as the reports of several probes are written
+    """
+    shuffled = []
+    for start in range(0, len(rows), window):
+        chunk = rows[start:start + window]
+        rng.shuffle(chunk)
+        shuffled += chunk
+    return shuffled
+
+
+def readCapture(path):
+    with open(path, newline='') as captureFile:
+        reader = csv.reader(captureFile)
+        return next(reader), list(reader)
+
+
+class MergeCapturesTest(unittest.TestCase):
+
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.directory = pathlib.Path(self.folder.name)
+        self.output = self.directory / 'merged.csv'
+
+    def tearDown(self):
+        self.folder.cleanup()
+
+    def captures(self, sessions=3, devices=30, duration=20000):
+        """
+        Capture files of consecutive, overlapping sessions
+        :return: (Paths, all the rows)
+        """
+        rng = random.Random(0)
+        paths = []
+        everything = []
+        for session in range(sessions):
+            rows, _, _ = advertisingTraffic(devices, duration, seed=session)
+            for row in rows:
+                row['Timestamp'] = str(int(row['Timestamp']) + session * duration // 2)
+            paths.append(self.directory / f'2026-10-{16 + session:02d}_10-00.csv')
+            writeCapture(paths[-1], looselyOrdered(rows, rng))
+            everything += rows
+        return paths, everything
+
+    def assertTimeOrdered(self, rows, position=0):
+        keys = [int(row[position]) for row in rows]
+        self.assertEqual(keys, sorted(keys))
+
+    def test_global_order(self):
+        paths, everything = self.captures()
+        sorter = CaptureSorter(memory=64, jobs=2, temporaryDirectory=self.directory)
+        sorter.blockSize = 64 * 1024    # Several runs per input
+        sorter.fanIn = 4                # Intermediate merges
+        with mock.patch.object(merge_captures, '__READ_SIZE__', 4096):
+            sorter.sort(paths, self.output)
+
+        header, rows = readCapture(self.output)
+        self.assertEqual(header, CAPTURE_FIELDS)
+        self.assertTimeOrdered(rows)
+        self.assertEqual(sorted(map(tuple, rows)), sorted(tuple(row.values()) for row in everything))
+        self.assertGreater(sorter.runs, 4)
+        self.assertEqual((sorter.rows, sorter.invalid, sorter.duplicates), (len(everything), 0, 0))
+        # The runs were removed with their directory
+        self.assertEqual(sorted(self.directory.iterdir()), sorted(paths + [self.output]))
+
+    def test_deduplicate(self):
+        paths, everything = self.captures(sessions=1)
+        copy = self.directory / 'copy.csv'
+        copy.write_bytes(paths[0].read_bytes())     # The same session saved by two collectors
+        sorter = CaptureSorter(memory=64, jobs=2)
+        sorter.sort(paths + [copy], self.output, deduplicated=True)
+        _, rows = readCapture(self.output)
+        self.assertEqual(len(rows), len(everything))
+        self.assertEqual(sorter.duplicates, len(everything))
+        self.assertTimeOrdered(rows)
+
+    def test_columns_and_invalid_rows(self):
+        first = self.directory / 'first.csv'
+        first.write_text('Timestamp,Address,DeviceName\n'
+                         '3000,c0:00:00:00:00:01,"Line\nbreak, and ""quotes"""\n'
+                         'soon,c0:00:00:00:00:02,\n'
+                         '1000,c0:00:00:00:00:01\n')
+        second = self.directory / 'second.csv'
+        second.write_text('Address,Timestamp,RSSI\nc0:00:00:00:00:03,2000,-60\n')
+        sorter = CaptureSorter(memory=64, jobs=1)
+        sorter.sort([first, second], self.output)
+        header, rows = readCapture(self.output)
+        self.assertEqual(header, ['Timestamp', 'Address', 'DeviceName', 'RSSI'])
+        self.assertEqual(rows, [['2000', 'c0:00:00:00:00:03', '', '-60'],
+                                ['3000', 'c0:00:00:00:00:01', 'Line\nbreak, and "quotes"', '']])
+        self.assertEqual(sorter.invalid, 2)
+
+    def test_blocks_end_outside_quoted_fields(self):
+        path = self.directory / 'names.csv'
+        names = [f'"Name {index}\n{"x" * (index % 300)}\n"' for index in range(5000)]
+        path.write_text('Timestamp,DeviceName\n' + ''.join(f'{index},{name}\n' for index, name in enumerate(names)))
+        with mock.patch.object(merge_captures, '__READ_SIZE__', 4096):
+            blocks = list(readBlocks(path, 1 << 16))
+        self.assertGreater(len(blocks), 1)
+        for block in blocks:
+            self.assertEqual(block.count(b'"') % 2, 0)
+            self.assertTrue(block.endswith(b'\n'))
+        self.assertEqual(b''.join(blocks), path.read_bytes().split(b'\n', 1)[1])
+
+    def test_timestamps(self):
+        self.assertEqual(sortKey('1500'), 1500000)
+        self.assertLess(sortKey('2026-10-16T23:59:59.999999'), sortKey('2026-10-17T00:00:00'))
+        with self.assertRaises(ValueError):
+            sortKey('12:00')
+
+    def test_not_a_capture(self):
+        path = self.directory / 'other.csv'
+        path.write_text('Address,RSSI\nc0:00:00:00:00:01,-60\n')
+        result = subprocess.run([sys.executable, REPOSITORY / 'merge_captures.py', path, '-o', self.output],
+                                capture_output=True, text=True, timeout=30)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn('no Timestamp column', result.stderr)
+        self.assertFalse(self.output.exists())
+
+    def test_command_line(self):
+        paths, everything = self.captures(sessions=2)
+        result = subprocess.run([sys.executable, REPOSITORY / 'merge_captures.py', *paths, '-o', self.output,
+                                 '-j', '2', '-m', '64', '-d'], capture_output=True, text=True, timeout=60)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertIn(f'{len(everything)} rows from 2 files', result.stdout)
+        self.assertIn('0 duplicate rows dropped', result.stdout)
+        self.assertIn('Peak memory', result.stdout)
+        _, rows = readCapture(self.output)
+        self.assertTimeOrdered(rows)
+
+
+if __name__ == '__main__':
+    unittest.main()
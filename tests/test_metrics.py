@@ -0,0 +1,117 @@
+import pathlib
+import random
+import socket
+import tempfile
+import unittest
+import urllib.error
+import urllib.request
+
+import collector
+from metrics import HdrHistogram, MetricsExporter, MetricsRegistry
+
+
+class HdrHistogramTest(unittest.TestCase):
+
+    def test_quantiles_within_precision(self):
+        rng = random.Random(0)
+        values = sorted(int(rng.lognormvariate(8, 3)) for _ in range(20000))
+        histogram = HdrHistogram()
+        for value in values:
+            histogram.recordValue(value)
+        self.assertEqual(histogram.count, len(values))
+        self.assertEqual(histogram.max, values[-1])
+        self.assertAlmostEqual(histogram.mean(), sum(values) / len(values))
+        for quantile in (0.01, 0.5, 0.9, 0.99, 0.999):
+            exact = values[int(len(values) * quantile) - 1]
+            self.assertLessEqual(abs(histogram.valueAtQuantile(quantile) - exact), exact / 128 + 1, quantile)
+        self.assertEqual(histogram.valueAtQuantile(1), values[-1])
+
+    def test_small_values_are_exact(self):
+        histogram = HdrHistogram()
+        for value in range(256):
+            histogram.recordValue(value)
+        self.assertEqual(histogram.valueAtQuantile(0.5), 127)
+        self.assertEqual(histogram.valueAtQuantile(0), 0)
+
+    def test_out_of_range_values(self):
+        histogram = HdrHistogram()
+        histogram.recordValue(-5)   # Clamped, the clock estimate placed the event before its cause
+        histogram.recordValue(1 << 40, count=3)     # Beyond the preallocated range, the buckets grow
+        self.assertEqual(histogram.valueAtQuantile(0.25), 0)
+        self.assertAlmostEqual(histogram.valueAtQuantile(0.5), 1 << 40, delta=(1 << 40) / 128)
+        self.assertEqual(histogram.total, 3 << 40)
+
+    def test_add(self):
+        rng = random.Random(1)
+        first, second, both = HdrHistogram(), HdrHistogram(), HdrHistogram()
+        for _ in range(5000):
+            value = rng.randrange(1 << 20)
+            (first if rng.random() < 0.3 else second).recordValue(value)
+            both.recordValue(value)
+        second.recordValue(1 << 36)
+        both.recordValue(1 << 36)
+        first.add(second)
+        self.assertEqual(first.counts, both.counts)
+        self.assertEqual((first.count, first.total, first.max), (both.count, both.total, both.max))
+
+
+class ProbeMetricsTest(unittest.TestCase):
+
+    def test_delay_buckets(self):
+        instruments = collector.ProbeMetrics(MetricsRegistry('test'), 'ESP 1')
+        counts = [0] * 24
+        counts[0], counts[1], counts[9] = 2, 1, 7     # Values 0, 1 and [256, 512)
+        instruments.delays_received(tuple(counts))
+        self.assertEqual(instruments.queue.count, 10)
+        self.assertEqual(instruments.queue.valueAtQuantile(0.2), 0)
+        self.assertEqual(instruments.queue.valueAtQuantile(0.3), 1)
+        self.assertEqual(instruments.queue.valueAtQuantile(1), 384)
+
+
+class MetricsRegistryTest(unittest.TestCase):
+
+    def registry(self):
+        registry = MetricsRegistry('test')
+        histogram = registry.histogram('stage_latency', 'Latency of a stage', probe='ESP "1"', stage='queue')
+        for value in (50, 100, 150, 200):    # Exact below 256 us
+            histogram.recordValue(value)
+        registry.counter('records', 'Records written', probe='ESP 1').value = 42
+        registry.gauges('top', 'Heaviest advertisers', lambda: [({'address': 'aa'}, 7)])
+        return registry
+
+    def test_prometheus_text(self):
+        lines = self.registry().render().splitlines()
+        self.assertIn('# TYPE test_stage_latency_seconds summary', lines)
+        self.assertIn('test_stage_latency_seconds{probe="ESP \\"1\\"",stage="queue",quantile="0.5"} 0.000100', lines)
+        self.assertIn('test_stage_latency_seconds_sum{probe="ESP \\"1\\"",stage="queue"} 0.000500', lines)
+        self.assertIn('test_stage_latency_seconds_count{probe="ESP \\"1\\"",stage="queue"} 4', lines)
+        self.assertIn('# TYPE test_records_total counter', lines)
+        self.assertIn('test_records_total{probe="ESP 1"} 42', lines)
+        self.assertIn('test_top{address="aa"} 7', lines)
+
+    def test_series_are_shared(self):
+        registry = MetricsRegistry('test')
+        self.assertIs(registry.counter('records', '', probe='a'), registry.counter('records', '', probe='a'))
+        self.assertIsNot(registry.counter('records', '', probe='a'), registry.counter('records', '', probe='b'))
+
+    def test_exporter(self):
+        registry = self.registry()
+        with socket.socket() as probe:  # A free port
+            probe.bind(('127.0.0.1', 0))
+            port = probe.getsockname()[1]
+        with tempfile.TemporaryDirectory() as folder:
+            path = pathlib.Path(folder) / 'textfile' / 'collector.prom'
+            exporter = MetricsExporter(registry, path, port, interval=3600)
+            try:
+                with urllib.request.urlopen(f'http://127.0.0.1:{port}/metrics', timeout=5) as response:
+                    self.assertEqual(response.read().decode('utf8'), registry.render())
+                with self.assertRaises(urllib.error.HTTPError):
+                    urllib.request.urlopen(f'http://127.0.0.1:{port}/other', timeout=5)
+            finally:
+                exporter.close()
+            self.assertEqual(path.read_text(), registry.render())   # Written once more when closed
+            self.assertEqual([file.name for file in path.parent.iterdir()], ['collector.prom'])
+
+
+if __name__ == '__main__':
+    unittest.main()
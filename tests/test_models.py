@@ -0,0 +1,160 @@
+import pathlib
+import random
+import shutil
+import statistics
+import subprocess
+import tempfile
+import unittest
+
+from models import ConnectionAlert, ModelInitialised
+from models import IntervalHistogramModel, SlidingQuantileModel
+
+REPOSITORY = pathlib.Path(__file__).resolve().parent.parent
+
+
+def feed(model, timestamps):
+    """
+    Feed the advertisements to the model, return the (timestamp, duration) of its alerts
+    """
+    alerts = []
+    for timestamp in timestamps:
+        try:
+            model.processAdv(timestamp)
+        except ModelInitialised:
+            pass
+        except ConnectionAlert as alert:
+            alerts.append((alert.timestamp, alert.duration))
+    return alerts
+
+
+def jittered(start, interval, count, seed=0):
+    """
+    Advertisements every `interval` ms plus the random advertising delay (0-10 ms)
+    """
+    rng = random.Random(seed)
+    timestamps = [start]
+    for _ in range(count - 1):
+        timestamps.append(timestamps[-1] + interval + rng.randrange(11))
+    return timestamps
+
+
+class SlidingQuantileModelTest(unittest.TestCase):
+
+    def test_exact_quantiles(self):
+        rng = random.Random(2)
+        model = SlidingQuantileModel(windowSize=31)
+        timestamps = [1000]
+        for _ in range(200):
+            timestamps.append(timestamps[-1] + rng.randrange(90, 140))
+            feed(model, timestamps[-1:])
+            window = sorted(model.window)
+            self.assertEqual(model.ordered, window)
+            if len(window) < 2:
+                continue
+            self.assertEqual(model.quantile(0.5), statistics.median(window))
+            self.assertEqual(model.quantile(0.25), statistics.quantiles(window, n=4, method='inclusive')[0])
+        self.assertEqual(len(model.window), 31)
+
+    def test_connection_alert(self):
+        model = SlidingQuantileModel()
+        timestamps = jittered(1000, 100, 40)
+        self.assertEqual(feed(model, timestamps), [])
+        alerts = feed(model, [timestamps[-1] + 2000, timestamps[-1] + 2105])
+        self.assertEqual(alerts, [(timestamps[-1] + 2000, 2000)])
+
+    def test_outlier_does_not_move_threshold(self):
+        model = SlidingQuantileModel(windowSize=11)
+        timestamps = jittered(1000, 100, 30)
+        feed(model, timestamps)
+        before = model.threshold()
+        # A missed advertisement (200 ms) enters the window, the quantiles barely move
+        feed(model, [timestamps[-1] + 205])
+        self.assertLess(abs(model.threshold() - before), 15)
+
+    def test_short_silences_ignored(self):
+        model = SlidingQuantileModel(windowSize=3)
+        feed(model, [1000, 1005, 1100, 1103, 1200, 1300])
+        self.assertEqual(list(model.window), [95, 97, 100])
+
+    def test_state_round_trip(self):
+        model = SlidingQuantileModel(windowSize=11)
+        feed(model, jittered(1000, 100, 8))
+        restored = SlidingQuantileModel(windowSize=11)
+        restored.unpackState(model.packState())
+        self.assertEqual(str(restored), str(model))
+        self.assertEqual(restored.initCnt, model.initCnt)
+
+
+def withConnections(start, interval, count, seed=0):
+    """
+    Jittered advertisements interrupted by connections and missed advertisements
+    """
+    rng = random.Random(seed)
+    timestamps = [start]
+    for _ in range(count - 1):
+        silence = interval + rng.randrange(11)
+        if rng.random() < 0.02:
+            silence += rng.randrange(300, 5000)
+        elif rng.random() < 0.05:
+            silence += interval
+        timestamps.append(timestamps[-1] + silence)
+    return timestamps
+
+
+class IntervalHistogramModelTest(unittest.TestCase):
+
+    def test_buckets(self):
+        for interval in range(16, 20000):
+            idx = IntervalHistogramModel.bucketIndex(interval)
+            if idx < IntervalHistogramModel.BucketCount - 1:
+                self.assertLessEqual(IntervalHistogramModel.bucketLowerBound(idx), interval)
+                self.assertLess(interval, IntervalHistogramModel.bucketLowerBound(idx + 1))
+        self.assertEqual(IntervalHistogramModel.bucketIndex(5), 0)
+        self.assertEqual(IntervalHistogramModel.bucketIndex(10 ** 6), IntervalHistogramModel.BucketCount - 1)
+
+    def test_decay(self):
+        model = IntervalHistogramModel(decayLimit=64)
+        for _ in range(63):
+            model.addInterval(100)
+        model.addInterval(1000)
+        self.assertEqual(sum(model.buckets), 64)
+        model.addInterval(100)     # Reaches the limit: everything is halved
+        self.assertEqual(model.buckets[model.bucketIndex(100)], 32)
+        self.assertEqual(model.buckets[model.bucketIndex(1000)], 0)
+
+    def test_connection_alert(self):
+        model = IntervalHistogramModel()
+        timestamps = jittered(1000, 100, 40)
+        self.assertEqual(feed(model, timestamps), [])
+        self.assertEqual(feed(model, [timestamps[-1] + 1500]), [(timestamps[-1] + 1500, 1500)])
+
+    def test_fixed_state(self):
+        model = IntervalHistogramModel()
+        feed(model, withConnections(1000, 100, 5000))
+        self.assertEqual(model.stateStruct().size, 52)
+        self.assertEqual(len(model.buckets), IntervalHistogramModel.BucketCount)
+        restored = IntervalHistogramModel()
+        restored.unpackState(model.packState())
+        self.assertEqual(str(restored), str(model))
+
+    @unittest.skipIf(shutil.which('cc') is None, 'No C compiler')
+    def test_same_as_probe(self):
+        """
+        The host model and the probe implementation (main/interval-histogram.c) detect the same connections
+        """
+        with tempfile.TemporaryDirectory() as directory:
+            binary = pathlib.Path(directory, 'interval_histogram_host')
+            subprocess.run(['cc', '-O2', '-I', REPOSITORY / 'main', '-I', REPOSITORY / 'tests' / 'host',
+                            REPOSITORY / 'main' / 'interval-histogram.c',
+                            REPOSITORY / 'tests' / 'host' / 'interval_histogram_host.c', '-o', binary], check=True)
+            for seed, interval in enumerate((30, 100, 152, 1000, 2000)):
+                timestamps = withConnections(1000, interval, 3000, seed)
+                probe = subprocess.run([binary], input='\n'.join(map(str, timestamps)), capture_output=True,
+                                       text=True, check=True).stdout.split()
+                host = feed(IntervalHistogramModel(), timestamps)
+                self.assertGreater(len(host), 10)
+                self.assertEqual(probe, [f'{timestamp},{duration}' for timestamp, duration in host])
+
+
+if __name__ == '__main__':
+    unittest.main()
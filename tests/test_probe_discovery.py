@@ -0,0 +1,129 @@
+import os
+import pathlib
+import pty
+import select
+import signal
+import subprocess
+import sys
+import threading
+import tty
+import unittest
+from unittest import mock
+
+import serial
+
+import collector
+from tests.test_models import REPOSITORY
+from tests.test_warm_attach import FakeProbeTest
+
+
+class OtherDevice(threading.Thread):
+    """
+    Serial device which is not a probe: it answers every line with `answer` (nothing if empty)
+    """
+
+    def __init__(self, path, answer=b''):
+        super().__init__(daemon=True)
+        self.master, self._slave = pty.openpty()
+        tty.setraw(self._slave)
+        self.path = pathlib.Path(path)
+        self.path.symlink_to(os.ttyname(self._slave))
+        self.answer = answer
+        self.stopped = False
+
+    def run(self):
+        while not self.stopped:
+            if select.select([self.master], [], [], 0.1)[0]:
+                if b'\n' in os.read(self.master, 256) and self.answer:
+                    os.write(self.master, self.answer)
+
+    def stop(self):
+        self.stopped = True
+        self.join()
+        os.close(self.master)
+        os.close(self._slave)
+
+
+class ProbeDiscoveryTest(FakeProbeTest):
+
+    def setUp(self):
+        super().setUp()
+        self.devices = []
+        # A device which answers nothing keeps the identification for its whole timeout
+        patcher = mock.patch.object(collector.identify_probe, '__defaults__', (1.5,))
+        patcher.start()
+        self.addCleanup(patcher.stop)
+
+    def tearDown(self):
+        for device in self.devices:
+            device.stop()
+        super().tearDown()
+
+    def call(self, function, *arguments, timeout=10):
+        """
+        Result of the call, which has to return within `timeout` (it blocked forever on a truncated frame)
+        """
+        result = []
+        thread = threading.Thread(target=lambda: result.append(function(*arguments)), daemon=True)
+        thread.start()
+        thread.join(timeout)
+        self.assertEqual(len(result), 1, f'{function.__name__} did not return')
+        return result[0]
+
+    def device(self, name, answer=b''):
+        device = OtherDevice(pathlib.Path(self.folder.name) / name, answer)
+        device.start()
+        self.devices.append(device)
+        return device
+
+    def test_truncated_identity(self):
+        device = self.device('ttyOTHER0', b'Ide:\x24\x0a\xc4')
+        conn = serial.Serial(str(device.path), 115200)     # No timeout, as open_serial()
+        self.ports.append(conn)
+        self.assertIsNone(self.call(collector.identify_probe, conn, 1, timeout=3))
+        self.assertIsNone(conn.timeout)
+
+    def test_discovery_ignores_other_devices(self):
+        probes = [self.probe(index, initDelay=10) for index in (3, 1)]
+        self.device('ttyFAKE7', b'Ide:\x24\x0a')   # Stops in the middle of an identity frame
+        self.device('ttyFAKE8')                     # Silent
+        self.device('ttyFAKE9', b'garbage\n')
+        pattern = str(pathlib.Path(self.folder.name) / 'ttyFAKE*')
+        discovered = self.call(collector.discover_probes, [pattern], 115200)
+        for conn, _ in discovered.values():
+            self.ports.append(conn)
+        self.assertEqual({chip: identity['Path'] for chip, (_, identity) in discovered.items()},
+                         {probe.chip.hex(':'): str(probe.path) for probe in probes})
+        identity = discovered[probes[0].chip.hex(':')][1]
+        self.assertEqual((identity['Channel'], identity['Mode'], identity['Build']),
+                         (37, 'advertising', 'fake-probe'))
+
+    def test_configuration_bound_by_identity(self):
+        probes = [self.probe(index) for index in range(4)]
+        folder = pathlib.Path(self.folder.name)
+        config = folder / 'collector.ini'
+        # Sections in another order than the devices, one with a channel which is not the one of its probe
+        config.write_text(''.join(f'[ESP {index + 1}]\nid = {probes[index].chip.hex(":").upper()}\n'
+                                  f'channel = {37 if index == 2 else probes[index].channel}\n\n'
+                                  for index in (2, 0, 3, 1)))
+        process = subprocess.Popen([sys.executable, REPOSITORY / 'collector.py', '-c', config, '--scan',
+                                    str(folder / 'ttyFAKE*'), '-o', folder / 'capture.csv'],
+                                   stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, cwd=folder)
+        try:
+            bound = {}
+            while len(bound) < len(probes):
+                line = process.stdout.readline()
+                self.assertTrue(line, 'The collector stopped')
+                if line.startswith('- ESP'):    # - ESP n: Probe <chip> on <path>
+                    section, _, path = line[2:].strip().partition(': Probe ')
+                    bound[section] = path.split(' on ')[1]
+        finally:
+            process.send_signal(signal.SIGINT)
+            _, errors = process.communicate(timeout=30)
+        self.assertEqual(bound, {f'ESP {index + 1}': str(probe.path) for index, probe in enumerate(probes)})
+        self.assertIn(f'ESP 3: Probe {probes[2].chip.hex(":")} captures channel 39 instead of the configured 37',
+                      errors)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,138 @@
+import csv
+import functools
+import io
+import threading
+import time
+import unittest
+
+import collector
+from records import isGap
+from tests.test_warm_attach import FakeProbeTest
+
+
+def stopSupervision():
+    raise SystemExit()  # Ends the supervising thread quietly
+
+
+class ProbeRecoveryTest(FakeProbeTest):
+    """
+    Fault injection: fake probes unplugged (and optionally restarted) while the collector captures them
+    """
+
+    def setUp(self):
+        super().setUp()
+        self.names = []
+
+    def tearDown(self):
+        for name in self.names:
+            collector.port_openers[name] = stopSupervision
+            collector.open_ports.pop(name, None)
+        super().tearDown()
+
+    def recover(self, name, opener):
+        """
+        Run recover_probe() as the capture thread of probe `name` would
+        """
+        self.names.append(name)
+        collector.port_openers[name] = opener
+        result = []
+        thread = threading.Thread(name=name, target=lambda: result.append(collector.recover_probe(name)))
+        thread.start()
+        thread.join(20)
+        self.assertEqual(len(result), 1)
+        self.ports.append(result[0][0])
+        return result[0]
+
+    def test_supervised_capture_marks_the_gaps(self):
+        probe = self.probe(0, faultInterval=0.8, faultDowntime=0.3)
+        name = 'ESP 1'
+        self.names.append(name)
+        collector.port_openers[name] = functools.partial(collector.open_serial, str(probe.path), 115200)
+        collector.open_ports[name] = str(probe.path)
+        capture = io.StringIO()
+        writer = csv.DictWriter(capture, fieldnames=[
+            'Timestamp', 'Address', 'AddressType', 'AdvertisingType', 'RSSI', 'Channel', 'DeviceName'
+        ])
+        thread = threading.Thread(name=name, target=collector.log_advertising_info,
+                                  args=(self.open(probe), writer), daemon=True)
+        thread.start()
+        time.sleep(0.1)
+        with collector.start_cond:
+            collector.start_cond.notify_all()
+
+        deadline = time.monotonic() + 20
+        while probe.faults < 3 and time.monotonic() < deadline:
+            time.sleep(0.05)
+        time.sleep(1.5)     # The last outage is over
+        with collector.write_lock:
+            rows = list(csv.DictReader(io.StringIO('Timestamp,Address,AddressType,AdvertisingType,RSSI,Channel,'
+                                                   'DeviceName\n' + capture.getvalue())))
+            faults = probe.faults
+            registered = collector.open_ports.get(name)
+
+        gaps = [row for row in rows if isGap(row)]
+        self.assertGreaterEqual(len(gaps), faults - 1)
+        self.assertGreaterEqual(len(gaps), 2)
+        for gap in gaps:    # Down for 0.3 s, back after the backoff and the warm attach
+            outage = collector.datetime.fromisoformat(gap['DeviceName']) - \
+                collector.datetime.fromisoformat(gap['Timestamp'])
+            self.assertTrue(0.25 < outage.total_seconds() < 1.5, outage)
+        self.assertGreater(len(rows) - len(gaps), 100)
+        if registered is not None:  # Not in the middle of an outage
+            self.assertEqual(registered, str(probe.path))
+
+    def test_recovered_path_bound_probe_is_not_scanned(self):
+        bound = self.probe(0)
+        other = self.probe(1)
+        self.waitCapturing(bound)
+        self.waitCapturing(other)
+
+        self.recover('ESP 1', functools.partial(collector.open_serial, str(bound.path), 115200))
+        self.assertEqual(collector.open_ports['ESP 1'], str(bound.path))
+
+        # A lost id-bound probe is searched for among the devices not in use
+        pattern = str(bound.path.parent / 'ttyFAKE*')
+        discovered = collector.discover_probes([pattern], 115200, exclude=collector.open_ports.values())
+        for conn, _ in discovered.values():
+            conn.close()
+        self.assertEqual(list(discovered), [other.chip.hex(':')])
+        self.assertAligned(self.ports[0])   # Nothing was stolen from the stream
+
+    def test_id_bound_probe_found_again(self):
+        probe = self.probe(2, faultReset=True)
+        self.waitCapturing(probe)
+        pattern = str(probe.path.parent / 'ttyFAKE*')
+        start = time.monotonic()
+        _, _, channel = self.recover('ESP 3', functools.partial(collector.find_probe, probe.chip.hex(':'),
+                                                                [pattern], 115200))
+        self.assertLess(time.monotonic() - start, 2)
+        self.assertEqual(channel, 39)
+        self.assertEqual(collector.open_ports['ESP 3'], str(probe.path))
+
+    def test_failed_handshake_releases_the_device(self):
+        probe = self.probe(0, initDelay=30)     # Never gets capturing within the handshake
+        name = 'ESP 1'
+        self.names.append(name)
+        attempts = []
+
+        def opener():
+            if attempts:
+                stopSupervision()
+            attempts.append(time.monotonic())
+            return collector.open_serial(str(probe.path), 115200)
+
+        collector.port_openers[name] = opener
+        original = collector.__HANDSHAKE_TIMEOUT__
+        collector.__HANDSHAKE_TIMEOUT__ = 1
+        try:
+            thread = threading.Thread(name=name, target=collector.recover_probe, args=(name,))
+            thread.start()
+            thread.join(20)
+        finally:
+            collector.__HANDSHAKE_TIMEOUT__ = original
+        self.assertEqual(len(attempts), 1)
+        self.assertNotIn(name, collector.open_ports)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,106 @@
+import random
+import unittest
+
+import numpy as np
+
+from rotation_linker import RotationLinker
+from rpa_resolver import BatchAes128, IrkStore, RpaResolver
+from tests.synthetic import randomAddress
+
+__DAY__ = 24 * 60 * 60 * 1000
+
+
+def isoTimestamp(ms):
+    """
+    Capture timestamp of `ms` since the midnight before the capture, the time of day wraps at midnight
+    """
+    day, ms = divmod(ms, __DAY__)
+    return f'2026-10-{16 + day:02d}T{ms // 3600000:02d}:{ms // 60000 % 60:02d}:{ms % 60000 / 1000:06.3f}'
+
+
+def resolvableAddress(rng, irk):
+    """
+    Resolvable private address of the IRK: prand (0b01 in the two most significant bits) || ah(IRK, prand)
+    """
+    prand = bytes((0x40 | rng.randrange(0x40), rng.randrange(256), rng.randrange(256)))
+    aes = BatchAes128(np.frombuffer(irk, dtype=np.uint8))
+    return (prand + bytes(aes.encrypt(bytes(13) + prand)[0][13:])).hex(':')
+
+
+def rotatingDevice(rng, addresses, start, duration, interval=200, rotation=5000, rssi=-60, name=''):
+    """
+    Rows of a device changing its address every `rotation` ms without breaking its advertising timer
+    :return: (rows with ms timestamps, addresses used)
+    """
+    rows = []
+    used = []
+    time = start
+    while time < start + duration:
+        address = next(addresses)
+        used.append(address)
+        end = time + rotation
+        while time < min(end, start + duration):
+            rows.append({'Timestamp': int(time), 'Address': address, 'AddressType': '1', 'AdvertisingType': '0',
+                         'RSSI': str(rssi + rng.randrange(-2, 3)), 'Channel': '37', 'DeviceName': name})
+            time += interval + rng.uniform(0, 10)
+    return rows, used
+
+
+def privateAddresses(rng):
+    while True:
+        yield randomAddress(rng)
+
+
+class RotationLinkerTest(unittest.TestCase):
+
+    def link(self, rows, linker, timestamp=str):
+        rows = sorted(rows, key=lambda row: row['Timestamp'])
+        linked = list(linker.link(dict(row, Timestamp=timestamp(row['Timestamp'])) for row in rows))
+        self.assertEqual(len(linked), len(rows))    # No row held back for ever
+        return linked
+
+    def test_rotations_are_linked(self):
+        rng = random.Random(0)
+        rows, used = rotatingDevice(rng, privateAddresses(rng), 1000, 60000)
+        linker = RotationLinker()
+        linked = self.link(rows, linker)
+        self.assertEqual({row['Address'] for row in linked}, {used[0]})
+        self.assertEqual(len(linker.links), len(used) - 1)
+
+    def test_across_midnight(self):
+        rng = random.Random(1)
+        start = __DAY__ - 30000    # 23:59:30
+        first, firstUsed = rotatingDevice(rng, privateAddresses(rng), start, 60000, interval=200)
+        second, secondUsed = rotatingDevice(rng, privateAddresses(rng), start, 60000, interval=500, name='Tile')
+        linker = RotationLinker()
+        linked = self.link(first + second, linker, isoTimestamp)
+        self.assertEqual({row['Address'] for row in linked}, {firstUsed[0], secondUsed[0]})
+        self.assertEqual(len(linker.links), len(firstUsed) + len(secondUsed) - 2)
+        # The silent addresses expire after midnight as well, only the recent ones are tracked
+        self.assertLessEqual(len(linker.tracks), 6)
+
+    def test_known_irks_are_not_linked(self):
+        rng = random.Random(2)
+        irk = rng.randbytes(16)
+        store = IrkStore()
+        store.add('Phone', irk.hex())
+        resolver = RpaResolver(store)
+
+        def rpas():
+            while True:
+                yield resolvableAddress(rng, irk)
+        known, knownUsed = rotatingDevice(rng, rpas(), 1000, 60000)
+        # Same advertising pattern, it would be a perfect continuation of the known device
+        unknown, unknownUsed = rotatingDevice(rng, privateAddresses(rng), 1000 + 60000 + 200, 60000)
+
+        linker = RotationLinker(resolver=resolver)
+        linked = self.link(known + unknown, linker)
+        self.assertEqual([row['Address'] for row in linked[:len(known)]], ['Phone'] * len(known))
+        self.assertEqual({row['Address'] for row in linked[len(known):]}, {unknownUsed[0]})
+        self.assertFalse(set(knownUsed) & (set(linker.links) | set(linker.links.values())))
+        self.assertEqual(len(linker.links), len(unknownUsed) - 1)
+        self.assertEqual(resolver.resolved, len(knownUsed))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,119 @@
+import pathlib
+import random
+import tempfile
+import unittest
+from unittest import mock
+
+import numpy as np
+
+import rpa_resolver
+from rpa_resolver import BatchAes128, IrkStore, RpaResolver, isResolvable, loadResolver
+
+# ah() sample data (Bluetooth Core 5.4 Vol. 3, Part H, D.7): IRK, prand, hash
+SAMPLE_IRK = 'ec0234a357c8ad05341010a60a397d9b'
+SAMPLE_RPA = '70:81:94:0d:fb:aa'
+
+
+def randomKeys(count, seed=0):
+    rng = random.Random(seed)
+    return [rng.randbytes(16) for _ in range(count)]
+
+
+def resolvableAddress(aes, lane, prand):
+    """
+    RPA of the key of `lane` (hash computed with the batch cipher, checked against the sample data below)
+    """
+    return (prand + bytes(aes.encrypt(bytes(13) + prand)[lane][13:])).hex(':')
+
+
+class BatchAes128Test(unittest.TestCase):
+
+    def test_known_answers(self):
+        # FIPS-197 Appendix C.1 and Appendix B, in a single batch
+        aes = BatchAes128(np.frombuffer(bytes(range(16)) + bytes.fromhex('2b7e151628aed2a6abf7158809cf4f3c'),
+                                        dtype=np.uint8))
+        self.assertEqual(bytes(aes.encrypt(bytes.fromhex('00112233445566778899aabbccddeeff'))[0]).hex(),
+                         '69c4e0d86a7b0430d8cdb78070b4c55a')
+        self.assertEqual(bytes(aes.encrypt(bytes.fromhex('3243f6a8885a308d313198a2e0370734'))[1]).hex(),
+                         '3925841d02dc09fbdc118597196a0b32')
+
+    def test_lanes_are_independent(self):
+        keys = randomKeys(50)
+        block = bytes(range(100, 116))
+        batch = BatchAes128(np.frombuffer(b''.join(keys), dtype=np.uint8)).encrypt(block)
+        for key, ciphertext in zip(keys, batch):
+            single = BatchAes128(np.frombuffer(key, dtype=np.uint8))
+            self.assertEqual(bytes(ciphertext), bytes(single.encrypt(block)[0]))
+        tiled = BatchAes128(np.frombuffer(b''.join(keys), dtype=np.uint8)).tiled(3)
+        self.assertEqual(len(tiled), 150)
+        self.assertTrue((tiled.encrypt(block) == np.tile(batch, (3, 1))).all())
+
+
+class RpaResolverTest(unittest.TestCase):
+
+    def setUp(self):
+        self.store = IrkStore()
+        for index, key in enumerate(randomKeys(40)):
+            self.store.add(f'Device {index}', key.hex())
+        self.store.add('Sample', SAMPLE_IRK)
+
+    def test_sample_address(self):
+        self.assertTrue(isResolvable(SAMPLE_RPA))
+        resolver = RpaResolver(self.store)
+        self.assertEqual(resolver.identity(SAMPLE_RPA), 'Sample')
+        self.assertEqual(resolver.identity(SAMPLE_RPA, addressType=0), SAMPLE_RPA)    # Public address
+        self.assertEqual(resolver.identity('70:81:94:0d:fb:ab'), '70:81:94:0d:fb:ab')
+        static = 'f0:81:94:0d:fb:aa'    # Not resolvable, never checked
+        self.assertEqual(resolver.identity(static), static)
+        self.assertEqual((resolver.resolutions, resolver.resolved), (2, 1))
+
+    def test_cache(self):
+        resolver = RpaResolver(self.store, cacheSize=2)
+        others = ['40:00:00:00:00:01', '40:00:00:00:00:02']
+        for address in [SAMPLE_RPA] * 3 + others[:1] + [SAMPLE_RPA] + others[1:]:
+            resolver.identity(address)
+        self.assertEqual(resolver.resolutions, 3)
+        self.assertEqual(list(resolver.cache), [SAMPLE_RPA, others[1]])    # Least recently used evicted
+        self.assertIsNone(resolver.cache[others[1]])
+        resolver.identity(others[0])
+        self.assertEqual(resolver.resolutions, 4)
+
+    def test_batches(self):
+        resolver = RpaResolver(self.store)
+        rng = random.Random(1)
+        aes = BatchAes128(np.frombuffer(b''.join(self.store.keys), dtype=np.uint8))
+        addresses = []
+        expected = []
+        for index in range(300):
+            lane = rng.randrange(len(self.store) + 20)
+            prand = bytes((0x40 | rng.randrange(0x40), rng.randrange(256), rng.randrange(256)))
+            if lane < len(self.store):
+                addresses.append(resolvableAddress(aes, lane, prand))
+                expected.append(self.store.identities[lane])
+            else:   # Unknown device, or not resolvable at all
+                static = f'c0:00:00:00:01:{index % 256:02x}'
+                addresses.append((prand + rng.randbytes(3)).hex(':') if index % 2 else static)
+                expected.append(None)
+        addresses.append(SAMPLE_RPA)
+        expected.append('Sample')
+
+        # Several passes of tiled keys, the last one shorter
+        with mock.patch.object(rpa_resolver, '__BATCH_ROWS__', len(self.store) * 23):
+            self.assertEqual(resolver.resolveMany(addresses), expected)
+        self.assertEqual(resolver.resolveMany(addresses), expected)
+        self.assertEqual(resolver.resolved, 2 * sum(identity is not None for identity in expected))
+        self.assertEqual(resolver.resolveMany([]), [])
+
+    def test_store(self):
+        with self.assertRaises(ValueError):
+            IrkStore().add('Short', '00' * 15)
+        self.assertIsNone(loadResolver(None))
+        with tempfile.TemporaryDirectory() as folder:
+            path = pathlib.Path(folder) / 'irks.csv'
+            path.write_text(f'Identity,IRK\nSample,{SAMPLE_IRK[:8]} {SAMPLE_IRK[8:]}\n')
+            self.assertEqual(loadResolver(path).identity(SAMPLE_RPA), 'Sample')
+        self.assertEqual(RpaResolver(IrkStore()).identity(SAMPLE_RPA), SAMPLE_RPA)
+
+
+if __name__ == '__main__':
+    unittest.main()
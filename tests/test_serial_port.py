@@ -0,0 +1,143 @@
+import os
+import pty
+import random
+import time
+import tty
+import unittest
+
+import collector
+from serial_port import Log2Histogram, RawSerial
+from tests.test_warm_attach import FakeProbeTest
+
+
+class Log2HistogramTest(unittest.TestCase):
+
+    def test_percentiles(self):
+        histogram = Log2Histogram('us')
+        for value in [0] * 10 + [3] * 80 + [100] * 9 + [5000]:
+            histogram.add(value)
+        self.assertEqual(histogram.percentile(5), 0)
+        self.assertEqual(histogram.percentile(50), 4)       # Bucket [2, 4)
+        self.assertEqual(histogram.percentile(95), 128)
+        self.assertEqual(histogram.percentile(100), 5000)   # Bounded by the maximum
+        self.assertIn('100 samples', str(histogram))
+
+
+class RawSerialTest(unittest.TestCase):
+    """
+    The termios backend on a pseudo terminal, the test writes as the probe
+    """
+
+    def setUp(self):
+        self.master, self.slave = pty.openpty()
+        tty.setraw(self.slave)
+        self.conn = RawSerial(os.ttyname(self.slave), 115200, timeout=0.2)
+
+    def tearDown(self):
+        self.conn.close()
+        if self.master is not None:
+            os.close(self.master)
+        os.close(self.slave)
+
+    def test_reads_a_burst_at_once(self):
+        frames = b''.join(b'Adv:' + bytes(range(i, i + 20)) for i in range(10))
+        os.write(self.master, frames)
+        time.sleep(0.05)
+        received = b''.join(self.conn.read(4) + self.conn.read(20) for _ in range(10))
+        self.assertEqual(received, frames)
+        self.assertEqual(self.conn.reads, 1)
+        self.assertEqual(self.conn.stats.readSizes.count, 1)
+        self.assertEqual(self.conn.stats.readSizes.max, len(frames))
+
+    def test_timeout_returns_fewer_bytes(self):
+        os.write(self.master, b'abc')
+        start = time.monotonic()
+        self.assertEqual(self.conn.read(10), b'abc')
+        self.assertGreaterEqual(time.monotonic() - start, 0.19)
+        os.write(self.master, b'no newline')
+        self.assertEqual(self.conn.readline(), b'no newline')
+        os.write(self.master, b'entry 0x40080680\nCapture')
+        self.assertEqual(self.conn.readline(), b'entry 0x40080680\n')
+        self.assertEqual(self.conn.read(7), b'Capture')
+
+    def test_stream_survives_buffer_compaction(self):
+        rng = random.Random(1)
+        data = rng.randbytes(200000)
+        received = bytearray()
+        written = 0
+        os.set_blocking(self.master, False)
+        while len(received) < len(data):
+            if written < len(data):
+                try:
+                    written += os.write(self.master, data[written:written + rng.randrange(1, 3000)])
+                except BlockingIOError:     # Pseudo terminal full until the port is read
+                    pass
+            received += self.conn.read(rng.randrange(1, 600))
+        self.assertEqual(bytes(received), data)
+
+    def test_arrival_stamp_of_the_consumed_byte(self):
+        os.write(self.master, b'first')
+        time.sleep(0.01)
+        self.conn.read(1)   # Reads the first chunk
+        os.write(self.master, b'second')
+        time.sleep(0.05)
+        self.conn.read(3)
+        first = self.conn.arrivalStamp()
+        self.conn.read(1)   # Last byte of the first chunk, the second one is not read yet
+        self.assertEqual(self.conn.arrivalStamp(), first)
+        self.assertEqual(self.conn.reads, 1)
+        self.conn.read(1)
+        self.assertGreater(self.conn.arrivalStamp() - first, 40000000)  # Read 50 ms later
+        self.assertAlmostEqual(self.conn.arrivalTime(), time.time_ns() // 1000, delta=100000)
+
+    def test_disconnection_is_an_os_error(self):
+        os.close(self.master)
+        self.master = None
+        with self.assertRaises(OSError):
+            self.conn.read(4)
+
+    def test_coalesced_reads(self):
+        self.conn.close()
+        self.conn = RawSerial(os.ttyname(self.slave), 115200, timeout=1, coalesce=1)
+        start = time.monotonic()
+        os.write(self.master, b'0123456789')
+        self.assertEqual(self.conn.read(10), b'0123456789')
+        self.assertGreaterEqual(time.monotonic() - start, 0.05)    # The driver waited VTIME for more
+        self.assertEqual(self.conn.reads, 1)
+
+    def test_port_settings(self):
+        self.assertEqual(self.conn.port, os.ttyname(self.slave))
+        with self.assertRaises(ValueError):
+            self.conn.baudrate = 123
+        self.conn.baudrate = 921600
+        self.assertEqual(self.conn.baudrate, 921600)
+        with self.assertRaises(OSError):    # No modem lines, esp_init() falls back to the RST command
+            self.conn.dtr = False
+
+
+class NativeCaptureTest(FakeProbeTest):
+
+    def setUp(self):
+        super().setUp()
+        collector.native_serial = True
+
+    def tearDown(self):
+        collector.native_serial = False
+        super().tearDown()
+
+    def test_cold_start_and_frames(self):
+        probe = self.probe(1)
+        conn = collector.open_serial(str(probe.path), 115200)
+        conn.timeout = 2
+        self.ports.append(conn)
+        clock, channel = collector.start_capture(conn, warm=False, timeout=5)
+        self.assertEqual(channel, 38)
+        self.assertAlmostEqual(clock.start_time, self.bootEpoch(probe), delta=20000)
+        time.sleep(0.3)     # About 60 frames queued in the driver
+        reads = conn.reads
+        self.assertAligned(conn, 40)
+        self.assertLess(conn.reads - reads, 5)  # The backlog is read in a few system calls
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,112 @@
+import os
+import struct
+import unittest
+
+from shm_ring import SHM_FOLDER, ShmRingConsumer, ShmRingPublisher, consumerStats
+from tests.synthetic import advertisingTraffic
+
+
+def reports(count, seed=0):
+    """
+    Decoded reports (timestamp in us, info) as published by the collector
+    """
+    rows, _, _ = advertisingTraffic(devices=max(count // 50, 1), duration=60000, seed=seed)
+    return [(int(row['Timestamp']) * 1000, {
+        'Address': row['Address'], 'AddressType': 1, 'AdvertisingType': 0, 'Channel': int(row['Channel']),
+        'RSSI': int(row['RSSI']), 'DeviceName': f'dev{index % 7}'
+    }) for index, row in enumerate(rows[:count])]
+
+
+class ShmRingTest(unittest.TestCase):
+
+    def setUp(self):
+        self.name = f'test-shm-ring-{os.getpid()}'
+        self.publisher = ShmRingPublisher(self.name, slots=64)
+        self.consumers = []
+
+    def tearDown(self):
+        for consumer in self.consumers:
+            consumer.close()
+        self.publisher.close()
+
+    def attach(self, fromStart=False):
+        consumer = ShmRingConsumer(self.name, fromStart)
+        self.consumers.append(consumer)
+        return consumer
+
+    def test_consumers_read_in_order(self):
+        first = self.attach()
+        second = self.attach()
+        published = reports(50)
+        for timestamp, info in published:
+            self.publisher.publish('probe', timestamp, info)
+
+        expected = [dict(info, Timestamp=timestamp) for timestamp, info in published]
+        self.assertEqual(first.read(), expected)
+        self.assertEqual(second.read(20) + second.read(), expected)     # At its own pace
+        self.assertEqual(first.read(), [])
+        self.assertEqual((first.overruns, second.overruns), (0, 0))
+
+    def test_lag_and_overruns(self):
+        slow = self.attach()
+        fast = self.attach()
+        published = reports(200)
+        for index, (timestamp, info) in enumerate(published):
+            self.publisher.publish('probe', timestamp, info)
+            if index % 10 == 9:
+                fast.read()
+
+        self.assertEqual(slow.lag(), 200)
+        self.assertEqual(sorted(lag for _, lag, _ in self.publisher.consumers()), [0, 200])
+
+        records = slow.read(1000)
+        self.assertEqual(slow.overruns, 200 - 64)   # Only the last ring of records is left
+        self.assertEqual(records[0]['Timestamp'], published[200 - 64][0])
+        self.assertEqual(len(records), 64)
+        self.assertIn((os.getpid(), 0, 200 - 64), self.publisher.consumers())
+
+    def test_reused_slot_is_skipped(self):
+        consumer = self.attach()
+        published = reports(10)
+        for timestamp, info in published:
+            self.publisher.publish('probe', timestamp, info)
+        # The publisher is rewriting the slot of record 3
+        offset = 64 + 32 * 24 + 3 * 64
+        struct.pack_into('<Q', self.publisher._map, offset, 0xFFFFFFFFFFFFFFFF)
+
+        records = consumer.read(3)
+        self.assertEqual(len(records), 3)
+        records = consumer.read()
+        self.assertGreater(consumer.overruns, 0)
+        self.assertNotIn(published[3][0], [record['Timestamp'] for record in records])
+
+    def test_entry_of_a_dead_consumer_is_reused(self):
+        consumer = self.attach()
+        consumer.read()
+        dead = 0x7FFFFFF0   # Above any pid in use
+        struct.pack_into('<I4xQQ', self.publisher._map, consumer._entry, dead, 0, 0)
+        replacement = self.attach()
+        self.assertEqual(replacement._entry, consumer._entry)
+        self.assertEqual([pid for pid, _, _ in consumerStats(self.publisher._map)], [os.getpid()])
+
+    def test_start_from_the_oldest_record(self):
+        published = reports(100)
+        for timestamp, info in published:
+            self.publisher.publish('probe', timestamp, info)
+        self.assertEqual(self.attach().read(), [])
+        late = self.attach(fromStart=True)
+        self.assertEqual([record['Timestamp'] for record in late.read()], [t for t, _ in published[-64:]])
+
+
+@unittest.skipUnless(SHM_FOLDER.is_dir(), "No shared memory folder")
+class ShmFolderTest(unittest.TestCase):
+
+    def test_unlinked_on_close(self):
+        publisher = ShmRingPublisher(f'test-shm-ring-close-{os.getpid()}', slots=8)
+        self.assertTrue(publisher.path.exists())
+        publisher.close()
+        self.assertFalse(publisher.path.exists())
+
+
+if __name__ == '__main__':
+    unittest.main()
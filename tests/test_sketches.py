@@ -0,0 +1,229 @@
+import collections
+import csv
+import math
+import pathlib
+import random
+import subprocess
+import sys
+import tempfile
+import unittest
+
+from metrics import MetricsRegistry
+from sketches import AppearanceTracker, BloomFilter, CountMinSketch, DistinctDeviceCounter, HeavyHitters
+from sketches import HeavyHitterTracker, HyperLogLog, RotatingBloomFilter, hashAddress, packAddress, readSketches
+from tests.test_models import REPOSITORY
+
+
+def packedAddresses(count, seed=0):
+    rng = random.Random(seed)
+    return [rng.getrandbits(48) for _ in range(count)]
+
+
+def report(address, channel=37):
+    return {'Address': address.to_bytes(6, 'big').hex(':'), 'AddressType': 1, 'Channel': channel}
+
+
+class HyperLogLogTest(unittest.TestCase):
+
+    def sketch(self, addresses, precision=12):
+        sketch = HyperLogLog(precision)
+        for address in addresses:
+            sketch.add(address)
+        return sketch
+
+    def test_accuracy(self):
+        # Standard error 1.04 / sqrt(4096) = 1.6 %, the bound is 4 of them; off by a device at most while the
+        # registers are sparse
+        for count, tolerance in ((0, 0), (10, 0.1), (100, 0.03), (1000, 0.065), (20000, 0.065), (200000, 0.065)):
+            estimate = self.sketch(packedAddresses(count, seed=count)).count()
+            self.assertLessEqual(abs(estimate - count), tolerance * count, count)
+
+    def test_duplicates_are_counted_once(self):
+        addresses = packedAddresses(500)
+        once = self.sketch(addresses)
+        self.assertEqual(self.sketch(addresses * 5).registers, once.registers)
+        self.assertEqual(len(once), round(once.count()))
+
+    def test_merge_is_the_sketch_of_the_union(self):
+        addresses = packedAddresses(30000)
+        first = self.sketch(addresses[:20000])
+        first.merge(self.sketch(addresses[10000:]))
+        self.assertEqual(first.registers, self.sketch(addresses).registers)
+        with self.assertRaises(ValueError):
+            first.merge(HyperLogLog(10))
+
+    def test_invalid_parameters(self):
+        for precision in (3, 17):
+            with self.assertRaises(ValueError):
+                HyperLogLog(precision)
+        with self.assertRaises(ValueError):
+            HyperLogLog(12, bytes(1024))
+
+    def test_address_packing(self):
+        self.assertEqual(packAddress('c0:01:02:03:04:05'), 0xc00102030405)
+
+
+class DistinctDeviceCounterTest(unittest.TestCase):
+
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.path = pathlib.Path(self.folder.name) / 'capture.hll'
+
+    def tearDown(self):
+        self.folder.cleanup()
+
+    def test_windows(self):
+        counter = DistinctDeviceCounter(self.path, window=60)
+        addresses = packedAddresses(300)
+        start = 1700000040  # Window start
+        for second in range(180):
+            for address in addresses[second % 3 * 100:second % 3 * 100 + 20]:
+                counter.publish('ESP 1', (start + second) * 1000000, report(address, 37 + second % 2))
+        counter.publish('ESP 2', (start + 61) * 1000000, report(addresses[0]))
+        # Two windows later, the first window was written already
+        counter.publish('ESP 1', (start + 175) * 1000000, report(addresses[0]))
+        counter.publish('ESP 1', (start + 10) * 1000000, report(addresses[299]))
+        self.assertEqual(counter.late, 1)
+        counter.close()
+
+        sketches = list(readSketches(self.path))
+        self.assertEqual([(s, w, probe, channel) for s, w, probe, channel, _ in sketches], [
+            (start, 60, 'ESP 1', 37), (start, 60, 'ESP 1', 38), (start + 60, 60, 'ESP 1', 37),
+            (start + 60, 60, 'ESP 1', 38), (start + 60, 60, 'ESP 2', 37), (start + 120, 60, 'ESP 1', 37),
+            (start + 120, 60, 'ESP 1', 38),
+        ])
+        merged = sketches[0][4].merge(sketches[1][4])
+        self.assertEqual(len(merged), 60)   # 3 x 20 addresses over both channels
+        self.assertEqual(len(sketches[4][4]), 1)
+
+    def test_interrupted_file(self):
+        counter = DistinctDeviceCounter(self.path, window=60)
+        for window in range(3):
+            counter.publish('ESP 1', window * 60 * 1000000, report(window))
+        counter.close()
+        data = self.path.read_bytes()
+        self.path.write_bytes(data[:-3])    # The collector was killed while writing the last window
+        self.assertEqual([start for start, *_ in readSketches(self.path)], [0, 60])
+        self.path.write_bytes(b'BLEHLL\x09\x0c')
+        with self.assertRaises(ValueError):
+            list(readSketches(self.path))
+
+
+def zipfStream(devices, reports, seed=0):
+    """
+    Packed addresses of `reports` reports among `devices` advertisers, the n-th heaviest sending as 1 / n
+    """
+    rng = random.Random(seed)
+    addresses = packedAddresses(devices, seed)
+    return rng.choices(addresses, weights=[1 / rank for rank in range(1, devices + 1)], k=reports), addresses
+
+
+class HeavyHitterTest(unittest.TestCase):
+
+    def test_count_min_bounds(self):
+        stream, addresses = zipfStream(5000, 100000)
+        sketch = CountMinSketch(width=256)
+        for address in stream:
+            sketch.add(address)
+        counts = collections.Counter(stream)
+        bound = math.e / sketch.width * sketch.total
+        errors = [sketch.estimate(address) - counts[address] for address in addresses]
+        self.assertGreaterEqual(min(errors), 0)     # Never below the count
+        self.assertLess(sum(error > bound for error in errors), 0.02 * len(errors))
+        self.assertEqual(sketch.total, len(stream))
+        with self.assertRaises(ValueError):
+            CountMinSketch(width=1000)
+
+    def test_heaviest_advertisers(self):
+        stream, addresses = zipfStream(5000, 100000, seed=1)
+        hitters = HeavyHitters(k=10)
+        for address in stream:
+            hitters.add(address)
+        heaviest = hitters.heaviest()
+        self.assertEqual([address for address, _ in heaviest[:5]], addresses[:5])
+        self.assertEqual(len(set(address for address, _ in heaviest) & set(addresses[:10])), 10)
+        counts = collections.Counter(stream)
+        for address, estimate in heaviest:
+            self.assertGreaterEqual(estimate, counts[address])
+
+    def test_at_least_one_hitter(self):
+        with self.assertRaises(ValueError):
+            HeavyHitters(k=0)
+
+    def test_tracker_windows(self):
+        registry = MetricsRegistry('test')
+        tracker = HeavyHitterTracker(registry, k=2, window=10)
+        loud, quiet = 0xc00000000001, 0xc00000000002
+        for index in range(100):
+            tracker.publish('ESP 1', (1000 + index // 10) * 1000000, report(loud if index % 4 else quiet))
+        self.assertEqual(tracker.last, {})  # The window is not complete yet
+        tracker.publish('ESP 1', 1010 * 1000000, report(quiet))
+        self.assertEqual(tracker.last['ESP 1'], (1000, 100, [('c0:00:00:00:00:01', 75), ('c0:00:00:00:00:02', 25)]))
+        lines = registry.render().splitlines()
+        self.assertIn('test_heavy_hitter_reports{probe="ESP 1",rank="1",address="c0:00:00:00:00:01"} 75', lines)
+        self.assertIn('test_window_reports{probe="ESP 1"} 100', lines)
+
+    def test_collector_options(self):
+        for options in (['--heavy-hitters', '4'], ['--heavy-hitters', '0', '--metrics-port', '9000'],
+                        ['--heavy-hitters', '4', '--heavy-window', '0', '--metrics', 'metrics.prom']):
+            with tempfile.TemporaryDirectory() as folder:
+                result = subprocess.run([sys.executable, REPOSITORY / 'collector.py', *options, '-o', 'out.csv'],
+                                        cwd=folder, capture_output=True, text=True, timeout=30)
+                self.assertEqual(result.returncode, 2, options)   # Usage error, before anything is opened
+                self.assertIn('--heavy-hitters', result.stderr)
+                self.assertEqual(list(pathlib.Path(folder).iterdir()), [])
+
+
+class BloomFilterTest(unittest.TestCase):
+
+    def test_false_positive_rate(self):
+        addresses = packedAddresses(40000, seed=3)
+        members, others = addresses[:20000], addresses[20000:]
+        for errorRate in (0.01, 0.001):
+            bloomFilter = BloomFilter(len(members), errorRate)
+            for address in members:
+                bloomFilter.add(bloomFilter.positions(hashAddress(address)))
+            self.assertTrue(all(bloomFilter.contains(bloomFilter.positions(hashAddress(a))) for a in members))
+            falsePositives = sum(bloomFilter.contains(bloomFilter.positions(hashAddress(a))) for a in others)
+            self.assertLess(falsePositives / len(others), 2 * errorRate, errorRate)
+
+    def test_rotation(self):
+        seen = RotatingBloomFilter(horizon=60, capacity=1000, errorRate=0.001)
+        self.assertTrue(seen.add(1, 0))
+        self.assertFalse(seen.add(1, 59))
+        self.assertTrue(seen.add(2, 100))
+        self.assertFalse(seen.add(1, 119))  # Remembered for at least the horizon after it was last heard
+        self.assertTrue(seen.add(1, 240))   # Forgotten after at most two horizons
+        self.assertTrue(seen.add(2, 10000))  # Every filter cleared after a long silence
+        self.assertEqual(seen.memory(), 2 * len(seen.filters[0].bits))
+        with self.assertRaises(ValueError):
+            RotatingBloomFilter(generations=1)
+
+    def test_ring_false_positive_rate(self):
+        seen = RotatingBloomFilter(horizon=60, capacity=10000, errorRate=0.01)
+        addresses = packedAddresses(22000, seed=4)
+        for index, address in enumerate(addresses[:20000]):    # 10000 per rotation, both filters at capacity
+            seen.add(address, index * 60 / 10000)
+        # The new addresses are remembered as well, only a few are checked so the newest filter stays near capacity
+        missed = sum(not seen.add(address, 119) for address in addresses[20000:])
+        self.assertLess(missed / 2000, 0.02)
+
+    def test_appearance_events(self):
+        with tempfile.TemporaryDirectory() as folder:
+            path = pathlib.Path(folder) / 'capture.appearances.csv'
+            registry = MetricsRegistry('test')
+            tracker = AppearanceTracker(path, horizon=60, capacity=1000, registry=registry)
+            start = 1700000000
+            for second, probe, address in ((0, 'ESP 1', 1), (1, 'ESP 2', 1), (2, 'ESP 2', 2), (130, 'ESP 1', 2),
+                                           (200, 'ESP 1', 1)):
+                tracker.publish(probe, (start + second) * 1000000, dict(report(address), AddressType=0))
+            tracker.close()
+            with path.open(newline='') as appearances:
+                rows = [(row['Address'], row['Probe']) for row in csv.DictReader(appearances)]
+            self.assertEqual(rows, [('00:00:00:00:00:01', 'ESP 1'), ('00:00:00:00:00:02', 'ESP 2'),
+                                    ('00:00:00:00:00:02', 'ESP 1'), ('00:00:00:00:00:01', 'ESP 1')])
+            self.assertIn('test_appearances_total{probe="ESP 1"} 3', registry.render().splitlines())
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,99 @@
+import json
+import pathlib
+import socket
+import tempfile
+import time
+import unittest
+
+from subscriptions import SubscriptionClient, SubscriptionFilter, SubscriptionServer
+
+
+def info(address, channel=37, rssi=-60, advertisingType=0, name=''):
+    return {'Address': address, 'AddressType': 1, 'AdvertisingType': advertisingType, 'Channel': channel,
+            'RSSI': rssi, 'DeviceName': name}
+
+
+class SubscriptionFilterTest(unittest.TestCase):
+
+    def test_valid_filter(self):
+        subscriptionFilter = SubscriptionFilter.fromJson(json.dumps({
+            'addresses': ['c0:01:02:03:04:05'], 'channels': [37, 39], 'minRssi': -70, 'types': [0],
+            'namePrefixes': ['Tile']
+        }))
+        self.assertEqual(subscriptionFilter.addresses, {bytes.fromhex('c00102030405')})
+        self.assertTrue(subscriptionFilter.matches(info('c0:01:02:03:04:05', 39, -65, 0, 'Tile Mate')))
+        self.assertFalse(subscriptionFilter.matches(info('c0:01:02:03:04:05', 38, -65, 0, 'Tile Mate')))
+        self.assertFalse(subscriptionFilter.matches(info('c0:01:02:03:04:05', 39, -75, 0, 'Tile Mate')))
+        self.assertFalse(subscriptionFilter.matches(info('c0:01:02:03:04:05', 39, -65, 0, 'AirTag')))
+
+    def test_invalid_filters(self):
+        for spec in ['[]', '{"minRssi": "x"}', '{"minRssi": true}', '{"minRssi": -200}', '{"minRssi": 1.5}',
+                     '{"namePrefixes": [1]}', '{"namePrefixes": "Tile"}', '{"channels": 5}', '{"channels": [40]}',
+                     '{"types": [-1]}', '{"addresses": ["c0:01"]}', '{"addresses": ["zz:01:02:03:04:05"]}',
+                     '{"addresses": [7]}', '{"rssi": -70}', 'not json']:
+            with self.subTest(spec=spec), self.assertRaises(ValueError):
+                SubscriptionFilter.fromJson(spec)
+
+
+class SubscriptionServerTest(unittest.TestCase):
+
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.path = pathlib.Path(self.folder.name) / 'records.sock'
+        self.server = SubscriptionServer(self.path, batchSize=4, batchDelay=0.005)
+
+    def tearDown(self):
+        self.server.close()
+        self.folder.cleanup()
+
+    def waitForSubscribers(self, count):
+        deadline = time.monotonic() + 5
+        while len(self.server.stats()) < count and time.monotonic() < deadline:
+            time.sleep(0.005)
+        self.assertEqual(len(self.server.stats()), count)
+
+    def test_filtered_streams(self):
+        byAddress = SubscriptionClient(self.path, addresses=['c0:00:00:00:00:01'])
+        strong = SubscriptionClient(self.path, minRssi=-50)
+        self.waitForSubscribers(2)
+
+        for index in range(20):
+            self.server.publish('probe', 1000 + index, info(f'c0:00:00:00:00:{index % 4:02x}', rssi=-40 - index))
+        self.server.close()
+
+        self.assertEqual([record['Timestamp'] for record in byAddress], [1001, 1005, 1009, 1013, 1017])
+        self.assertEqual([record['RSSI'] for record in strong], list(range(-40, -51, -1)))
+        byAddress.close()
+        strong.close()
+
+    def test_invalid_filter_is_refused(self):
+        with self.assertRaises(ValueError) as refused:
+            SubscriptionClient(self.path, minRssi='x')
+        self.assertIn('ERROR minRssi', str(refused.exception))
+
+        conn = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        conn.connect(str(self.path))
+        conn.sendall(b'{"channels": 5}\n')
+        self.assertTrue(conn.makefile('rb').readline().startswith(b'ERROR channels'))
+        conn.close()
+        self.assertEqual(self.server.stats(), [])
+
+    def test_faulty_filter_only_drops_its_subscriber(self):
+        faulty = SubscriptionClient(self.path, channels=[37])
+        healthy = SubscriptionClient(self.path)
+        self.waitForSubscribers(2)
+        subscriber, = [s for s in self.server._subscribers if s.filter.channels is not None]
+        subscriber.filter.channels = None
+        subscriber.filter.minRssi = 'x'    # Cannot be compared with a number
+
+        self.server.publish('probe', 1000, info('c0:00:00:00:00:01'))   # Does not raise
+        self.assertEqual(len(self.server.stats()), 1)
+        self.server.close()
+        self.assertEqual(list(faulty), [])
+        self.assertEqual([record['Timestamp'] for record in healthy], [1000])
+        faulty.close()
+        healthy.close()
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,100 @@
+import csv
+import io
+import pathlib
+import tempfile
+import unittest
+
+import numpy as np
+
+from detector import Detector
+from models import modelFactory
+from records import GAP_TYPE, isGap
+from sweep import loadCapture, parseSweep, SimpleStatisticsLanes, SlidingWindowLanes
+from tests.synthetic import captureText
+from tests.test_models import feed, withConnections
+
+
+def outageCapture(start, end):
+    """
+    Rows of two advertisers with the capture lost from `start` to `end` (ms), the gap row written at the resume
+    """
+    rows = [{'Timestamp': timestamp, 'Address': address, 'RSSI': -60, 'Channel': 37}
+            for address, timestamps in (('a', withConnections(1000, 100, 600)), ('b', withConnections(1050, 1000, 60)))
+            for timestamp in timestamps]
+    rows = sorted((row for row in rows if not start <= row['Timestamp'] < end), key=lambda row: row['Timestamp'])
+    resume = next(index for index, row in enumerate(rows) if row['Timestamp'] >= end)
+    gap = {'Timestamp': start, 'Address': '', 'AdvertisingType': GAP_TYPE, 'Channel': 37, 'DeviceName': end}
+    return rows[:resume] + [gap] + rows[resume:]
+
+
+class SweepTest(unittest.TestCase):
+
+    def assertSameAsModels(self, name, lanes, params, timestamps):
+        alerts = lanes(params).run(np.array(timestamps, dtype=np.int64))
+        for lane, param in enumerate(params):
+            spec = name + ':' + ','.join(f'{key}={value}' for key, value in param.items())
+            expected = [timestamp for timestamp, _ in feed(modelFactory(spec)(), timestamps)]
+            self.assertEqual([timestamps[i + 1] for i in np.flatnonzero(alerts[:, lane])], expected, spec)
+
+    def test_lanes_same_as_models(self):
+        _, simple = parseSweep('simple_statistics:initElements=3|10,thresholdFactor=1.5|2|3')
+        _, window = parseSweep('sliding_window:windowSize=2|5|11,meanFactor=1.5|2,stdDevFactor=1|2')
+        for seed, interval in enumerate((30, 100, 1000)):
+            timestamps = withConnections(1000, interval, 2000, seed)
+            self.assertSameAsModels('simple_statistics', SimpleStatisticsLanes, simple, timestamps)
+            self.assertSameAsModels('sliding_window', SlidingWindowLanes, window, timestamps)
+
+    def test_parameter_parsing(self):
+        _, params = parseSweep('sliding_window:windowSize=7|11,meanFactor=2|1e0|1.5')
+        self.assertEqual([(p['windowSize'], p['meanFactor']) for p in params],
+                         [(7, 2), (7, 1.0), (7, 1.5), (11, 2), (11, 1.0), (11, 1.5)])
+        self.assertIsInstance(params[0]['meanFactor'], int)
+
+    def test_window_of_one_rejected(self):
+        with self.assertRaises(ValueError):
+            parseSweep('sliding_window:windowSize=1|11')
+
+    def test_zero_timestamps_dropped(self):
+        rows = [{'Timestamp': timestamp, 'Address': 'a', 'Channel': 37} for timestamp in ('100', '0', '200')]
+        with tempfile.TemporaryDirectory() as directory:
+            path = pathlib.Path(directory, 'capture.csv')
+            path.write_text(captureText(rows))
+            self.assertEqual(loadCapture(path, False, 10), ({'a': [100, 200]}, {}))
+
+    def test_capture_outage(self):
+        start, end = 20000, 28000
+        rows = outageCapture(start, end)
+        with tempfile.TemporaryDirectory() as directory:
+            path = pathlib.Path(directory, 'capture.csv')
+            path.write_text(captureText(rows))
+            timestamps, skipped = loadCapture(path, False, 10)
+            self.assertEqual(loadCapture(path, True, 10), (timestamps, skipped))
+        self.assertNotIn('', timestamps)
+        for address, (before,) in skipped.items():
+            self.assertLess(timestamps[address][before], start)
+            self.assertGreaterEqual(timestamps[address][before + 1], end)
+        self.assertEqual(set(skipped), {'a', 'b'})
+
+        for spec in ('simple_statistics', 'sliding_window'):
+            _, params = parseSweep(spec)
+            lanes = {'simple_statistics': SimpleStatisticsLanes, 'sliding_window': SlidingWindowLanes}[spec](params)
+            alertLog = io.StringIO()
+            detector = Detector(spec, io.StringIO(), alertLog)
+            for row in rows:
+                if isGap(row):
+                    detector.processGap(row['DeviceName'])
+                else:
+                    detector.processAdv(row['Address'], row['Timestamp'])
+            alertLog.seek(0)
+            expected = sorted((row['Address'], int(row['Timestamp'])) for row in csv.DictReader(alertLog))
+            alerts = sorted((address, int(times[i + 1])) for address, times in timestamps.items()
+                            for i in np.flatnonzero(lanes.run(np.array(times), skipped.get(address, []))[:, 0]))
+            self.assertEqual(alerts, expected, spec)
+            # Without the outage, its silence would be an alert
+            unaware = [int(times[i + 1]) for address, times in timestamps.items()
+                       for i in np.flatnonzero(lanes.run(np.array(times))[:, 0])]
+            self.assertGreater(len(unaware), len(alerts))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,62 @@
+import random
+import unittest
+
+from timer_wheel import HierarchicalTimerWheel
+
+
+class HierarchicalTimerWheelTest(unittest.TestCase):
+
+    def test_fires_in_time(self):
+        wheel = HierarchicalTimerWheel(tick=1, slotBits=4, levels=3)
+        wheel.schedule('a', 5)
+        wheel.schedule('b', 300)
+        wheel.schedule('c', 10000)     # Beyond the wheel range (4096 ticks)
+        self.assertEqual(wheel.advance(4), [])
+        self.assertEqual(wheel.advance(5), [('a', 5)])
+        self.assertEqual(wheel.advance(299), [])
+        self.assertEqual(wheel.advance(300), [('b', 300)])
+        self.assertEqual(wheel.advance(9999), [])
+        self.assertEqual(wheel.advance(20000), [('c', 10000)])
+        self.assertEqual(len(wheel), 0)
+
+    def test_reschedule_and_cancel(self):
+        wheel = HierarchicalTimerWheel()
+        wheel.schedule('a', 100)
+        wheel.schedule('a', 50)
+        wheel.schedule('b', 70)
+        self.assertTrue(wheel.cancel('b'))
+        self.assertFalse(wheel.cancel('b'))
+        self.assertEqual(wheel.advance(1000), [('a', 50)])
+
+    def test_past_expiry_fires_on_next_tick(self):
+        wheel = HierarchicalTimerWheel()
+        wheel.advance(100)
+        wheel.schedule('a', 10)
+        self.assertEqual(wheel.advance(101), [('a', 10)])
+
+    def test_random_against_reference(self):
+        rng = random.Random(1)
+        wheel = HierarchicalTimerWheel(tick=1, slotBits=3, levels=3)
+        reference = {}
+        now = 0
+        for _ in range(20000):
+            action = rng.random()
+            key = rng.randrange(200)
+            if action < 0.5:
+                expiry = now + rng.choice((rng.randrange(1, 8), rng.randrange(1, 600), rng.randrange(1, 5000)))
+                wheel.schedule(key, expiry)
+                reference[key] = expiry
+            elif action < 0.6:
+                self.assertEqual(wheel.cancel(key), reference.pop(key, None) is not None)
+            else:
+                now += rng.randrange(0, 40)
+                fired = sorted(wheel.advance(now))
+                expected = sorted((key, expiry) for key, expiry in reference.items() if expiry <= now)
+                self.assertEqual(fired, expected)
+                for key, _ in expected:
+                    del reference[key]
+            self.assertEqual(len(wheel), len(reference))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,124 @@
+import contextlib
+import io
+import random
+import unittest
+from unittest import mock
+
+import vectorised_models
+from detector import Detector
+from tests.synthetic import advertisingTraffic
+from vectorised_models import CaptureArrays, SlidingWindowVector, VectorDetector
+
+# Detector specifications of the vectorised models, default and other parameters
+SPECS = ['simple_statistics', 'simple_statistics:initElements=3,thresholdFactor=1.5', 'sliding_window',
+         'sliding_window:windowSize=4,meanFactor=1.2,stdDevFactor=0.5', 'sliding_window:windowSize=25']
+
+
+def detectorCalls(devices=30, duration=120000, seed=0):
+    """
+    Calls of the detector loop on a synthetic capture with connections, capture outages (rows dropped, then the
+    gap row at the resume time), rotation pauses and rows with the invalid timestamp 0
+    """
+    rng = random.Random(seed)
+    rows, _, _ = advertisingTraffic(devices, duration, seed=seed, connectionRate=0.01)
+    ends = sorted(rng.randrange(10000, duration, 10000) + rng.randrange(2000, 4000) for _ in range(4))
+    calls = []
+    for row in rows:
+        timestamp = int(row['Timestamp'])
+        if ends and timestamp >= ends[0] - 2000:    # Outages of 2 s
+            if timestamp < ends[0]:
+                continue
+            calls.append(('gap', ends.pop(0)))
+        if rng.random() < 0.002:
+            calls.append(('rotation', row['Address']))
+        calls.append(('adv', row['Address'], 0 if rng.random() < 0.001 else timestamp))
+    return calls
+
+
+def run(detector, sink, calls):
+    for call, *arguments in calls:
+        {'adv': sink.processAdv, 'rotation': sink.processRotation, 'gap': sink.processGap}[call](*arguments)
+    if isinstance(detector, VectorDetector):
+        detector.run(sink, sink.group())
+
+
+def logs(detectorClass, spec, calls):
+    """
+    :return: (Alert log, last model state line per address) of a detector backend
+    """
+    modelLog, alertLog = io.StringIO(), io.StringIO()
+    detector = detectorClass(spec, modelLog, alertLog)
+    with contextlib.redirect_stdout(io.StringIO()):     # Rejected timestamps
+        run(detector, CaptureArrays() if detectorClass is VectorDetector else detector, calls)
+    states = {}
+    for line in modelLog.getvalue().splitlines()[1:]:
+        address, _, state = line.partition(',')
+        states[address] = state
+    return alertLog.getvalue(), states
+
+
+class VectorDetectorTest(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.calls = detectorCalls()
+
+    def test_same_alerts_and_states(self):
+        self.assertEqual({call for call, *_ in self.calls}, {'adv', 'gap', 'rotation'})
+        self.assertIn(0, [arguments[-1] for call, *arguments in self.calls if call == 'adv'])
+        for spec in SPECS:
+            alerts, states = logs(Detector, spec, self.calls)
+            vectorAlerts, vectorStates = logs(VectorDetector, spec, self.calls)
+            self.assertGreater(alerts.count('\n'), 10, spec)
+            self.assertEqual(vectorAlerts, alerts, spec)
+            self.assertEqual(vectorStates, states, spec)
+
+    def test_without_skipped_silences(self):
+        calls = [call for call in self.calls if call[0] == 'adv']
+        for spec in SPECS[::2]:
+            self.assertEqual(logs(VectorDetector, spec, calls), logs(Detector, spec, calls), spec)
+
+    def test_scalar_lanes(self):
+        # A few addresses only: the SimpleStatistics recurrence runs in scalar code
+        calls = detectorCalls(devices=5, seed=1)
+        self.assertEqual(logs(VectorDetector, SPECS[0], calls), logs(Detector, SPECS[0], calls))
+
+    def test_ties_and_large_silences(self):
+        # Constant intervals put the silences exactly on the thresholds, the long silences beyond the exact sums
+        calls = []
+        for index, interval in enumerate((100, 200, 10 ** 9)):
+            timestamp = 1
+            for step in range(60):
+                timestamp += interval if step % 20 else interval * 3
+                calls.append(('adv', f'device {index}', timestamp))
+        for spec in SPECS:
+            self.assertEqual(logs(VectorDetector, spec, calls), logs(Detector, spec, calls), spec)
+
+    def test_exact_thresholds(self):
+        # Every decision checked with the statistics module, as the ones within the tie margin
+        calls = detectorCalls(devices=10, duration=60000, seed=2)
+        with mock.patch.object(vectorised_models, '__TIE_MARGIN__', 1.0):
+            for spec in SPECS[2:]:
+                self.assertEqual(logs(VectorDetector, spec, calls), logs(Detector, spec, calls), spec)
+
+    def test_empty_capture(self):
+        for spec in SPECS:
+            self.assertEqual(logs(VectorDetector, spec, []), logs(Detector, spec, []), spec)
+
+    def test_unsupported_models(self):
+        with self.assertRaises(ValueError):
+            VectorDetector('sliding_quantile', io.StringIO(), io.StringIO())
+        with self.assertRaises(ValueError):
+            VectorDetector('sliding_window:windowSize=1', io.StringIO(), io.StringIO())
+
+    def test_fixpoint_passes(self):
+        sink = CaptureArrays()
+        run(None, sink, self.calls)
+        sink.group()
+        vector = SlidingWindowVector(VectorDetector('sliding_window', io.StringIO(), io.StringIO()).vector)
+        vector.run(sink)
+        self.assertGreater(vector.passes, 1)    # The alerts changed the windows of the later silences
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,119 @@
+import pathlib
+import tempfile
+import time
+import unittest
+
+import serial
+
+import collector
+from fake_probe import FakeProbe
+
+
+class FakeProbeTest(unittest.TestCase):
+    """
+    Collector against simulated probes on pseudo terminals, with short boot and bring-up delays
+    """
+
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.probes = []
+        self.ports = []
+
+    def tearDown(self):
+        for conn in self.ports:
+            conn.close()
+        for probe in self.probes:
+            probe.stop()
+        self.folder.cleanup()
+
+    def probe(self, index=0, **options):
+        options = dict(dict(bootDelay=0.05, initDelay=0.2, rate=200), **options)
+        probe = FakeProbe(index, pathlib.Path(self.folder.name) / f'ttyFAKE{index}', **options)
+        probe.start()
+        self.probes.append(probe)
+        return probe
+
+    def open(self, probe, timeout=2):
+        conn = serial.Serial(str(probe.path), 115200, timeout=timeout)
+        self.ports.append(conn)
+        return conn
+
+    def waitCapturing(self, probe, timeout=5):
+        deadline = time.monotonic() + timeout
+        while not probe.capturing and time.monotonic() < deadline:
+            time.sleep(0.01)
+        self.assertTrue(probe.capturing)
+
+    @staticmethod
+    def bootEpoch(probe):
+        """
+        Host time of the probe boot (us since the epoch)
+        """
+        return time.time_ns() // 1000 - probe.deviceTime()
+
+    def assertAligned(self, conn, frames=50):
+        """
+        The stream continues with whole frames
+        """
+        for _ in range(frames):
+            start = conn.read(4)
+            if start == b'Adv:':
+                collector.get_advertising_info_from_serial(conn)
+            elif start == b'Syn:':
+                collector.get_sync_from_serial(conn)
+            elif start == b'Lat:':
+                collector.get_delays_from_serial(conn)
+            elif start == b'Dia:':
+                collector.get_diagnostics_from_serial(conn)
+            else:
+                self.fail(f"Frame starts with {start}")
+
+
+class WarmAttachTest(FakeProbeTest):
+
+    def test_cold_start(self):
+        probe = self.probe(1)
+        clock, channel = collector.start_capture(self.open(probe), warm=False, timeout=5)
+        self.assertEqual(channel, 38)
+        self.assertAlmostEqual(clock.start_time, self.bootEpoch(probe), delta=20000)   # Banner in ms
+        self.assertAligned(self.ports[0])
+
+    def test_attach_to_a_running_capture(self):
+        probe = self.probe(2)
+        self.waitCapturing(probe)
+        boot = probe.bootTime
+        time.sleep(0.1)
+
+        start = time.monotonic()
+        clock, channel = collector.start_capture(self.open(probe), warm=True, timeout=5)
+        self.assertLess(time.monotonic() - start, 1)
+        self.assertEqual(probe.bootTime, boot)  # Not reset
+        self.assertEqual(channel, 39)
+        self.assertAlmostEqual(clock.start_time, self.bootEpoch(probe), delta=5000)
+        self.assertAligned(self.ports[0])
+
+    def test_attach_resets_a_probe_not_capturing(self):
+        probe = self.probe(0, initDelay=1)
+        time.sleep(0.2)     # Application running, Bluetooth not up yet
+        boot = probe.bootTime
+
+        clock, channel = collector.start_capture(self.open(probe), warm=True, timeout=10)
+        self.assertNotEqual(probe.bootTime, boot)
+        self.assertEqual(channel, 37)
+        self.waitCapturing(probe, timeout=1)    # Set right after the channel message was sent
+
+    def test_clock_follows_the_sync_frames(self):
+        probe = self.probe(0)
+        self.waitCapturing(probe)
+        conn = self.open(probe)
+        clock, _ = collector.start_capture(conn, warm=True, timeout=5)
+        # The capture loop feeds every sync frame, the estimate keeps the earliest one
+        for _ in range(3):
+            received = collector.find_frame(conn, b'Syn:', b'SYN?\n', 2)
+            clock.update(received, collector.get_sync_from_serial(conn)['Timestamp'])
+        self.assertEqual(len(clock.samples), 4)
+        self.assertAlmostEqual(clock.start_time, self.bootEpoch(probe), delta=5000)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,104 @@
+class HierarchicalTimerWheel:
+    """
+    Hierarchical timing wheel (Varghese & Lauck) keyed by an arbitrary hashable key.
+
+    Every level has 2^slotBits slots; a slot of level L spans 2^(slotBits * L) ticks. A timer is stored in the level
+    matching its distance from the current tick and cascades down a level whenever the lower level wraps around.
+    Scheduling and cancelling a timer is O(1), every timer is cascaded at most `levels` times.
+    """
+
+    def __init__(self, tick=1, slotBits=8, levels=4, start=0):
+        self.tick = tick  # Duration of a single tick (ms)
+        self.slotBits = slotBits
+        self.levels = levels
+        self._mask = (1 << slotBits) - 1
+        self._slots = [[{} for _ in range(1 << slotBits)] for _ in range(levels)]
+        self._counts = [0] * levels  # Number of timers stored in each level
+        self._timers = {}  # Key -> (level, slot)
+        self._now = start // tick  # Current tick, every timer expiring at or before it has already fired
+
+    def __len__(self):
+        return len(self._timers)
+
+    def __contains__(self, key):
+        return key in self._timers
+
+    def now(self):
+        return self._now * self.tick
+
+    def schedule(self, key, expiry):
+        """
+        (Re)schedule the timer of `key` to fire at time `expiry` (ms)
+        """
+        self.cancel(key)
+        self._place(key, max(int(expiry // self.tick), self._now + 1), expiry)
+
+    def cancel(self, key):
+        try:
+            level, slot = self._timers.pop(key)
+        except KeyError:
+            return False
+        del self._slots[level][slot][key]
+        self._counts[level] -= 1
+        return True
+
+    def advance(self, now):
+        """
+        Move the wheel to time `now` (ms) and return the list of (key, expiry) of the fired timers
+        """
+        target = int(now // self.tick)
+        fired = []
+
+        while self._now < target:
+            if not self._timers:
+                self._now = target
+                break
+
+            # Skip the ticks on which nothing can fire: jump right before the next wrap of the lowest non-empty level
+            level = 0
+            while self._counts[level] == 0:
+                level += 1
+            if level > 0:
+                shift = self.slotBits * level
+                self._now = min(target, (((self._now >> shift) + 1) << shift) - 1)
+                if self._now == target:
+                    break
+
+            self._now += 1
+            self._cascade()
+
+            slot = self._slots[0][self._now & self._mask]
+            if slot:
+                for key, (_, expiry) in slot.items():
+                    del self._timers[key]
+                    fired.append((key, expiry))
+                self._counts[0] -= len(slot)
+                slot.clear()
+
+        return fired
+
+    def _place(self, key, expiryTick, expiry):
+        delta = expiryTick - self._now
+        level = 0
+        while level < self.levels - 1 and delta >> (self.slotBits * (level + 1)):
+            level += 1
+        # Timers beyond the wheel range wait in the top level and get re-placed on every cascade
+        slot = (expiryTick >> (self.slotBits * level)) & self._mask
+        self._slots[level][slot][key] = (expiryTick, expiry)
+        self._timers[key] = (level, slot)
+        self._counts[level] += 1
+
+    def _cascade(self):
+        for level in range(1, self.levels):
+            shift = self.slotBits * level
+            if self._now & ((1 << shift) - 1):
+                break
+            slotIdx = (self._now >> shift) & self._mask
+            slot = self._slots[level][slotIdx]
+            if not slot:
+                continue
+            self._counts[level] -= len(slot)
+            entries = list(slot.items())
+            slot.clear()
+            for key, (expiryTick, expiry) in entries:
+                self._place(key, expiryTick, expiry)
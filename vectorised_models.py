@@ -0,0 +1,328 @@
+import csv
+import statistics
+from array import array
+
+import numpy as np
+
+from models import SimpleStatisticsModel, SlidingWindowModel, modelFactory
+
+__SCALAR_LANES__ = 32       # Lanes left when the SimpleStatistics recurrence continues in scalar code
+__TIE_MARGIN__ = 1e-9       # Relative distance of a silence to the SlidingWindow threshold checked exactly
+__MAX_SUM__ = 2 ** 63       # Bound of the exact integer window sums (W * sum^2)
+
+
+class CaptureArrays:
+    """
+    Advertisements of a capture collected for the vectorised detectors. It takes the calls of the detector
+    loop (processGap, processRotation, processAdv) in place of the detectors, then groups the advertisements
+    by address (stable, so in capture order) with the silence before each of them.
+    """
+
+    def __init__(self):
+        self.addresses = {}     # Address -> index, in the order of the first advertisement
+        self._indices = array('q')
+        self._timestamps = array('q')
+        self._rotations = []    # (Address index, position) of the advertisements after a rotation pause
+        self._gaps = []         # (Position, end) of the capture outages, before the advertisement at position
+
+    def processAdv(self, address, timestamp):
+        self._indices.append(self.addresses.setdefault(address, len(self.addresses)))
+        self._timestamps.append(timestamp)
+
+    def processRotation(self, address):
+        self._rotations.append((self.addresses.setdefault(address, len(self.addresses)), len(self._indices)))
+
+    def processGap(self, end):
+        self._gaps.append((len(self._indices), end))
+
+    def __len__(self):
+        return len(self._indices)
+
+    def names(self):
+        return list(self.addresses)
+
+    def group(self):
+        """
+        Group the advertisements by address. Sets the arrays (one entry per advertisement with a valid
+        timestamp, grouped by address): address, timestamp, position (in the capture), silence and hasSilence
+        (False for the first advertisement of an address and after a skipped silence), and lastSeen per address.
+        :return: Addresses of the advertisements with the invalid timestamp 0 (rejected by the models)
+        """
+        indices = np.frombuffer(self._indices, dtype=np.int64)
+        timestamps = np.frombuffer(self._timestamps, dtype=np.int64)
+        positions = np.arange(len(indices), dtype=np.int64)
+
+        valid = timestamps != 0
+        order = np.argsort(indices[valid], kind='stable')
+        self.address = indices[valid][order]
+        self.timestamp = timestamps[valid][order]
+        self.position = positions[valid][order]
+
+        count = len(self.address)
+        self.silence = np.zeros(count, dtype=np.int64)
+        self.silence[1:] = np.diff(self.timestamp)
+        self.hasSilence = np.zeros(count, dtype=bool)
+        self.hasSilence[1:] = self.address[1:] == self.address[:-1]
+        follows = np.flatnonzero(self.hasSilence)
+        self.hasSilence[follows] = ~self._skipped(self.address[follows], self.position[follows - 1],
+                                                  self.timestamp[follows - 1], self.position[follows])
+
+        # State after the last advertisement of every address
+        self.lastSeen = np.zeros(len(self.addresses), dtype=np.int64)
+        last = np.flatnonzero(np.append(self.address[1:] != self.address[:-1], count > 0))
+        self.lastSeen[self.address[last]] = self.timestamp[last]
+        names = self.names()
+        return [names[index] for index in indices[~valid].tolist()]
+
+    def _skipped(self, address, previous, lastSeen, position):
+        """
+        Whether the silence between the advertisements of `address` at `previous` and `position` is skipped:
+        a rotation pause of the address or a capture outage which ended after the previous advertisement
+        """
+        skipped = np.zeros(len(address), dtype=bool)
+        if self._rotations:
+            # Rotations keyed by (address, position), one within (previous, position] skips the silence
+            stride = len(self._indices) + 1
+            keys = np.sort(np.array([index * stride + at for index, at in self._rotations], dtype=np.int64))
+            skipped |= (np.searchsorted(keys, address * stride + position, side='right')
+                        > np.searchsorted(keys, address * stride + previous, side='right'))
+        if self._gaps:
+            gapPositions = np.array([at for at, _ in self._gaps], dtype=np.int64)
+            # Outages within (previous, position], the latest end among them (sparse table range maximum)
+            low = np.searchsorted(gapPositions, previous, side='right')
+            high = np.searchsorted(gapPositions, position, side='right')
+            spanned = high > low
+            table = [np.array([end for _, end in self._gaps], dtype=np.int64)]
+            while 2 << (len(table) - 1) <= len(self._gaps):
+                step = 1 << (len(table) - 1)
+                table.append(np.maximum(table[-1][:-step], table[-1][step:]))
+            low, high, lastSeen = low[spanned], high[spanned], lastSeen[spanned]
+            level = np.floor(np.log2(high - low)).astype(np.int64)
+            latestEnd = np.empty(len(low), dtype=np.int64)
+            for k in np.unique(level):
+                at = level == k
+                latestEnd[at] = np.maximum(table[k][low[at]], table[k][high[at] - (1 << k)])
+            skipped[np.flatnonzero(spanned)[lastSeen < latestEnd]] = True
+        return skipped
+
+
+class SimpleStatisticsVector:
+    """
+    SimpleStatisticsModel evaluated for all the addresses at once, one address per array lane. The midpoint
+    is a running float average, so the silences are stepped through in order with the same float operations
+    as the model (exact). The lanes are sorted by their number of silences, the active ones are a prefix;
+    the few longest continue in scalar code, where the per-step array overhead would dominate.
+    """
+
+    def __init__(self, model):
+        self.initElements = model.initElements
+        self.thresholdFactor = model.thresholdFactor
+
+    def run(self, capture):
+        """
+        :return: Boolean alerts per advertisement of `capture` (grouped), final model per address index
+        """
+        silent = np.flatnonzero(capture.hasSilence)
+        silences = capture.silence[silent]
+        alerts = np.zeros(len(capture.address), dtype=bool)
+
+        lanes, starts, lengths = np.unique(capture.address[silent], return_index=True, return_counts=True)
+        order = np.argsort(-lengths, kind='stable')
+        lanes, starts, lengths = lanes[order], starts[order], lengths[order]
+        descending = -lengths
+
+        count = len(lanes)
+        midpoint = np.zeros(count)
+        threshold = np.zeros(count)
+        initLeft = np.full(count, self.initElements, dtype=np.float64)
+        averaged = np.zeros(count, dtype=bool)      # The midpoint is a float (int while only set)
+        raised = np.zeros(count, dtype=bool)        # The threshold is a float (raised after the first update)
+        values = silences.astype(np.float64)
+        laneAlerts = np.zeros(len(silences), dtype=bool)
+
+        step = 0
+        active = count
+        while active > __SCALAR_LANES__:
+            at = starts[:active] + step
+            silence = values[at]
+            current = midpoint[:active]
+            unset = current == 0
+            delta = np.abs(current - silence)
+            alert = (initLeft[:active] <= 0) & ~unset & (delta > self.thresholdFactor * threshold[:active])
+            update = ~unset & ~alert
+            raised[:active] |= update & averaged[:active] & (delta > threshold[:active])
+            averaged[:active] |= update
+            initLeft[:active] -= update & (initLeft[:active] > 0)
+            midpoint[:active] = np.where(unset, silence, np.where(update, (current + silence) / 2, current))
+            threshold[:active] = np.where(update, np.maximum(threshold[:active], delta), threshold[:active])
+            laneAlerts[at] = alert
+            step += 1
+            active = np.searchsorted(descending, -step)    # Lanes longer than step
+
+        states = {}
+        for lane in range(count):
+            state = (self._number(midpoint[lane], averaged[lane]), self._number(threshold[lane], raised[lane]),
+                     initLeft[lane].item())
+            if lane < active:   # Continued in scalar code
+                state = self._scalar(state, silences, starts[lane] + step, starts[lane] + lengths[lane], laneAlerts)
+            states[lanes[lane]] = state
+
+        alerts[silent] = laneAlerts
+        models = {}
+        for index in range(len(capture.addresses)):
+            model = SimpleStatisticsModel(self.initElements, self.thresholdFactor)
+            model.lastSeen = capture.lastSeen[index].item()
+            if index in states:
+                model.silenceMidpoint, model.currThreshold, initElements = states[index]
+                model.initElements = type(self.initElements)(initElements)
+            models[index] = model
+        return alerts, models
+
+    def _scalar(self, state, silences, start, stop, alerts):
+        """
+        Same steps as SimpleStatisticsModel.processAdv()
+        """
+        midpoint, threshold, initLeft = state
+        for at, silence in enumerate(silences[start:stop].tolist(), start):
+            if midpoint == 0:
+                midpoint = silence
+                continue
+            delta = abs(midpoint - silence)
+            if initLeft <= 0 and delta > self.thresholdFactor * threshold:
+                alerts[at] = True
+                continue
+            if initLeft > 0:
+                initLeft -= 1
+            midpoint = (midpoint + silence) / 2
+            threshold = delta if delta > threshold else threshold
+        return midpoint, threshold, initLeft
+
+    @staticmethod
+    def _number(value, isFloat):
+        return value.item() if isFloat else int(value)
+
+
+class SlidingWindowVector:
+    """
+    SlidingWindowModel evaluated for all the addresses at once. The window of a silence holds the last
+    `windowSize` accepted silences of its address (the alerts are not accepted), which depend on the earlier
+    alerts: starting from all silences accepted, the alerts are evaluated from exact integer rolling sums of
+    the accepted silences and the acceptance updated until the alerts do not change. Every pass settles at least
+    the earliest wrong decision of each address, the fixpoint is the sequential result. The thresholds
+    too close to a silence for the float rounding (the model takes the correctly rounded statistics) are checked
+    with the statistics module.
+    """
+
+    def __init__(self, model):
+        if model.windowSize < 2:
+            raise ValueError("The window needs at least two silences for a standard deviation.")
+        self.windowSize = model.windowSize
+        self.meanFactor = model.meanFactor
+        self.stdDevFactor = model.stdDevFactor
+        self.passes = 0
+
+    def run(self, capture):
+        """
+        :return: Boolean alerts per advertisement of `capture` (grouped), final model per address index
+        """
+        size = self.windowSize
+        silent = np.flatnonzero(capture.hasSilence &
+                                (capture.silence >= SlidingWindowModel.BLE_LowDutyCycle_MinInterval))
+        silences = capture.silence[silent]
+        lanes = capture.address[silent]
+        first = np.ones(len(silent), dtype=bool)
+        first[1:] = lanes[1:] != lanes[:-1]
+        laneStart = np.maximum.accumulate(np.where(first, np.arange(len(silent)), 0))
+        bound = np.sqrt(__MAX_SUM__ / size) / 2
+
+        laneAlerts = np.zeros(len(silent), dtype=bool)
+        self.passes = 0
+        while True:
+            self.passes += 1
+            accepted = ~laneAlerts
+            before = np.cumsum(accepted) - accepted     # Accepted silences before each one
+            decided = np.flatnonzero(before - before[laneStart] >= size)    # Initialised windows
+            window = silences[accepted]
+            sums = np.concatenate(([0], np.cumsum(window)))
+            squares = np.concatenate(([0], np.cumsum(window * window)))     # Wraps, the differences are exact
+
+            end = before[decided]
+            total = sums[end] - sums[end - size]
+            totalSquares = squares[end] - squares[end - size]
+            mean = total / size
+            with np.errstate(invalid='ignore'):     # Wrapped sums beyond the bound, checked exactly below
+                stdDev = np.sqrt((size * totalSquares - total * total) / (size * (size - 1)))
+            threshold = self.meanFactor * mean + self.stdDevFactor * stdDev
+            silence = silences[decided]
+
+            alerts = np.zeros(len(silent), dtype=bool)
+            alerts[decided] = silence > threshold
+            close = (np.abs(silence - threshold) <= __TIE_MARGIN__ * np.abs(threshold)) | (total >= bound)
+            for at, stop in zip(decided[close].tolist(), end[close].tolist()):
+                exact = window[stop - size:stop].tolist()
+                alerts[at] = silences[at] > (self.meanFactor * statistics.mean(exact)
+                                             + self.stdDevFactor * statistics.stdev(exact))
+
+            if np.array_equal(alerts, laneAlerts):
+                break
+            laneAlerts = alerts
+
+        result = np.zeros(len(capture.address), dtype=bool)
+        result[silent] = laneAlerts
+        kept = silences[~laneAlerts].tolist()
+        keptLanes = lanes[~laneAlerts]
+        starts = np.searchsorted(keptLanes, np.arange(len(capture.addresses)))
+        stops = np.searchsorted(keptLanes, np.arange(len(capture.addresses)), side='right')
+        models = {}
+        for index, (start, stop) in enumerate(zip(starts.tolist(), stops.tolist())):
+            model = SlidingWindowModel(self.windowSize, self.meanFactor, self.stdDevFactor)
+            model.lastSeen = capture.lastSeen[index].item()
+            model.window = kept[max(start, stop - size):stop]
+            model.initCnt -= len(model.window)
+            models[index] = model
+        return result, models
+
+
+VECTORISED = {
+    SimpleStatisticsModel: SimpleStatisticsVector,
+    SlidingWindowModel: SlidingWindowVector,
+}
+
+
+class VectorDetector:
+    """
+    One detector configuration evaluated on the whole capture at once, with the output logs of Detector.
+    The model log holds the state of every model after its last advertisement (the Python backend logs the state
+    after every advertisement, its last line per address is the same).
+    """
+
+    def __init__(self, spec, modelLogFile, alertLogFile):
+        self.spec = spec
+        prototype = modelFactory(spec)()
+        try:
+            self.vector = VECTORISED[type(prototype)](prototype)
+        except KeyError:
+            raise ValueError(f"No vectorised backend for {type(prototype).__name__}.")
+        self.modelLogFile = modelLogFile
+        self.alertLogFile = alertLogFile
+        self.modelLogFile.write('bdaddr,' + prototype.headerStr() + '\n')
+
+    def run(self, capture, rejected=()):
+        """
+        :param capture: Grouped CaptureArrays
+        :param rejected: Addresses of the advertisements with an invalid timestamp
+        """
+        for address in rejected:
+            print(f"Error occurred while processing {address} at 0 by {self.spec}.")
+
+        alerts, models = self.vector.run(capture)
+        alerted = np.flatnonzero(alerts)
+        alerted = alerted[np.argsort(capture.position[alerted], kind='stable')]    # Capture order
+        names = capture.names()
+
+        alertLog = csv.writer(self.alertLogFile)
+        alertLog.writerow(['Address', 'Timestamp', 'Duration'])
+        alertLog.writerows(zip([names[index] for index in capture.address[alerted].tolist()],
+                               capture.timestamp[alerted].tolist(), capture.silence[alerted].tolist()))
+        for index, name in enumerate(names):
+            self.modelLogFile.write(f"{name},{str(models[index])}\n")